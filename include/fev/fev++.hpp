@@ -12,20 +12,34 @@
 
 #include <fev/fev.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <chrono>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <ctime>
 #include <exception>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <optional>
 #include <system_error>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define FEV_HAS_COROUTINES 1
+#endif
 
 namespace fev {
 
@@ -128,6 +142,8 @@ public:
     detail::throw_on_err(err, "Running scheduler failed");
   }
 
+  std::uint32_t num_workers() const noexcept { return fev_sched_get_num_workers(impl()); }
+
   const fev_sched *impl() const noexcept { return impl_.get(); }
   fev_sched *impl() noexcept { return impl_.get(); }
 
@@ -246,6 +262,30 @@ private:
     func_args.release();
   }
 
+  template <typename Range, typename Func>
+  static void spawn_n_impl(fev_sched *sched, Range &&range, Func &&func)
+  {
+    using Elem = std::decay_t<decltype(*std::begin(range))>;
+    using FuncArgs = std::tuple<std::decay_t<Func>, Elem>;
+    std::vector<std::unique_ptr<FuncArgs>> func_args;
+    for (auto &&elem : range)
+      func_args.emplace_back(new FuncArgs{func, std::forward<decltype(elem)>(elem)});
+
+    if (func_args.size() > std::numeric_limits<std::uint32_t>::max())
+      detail::throw_err(-EINVAL, "Spawning fibers failed");
+
+    std::vector<void *> args;
+    args.reserve(func_args.size());
+    for (auto &func_arg : func_args)
+      args.push_back(func_arg.get());
+
+    int err = fev_fiber_spawn_n(sched, &proxy<FuncArgs>, args.data(),
+                                static_cast<std::uint32_t>(args.size()));
+    detail::throw_on_err(err, "Spawning fibers failed");
+    for (auto &func_arg : func_args)
+      func_arg.release();
+  }
+
 public:
   fiber() noexcept = default;
 
@@ -308,6 +348,19 @@ public:
     spawn_impl(sched.impl(), std::forward<Func>(func), std::forward<Args>(args)...);
   }
 
+  // Spawns a detached fiber calling func(elem) for each element of the range. All fibers are
+  // pushed to the run queue at once.
+  template <typename Range, typename Func> static void spawn_n(Range &&range, Func &&func)
+  {
+    spawn_n_impl(nullptr, std::forward<Range>(range), std::forward<Func>(func));
+  }
+
+  template <typename Range, typename Func>
+  static void spawn_n(sched &sched, Range &&range, Func &&func)
+  {
+    spawn_n_impl(sched.impl(), std::forward<Range>(range), std::forward<Func>(func));
+  }
+
   bool joinable() const noexcept { return impl_ != nullptr; }
 
   void join()
@@ -328,6 +381,16 @@ public:
     impl_ = nullptr;
   }
 
+  // Blocking calls in the fiber throw std::system_error with std::errc::operation_canceled from
+  // now on, see fev_fiber_cancel().
+  void cancel()
+  {
+    int err = -EINVAL;
+    if (joinable())
+      err = fev_fiber_cancel(impl_);
+    detail::throw_on_err(err, "Canceling fiber failed");
+  }
+
   void swap(fiber &other) noexcept { std::swap(impl_, other.impl_); }
 
   const fev_fiber *impl() const noexcept { return impl_; }
@@ -339,247 +402,1696 @@ private:
 
 namespace this_fiber {
 
-// TODO: Add sleep_for() and sleep_until() on top of fev_sleep_for() and fev_sleep_until(), when
-// they are implemented.
+inline fev_fiber *self() noexcept { return fev_fiber_self(); }
 
 inline void yield() noexcept { fev_yield(); }
 
+// Returns the index of the worker running the calling fiber, see fev_cur_worker_index().
+inline std::uint32_t worker_index() noexcept { return fev_cur_worker_index(); }
+
+// Blocks until the permit of the calling fiber is available and consumes it, see fev_park().
+inline void park()
+{
+  int err = fev_park(/*recheck=*/nullptr, /*arg=*/nullptr, /*abs_time=*/nullptr);
+  detail::throw_on_err(err, "Parking failed");
+}
+
+// Returns false if the timeout has expired.
+inline bool park_until(const timespec &abs_time)
+{
+  int ret = fev_park(/*recheck=*/nullptr, /*arg=*/nullptr, &abs_time);
+  if (ret == 0)
+    return true;
+  if (ret == -ETIMEDOUT)
+    return false;
+  detail::throw_err(ret, "Parking failed");
+}
+
+inline void sleep_until(const timespec &abs_time)
+{
+  int err = fev_sleep_until(&abs_time);
+  detail::throw_on_err(err, "Sleeping failed");
+}
+
+inline void sleep_for(const timespec &rel_time)
+{
+  int err = fev_sleep_for(&rel_time);
+  detail::throw_on_err(err, "Sleeping failed");
+}
+
+template <typename Rep, typename Period>
+void sleep_for(const std::chrono::duration<Rep, Period> &rel_time)
+{
+  const auto ts = detail::duration_to_timespec(rel_time);
+  sleep_for(ts);
+}
+
 } // namespace this_fiber
 
-class mutex final {
+// Makes the permit of `fiber` available, see fev_unpark().
+inline void unpark(fev_fiber *fiber) noexcept { fev_unpark(fiber); }
+
+// Makes the permit of `fiber` available and switches to it if it was parked, see fev_yield_to().
+inline void yield_to(fev_fiber *fiber) noexcept { fev_yield_to(fiber); }
+
+// A value of type T per fiber. The value is default-constructed on the first access in a fiber and
+// destroyed when that fiber exits. Keys cannot be deleted, thus fiber_local objects should have
+// static storage duration.
+template <typename T> class fiber_local final {
 private:
-  fev_mutex *create()
+  static void destroy(void *value) noexcept { delete static_cast<T *>(value); }
+
+  static fev_fls_key_t create()
   {
-    fev_mutex *mutex;
-    int err = fev_mutex_create(&mutex);
-    detail::throw_on_err(err, "Creating mutex failed");
-    return mutex;
+    fev_fls_key_t key;
+    int err = fev_fls_key_create(&key, &destroy);
+    detail::throw_on_err(err, "Creating fiber-local key failed");
+    return key;
   }
 
 public:
-  mutex() : impl_{create(), &fev_mutex_destroy} {}
+  fiber_local() : impl_{create()} {}
 
-  mutex(const mutex &) = delete;
-  void operator=(const mutex &) = delete;
+  fiber_local(const fiber_local &) = delete;
+  void operator=(const fiber_local &) = delete;
 
-  mutex(mutex &&) = default;
-  mutex &operator=(mutex &&) = default;
+  T &get()
+  {
+    void *value = fev_fls_get(impl_);
+    if (value != nullptr)
+      return *static_cast<T *>(value);
 
-  void lock() noexcept { fev_mutex_lock(impl()); }
+    std::unique_ptr<T> new_value{new T{}};
+    int err = fev_fls_set(impl_, new_value.get());
+    detail::throw_on_err(err, "Setting fiber-local value failed");
+    return *new_value.release();
+  }
 
-  bool try_lock() noexcept { return fev_mutex_try_lock(impl()); }
+  T &operator*() { return get(); }
+  T *operator->() { return &get(); }
 
-  bool try_lock_until(const timespec &abs_time)
+  fev_fls_key_t impl() const noexcept { return impl_; }
+
+private:
+  fev_fls_key_t impl_;
+};
+
+// A value of type T per worker of a scheduler, see fev_worker_local_create(). The values are
+// value-initialized and destroyed with the object. local() must be called from a fiber of the
+// scheduler and the reference must not be kept across calls that can switch the fiber.
+template <typename T> class worker_local final {
+private:
+  static_assert(alignof(T) <= alignof(std::max_align_t), "T is overaligned");
+
+  static fev_worker_local *create(fev_sched *sched)
   {
-    int ret = fev_mutex_try_lock_until(impl(), &abs_time);
-    if (ret == 0)
-      return true;
-    if (ret == -ETIMEDOUT)
-      return false;
-    detail::throw_err(ret, "Trying to lock mutex failed");
+    fev_worker_local *worker_local;
+    int err = fev_worker_local_create(&worker_local, sched, sizeof(T));
+    detail::throw_on_err(err, "Creating worker-local storage failed");
+    return worker_local;
   }
 
-  bool try_lock_for(const timespec &rel_time)
+  void destroy_values(std::uint32_t num_values) noexcept
   {
-    int ret = fev_mutex_try_lock_for(impl(), &rel_time);
-    if (ret == 0)
-      return true;
-    if (ret == -ETIMEDOUT)
-      return false;
-    detail::throw_err(ret, "Trying to lock mutex failed");
+    for (std::uint32_t i = 0; i < num_values; i++)
+      (*this)[i].~T();
   }
 
-  template <typename Rep, typename Period>
-  bool try_lock_for(const std::chrono::duration<Rep, Period> &rel_time)
+public:
+  explicit worker_local(sched &sched)
+      : impl_{create(sched.impl()), &fev_worker_local_destroy}, size_{sched.num_workers()}
   {
-    const auto ts = detail::duration_to_timespec(rel_time);
-    return try_lock_for(ts);
+    std::uint32_t i = 0;
+    try {
+      for (; i < size_; i++)
+        ::new (fev_worker_local_at(impl(), i)) T{};
+    } catch (...) {
+      destroy_values(i);
+      throw;
+    }
   }
 
-  void unlock() noexcept { fev_mutex_unlock(impl()); }
+  worker_local(const worker_local &) = delete;
+  void operator=(const worker_local &) = delete;
 
-  const fev_mutex *impl() const noexcept { return impl_.get(); }
-  fev_mutex *impl() noexcept { return impl_.get(); }
+  ~worker_local() { destroy_values(size_); }
+
+  T &local() noexcept { return *static_cast<T *>(fev_worker_local_get(impl())); }
+
+  T &operator[](std::uint32_t index) noexcept
+  {
+    return *static_cast<T *>(fev_worker_local_at(impl(), index));
+  }
+
+  std::uint32_t size() const noexcept { return size_; }
+
+  const fev_worker_local *impl() const noexcept { return impl_.get(); }
+  fev_worker_local *impl() noexcept { return impl_.get(); }
 
 private:
-  std::unique_ptr<fev_mutex, void (*)(fev_mutex *)> impl_;
+  std::unique_ptr<fev_worker_local, void (*)(fev_worker_local *)> impl_;
+  std::uint32_t size_;
 };
 
-class condition_variable final {
+// A counter sharded by workers, see fev_counter_create().
+class counter final {
 private:
-  fev_cond *create()
+  static fev_counter *create(fev_sched *sched)
   {
-    fev_cond *cond;
-    int err = fev_cond_create(&cond);
-    detail::throw_on_err(err, "Creating condition variable failed");
-    return cond;
+    fev_counter *counter;
+    int err = fev_counter_create(&counter, sched);
+    detail::throw_on_err(err, "Creating counter failed");
+    return counter;
   }
 
 public:
-  condition_variable() : impl_{create(), &fev_cond_destroy} {}
+  explicit counter(sched &sched) : impl_{create(sched.impl()), &fev_counter_destroy} {}
 
-  condition_variable(const condition_variable &) = delete;
-  void operator=(const condition_variable &) = delete;
+  counter(const counter &) = delete;
+  void operator=(const counter &) = delete;
 
-  condition_variable(condition_variable &&) = default;
-  condition_variable &operator=(condition_variable &&) = default;
+  counter(counter &&) = default;
+  counter &operator=(counter &&) = default;
 
-  void notify_one() noexcept { fev_cond_notify_one(impl()); }
+  void add(std::uint64_t value = 1) noexcept { fev_counter_add(impl(), value); }
 
-  void notify_all() noexcept { fev_cond_notify_all(impl()); }
+  std::uint64_t read() const noexcept { return fev_counter_read(impl()); }
 
-  void wait(std::unique_lock<fev::mutex> &lock) noexcept
-  {
-    fev_cond_wait(impl(), lock.mutex()->impl());
-  }
+  const fev_counter *impl() const noexcept { return impl_.get(); }
+  fev_counter *impl() noexcept { return impl_.get(); }
 
-  template <typename Predicate>
-  void wait(std::unique_lock<fev::mutex> &lock, Predicate pred) noexcept
-  {
-    while (!pred())
-      wait(lock);
-  }
+private:
+  std::unique_ptr<fev_counter, void (*)(fev_counter *)> impl_;
+};
 
-  std::cv_status wait_until(std::unique_lock<fev::mutex> &lock, const timespec &abs_time)
-  {
-    int ret = fev_cond_wait_until(impl(), lock.mutex()->impl(), &abs_time);
-    if (ret == 0 || ret == -EAGAIN)
-      return std::cv_status::no_timeout;
-    if (ret == -ETIMEDOUT)
-      return std::cv_status::timeout;
-    detail::throw_err(ret, "Waiting on condition variable failed");
-  }
+#ifdef FEV_HAS_COROUTINES
 
-  template <typename Predicate>
-  bool wait_until(std::unique_lock<fev::mutex> &lock, const timespec &abs_time, Predicate pred)
-  {
-    while (!pred()) {
-      auto status = wait_until(lock, abs_time);
-      if (status == std::cv_status::timeout)
-        return pred();
+// Coroutines
+//
+// A coroutine returning fev::task<T> starts when it is awaited. Top-level tasks are started with
+// co_spawn(), which runs them on a stackless fiber (see fev_stackless_spawn()), thus a suspended
+// coroutine costs only its frame instead of a fiber stack. Coroutines and fibers can run in the
+// same scheduler and share mutexes, semaphores and sockets.
+// A task can be suspended only by awaiting other tasks and the async_*() awaitables, it should not
+// call the blocking functions (like mutex::lock()).
+
+template <typename T = void> class task;
+
+namespace detail {
+
+class spawned_task;
+
+struct task_promise_base {
+  struct final_awaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+    {
+      // Resume the awaiting coroutine or return to the stackless fiber if this is the top-level
+      // task.
+      auto continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
     }
-    return true;
-  }
 
-  std::cv_status wait_for(std::unique_lock<fev::mutex> &lock, const timespec &rel_time)
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+  final_awaiter final_suspend() const noexcept { return {}; }
+  void unhandled_exception() noexcept { exception = std::current_exception(); }
+
+  std::coroutine_handle<> continuation;
+
+  // The coroutine that waits for an operation is stored here, the stackless fiber resumes it.
+  std::coroutine_handle<> *resume_point{nullptr};
+
+  std::exception_ptr exception;
+};
+
+template <typename T> struct task_promise final : task_promise_base {
+  task<T> get_return_object() noexcept;
+
+  template <typename U> void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+
+  T result()
   {
-    int ret = fev_cond_wait_for(impl(), lock.mutex()->impl(), &rel_time);
-    if (ret == 0 || ret == -EAGAIN)
-      return std::cv_status::no_timeout;
-    if (ret == -ETIMEDOUT)
-      return std::cv_status::timeout;
-    detail::throw_err(ret, "Waiting on condition variable failed");
+    if (exception)
+      std::rethrow_exception(exception);
+    return std::move(*value);
   }
 
-  template <typename Predicate>
-  bool wait_for(std::unique_lock<fev::mutex> &lock, const timespec &rel_time, Predicate pred)
+  std::optional<T> value;
+};
+
+template <> struct task_promise<void> final : task_promise_base {
+  task<void> get_return_object() noexcept;
+
+  void return_void() noexcept {}
+
+  void result()
   {
-    // TODO: Allow user to choose clock id.
-    clockid_t clock_id = CLOCK_MONOTONIC;
-    timespec abs_time;
-    int err = clock_gettime(clock_id, &abs_time);
-    if (err < 0)
-      detail::throw_err(-errno, "Getting time failed");
-    abs_time.tv_sec += rel_time.tv_sec + (abs_time.tv_nsec + rel_time.tv_nsec) / 1'000'000'000;
-    abs_time.tv_nsec = (abs_time.tv_nsec + rel_time.tv_nsec) % 1'000'000'000;
-    return wait_until(lock, abs_time, std::move(pred));
+    if (exception)
+      std::rethrow_exception(exception);
   }
+};
 
-  template <typename Rep, typename Period>
-  std::cv_status wait_for(std::unique_lock<fev::mutex> &lock,
-                          const std::chrono::duration<Rep, Period> &rel_time)
+// Awaits fev_stackless_*() operation `op`. If it returns -EINPROGRESS, the coroutine is suspended
+// until the stackless fiber is resumed. `finish` converts the result of the operation.
+template <typename Op, typename Finish> class stackless_awaiter final {
+public:
+  stackless_awaiter(Op op, Finish finish) : op_{std::move(op)}, finish_{std::move(finish)} {}
+
+  bool await_ready() const noexcept { return false; }
+
+  template <typename Promise> bool await_suspend(std::coroutine_handle<Promise> handle) noexcept
   {
-    const auto ts = detail::duration_to_timespec(rel_time);
-    return wait_for(lock, ts);
+    ret_ = op_();
+    if (ret_ != -EINPROGRESS)
+      return false;
+
+    *handle.promise().resume_point = handle;
+    return true;
   }
 
-  template <typename Rep, typename Period, typename Predicate>
-  bool wait_for(std::unique_lock<fev::mutex> &lock,
-                const std::chrono::duration<Rep, Period> &rel_time, Predicate pred)
+  decltype(auto) await_resume()
   {
-    const auto ts = detail::duration_to_timespec(rel_time);
-    return wait_for(lock, ts, std::move(pred));
+    return finish_(ret_ == -EINPROGRESS ? fev_stackless_result() : ret_);
   }
 
-  const fev_cond *impl() const noexcept { return impl_.get(); }
-  fev_cond *impl() noexcept { return impl_.get(); }
-
 private:
-  std::unique_ptr<fev_cond, void (*)(fev_cond *)> impl_;
+  Op op_;
+  Finish finish_;
+  ssize_t ret_{0};
 };
 
-class semaphore final {
+} // namespace detail
+
+template <typename T> class [[nodiscard]] task final {
 private:
-  static fev_sem *create(std::int32_t value)
-  {
-    fev_sem *sem;
-    int err = fev_sem_create(&sem, value);
-    detail::throw_on_err(err, "Creating semaphore failed");
-    return sem;
-  }
+  using handle_type = std::coroutine_handle<detail::task_promise<T>>;
 
-public:
-  explicit semaphore(std::int32_t value) : impl_{create(value), &fev_sem_destroy} {}
+  struct awaiter {
+    bool await_ready() const noexcept { return false; }
 
-  semaphore(const semaphore &) = delete;
-  void operator=(const semaphore &) = delete;
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> awaiting) noexcept
+    {
+      handle.promise().continuation = awaiting;
+      handle.promise().resume_point = awaiting.promise().resume_point;
+      return handle;
+    }
 
-  semaphore(semaphore &&) = default;
-  semaphore &operator=(semaphore &&) = default;
+    T await_resume() { return handle.promise().result(); }
 
-  void post() noexcept { fev_sem_post(impl()); }
+    handle_type handle;
+  };
 
-  void wait() noexcept { fev_sem_wait(impl()); }
+public:
+  using promise_type = detail::task_promise<T>;
 
-  bool wait_until(const timespec &abs_time)
-  {
-    int ret = fev_sem_wait_until(impl(), &abs_time);
-    if (ret == 0)
-      return true;
-    if (ret == -ETIMEDOUT)
-      return false;
-    detail::throw_err(ret, "Waiting on semaphore failed");
-  }
+  task() noexcept = default;
+  explicit task(handle_type handle) noexcept : handle_{handle} {}
 
-  bool wait_for(const timespec &rel_time)
+  task(const task &) = delete;
+  void operator=(const task &) = delete;
+
+  task(task &&other) noexcept : handle_{std::exchange(other.handle_, nullptr)} {}
+
+  task &operator=(task &&other) noexcept
   {
-    int ret = fev_sem_wait_for(impl(), &rel_time);
-    if (ret == 0)
-      return true;
-    if (ret == -ETIMEDOUT)
-      return false;
-    detail::throw_err(ret, "Waiting on semaphore failed");
+    if (this != &other) {
+      if (handle_)
+        handle_.destroy();
+      handle_ = std::exchange(other.handle_, nullptr);
+    }
+    return *this;
   }
 
-  template <typename Rep, typename Period>
-  bool wait_for(const std::chrono::duration<Rep, Period> &rel_time)
+  ~task()
   {
-    const auto ts = detail::duration_to_timespec(rel_time);
-    return wait_for(ts);
+    if (handle_)
+      handle_.destroy();
   }
 
-  const fev_sem *impl() const noexcept { return impl_.get(); }
-  fev_sem *impl() noexcept { return impl_.get(); }
+  awaiter operator co_await() const noexcept { return awaiter{handle_}; }
 
 private:
-  std::unique_ptr<fev_sem, void (*)(fev_sem *)> impl_;
+  friend class detail::spawned_task;
+
+  handle_type handle_;
 };
 
-class socket final {
+namespace detail {
+
+template <typename T> task<T> task_promise<T>::get_return_object() noexcept
+{
+  return task<T>{std::coroutine_handle<task_promise<T>>::from_promise(*this)};
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+  return task<void>{std::coroutine_handle<task_promise<void>>::from_promise(*this)};
+}
+
+class spawned_task final {
 private:
-  static fev_socket *create()
+  static void resume(void *arg) noexcept
   {
-    fev_socket *socket;
-    int err = fev_socket_create(&socket);
-    detail::throw_on_err(err, "Creating socket failed");
-    return socket;
-  }
+    auto *self = static_cast<spawned_task *>(arg);
 
-public:
-  socket() : impl_{create(), &fev_socket_destroy} {}
+    std::exchange(self->resume_point_, nullptr).resume();
 
-  socket(const socket &) = delete;
-  void operator=(const socket &) = delete;
+    // If the task hasn't finished, it is waiting for an operation and will be resumed later.
+    if (self->handle_.done()) {
+      if (self->handle_.promise().exception) {
+        std::cerr << "Uncaught exception in coroutine\n";
+        std::terminate();
+      }
+      delete self;
+    }
+  }
+
+  explicit spawned_task(task<void> &&task) noexcept
+      : handle_{std::exchange(task.handle_, nullptr)}, resume_point_{handle_}
+  {
+    handle_.promise().resume_point = &resume_point_;
+  }
+
+public:
+  spawned_task(const spawned_task &) = delete;
+  void operator=(const spawned_task &) = delete;
+
+  ~spawned_task() { handle_.destroy(); }
+
+  static void spawn(fev_sched *sched, task<void> &&task)
+  {
+    std::unique_ptr<spawned_task> spawned{new spawned_task{std::move(task)}};
+    int err = fev_stackless_spawn(sched, &resume, spawned.get());
+    detail::throw_on_err(err, "Spawning coroutine failed");
+    spawned.release();
+  }
+
+private:
+  std::coroutine_handle<task_promise<void>> handle_;
+  std::coroutine_handle<> resume_point_;
+};
+
+} // namespace detail
+
+inline void co_spawn(task<void> task) { detail::spawned_task::spawn(nullptr, std::move(task)); }
+
+inline void co_spawn(sched &sched, task<void> task)
+{
+  detail::spawned_task::spawn(sched.impl(), std::move(task));
+}
+
+namespace this_coroutine {
+
+inline auto yield() noexcept
+{
+  return detail::stackless_awaiter{[] { return fev_stackless_yield(); }, [](ssize_t) noexcept {}};
+}
+
+inline auto sleep_until(const timespec &abs_time) noexcept
+{
+  return detail::stackless_awaiter{
+      [abs_time] { return fev_stackless_sleep_until(&abs_time); },
+      [](ssize_t ret) { detail::throw_on_err(static_cast<int>(ret), "Sleeping failed"); }};
+}
+
+inline auto sleep_for(const timespec &rel_time) noexcept
+{
+  return detail::stackless_awaiter{
+      [rel_time] { return fev_stackless_sleep_for(&rel_time); },
+      [](ssize_t ret) { detail::throw_on_err(static_cast<int>(ret), "Sleeping failed"); }};
+}
+
+template <typename Rep, typename Period>
+auto sleep_for(const std::chrono::duration<Rep, Period> &rel_time)
+{
+  const auto ts = detail::duration_to_timespec(rel_time);
+  return sleep_for(ts);
+}
+
+} // namespace this_coroutine
+
+#endif // FEV_HAS_COROUTINES
+
+class mutex final {
+private:
+  fev_mutex *create()
+  {
+    fev_mutex *mutex;
+    int err = fev_mutex_create(&mutex);
+    detail::throw_on_err(err, "Creating mutex failed");
+    return mutex;
+  }
+
+public:
+  mutex() : impl_{create(), &fev_mutex_destroy} {}
+
+  mutex(const mutex &) = delete;
+  void operator=(const mutex &) = delete;
+
+  mutex(mutex &&) = default;
+  mutex &operator=(mutex &&) = default;
+
+  void lock() noexcept { fev_mutex_lock(impl()); }
+
+  bool try_lock() noexcept { return fev_mutex_try_lock(impl()); }
+
+  bool try_lock_until(const timespec &abs_time)
+  {
+    int ret = fev_mutex_try_lock_until(impl(), &abs_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Trying to lock mutex failed");
+  }
+
+  bool try_lock_for(const timespec &rel_time)
+  {
+    int ret = fev_mutex_try_lock_for(impl(), &rel_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Trying to lock mutex failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool try_lock_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return try_lock_for(ts);
+  }
+
+  void unlock() noexcept { fev_mutex_unlock(impl()); }
+
+#ifdef FEV_HAS_COROUTINES
+  auto async_lock() noexcept
+  {
+    return detail::stackless_awaiter{
+        [this] { return fev_stackless_mutex_lock(impl()); },
+        [](ssize_t ret) { detail::throw_on_err(static_cast<int>(ret), "Locking mutex failed"); }};
+  }
+#endif
+
+  const fev_mutex *impl() const noexcept { return impl_.get(); }
+  fev_mutex *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_mutex, void (*)(fev_mutex *)> impl_;
+};
+
+// Satisfies SharedTimedMutex for the duration overloads, thus it can be used with
+// std::shared_lock.
+class shared_mutex final {
+private:
+  fev_rwlock *create()
+  {
+    fev_rwlock *rwlock;
+    int err = fev_rwlock_create(&rwlock);
+    detail::throw_on_err(err, "Creating shared mutex failed");
+    return rwlock;
+  }
+
+  static bool timed_result(int ret, const char *msg)
+  {
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, msg);
+  }
+
+public:
+  shared_mutex() : impl_{create(), &fev_rwlock_destroy} {}
+
+  shared_mutex(const shared_mutex &) = delete;
+  void operator=(const shared_mutex &) = delete;
+
+  shared_mutex(shared_mutex &&) = default;
+  shared_mutex &operator=(shared_mutex &&) = default;
+
+  // Exclusive ownership
+
+  void lock() noexcept { fev_rwlock_write_lock(impl()); }
+
+  bool try_lock() noexcept { return fev_rwlock_try_write_lock(impl()); }
+
+  bool try_lock_until(const timespec &abs_time)
+  {
+    int ret = fev_rwlock_try_write_lock_until(impl(), &abs_time);
+    return timed_result(ret, "Trying to lock shared mutex failed");
+  }
+
+  bool try_lock_for(const timespec &rel_time)
+  {
+    int ret = fev_rwlock_try_write_lock_for(impl(), &rel_time);
+    return timed_result(ret, "Trying to lock shared mutex failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool try_lock_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return try_lock_for(ts);
+  }
+
+  void unlock() noexcept { fev_rwlock_write_unlock(impl()); }
+
+  // Shared ownership
+
+  void lock_shared() noexcept { fev_rwlock_read_lock(impl()); }
+
+  bool try_lock_shared() noexcept { return fev_rwlock_try_read_lock(impl()); }
+
+  bool try_lock_shared_until(const timespec &abs_time)
+  {
+    int ret = fev_rwlock_try_read_lock_until(impl(), &abs_time);
+    return timed_result(ret, "Trying to lock shared mutex failed");
+  }
+
+  bool try_lock_shared_for(const timespec &rel_time)
+  {
+    int ret = fev_rwlock_try_read_lock_for(impl(), &rel_time);
+    return timed_result(ret, "Trying to lock shared mutex failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool try_lock_shared_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return try_lock_shared_for(ts);
+  }
+
+  void unlock_shared() noexcept { fev_rwlock_read_unlock(impl()); }
+
+  const fev_rwlock *impl() const noexcept { return impl_.get(); }
+  fev_rwlock *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_rwlock, void (*)(fev_rwlock *)> impl_;
+};
+
+class condition_variable final {
+private:
+  fev_cond *create()
+  {
+    fev_cond *cond;
+    int err = fev_cond_create(&cond);
+    detail::throw_on_err(err, "Creating condition variable failed");
+    return cond;
+  }
+
+public:
+  condition_variable() : impl_{create(), &fev_cond_destroy} {}
+
+  condition_variable(const condition_variable &) = delete;
+  void operator=(const condition_variable &) = delete;
+
+  condition_variable(condition_variable &&) = default;
+  condition_variable &operator=(condition_variable &&) = default;
+
+  void notify_one() noexcept { fev_cond_notify_one(impl()); }
+
+  void notify_all() noexcept { fev_cond_notify_all(impl()); }
+
+  void wait(std::unique_lock<fev::mutex> &lock)
+  {
+    int err = fev_cond_wait(impl(), lock.mutex()->impl());
+    detail::throw_on_err(err, "Waiting on condition variable failed");
+  }
+
+  template <typename Predicate> void wait(std::unique_lock<fev::mutex> &lock, Predicate pred)
+  {
+    while (!pred())
+      wait(lock);
+  }
+
+  std::cv_status wait_until(std::unique_lock<fev::mutex> &lock, const timespec &abs_time)
+  {
+    int ret = fev_cond_wait_until(impl(), lock.mutex()->impl(), &abs_time);
+    if (ret == 0 || ret == -EAGAIN)
+      return std::cv_status::no_timeout;
+    if (ret == -ETIMEDOUT)
+      return std::cv_status::timeout;
+    detail::throw_err(ret, "Waiting on condition variable failed");
+  }
+
+  template <typename Predicate>
+  bool wait_until(std::unique_lock<fev::mutex> &lock, const timespec &abs_time, Predicate pred)
+  {
+    while (!pred()) {
+      auto status = wait_until(lock, abs_time);
+      if (status == std::cv_status::timeout)
+        return pred();
+    }
+    return true;
+  }
+
+  std::cv_status wait_for(std::unique_lock<fev::mutex> &lock, const timespec &rel_time)
+  {
+    int ret = fev_cond_wait_for(impl(), lock.mutex()->impl(), &rel_time);
+    if (ret == 0 || ret == -EAGAIN)
+      return std::cv_status::no_timeout;
+    if (ret == -ETIMEDOUT)
+      return std::cv_status::timeout;
+    detail::throw_err(ret, "Waiting on condition variable failed");
+  }
+
+  template <typename Predicate>
+  bool wait_for(std::unique_lock<fev::mutex> &lock, const timespec &rel_time, Predicate pred)
+  {
+    // TODO: Allow user to choose clock id.
+    clockid_t clock_id = CLOCK_MONOTONIC;
+    timespec abs_time;
+    int err = clock_gettime(clock_id, &abs_time);
+    if (err < 0)
+      detail::throw_err(-errno, "Getting time failed");
+    abs_time.tv_sec += rel_time.tv_sec + (abs_time.tv_nsec + rel_time.tv_nsec) / 1'000'000'000;
+    abs_time.tv_nsec = (abs_time.tv_nsec + rel_time.tv_nsec) % 1'000'000'000;
+    return wait_until(lock, abs_time, std::move(pred));
+  }
+
+  template <typename Rep, typename Period>
+  std::cv_status wait_for(std::unique_lock<fev::mutex> &lock,
+                          const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(lock, ts);
+  }
+
+  template <typename Rep, typename Period, typename Predicate>
+  bool wait_for(std::unique_lock<fev::mutex> &lock,
+                const std::chrono::duration<Rep, Period> &rel_time, Predicate pred)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(lock, ts, std::move(pred));
+  }
+
+  const fev_cond *impl() const noexcept { return impl_.get(); }
+  fev_cond *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_cond, void (*)(fev_cond *)> impl_;
+};
+
+class semaphore final {
+private:
+  static fev_sem *create(std::int32_t value)
+  {
+    fev_sem *sem;
+    int err = fev_sem_create(&sem, value);
+    detail::throw_on_err(err, "Creating semaphore failed");
+    return sem;
+  }
+
+public:
+  explicit semaphore(std::int32_t value) : impl_{create(value), &fev_sem_destroy} {}
+
+  semaphore(const semaphore &) = delete;
+  void operator=(const semaphore &) = delete;
+
+  semaphore(semaphore &&) = default;
+  semaphore &operator=(semaphore &&) = default;
+
+  void post() noexcept { fev_sem_post(impl()); }
+
+  void post(std::uint32_t n) noexcept { fev_sem_post_n(impl(), n); }
+
+  // Posts from any thread, the unit is added by a worker of `s`, see fev_sem_post_from_thread().
+  void post_from_thread(sched &s) noexcept { fev_sem_post_from_thread(impl(), s.impl()); }
+
+  void wait()
+  {
+    int err = fev_sem_wait(impl());
+    detail::throw_on_err(err, "Waiting on semaphore failed");
+  }
+
+  void wait(std::uint32_t n)
+  {
+    int err = fev_sem_wait_n(impl(), n);
+    detail::throw_on_err(err, "Waiting on semaphore failed");
+  }
+
+  bool wait_until(const timespec &abs_time)
+  {
+    int ret = fev_sem_wait_until(impl(), &abs_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on semaphore failed");
+  }
+
+  bool wait_for(const timespec &rel_time)
+  {
+    int ret = fev_sem_wait_for(impl(), &rel_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on semaphore failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(ts);
+  }
+
+#ifdef FEV_HAS_COROUTINES
+  auto async_wait() noexcept
+  {
+    return detail::stackless_awaiter{
+        [this] { return fev_stackless_sem_wait(impl()); },
+        [](ssize_t ret) {
+          detail::throw_on_err(static_cast<int>(ret), "Waiting on semaphore failed");
+        }};
+  }
+#endif
+
+  const fev_sem *impl() const noexcept { return impl_.get(); }
+  fev_sem *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_sem, void (*)(fev_sem *)> impl_;
+};
+
+// An event that OS threads can set and a fiber can wait for, see fev_thread_event_create().
+class thread_event final {
+private:
+  static fev_thread_event *create()
+  {
+    fev_thread_event *event;
+    int err = fev_thread_event_create(&event);
+    detail::throw_on_err(err, "Creating thread event failed");
+    return event;
+  }
+
+public:
+  thread_event() : impl_{create(), &fev_thread_event_destroy} {}
+
+  thread_event(const thread_event &) = delete;
+  void operator=(const thread_event &) = delete;
+
+  thread_event(thread_event &&) = default;
+  thread_event &operator=(thread_event &&) = default;
+
+  bool is_set() const noexcept { return fev_thread_event_is_set(impl()); }
+
+  void set() noexcept { fev_thread_event_set(impl()); }
+
+  void reset() noexcept { fev_thread_event_reset(impl()); }
+
+  void wait()
+  {
+    int err = fev_thread_event_wait(impl());
+    detail::throw_on_err(err, "Waiting on thread event failed");
+  }
+
+  bool wait_until(const timespec &abs_time)
+  {
+    int ret = fev_thread_event_wait_until(impl(), &abs_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on thread event failed");
+  }
+
+  bool wait_for(const timespec &rel_time)
+  {
+    int ret = fev_thread_event_wait_for(impl(), &rel_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on thread event failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(ts);
+  }
+
+  const fev_thread_event *impl() const noexcept { return impl_.get(); }
+  fev_thread_event *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_thread_event, void (*)(fev_thread_event *)> impl_;
+};
+
+class waitgroup final {
+private:
+  static fev_waitgroup *create()
+  {
+    fev_waitgroup *waitgroup;
+    int err = fev_waitgroup_create(&waitgroup);
+    detail::throw_on_err(err, "Creating wait group failed");
+    return waitgroup;
+  }
+
+public:
+  waitgroup() : impl_{create(), &fev_waitgroup_destroy} {}
+
+  waitgroup(const waitgroup &) = delete;
+  void operator=(const waitgroup &) = delete;
+
+  waitgroup(waitgroup &&) = default;
+  waitgroup &operator=(waitgroup &&) = default;
+
+  void add(std::int32_t delta) noexcept { fev_waitgroup_add(impl(), delta); }
+
+  void done() noexcept { fev_waitgroup_done(impl()); }
+
+  void wait() noexcept { fev_waitgroup_wait(impl()); }
+
+  bool wait_until(const timespec &abs_time)
+  {
+    int ret = fev_waitgroup_wait_until(impl(), &abs_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on wait group failed");
+  }
+
+  bool wait_for(const timespec &rel_time)
+  {
+    int ret = fev_waitgroup_wait_for(impl(), &rel_time);
+    if (ret == 0)
+      return true;
+    if (ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Waiting on wait group failed");
+  }
+
+  template <typename Rep, typename Period>
+  bool wait_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(ts);
+  }
+
+  const fev_waitgroup *impl() const noexcept { return impl_.get(); }
+  fev_waitgroup *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_waitgroup, void (*)(fev_waitgroup *)> impl_;
+};
+
+// Like std::latch, but blocks only the waiting fiber.
+class latch final {
+private:
+  static fev_latch *create(std::ptrdiff_t expected)
+  {
+    fev_latch *latch;
+    int err = fev_latch_create(&latch, static_cast<std::uint32_t>(expected));
+    detail::throw_on_err(err, "Creating latch failed");
+    return latch;
+  }
+
+public:
+  explicit latch(std::ptrdiff_t expected) : impl_{create(expected), &fev_latch_destroy} {}
+
+  latch(const latch &) = delete;
+  void operator=(const latch &) = delete;
+
+  static constexpr std::ptrdiff_t max() noexcept
+  {
+    return std::numeric_limits<std::uint32_t>::max();
+  }
+
+  void count_down(std::ptrdiff_t n = 1) noexcept
+  {
+    fev_latch_count_down(impl(), static_cast<std::uint32_t>(n));
+  }
+
+  bool try_wait() const noexcept { return fev_latch_try_wait(impl()); }
+
+  void wait() const noexcept { fev_latch_wait(impl_.get()); }
+
+  void arrive_and_wait(std::ptrdiff_t n = 1) noexcept
+  {
+    fev_latch_arrive_and_wait(impl(), static_cast<std::uint32_t>(n));
+  }
+
+  const fev_latch *impl() const noexcept { return impl_.get(); }
+  fev_latch *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_latch, void (*)(fev_latch *)> impl_;
+};
+
+namespace detail {
+
+struct barrier_empty_completion {
+  void operator()() noexcept {}
+};
+
+} // namespace detail
+
+// Like std::barrier, but blocks only the waiting fiber. The completion is run by the last arriving
+// fiber. The barrier cannot be moved, as the C barrier refers to it.
+template <typename CompletionFunction = detail::barrier_empty_completion> class barrier final {
+private:
+  static void complete(void *arg) noexcept { static_cast<barrier *>(arg)->completion_(); }
+
+  static fev_barrier *create(std::ptrdiff_t expected, barrier *self)
+  {
+    constexpr bool has_completion =
+        !std::is_same_v<CompletionFunction, detail::barrier_empty_completion>;
+    fev_barrier *barrier;
+    int err = fev_barrier_create(&barrier, static_cast<std::uint32_t>(expected),
+                                 has_completion ? &complete : nullptr, self);
+    detail::throw_on_err(err, "Creating barrier failed");
+    return barrier;
+  }
+
+public:
+  class arrival_token final {
+  private:
+    explicit arrival_token(std::uint32_t phase) noexcept : phase_{phase} {}
+
+    std::uint32_t phase_;
+
+    friend class barrier;
+  };
+
+  explicit barrier(std::ptrdiff_t expected, CompletionFunction completion = CompletionFunction())
+      : completion_{std::move(completion)}, impl_{create(expected, this), &fev_barrier_destroy}
+  {
+  }
+
+  barrier(const barrier &) = delete;
+  void operator=(const barrier &) = delete;
+
+  static constexpr std::ptrdiff_t max() noexcept
+  {
+    return std::numeric_limits<std::uint32_t>::max();
+  }
+
+  [[nodiscard]] arrival_token arrive(std::ptrdiff_t update = 1) noexcept
+  {
+    std::uint32_t phase = fev_barrier_arrive(impl());
+    for (std::ptrdiff_t i = 1; i < update; i++)
+      fev_barrier_arrive(impl());
+    return arrival_token{phase};
+  }
+
+  void wait(arrival_token &&arrival) const noexcept
+  {
+    fev_barrier_wait(impl_.get(), arrival.phase_);
+  }
+
+  void arrive_and_wait() noexcept { fev_barrier_arrive_and_wait(impl()); }
+
+  void arrive_and_drop() noexcept { fev_barrier_arrive_and_drop(impl()); }
+
+  const fev_barrier *impl() const noexcept { return impl_.get(); }
+  fev_barrier *impl() noexcept { return impl_.get(); }
+
+private:
+  CompletionFunction completion_;
+  std::unique_ptr<fev_barrier, void (*)(fev_barrier *)> impl_;
+};
+
+// Spawns detached fibers in the current scheduler and waits for all of them. The first exception
+// thrown by a child is rethrown by wait(). The destructor waits for the children as well, an
+// exception that has not been rethrown by then terminates the program.
+class nursery final {
+private:
+  template <typename Func, typename... Args> void run(Func &&func, Args &&... args) noexcept
+  {
+    try {
+      std::invoke(std::forward<Func>(func), std::forward<Args>(args)...);
+    } catch (...) {
+      if (!failed_.exchange(true, std::memory_order_relaxed))
+        exception_ = std::current_exception();
+    }
+    waitgroup_.done();
+  }
+
+public:
+  nursery() = default;
+
+  nursery(const nursery &) = delete;
+  void operator=(const nursery &) = delete;
+
+  ~nursery()
+  {
+    waitgroup_.wait();
+    if (exception_) {
+      std::cerr << "Uncaught exception in nursery\n";
+      std::terminate();
+    }
+  }
+
+  template <typename Func, typename... Args> void spawn(Func &&func, Args &&... args)
+  {
+    waitgroup_.add(1);
+    try {
+      fiber::spawn(
+          [this](auto &&func, auto &&... args) {
+            run(std::forward<decltype(func)>(func), std::forward<decltype(args)>(args)...);
+          },
+          std::forward<Func>(func), std::forward<Args>(args)...);
+    } catch (...) {
+      waitgroup_.done();
+      throw;
+    }
+  }
+
+  void wait()
+  {
+    waitgroup_.wait();
+    if (exception_) {
+      failed_.store(false, std::memory_order_relaxed);
+      std::rethrow_exception(std::exchange(exception_, nullptr));
+    }
+  }
+
+private:
+  waitgroup waitgroup_;
+  std::atomic<bool> failed_{false};
+  std::exception_ptr exception_;
+};
+
+template <typename T> class promise;
+
+namespace detail {
+
+template <typename T> class future_value {
+public:
+  template <typename... Args> void set(Args &&... args)
+  {
+    value_.emplace(std::forward<Args>(args)...);
+  }
+
+  T get() { return std::move(*value_); }
+
+private:
+  std::optional<T> value_;
+};
+
+template <> class future_value<void> {
+public:
+  void set() noexcept {}
+
+  void get() noexcept {}
+};
+
+} // namespace detail
+
+// The state shared with the promise lives in the future itself, thus a future can be placed on the
+// stack or in a caller-provided buffer without allocating. A future cannot be moved and must
+// outlive its promise. At most one fiber can wait for a future at a time.
+template <typename T> class future final {
+public:
+  future() noexcept { fev_future_init(&impl_); }
+
+  future(const future &) = delete;
+  void operator=(const future &) = delete;
+
+  ~future()
+  {
+    if (promise_retrieved_ && !is_ready()) {
+      std::cerr << "Destructor called on future with pending promise\n";
+      std::terminate();
+    }
+  }
+
+  promise<T> get_promise()
+  {
+    if (std::exchange(promise_retrieved_, true))
+      throw std::future_error{std::future_errc::future_already_retrieved};
+    return promise<T>{this};
+  }
+
+  bool is_ready() const noexcept { return fev_future_is_set(&impl_); }
+
+  void wait()
+  {
+    int err = fev_future_wait(&impl_);
+    detail::throw_on_err(err, "Waiting on future failed");
+  }
+
+  std::future_status wait_until(const timespec &abs_time)
+  {
+    int ret = fev_future_wait_until(&impl_, &abs_time);
+    if (ret == 0)
+      return std::future_status::ready;
+    if (ret == -ETIMEDOUT)
+      return std::future_status::timeout;
+    detail::throw_err(ret, "Waiting on future failed");
+  }
+
+  std::future_status wait_for(const timespec &rel_time)
+  {
+    int ret = fev_future_wait_for(&impl_, &rel_time);
+    if (ret == 0)
+      return std::future_status::ready;
+    if (ret == -ETIMEDOUT)
+      return std::future_status::timeout;
+    detail::throw_err(ret, "Waiting on future failed");
+  }
+
+  template <typename Rep, typename Period>
+  std::future_status wait_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return wait_for(ts);
+  }
+
+  // Waits for the result and moves it out of the future.
+  T get()
+  {
+    wait();
+    if (exception_)
+      std::rethrow_exception(exception_);
+    return value_.get();
+  }
+
+  const fev_future *impl() const noexcept { return &impl_; }
+  fev_future *impl() noexcept { return &impl_; }
+
+private:
+  friend class promise<T>;
+
+  fev_future impl_;
+  detail::future_value<T> value_;
+  std::exception_ptr exception_;
+  bool promise_retrieved_{false};
+};
+
+// Sets the result of a future from another fiber. A promise that is destroyed without setting the
+// result sets std::future_errc::broken_promise.
+template <typename T> class promise final {
+private:
+  explicit promise(future<T> *state) noexcept : state_{state} {}
+
+  future<T> *release_state()
+  {
+    if (state_ == nullptr)
+      throw std::future_error{std::future_errc::no_state};
+    return std::exchange(state_, nullptr);
+  }
+
+  static void set_exception(future<T> *state, std::exception_ptr exception) noexcept
+  {
+    state->exception_ = std::move(exception);
+    fev_future_set(&state->impl_);
+  }
+
+public:
+  promise() noexcept = default;
+
+  promise(const promise &) = delete;
+  void operator=(const promise &) = delete;
+
+  promise(promise &&other) noexcept : state_{std::exchange(other.state_, nullptr)} {}
+
+  promise &operator=(promise &&other) noexcept
+  {
+    if (this != &other) {
+      abandon();
+      state_ = std::exchange(other.state_, nullptr);
+    }
+    return *this;
+  }
+
+  ~promise() { abandon(); }
+
+  template <typename... Args> void set_value(Args &&... args)
+  {
+    future<T> *state = release_state();
+    try {
+      state->value_.set(std::forward<Args>(args)...);
+    } catch (...) {
+      set_exception(state, std::current_exception());
+      throw;
+    }
+    fev_future_set(&state->impl_);
+  }
+
+  void set_exception(std::exception_ptr exception)
+  {
+    set_exception(release_state(), std::move(exception));
+  }
+
+private:
+  void abandon() noexcept
+  {
+    if (state_ != nullptr) {
+      auto exception = std::make_exception_ptr(std::future_error{std::future_errc::broken_promise});
+      set_exception(std::exchange(state_, nullptr), std::move(exception));
+    }
+  }
+
+  friend class future<T>;
+
+  future<T> *state_{nullptr};
+};
+
+// Waits until all futures in the range are ready.
+template <typename Range> void when_all(Range &futures)
+{
+  for (auto &future : futures)
+    future.wait();
+}
+
+// Waits until any future in the range is ready and returns its index.
+template <typename Range> std::size_t when_any(Range &futures)
+{
+  // Avoid allocating for small ranges.
+  constexpr std::size_t inline_size = 16;
+  fev_future *inline_impls[inline_size];
+  std::vector<fev_future *> heap_impls;
+  std::size_t size = 0;
+
+  for (auto &future : futures) {
+    if (size < inline_size) {
+      inline_impls[size] = future.impl();
+    } else {
+      if (size == inline_size)
+        heap_impls.assign(inline_impls, inline_impls + inline_size);
+      heap_impls.push_back(future.impl());
+    }
+    size++;
+  }
+
+  fev_future **impls = size <= inline_size ? inline_impls : heap_impls.data();
+  int ret = fev_future_wait_any(impls, size);
+  if (ret < 0)
+    detail::throw_err(ret, "Waiting on futures failed");
+  return static_cast<std::size_t>(ret);
+}
+
+// Marks an RCU read-side critical section, see fev_rcu_read_lock(). The references must not be kept
+// across calls that can switch the fiber.
+class rcu_read_guard final {
+public:
+  rcu_read_guard() noexcept { fev_rcu_read_lock(); }
+
+  rcu_read_guard(const rcu_read_guard &) = delete;
+  void operator=(const rcu_read_guard &) = delete;
+
+  ~rcu_read_guard() { fev_rcu_read_unlock(); }
+};
+
+// Deletes `ptr` after a grace period, see fev_rcu_call().
+template <typename T> void rcu_delete(T *ptr)
+{
+  int err = fev_rcu_call(ptr, [](void *p) { delete static_cast<T *>(p); });
+  detail::throw_on_err(err, "Deferring deletion failed");
+}
+
+inline void rcu_synchronize() noexcept { fev_rcu_synchronize(); }
+
+// A bounded channel of T, see fev_chan_create(). Values that are trivially copyable and fit in a
+// pointer are stored in the channel directly, other values are moved to the heap. The functions
+// return false (or std::nullopt) if the channel is closed, full (empty) or the timeout has expired,
+// and throw if the fiber has been canceled. A value that could not be sent is left unchanged.
+template <typename T> class channel final {
+private:
+  static constexpr bool is_inline = std::is_trivially_copyable_v<T> &&
+                                    std::is_trivially_default_constructible_v<T> &&
+                                    sizeof(T) <= sizeof(void *) && alignof(T) <= alignof(void *);
+
+  template <typename U>
+  using enable_if_value = std::enable_if_t<std::is_same_v<std::decay_t<U>, T>, int>;
+
+  static constexpr std::size_t batch_size = 64;
+
+  static fev_chan *create(std::uint32_t capacity)
+  {
+    fev_chan *chan;
+    int err = fev_chan_create(&chan, capacity);
+    detail::throw_on_err(err, "Creating channel failed");
+    return chan;
+  }
+
+  static void destroy(fev_chan *chan) noexcept
+  {
+    if constexpr (!is_inline) {
+      void *elem;
+      while (fev_chan_try_recv(chan, &elem) == 0)
+        discard(elem);
+    }
+    fev_chan_destroy(chan);
+  }
+
+  template <typename U> static void *to_elem(U &&value)
+  {
+    if constexpr (is_inline) {
+      void *elem = nullptr;
+      std::memcpy(&elem, &value, sizeof(T));
+      return elem;
+    } else {
+      return new T(std::forward<U>(value));
+    }
+  }
+
+  static T from_elem(void *elem)
+  {
+    if constexpr (is_inline) {
+      T value;
+      std::memcpy(&value, &elem, sizeof(T));
+      return value;
+    } else {
+      std::unique_ptr<T> box{static_cast<T *>(elem)};
+      return std::move(*box);
+    }
+  }
+
+  static void discard(void *elem) noexcept
+  {
+    if constexpr (!is_inline)
+      delete static_cast<T *>(elem);
+  }
+
+  template <typename U, typename Op> bool send_impl(U &&value, Op op)
+  {
+    void *elem = to_elem(std::forward<U>(value));
+    int ret = op(elem);
+    if (ret == 0)
+      return true;
+
+    // Give the value back if it has been moved.
+    if constexpr (!is_inline && !std::is_lvalue_reference_v<U>)
+      value = std::move(*static_cast<T *>(elem));
+    discard(elem);
+
+    if (ret == -EPIPE || ret == -EAGAIN || ret == -ETIMEDOUT)
+      return false;
+    detail::throw_err(ret, "Sending to channel failed");
+  }
+
+  template <typename Op> std::optional<T> recv_impl(Op op)
+  {
+    void *elem;
+    int ret = op(&elem);
+    if (ret == 0)
+      return from_elem(elem);
+    if (ret == -EPIPE || ret == -EAGAIN || ret == -ETIMEDOUT)
+      return std::nullopt;
+    detail::throw_err(ret, "Receiving from channel failed");
+  }
+
+public:
+  explicit channel(std::uint32_t capacity) : impl_{create(capacity), &destroy} {}
+
+  channel(const channel &) = delete;
+  void operator=(const channel &) = delete;
+
+  channel(channel &&) = default;
+  channel &operator=(channel &&) = default;
+
+  void close() noexcept { fev_chan_close(impl()); }
+
+  bool is_closed() const noexcept { return fev_chan_is_closed(impl()); }
+
+  template <typename U, enable_if_value<U> = 0> bool send(U &&value)
+  {
+    return send_impl(std::forward<U>(value),
+                     [this](void *elem) { return fev_chan_send(impl(), elem); });
+  }
+
+  template <typename U, enable_if_value<U> = 0> bool try_send(U &&value)
+  {
+    return send_impl(std::forward<U>(value),
+                     [this](void *elem) { return fev_chan_try_send(impl(), elem); });
+  }
+
+  template <typename U, enable_if_value<U> = 0> bool send_until(U &&value, const timespec &abs_time)
+  {
+    return send_impl(std::forward<U>(value), [this, &abs_time](void *elem) {
+      return fev_chan_send_until(impl(), elem, &abs_time);
+    });
+  }
+
+  template <typename U, enable_if_value<U> = 0> bool send_for(U &&value, const timespec &rel_time)
+  {
+    return send_impl(std::forward<U>(value), [this, &rel_time](void *elem) {
+      return fev_chan_send_for(impl(), elem, &rel_time);
+    });
+  }
+
+  template <typename U, typename Rep, typename Period, enable_if_value<U> = 0>
+  bool send_for(U &&value, const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return send_for(std::forward<U>(value), ts);
+  }
+
+  // Sends the values in [first, last), waking up the receivers once per batch. Returns the iterator
+  // past the last sent value, which is not `last` only if the channel has been closed. The values
+  // are read (or moved if `first` is a move iterator) in batches, thus some values that have not
+  // been sent might have been read anyway.
+  template <typename ForwardIt> ForwardIt send_n(ForwardIt first, ForwardIt last)
+  {
+    void *elems[batch_size];
+
+    while (first != last) {
+      std::size_t num_elems = 0, num_sent = 0;
+      auto it = first;
+
+      for (; it != last && num_elems < batch_size; ++it)
+        elems[num_elems++] = to_elem(*it);
+
+      while (num_sent < num_elems) {
+        auto ret = fev_chan_send_n(impl(), elems + num_sent, num_elems - num_sent);
+        if (ret < 0) {
+          for (std::size_t i = num_sent; i < num_elems; i++)
+            discard(elems[i]);
+          if (ret == -EPIPE)
+            return std::next(first, static_cast<std::ptrdiff_t>(num_sent));
+          detail::throw_err(static_cast<int>(ret), "Sending to channel failed");
+        }
+        num_sent += static_cast<std::size_t>(ret);
+      }
+
+      first = it;
+    }
+
+    return first;
+  }
+
+  std::optional<T> recv()
+  {
+    return recv_impl([this](void **elem_ptr) { return fev_chan_recv(impl(), elem_ptr); });
+  }
+
+  std::optional<T> try_recv()
+  {
+    return recv_impl([this](void **elem_ptr) { return fev_chan_try_recv(impl(), elem_ptr); });
+  }
+
+  std::optional<T> recv_until(const timespec &abs_time)
+  {
+    return recv_impl([this, &abs_time](void **elem_ptr) {
+      return fev_chan_recv_until(impl(), elem_ptr, &abs_time);
+    });
+  }
+
+  std::optional<T> recv_for(const timespec &rel_time)
+  {
+    return recv_impl([this, &rel_time](void **elem_ptr) {
+      return fev_chan_recv_for(impl(), elem_ptr, &rel_time);
+    });
+  }
+
+  template <typename Rep, typename Period>
+  std::optional<T> recv_for(const std::chrono::duration<Rep, Period> &rel_time)
+  {
+    const auto ts = detail::duration_to_timespec(rel_time);
+    return recv_for(ts);
+  }
+
+  // Waits for at least one value and receives at most `max_values` (and at most 64) values without
+  // waiting further. Returns the output iterator past the last received value, which is `out` only
+  // if the channel has been closed.
+  template <typename OutputIt> OutputIt recv_n(OutputIt out, std::size_t max_values)
+  {
+    void *elems[batch_size];
+
+    auto ret = fev_chan_recv_n(impl(), elems, std::min(max_values, batch_size));
+    if (ret < 0) {
+      if (ret == -EPIPE)
+        return out;
+      detail::throw_err(static_cast<int>(ret), "Receiving from channel failed");
+    }
+
+    for (std::size_t i = 0; i < static_cast<std::size_t>(ret); i++)
+      *out++ = from_elem(elems[i]);
+    return out;
+  }
+
+  const fev_chan *impl() const noexcept { return impl_.get(); }
+  fev_chan *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_chan, void (*)(fev_chan *)> impl_;
+};
+
+// A broadcast of values that fit in a pointer, usually pointers to immutable data whose lifetime is
+// managed by the sender (see fev_broadcast_create() in fev.h). A subscriber that has fallen behind
+// skips the lost values, num_missed() returns how many.
+template <typename T> class broadcast final {
+private:
+  static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_default_constructible_v<T> &&
+                    sizeof(T) <= sizeof(void *) && alignof(T) <= alignof(void *),
+                "The values of a broadcast must fit in a pointer");
+
+  static fev_broadcast *create(std::uint32_t capacity)
+  {
+    fev_broadcast *broadcast;
+    int err = fev_broadcast_create(&broadcast, capacity);
+    detail::throw_on_err(err, "Creating broadcast failed");
+    return broadcast;
+  }
+
+public:
+  class subscriber final {
+  private:
+    static fev_broadcast_sub *create(fev_broadcast *broadcast)
+    {
+      fev_broadcast_sub *sub;
+      int err = fev_broadcast_subscribe(broadcast, &sub);
+      detail::throw_on_err(err, "Subscribing to broadcast failed");
+      return sub;
+    }
+
+    template <typename Op> std::optional<T> recv_impl(Op op)
+    {
+      void *elem;
+      int ret;
+
+      // The lost values have been skipped and counted, receive the oldest available one.
+      do {
+        ret = op(&elem);
+      } while (ret == -EOVERFLOW);
+
+      if (ret == 0) {
+        T value;
+        std::memcpy(&value, &elem, sizeof(T));
+        return value;
+      }
+      if (ret == -EPIPE || ret == -EAGAIN || ret == -ETIMEDOUT)
+        return std::nullopt;
+      detail::throw_err(ret, "Receiving from broadcast failed");
+    }
+
+  public:
+    explicit subscriber(broadcast &broadcast)
+        : impl_{create(broadcast.impl()), &fev_broadcast_unsubscribe}
+    {
+    }
+
+    subscriber(const subscriber &) = delete;
+    void operator=(const subscriber &) = delete;
+
+    subscriber(subscriber &&) = default;
+    subscriber &operator=(subscriber &&) = default;
+
+    std::uint64_t num_missed() const noexcept { return fev_broadcast_sub_num_missed(impl()); }
+
+    std::optional<T> recv()
+    {
+      return recv_impl([this](void **elem_ptr) { return fev_broadcast_recv(impl(), elem_ptr); });
+    }
+
+    std::optional<T> try_recv()
+    {
+      return recv_impl(
+          [this](void **elem_ptr) { return fev_broadcast_try_recv(impl(), elem_ptr); });
+    }
+
+    std::optional<T> recv_until(const timespec &abs_time)
+    {
+      return recv_impl([this, &abs_time](void **elem_ptr) {
+        return fev_broadcast_recv_until(impl(), elem_ptr, &abs_time);
+      });
+    }
+
+    std::optional<T> recv_for(const timespec &rel_time)
+    {
+      return recv_impl([this, &rel_time](void **elem_ptr) {
+        return fev_broadcast_recv_for(impl(), elem_ptr, &rel_time);
+      });
+    }
+
+    template <typename Rep, typename Period>
+    std::optional<T> recv_for(const std::chrono::duration<Rep, Period> &rel_time)
+    {
+      const auto ts = detail::duration_to_timespec(rel_time);
+      return recv_for(ts);
+    }
+
+    const fev_broadcast_sub *impl() const noexcept { return impl_.get(); }
+    fev_broadcast_sub *impl() noexcept { return impl_.get(); }
+
+  private:
+    std::unique_ptr<fev_broadcast_sub, void (*)(fev_broadcast_sub *)> impl_;
+  };
+
+  explicit broadcast(std::uint32_t capacity) : impl_{create(capacity), &fev_broadcast_destroy} {}
+
+  broadcast(const broadcast &) = delete;
+  void operator=(const broadcast &) = delete;
+
+  broadcast(broadcast &&) = default;
+  broadcast &operator=(broadcast &&) = default;
+
+  void close() noexcept { fev_broadcast_close(impl()); }
+
+  bool is_closed() const noexcept { return fev_broadcast_is_closed(impl()); }
+
+  // Returns false if the broadcast is closed.
+  bool send(const T &value) noexcept
+  {
+    void *elem = nullptr;
+    std::memcpy(&elem, &value, sizeof(T));
+    return fev_broadcast_send(impl(), elem) == 0;
+  }
+
+  subscriber subscribe() { return subscriber{*this}; }
+
+  const fev_broadcast *impl() const noexcept { return impl_.get(); }
+  fev_broadcast *impl() noexcept { return impl_.get(); }
+
+private:
+  std::unique_ptr<fev_broadcast, void (*)(fev_broadcast *)> impl_;
+};
+
+class socket final {
+private:
+  static fev_socket *create()
+  {
+    fev_socket *socket;
+    int err = fev_socket_create(&socket);
+    detail::throw_on_err(err, "Creating socket failed");
+    return socket;
+  }
+
+  // Takes the ownership of a socket accepted by a listener group.
+  explicit socket(fev_socket *impl) noexcept : impl_{impl, &fev_socket_destroy} {}
+
+  friend class listener_group;
+
+public:
+  socket() : impl_{create(), &fev_socket_destroy} {}
+
+  socket(const socket &) = delete;
+  void operator=(const socket &) = delete;
 
   socket(socket &&) = default;
   socket &operator=(socket &&) = default;
@@ -786,10 +2298,133 @@ public:
     return try_write_for(buffer, size, ts);
   }
 
+// The stackless socket operations are not implemented with io_uring, see fev.h.
+#if defined(FEV_HAS_COROUTINES) && !defined(FEV_POLLER_IO_URING)
+  // Coroutines
+
+  task<socket> async_accept(sockaddr *address, socklen_t *address_len)
+  {
+    socket new_socket{};
+    co_await detail::stackless_awaiter{
+        [&] {
+          return fev_stackless_socket_accept(impl(), new_socket.impl(), address, address_len);
+        },
+        [](ssize_t ret) {
+          detail::throw_on_err(static_cast<int>(ret), "Accepting socket failed");
+        }};
+    co_return new_socket;
+  }
+
+  task<socket> async_accept() { return async_accept(nullptr, nullptr); }
+
+  auto async_connect(sockaddr *address, socklen_t address_len) noexcept
+  {
+    return detail::stackless_awaiter{
+        [this, address, address_len] {
+          return fev_stackless_socket_connect(impl(), address, address_len);
+        },
+        [](ssize_t ret) { detail::throw_on_err(static_cast<int>(ret), "Connecting failed"); }};
+  }
+
+  auto async_read(void *buffer, std::size_t size) noexcept
+  {
+    return detail::stackless_awaiter{
+        [this, buffer, size] { return fev_stackless_socket_read(impl(), buffer, size); },
+        [](ssize_t ret) {
+          if (ret < 0)
+            detail::throw_err(static_cast<int>(ret), "Reading from socket failed");
+          return static_cast<std::size_t>(ret);
+        }};
+  }
+
+  auto async_write(const void *buffer, std::size_t size) noexcept
+  {
+    return detail::stackless_awaiter{
+        [this, buffer, size] { return fev_stackless_socket_write(impl(), buffer, size); },
+        [](ssize_t ret) {
+          if (ret < 0)
+            detail::throw_err(static_cast<int>(ret), "Writing to socket failed");
+          return static_cast<std::size_t>(ret);
+        }};
+  }
+#endif
+
 private:
   std::unique_ptr<fev_socket, void (*)(fev_socket *)> impl_;
 };
 
+// Listening sockets bound to the same address, each with its own acceptor fiber, see
+// fev_listener_group_create(). The handler is called with each accepted socket in a new fiber. The
+// group cannot be moved, as the acceptors refer to it, and it must outlive the handlers.
+class listener_group final {
+private:
+  static fev_listener_group *create(std::uint32_t num_listeners, const sockaddr *address,
+                                    socklen_t address_len, int backlog)
+  {
+    fev_listener_group *group;
+    int err = fev_listener_group_create(&group, num_listeners, address, address_len, backlog);
+    detail::throw_on_err(err, "Creating listener group failed");
+    return group;
+  }
+
+  static void handle(fev_socket *impl, void *arg)
+  {
+    socket new_socket{impl};
+    try {
+      static_cast<listener_group *>(arg)->handler_(std::move(new_socket));
+    } catch (...) {
+      std::cerr << "Uncaught exception in listener group handler\n";
+      std::terminate();
+    }
+  }
+
+public:
+  listener_group(std::uint32_t num_listeners, const sockaddr *address, socklen_t address_len,
+                 int backlog)
+      : impl_{create(num_listeners, address, address_len, backlog), &fev_listener_group_destroy}
+  {
+  }
+
+  listener_group(const listener_group &) = delete;
+  void operator=(const listener_group &) = delete;
+
+  ~listener_group()
+  {
+    if (started_)
+      fev_listener_group_stop(impl());
+  }
+
+  std::uint32_t num_listeners() const noexcept { return fev_listener_group_num_listeners(impl()); }
+
+  fev_socket *listener(std::uint32_t index) const noexcept
+  {
+    return fev_listener_group_listener(impl(), index);
+  }
+
+  const fev_listener_group *impl() const noexcept { return impl_.get(); }
+  fev_listener_group *impl() noexcept { return impl_.get(); }
+
+  template <typename Handler> void start(Handler &&handler)
+  {
+    handler_ = std::forward<Handler>(handler);
+    int err = fev_listener_group_start(impl(), &handle, this);
+    detail::throw_on_err(err, "Starting listener group failed");
+    started_ = true;
+  }
+
+  void stop()
+  {
+    started_ = false;
+    int err = fev_listener_group_stop(impl());
+    detail::throw_on_err(err, "Stopping listener group failed");
+  }
+
+private:
+  std::unique_ptr<fev_listener_group, void (*)(fev_listener_group *)> impl_;
+  std::function<void(socket)> handler_;
+  bool started_{false};
+};
+
 } // namespace fev
 
 namespace std {
@@ -59,17 +59,30 @@ extern "C" {
 
 /* Types */
 
+struct fev_barrier;
+struct fev_broadcast;
+struct fev_broadcast_sub;
+struct fev_chan;
 struct fev_cond;
+struct fev_counter;
 struct fev_fiber;
 struct fev_fiber_attr;
+struct fev_latch;
+struct fev_listener_group;
 struct fev_mutex;
+struct fev_rwlock;
 struct fev_sched;
 struct fev_sched_attr;
 struct fev_sem;
 struct fev_socket;
+struct fev_thread_event;
+struct fev_waitgroup;
+struct fev_worker_local;
 
 typedef void *(*fev_realloc_t)(void *ptr, size_t size);
 
+typedef uint32_t fev_fls_key_t;
+
 /* The functions return 0 on success or a negative error code (such as -ENOMEM) on failure. */
 
 /* Allocator */
@@ -105,6 +118,8 @@ FEV_NONNULL(1) void fev_sched_destroy(struct fev_sched *sched);
 
 FEV_NONNULL(1) int fev_sched_run(struct fev_sched *sched);
 
+FEV_NONNULL(1) FEV_PURE uint32_t fev_sched_get_num_workers(const struct fev_sched *sched);
+
 /* Fiber attributes */
 
 FEV_NONNULL(1) int fev_fiber_attr_create(struct fev_fiber_attr **attr_ptr);
@@ -156,23 +171,167 @@ int fev_fiber_create(struct fev_fiber **fiber_ptr, struct fev_sched *sched,
 FEV_NONNULL(2)
 int fev_fiber_spawn(struct fev_sched *sched, void *(*start_routine)(void *), void *arg);
 
+/*
+ * Creates 'num_fibers' detached fibers in 'sched', the i-th fiber calls start_routine(args[i]) or
+ * start_routine(NULL) if 'args' is NULL. The fibers are pushed to the run queue at once, which is
+ * cheaper than calling fev_fiber_spawn() in a loop. Either all or none of the fibers are created.
+ */
+FEV_NONNULL(2)
+int fev_fiber_spawn_n(struct fev_sched *sched, void *(*start_routine)(void *), void *const *args,
+                      uint32_t num_fibers);
+
 /* Terminates the calling fiber. */
 FEV_NORETURN void fev_fiber_exit(void *return_value);
 
 /* Detaches 'fiber'. This can be only called from another fiber. */
 FEV_NONNULL(1) int fev_fiber_detach(struct fev_fiber *fiber);
 
-/* Joins 'fiber'. This can be only called from another fiber. */
+/*
+ * Joins 'fiber'. This can be only called from another fiber. Joining is not a cancellation point,
+ * thus a canceled fiber can still join its children.
+ */
 FEV_NONNULL(1) int fev_fiber_join(struct fev_fiber *fiber, void **return_value_ptr);
 
+/*
+ * Cancels 'fiber', which must be joinable and not joined yet. This can be only called from another
+ * fiber. The cancellation is sticky: the blocking call the fiber is waiting in right now and all
+ * following ones fail with -ECANCELED. The cancellation points are socket operations, condition
+ * variable and semaphore waits, fev_mutex_try_lock_for()/until(), fev_park() and sleeps.
+ * fev_mutex_lock() and fev_fiber_join() are not cancellation points. With the io_uring poller,
+ * socket operations are not cancellation points either.
+ */
+FEV_NONNULL(1) int fev_fiber_cancel(struct fev_fiber *fiber);
+
+/* Returns the calling fiber. This can be only called from a fiber. */
+struct fev_fiber *fev_fiber_self(void);
+
 /* Yields to the current scheduler, allowing another fiber to be scheduled. */
 void fev_yield(void);
 
-#if 0
-FEV_NONNULL(1) void fev_sleep_for(const struct timespec *rel_time);
+/*
+ * Suspends the calling fiber until the timeout has expired. Returns 0 or a _negative_ error code:
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1) int fev_sleep_for(const struct timespec *rel_time);
 
-FEV_NONNULL(1) void fev_sleep_until(const struct timespec *abs_time);
-#endif
+FEV_NONNULL(1) int fev_sleep_until(const struct timespec *abs_time);
+
+/* Parking */
+
+/*
+ * Low-level blocking for custom synchronization primitives. Each fiber has a permit, which is
+ * initially not available. fev_unpark() makes the permit available, fev_park() consumes it or
+ * blocks until it becomes available. Thus, an unpark that happens before the park is not lost.
+ * Writes done before fev_unpark() are visible to the fiber returning from fev_park().
+ *
+ * A typical primitive registers fev_fiber_self() in some structure and parks, while the waking
+ * fiber removes it and calls fev_unpark(). The caller of fev_unpark() must make sure that the fiber
+ * has not exited.
+ */
+
+/*
+ * Parks the calling fiber until its permit is available. If 'recheck' is not NULL, it is called
+ * with 'arg' before blocking, the fiber doesn't block if it returns false. 'abs_time' is the
+ * deadline or NULL. Returns 0 if the permit has been consumed or 'recheck' returned false.
+ * Otherwise, it returns a _negative_ error code and keeps the permit:
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ * This can be only called from a fiber, which is not stackless.
+ */
+int fev_park(bool (*recheck)(void *arg), void *arg, const struct timespec *abs_time);
+
+/*
+ * Makes the permit of 'fiber' available and wakes it up if parked. This can be only called from a
+ * fiber.
+ */
+FEV_NONNULL(1) void fev_unpark(struct fev_fiber *fiber);
+
+/*
+ * Like fev_unpark(), but if 'fiber' was parked, the calling fiber yields to it: the calling fiber
+ * is pushed to the run queue and the worker switches to 'fiber' right away, without going through
+ * the scheduler. This suits tight handoffs between two fibers (e.g. ping-pong), as the woken fiber
+ * runs next instead of waiting in the run queue. This can be only called from a fiber.
+ */
+FEV_NONNULL(1) void fev_yield_to(struct fev_fiber *fiber);
+
+/*
+ * Calls fev_unpark() for each of 'fibers', the parked fibers are pushed to the run queue at once.
+ */
+void fev_unpark_n(struct fev_fiber *const *fibers, size_t num_fibers);
+
+/* Fiber-local storage */
+
+/*
+ * Creates a key for fiber-local values. Keys cannot be deleted. When a fiber exits, 'destructor'
+ * (if not NULL) is called with each non-null value of the key. Returns -EAGAIN if there are too
+ * many keys.
+ */
+FEV_NONNULL(1) int fev_fls_key_create(fev_fls_key_t *key_ptr, void (*destructor)(void *value));
+
+/* Returns the value of 'key' in the current fiber or NULL if the value is not set. */
+void *fev_fls_get(fev_fls_key_t key);
+
+/* Sets the value of 'key' in the current fiber. This can be only called from a fiber. */
+int fev_fls_set(fev_fls_key_t key, void *value);
+
+/* Worker-local storage */
+
+/*
+ * A fiber runs on the same worker until it blocks or yields, then it can be migrated to another
+ * worker. Thus, a worker-local slot obtained by a fiber belongs to that fiber until the next call
+ * that can switch the fiber (e.g. waits, sleeps, socket operations), and it can be updated with
+ * plain (non-atomic) operations. The pointer must not be kept across such calls. Slots of other
+ * workers can be read concurrently only if their fields are atomic; relaxed loads and stores
+ * compile to plain moves, see fev_counter.
+ */
+
+/*
+ * Returns the index of the worker running the calling fiber, between 0 and the number of workers
+ * of its scheduler minus 1. Returns UINT32_MAX if not called from a fiber.
+ */
+uint32_t fev_cur_worker_index(void);
+
+/*
+ * Creates 'size' bytes of zeroed storage for each worker of 'sched'. Each slot starts on its own
+ * cache line, so the workers don't share lines. Returns -EINVAL if 'size' is 0.
+ */
+FEV_NONNULL(1, 2)
+int fev_worker_local_create(struct fev_worker_local **worker_local_ptr, struct fev_sched *sched,
+                            size_t size);
+
+FEV_NONNULL(1) void fev_worker_local_destroy(struct fev_worker_local *worker_local);
+
+/* Returns the slot of the worker 'index', which must be less than the number of workers. */
+FEV_NONNULL(1) FEV_PURE void *fev_worker_local_at(struct fev_worker_local *worker_local,
+                                                  uint32_t index);
+
+/*
+ * Returns the slot of the worker running the calling fiber or NULL if not called from a fiber of
+ * the scheduler of 'worker_local'.
+ */
+FEV_NONNULL(1) void *fev_worker_local_get(struct fev_worker_local *worker_local);
+
+/*
+ * A counter sharded by workers. Additions only update the shard of the current worker, reads sum up
+ * all shards. Additions from outside of the fibers of the scheduler go to an atomic shared shard.
+ */
+
+FEV_NONNULL(1, 2) int fev_counter_create(struct fev_counter **counter_ptr, struct fev_sched *sched);
+
+FEV_NONNULL(1) void fev_counter_destroy(struct fev_counter *counter);
+
+FEV_NONNULL(1) void fev_counter_add(struct fev_counter *counter, uint64_t value);
+
+/*
+ * Returns the sum of all shards. The shards are read one by one, this is not a snapshot if the
+ * counter is updated concurrently.
+ */
+FEV_NONNULL(1) uint64_t fev_counter_read(const struct fev_counter *counter);
 
 /* Mutex */
 
@@ -197,6 +356,7 @@ FEV_NONNULL(1) bool fev_mutex_try_lock(struct fev_mutex *mutex);
  * fev_mutex_try_lock_for() and fev_mutex_try_lock_until() return 0 if the mutex is acquired
  * successfully within the specified timeout. Otherwise, it returns a _negative_ error code:
  * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
  * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
  *              binheap).
  */
@@ -207,11 +367,66 @@ int fev_mutex_try_lock_for(struct fev_mutex *mutex, const struct timespec *rel_t
 FEV_NONNULL(1, 2)
 int fev_mutex_try_lock_until(struct fev_mutex *mutex, const struct timespec *abs_time);
 
+/*
+ * If libfev is built with FEV_DIRECT_SWITCH_ON_WAKE and a waiter is woken up, the calling fiber
+ * yields to it, see fev_yield_to(). The same applies to fev_sem_post(), fev_sem_post_n() (if it
+ * wakes up one fiber) and fev_chan_send().
+ */
 FEV_NONNULL(1) void fev_mutex_unlock(struct fev_mutex *mutex);
 
+/* Reader-writer lock */
+
+/*
+ * The lock prefers writers: once a writer waits for the lock, new readers wait until all writers
+ * have left. Each worker counts its readers on a separate cache line, thus readers don't contend
+ * with each other. A read lock can be released on another worker than it was acquired on. The
+ * functions can be only called from a fiber. Like fev_mutex_lock(), fev_rwlock_read_lock() and
+ * fev_rwlock_write_lock() are not cancellation points.
+ */
+
+FEV_NONNULL(1) int fev_rwlock_create(struct fev_rwlock **rwlock_ptr);
+
+FEV_NONNULL(1) void fev_rwlock_destroy(struct fev_rwlock *rwlock);
+
+FEV_NONNULL(1) void fev_rwlock_read_lock(struct fev_rwlock *rwlock);
+
+FEV_NONNULL(1) bool fev_rwlock_try_read_lock(struct fev_rwlock *rwlock);
+
+/*
+ * The _for() and _until() functions return 0 if the lock is acquired successfully within the
+ * specified timeout. Otherwise, they return a _negative_ error code:
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_read_lock_for(struct fev_rwlock *rwlock, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_read_lock_until(struct fev_rwlock *rwlock, const struct timespec *abs_time);
+
+FEV_NONNULL(1) void fev_rwlock_read_unlock(struct fev_rwlock *rwlock);
+
+FEV_NONNULL(1) void fev_rwlock_write_lock(struct fev_rwlock *rwlock);
+
+FEV_NONNULL(1) bool fev_rwlock_try_write_lock(struct fev_rwlock *rwlock);
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_write_lock_for(struct fev_rwlock *rwlock, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_write_lock_until(struct fev_rwlock *rwlock, const struct timespec *abs_time);
+
+FEV_NONNULL(1) void fev_rwlock_write_unlock(struct fev_rwlock *rwlock);
+
 /* Condition variable */
 
-/* _wait() functions can fail spuriously, be sure to recheck the condition. */
+/*
+ * _wait() functions can fail spuriously, be sure to recheck the condition. If the fiber has been
+ * canceled, they return -ECANCELED with the mutex reacquired.
+ */
 
 FEV_NONNULL(1) int fev_cond_create(struct fev_cond **cond_ptr);
 
@@ -222,7 +437,7 @@ FEV_NONNULL(1) void fev_cond_notify_one(struct fev_cond *cond);
 FEV_NONNULL(1) void fev_cond_notify_all(struct fev_cond *cond);
 
 FEV_NONNULL(1, 2)
-void fev_cond_wait(struct fev_cond *cond, struct fev_mutex *mutex);
+int fev_cond_wait(struct fev_cond *cond, struct fev_mutex *mutex);
 
 FEV_NONNULL(1, 2, 3)
 int fev_cond_wait_for(struct fev_cond *cond, struct fev_mutex *mutex,
@@ -240,12 +455,351 @@ FEV_NONNULL(1) void fev_sem_destroy(struct fev_sem *sem);
 
 FEV_NONNULL(1) void fev_sem_post(struct fev_sem *sem);
 
-FEV_NONNULL(1) void fev_sem_wait(struct fev_sem *sem);
+/* Adds `n` units and wakes the waiters they suffice for at once. */
+FEV_NONNULL(1) void fev_sem_post_n(struct fev_sem *sem, uint32_t n);
+
+/*
+ * Posts `sem` from any thread, e.g. from a thread pool that computes results for fibers running in
+ * 'sched'. The post doesn't block: the unit is handed over to a worker of 'sched', which adds it
+ * and wakes up a waiter. Thus, the unit becomes available a moment later and the semaphore must not
+ * be destroyed before the waiters have taken it. Called from a fiber of 'sched', this is
+ * fev_sem_post().
+ */
+FEV_NONNULL(1, 2) void fev_sem_post_from_thread(struct fev_sem *sem, struct fev_sched *sched);
+
+/*
+ * The _wait() functions return -ECANCELED if the fiber has been canceled. The waiters are served
+ * in FIFO order.
+ */
+
+FEV_NONNULL(1) int fev_sem_wait(struct fev_sem *sem);
+
+/*
+ * Takes `n` units at once, e.g. bytes of a memory budget. Returns -EINVAL if `n` is greater than
+ * INT32_MAX.
+ */
+FEV_NONNULL(1) int fev_sem_wait_n(struct fev_sem *sem, uint32_t n);
 
 FEV_NONNULL(1, 2) int fev_sem_wait_for(struct fev_sem *sem, const struct timespec *rel_time);
 
 FEV_NONNULL(1, 2) int fev_sem_wait_until(struct fev_sem *sem, const struct timespec *abs_time);
 
+/* Wait group */
+
+/*
+ * A wait group waits for a collection of fibers to finish. The waiting fiber calls
+ * fev_waitgroup_add() with the number of fibers to wait for, then each of the fibers calls
+ * fev_waitgroup_done() when finished. The counter must not become negative. Like fev_fiber_join(),
+ * the _wait() functions are not cancellation points.
+ */
+
+FEV_NONNULL(1) int fev_waitgroup_create(struct fev_waitgroup **waitgroup_ptr);
+
+FEV_NONNULL(1) void fev_waitgroup_destroy(struct fev_waitgroup *waitgroup);
+
+FEV_NONNULL(1) void fev_waitgroup_add(struct fev_waitgroup *waitgroup, int32_t delta);
+
+FEV_NONNULL(1) void fev_waitgroup_done(struct fev_waitgroup *waitgroup);
+
+FEV_NONNULL(1) void fev_waitgroup_wait(struct fev_waitgroup *waitgroup);
+
+/*
+ * fev_waitgroup_wait_for() and fev_waitgroup_wait_until() return 0 if the counter has dropped to 0
+ * within the specified timeout. Otherwise, they return -ETIMEDOUT or -ENOMEM (only if FEV_TIMERS
+ * is set to binheap).
+ */
+
+FEV_NONNULL(1, 2)
+int fev_waitgroup_wait_for(struct fev_waitgroup *waitgroup, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2)
+int fev_waitgroup_wait_until(struct fev_waitgroup *waitgroup, const struct timespec *abs_time);
+
+/* Barrier */
+
+/*
+ * A barrier blocks a group of `count` fibers until all of them have arrived, then it starts the
+ * next phase and can be reused. Each phase must see exactly the expected number of arrivals, a
+ * fiber that calls fev_barrier_arrive_and_drop() arrives and is no longer expected in the following
+ * phases. The arrivals are counted in a combining tree, thus large groups don't contend on a single
+ * counter. If `completion` is not NULL, it is called with `arg` by the last arriving fiber before
+ * the waiters are released. Like fev_fiber_join(), the waits are not cancellation points.
+ */
+
+FEV_NONNULL(1)
+int fev_barrier_create(struct fev_barrier **barrier_ptr, uint32_t count,
+                       void (*completion)(void *arg), void *arg);
+
+FEV_NONNULL(1) void fev_barrier_destroy(struct fev_barrier *barrier);
+
+/* Arrives without blocking, returns the token of the phase to pass to fev_barrier_wait(). */
+FEV_NONNULL(1) uint32_t fev_barrier_arrive(struct fev_barrier *barrier);
+
+/* Blocks until the phase of `token` has completed. */
+FEV_NONNULL(1) void fev_barrier_wait(struct fev_barrier *barrier, uint32_t token);
+
+FEV_NONNULL(1) void fev_barrier_arrive_and_wait(struct fev_barrier *barrier);
+
+FEV_NONNULL(1) void fev_barrier_arrive_and_drop(struct fev_barrier *barrier);
+
+/* Latch */
+
+/*
+ * A latch is a single-use counter that releases all waiting fibers when it drops to 0, e.g. to
+ * start a group of fibers at once. The counter must not become negative. Like fev_fiber_join(), the
+ * waits are not cancellation points.
+ */
+
+FEV_NONNULL(1) int fev_latch_create(struct fev_latch **latch_ptr, uint32_t count);
+
+FEV_NONNULL(1) void fev_latch_destroy(struct fev_latch *latch);
+
+FEV_NONNULL(1) void fev_latch_count_down(struct fev_latch *latch, uint32_t n);
+
+/* Returns true if the counter has dropped to 0. */
+FEV_NONNULL(1) bool fev_latch_try_wait(const struct fev_latch *latch);
+
+FEV_NONNULL(1) void fev_latch_wait(struct fev_latch *latch);
+
+FEV_NONNULL(1) void fev_latch_arrive_and_wait(struct fev_latch *latch, uint32_t n);
+
+/* Future */
+
+/*
+ * A one-shot event that is set once, usually by the fiber that produces a result, and waited for by
+ * at most one fiber at a time. A future doesn't allocate, it can be placed anywhere (e.g. on the
+ * stack) and must be initialized with fev_future_init(). The members are private.
+ */
+struct fev_future {
+  uintptr_t state;
+};
+
+FEV_NONNULL(1) void fev_future_init(struct fev_future *future);
+
+FEV_NONNULL(1) bool fev_future_is_set(const struct fev_future *future);
+
+/*
+ * Sets the future and wakes up the waiting fiber, if any. Writes done before are visible to the
+ * fiber returning from a wait. This can be only called from a fiber.
+ */
+FEV_NONNULL(1) void fev_future_set(struct fev_future *future);
+
+/*
+ * The _wait() functions return 0 if the future is set. Otherwise, they return a _negative_ error
+ * code:
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1) int fev_future_wait(struct fev_future *future);
+
+FEV_NONNULL(1, 2)
+int fev_future_wait_for(struct fev_future *future, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2)
+int fev_future_wait_until(struct fev_future *future, const struct timespec *abs_time);
+
+/*
+ * Waits until any of 'futures' is set and returns its index. Returns -ECANCELED if the fiber has
+ * been canceled.
+ */
+FEV_NONNULL(1) int fev_future_wait_any(struct fev_future *const *futures, size_t num_futures);
+
+/* Thread event */
+
+/*
+ * An event that can be set from any thread (e.g. by a thread pool that computes a result for a
+ * fiber) and waited for by at most one fiber at a time. Setting the event doesn't block the thread,
+ * the waiting fiber is handed over to a worker of its scheduler, which wakes it up. The event stays
+ * set until it is reset.
+ */
+
+FEV_NONNULL(1) int fev_thread_event_create(struct fev_thread_event **event_ptr);
+
+/* The event must not be destroyed while a fiber waits for it or it is being set. */
+FEV_NONNULL(1) void fev_thread_event_destroy(struct fev_thread_event *event);
+
+FEV_NONNULL(1) bool fev_thread_event_is_set(const struct fev_thread_event *event);
+
+/*
+ * Sets the event and wakes up the waiting fiber, if any. Writes done before are visible to the
+ * fiber returning from a wait. This can be called from any thread.
+ */
+FEV_NONNULL(1) void fev_thread_event_set(struct fev_thread_event *event);
+
+/* Resets the event if it is set, usually called by the waiting fiber before reusing the event. */
+FEV_NONNULL(1) void fev_thread_event_reset(struct fev_thread_event *event);
+
+/*
+ * The _wait() functions return 0 if the event is set. Otherwise, they return a _negative_ error
+ * code:
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1) int fev_thread_event_wait(struct fev_thread_event *event);
+
+FEV_NONNULL(1, 2)
+int fev_thread_event_wait_for(struct fev_thread_event *event, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2)
+int fev_thread_event_wait_until(struct fev_thread_event *event, const struct timespec *abs_time);
+
+/* RCU */
+
+/*
+ * Read-copy-update for read-mostly data (e.g. routing tables or configuration). Readers load a
+ * shared pointer with an acquire load and use the object without taking locks or updating counters.
+ * Writers publish a new object with a release store and reclaim the old one after a grace period,
+ * that is after every worker has gone through its scheduler loop.
+ *
+ * A read-side critical section lasts until the fiber blocks or yields: the references must not be
+ * kept across calls that can switch the fiber (e.g. waits, sleeps, socket operations). Thus,
+ * fev_rcu_read_lock() and fev_rcu_read_unlock() only mark the section and do nothing.
+ */
+
+static inline void fev_rcu_read_lock(void) {}
+
+static inline void fev_rcu_read_unlock(void) {}
+
+/*
+ * Calls free_fn(ptr) after a grace period. The callback is run by a worker outside of any fiber and
+ * must not block. The calling fiber must not access 'ptr' afterwards. Returns -ENOMEM if there is
+ * not enough memory. This can be only called from a fiber.
+ */
+FEV_NONNULL(2) int fev_rcu_call(void *ptr, void (*free_fn)(void *ptr));
+
+/*
+ * Blocks the calling fiber until a grace period has elapsed, the readers cannot access the objects
+ * unpublished before. This is not a cancellation point.
+ */
+void fev_rcu_synchronize(void);
+
+/* Channel */
+
+/*
+ * A bounded multi-producer multi-consumer FIFO of pointers. The capacity is rounded up to a power
+ * of 2. Sending and receiving don't take any lock unless the fiber has to wait or wake up a waiting
+ * fiber. After fev_chan_close(), sending fails and receiving fails once the channel is empty.
+ * Sending concurrently with closing may leave the sent element in the channel.
+ */
+
+FEV_NONNULL(1) int fev_chan_create(struct fev_chan **chan_ptr, uint32_t capacity);
+
+FEV_NONNULL(1) void fev_chan_destroy(struct fev_chan *chan);
+
+/* Closes the channel and wakes up all waiting fibers. */
+FEV_NONNULL(1) void fev_chan_close(struct fev_chan *chan);
+
+FEV_NONNULL(1) bool fev_chan_is_closed(const struct fev_chan *chan);
+
+/*
+ * The send and receive functions return 0 on success. Otherwise, they return a _negative_ error
+ * code:
+ * -EPIPE     - If the channel is closed (and empty when receiving).
+ * -EAGAIN    - If the channel is full (empty) in fev_chan_try_send() (fev_chan_try_recv()).
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1) int fev_chan_send(struct fev_chan *chan, void *elem);
+
+FEV_NONNULL(1) int fev_chan_try_send(struct fev_chan *chan, void *elem);
+
+FEV_NONNULL(1, 3)
+int fev_chan_send_for(struct fev_chan *chan, void *elem, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 3)
+int fev_chan_send_until(struct fev_chan *chan, void *elem, const struct timespec *abs_time);
+
+FEV_NONNULL(1, 2) int fev_chan_recv(struct fev_chan *chan, void **elem_ptr);
+
+FEV_NONNULL(1, 2) int fev_chan_try_recv(struct fev_chan *chan, void **elem_ptr);
+
+FEV_NONNULL(1, 2, 3)
+int fev_chan_recv_for(struct fev_chan *chan, void **elem_ptr, const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2, 3)
+int fev_chan_recv_until(struct fev_chan *chan, void **elem_ptr, const struct timespec *abs_time);
+
+/*
+ * Like write() and read(), the batch functions wait until at least one element can be sent
+ * (received), then send (receive) as many elements as possible without waiting. They return the
+ * number of sent (received) elements or a negative error code like above. The waiting fibers of
+ * the other side are woken up once for the whole batch.
+ */
+
+FEV_NONNULL(1, 2)
+ssize_t fev_chan_send_n(struct fev_chan *chan, void *const *elems, size_t num_elems);
+
+FEV_NONNULL(1, 2) ssize_t fev_chan_recv_n(struct fev_chan *chan, void **elems, size_t num_elems);
+
+/* Broadcast */
+
+/*
+ * A ring of the last `capacity` sent pointers, each of them is received by every subscriber. A
+ * message is written once, no matter how many subscribers there are, and sending never waits: the
+ * oldest message is overwritten. A subscriber receives the messages sent after it has subscribed
+ * in order, and a subscriber that falls behind by more than `capacity` messages skips the lost
+ * ones. All waiting subscribers are woken up at once when a message is sent. A subscriber must be
+ * used by one fiber at a time.
+ *
+ * Only the pointers are copied, the sender must keep the pointed-to data valid while a subscriber
+ * may still read it, e.g. by freeing it with fev_rcu_call() and reading it in a read-side critical
+ * section.
+ */
+
+FEV_NONNULL(1) int fev_broadcast_create(struct fev_broadcast **broadcast_ptr, uint32_t capacity);
+
+/* All subscribers must have unsubscribed. */
+FEV_NONNULL(1) void fev_broadcast_destroy(struct fev_broadcast *broadcast);
+
+/* Fails further sends and wakes up all waiting subscribers. */
+FEV_NONNULL(1) void fev_broadcast_close(struct fev_broadcast *broadcast);
+
+FEV_NONNULL(1) bool fev_broadcast_is_closed(const struct fev_broadcast *broadcast);
+
+/* Returns 0 on success or -EPIPE if the broadcast is closed. */
+FEV_NONNULL(1) int fev_broadcast_send(struct fev_broadcast *broadcast, void *elem);
+
+FEV_NONNULL(1, 2)
+int fev_broadcast_subscribe(struct fev_broadcast *broadcast, struct fev_broadcast_sub **sub_ptr);
+
+FEV_NONNULL(1) void fev_broadcast_unsubscribe(struct fev_broadcast_sub *sub);
+
+/* Returns the number of messages the subscriber has skipped so far. */
+FEV_NONNULL(1) uint64_t fev_broadcast_sub_num_missed(const struct fev_broadcast_sub *sub);
+
+/*
+ * The receive functions return 0 on success. Otherwise, they return a _negative_ error code:
+ * -EOVERFLOW - If the subscriber has fallen behind. The lost messages have been skipped, the next
+ *              call receives the oldest message that is still available.
+ * -EPIPE     - If the broadcast is closed and the subscriber has received all messages.
+ * -EAGAIN    - If there is no new message in fev_broadcast_try_recv().
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation (only if FEV_TIMERS is set to
+ *              binheap).
+ */
+
+FEV_NONNULL(1, 2) int fev_broadcast_recv(struct fev_broadcast_sub *sub, void **elem_ptr);
+
+FEV_NONNULL(1, 2) int fev_broadcast_try_recv(struct fev_broadcast_sub *sub, void **elem_ptr);
+
+FEV_NONNULL(1, 2, 3)
+int fev_broadcast_recv_for(struct fev_broadcast_sub *sub, void **elem_ptr,
+                           const struct timespec *rel_time);
+
+FEV_NONNULL(1, 2, 3)
+int fev_broadcast_recv_until(struct fev_broadcast_sub *sub, void **elem_ptr,
+                             const struct timespec *abs_time);
+
 /* Socket */
 
 FEV_NONNULL(1) int fev_socket_create(struct fev_socket **socket_ptr);
@@ -315,6 +869,164 @@ FEV_NONNULL(1, 2)
 ssize_t fev_socket_try_write_until(struct fev_socket *socket, const void *buffer, size_t size,
                                    const struct timespec *abs_time);
 
+/* Listener group */
+
+/*
+ * A group of `num_listeners` listening sockets bound to the same address with SO_REUSEPORT,
+ * usually one per worker. On Linux, a classic BPF program steers each new connection to the
+ * listener of index `cpu % num_listeners`, where `cpu` is the CPU that has received the
+ * connection. Otherwise, or if the program cannot be attached, the kernel picks the listener by a
+ * hash of the connection. If the port in `address` is 0, all listeners are bound to the port
+ * chosen for the first one.
+ *
+ * fev_listener_group_start() runs one acceptor fiber per listener. Each accepted connection is
+ * passed to `handler` in a new detached fiber, which is spawned by the worker running the acceptor.
+ * The handler owns the socket, it must close and destroy it. The functions can be only called from
+ * a fiber.
+ */
+
+FEV_NONNULL(1, 3)
+int fev_listener_group_create(struct fev_listener_group **group_ptr, uint32_t num_listeners,
+                              const struct sockaddr *address, socklen_t address_len, int backlog);
+
+/* Closes the listeners, the group must not be started. */
+FEV_NONNULL(1) void fev_listener_group_destroy(struct fev_listener_group *group);
+
+FEV_NONNULL(1) FEV_PURE
+uint32_t fev_listener_group_num_listeners(const struct fev_listener_group *group);
+
+/* Returns the listener 'index', which must be less than the number of listeners. */
+FEV_NONNULL(1) FEV_PURE
+struct fev_socket *fev_listener_group_listener(const struct fev_listener_group *group,
+                                               uint32_t index);
+
+/* The group is stopped if starting fails. */
+FEV_NONNULL(1, 2)
+int fev_listener_group_start(struct fev_listener_group *group,
+                             void (*handler)(struct fev_socket *socket, void *arg), void *arg);
+
+/*
+ * Stops accepting and waits for the acceptors, the already started handlers keep running. The
+ * listeners are shut down, thus the group cannot be started again. Returns the first error that
+ * has stopped an acceptor before, or 0.
+ */
+FEV_NONNULL(1) int fev_listener_group_stop(struct fev_listener_group *group);
+
+/* Select */
+
+enum fev_select_op {
+  /* Wait until the socket is readable (or has a pending connection). */
+  FEV_SELECT_READ,
+
+  /* Wait until the socket is writable (or connected). */
+  FEV_SELECT_WRITE,
+
+  /* Receive an element from the channel into 'elem'. */
+  FEV_SELECT_RECV,
+
+  /* Send 'elem' to the channel. */
+  FEV_SELECT_SEND,
+
+  /* Decrement the semaphore. */
+  FEV_SELECT_SEM_WAIT,
+
+  /* Wait for a notification of the condition variable, 'mutex' must be locked by the caller. */
+  FEV_SELECT_COND_WAIT,
+};
+
+struct fev_select_case {
+  enum fev_select_op op;
+
+  union {
+    struct fev_socket *socket;
+    struct fev_chan *chan;
+    struct fev_sem *sem;
+    struct fev_cond *cond;
+  };
+
+  /* The element to send or the received element. */
+  void *elem;
+
+  /* The mutex of a condition variable. */
+  struct fev_mutex *mutex;
+
+  /* Result of the selected channel case, 0 or -EPIPE if the channel is closed (and empty). */
+  int result;
+};
+
+/*
+ * Waits until one of 'cases' can proceed, performs it and returns its index. Only one case is
+ * performed. If several cases are ready before waiting, the first of them is chosen. A socket case
+ * only waits for readiness, the following operation may still wait if another fiber has consumed
+ * the readiness in the meantime. All condition variable cases must use the same mutex, which is
+ * unlocked while waiting and locked again before returning (also on timeout and cancellation).
+ * Otherwise, the functions return a _negative_ error code:
+ * -EINVAL    - If 'num_cases' is 0 or a case is invalid.
+ * -ENOSYS    - If a socket case is used with FEV_POLLER set to io_uring.
+ * -ETIMEDOUT - If the specified timeout has expired.
+ * -ECANCELED - If the fiber has been canceled.
+ * -ENOMEM    - Insufficient memory exists to perform the operation.
+ * Registering a socket in the poller can fail with other errors.
+ */
+
+FEV_NONNULL(1) int fev_select(struct fev_select_case *cases, size_t num_cases);
+
+FEV_NONNULL(1, 3)
+int fev_select_for(struct fev_select_case *cases, size_t num_cases,
+                   const struct timespec *rel_time);
+
+FEV_NONNULL(1, 3)
+int fev_select_until(struct fev_select_case *cases, size_t num_cases,
+                     const struct timespec *abs_time);
+
+/* Stackless fiber */
+
+/*
+ * A stackless fiber does not own a stack, it is meant for running C++20 coroutines (see fev++.hpp).
+ * Each time the fiber is scheduled, 'resume_routine' is called with 'arg' on a stack lent by the
+ * worker. To wait, the routine calls one of the functions below, and if it returns -EINPROGRESS,
+ * the routine must return. The fiber is scheduled again once the operation has completed, and
+ * fev_stackless_result() returns its result then. If the routine returns without starting such an
+ * operation, the fiber exits.
+ * The routine should not call the blocking functions (like fev_mutex_lock()), since the fiber would
+ * keep the borrowed stack while blocked.
+ */
+FEV_NONNULL(2)
+int fev_stackless_spawn(struct fev_sched *sched, void (*resume_routine)(void *), void *arg);
+
+/* Returns the result of the last operation that returned -EINPROGRESS. */
+ssize_t fev_stackless_result(void);
+
+int fev_stackless_yield(void);
+
+FEV_NONNULL(1) int fev_stackless_sleep_for(const struct timespec *rel_time);
+
+FEV_NONNULL(1) int fev_stackless_sleep_until(const struct timespec *abs_time);
+
+/* The mutex is held by the fiber when it is resumed. */
+FEV_NONNULL(1) int fev_stackless_mutex_lock(struct fev_mutex *mutex);
+
+FEV_NONNULL(1) int fev_stackless_sem_wait(struct fev_sem *sem);
+
+/*
+ * The socket operations return -ENOSYS with FEV_POLLER set to io_uring, where the operations are
+ * submitted and waited for within a stackful fiber.
+ */
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_accept(struct fev_socket *socket, struct fev_socket *new_socket,
+                                struct sockaddr *address, socklen_t *address_len);
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_connect(struct fev_socket *socket, struct sockaddr *address,
+                                 socklen_t address_len);
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_read(struct fev_socket *socket, void *buffer, size_t size);
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_write(struct fev_socket *socket, const void *buffer, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
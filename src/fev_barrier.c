@@ -0,0 +1,236 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+/*
+ * The arrivals are counted in a combining tree instead of a single counter. An arriving fiber takes
+ * a slot in one of the leaves, the fiber that fills up a node goes on to its parent, and the fiber
+ * that fills up the root completes the phase. The capacities of the nodes are fixed for a phase, so
+ * that the total capacity of the leaves equals the number of expected arrivals, thus there is
+ * always a free slot for an arriving fiber. The completing fiber resets the tree for the next phase
+ * before it advances the phase and releases all waiters at once.
+ */
+
+#include "fev_barrier.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_sched_impl.h"
+#include "fev_waiters_queue_impl.h"
+
+/* Sets the capacities of the nodes for `n` arrivals and clears the counts. */
+FEV_NONNULL(1) static void fev_barrier_layout(struct fev_barrier *barrier, uint32_t n)
+{
+  struct fev_barrier_node *nodes = barrier->nodes;
+  uint32_t num_leaves = barrier->num_leaves;
+
+  for (uint32_t i = 0; i < barrier->num_nodes; i++) {
+    atomic_store_explicit(&nodes[i].count, 0, memory_order_relaxed);
+    nodes[i].capacity = i < num_leaves ? n / num_leaves + (i < n % num_leaves) : 0;
+  }
+
+  /* The children come before their parents, an inner node waits only for non-empty children. */
+  for (uint32_t i = 0; i < barrier->num_nodes - 1; i++) {
+    if (nodes[i].capacity > 0)
+      nodes[i].parent->capacity++;
+  }
+}
+
+FEV_NONNULL(1)
+int fev_barrier_create(struct fev_barrier **barrier_ptr, uint32_t count,
+                       void (*completion)(void *arg), void *arg)
+{
+  struct fev_barrier *barrier;
+  uint32_t num_leaves, num_nodes, level_start, level_size;
+  int ret;
+
+  num_leaves = count / FEV_BARRIER_LEAF_SIZE + (count % FEV_BARRIER_LEAF_SIZE != 0);
+  if (num_leaves == 0)
+    num_leaves = 1;
+
+  num_nodes = 0;
+  for (level_size = num_leaves; level_size > 1;
+       level_size = (level_size + FEV_BARRIER_FAN_IN - 1) / FEV_BARRIER_FAN_IN) {
+    num_nodes += level_size;
+  }
+  num_nodes++;
+
+  barrier = fev_malloc(sizeof(*barrier));
+  if (FEV_UNLIKELY(barrier == NULL))
+    return -ENOMEM;
+
+  barrier->nodes = fev_aligned_alloc(FEV_DCACHE_LINE_SIZE, num_nodes * sizeof(*barrier->nodes));
+  if (FEV_UNLIKELY(barrier->nodes == NULL)) {
+    ret = -ENOMEM;
+    goto fail_barrier;
+  }
+
+  ret = fev_waiters_queue_init(&barrier->wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_nodes;
+
+  /* Link each level to the next one. */
+  level_start = 0;
+  for (level_size = num_leaves; level_size > 1;
+       level_size = (level_size + FEV_BARRIER_FAN_IN - 1) / FEV_BARRIER_FAN_IN) {
+    for (uint32_t i = 0; i < level_size; i++) {
+      barrier->nodes[level_start + i].parent =
+          &barrier->nodes[level_start + level_size + i / FEV_BARRIER_FAN_IN];
+    }
+    level_start += level_size;
+  }
+  FEV_ASSERT(level_start == num_nodes - 1);
+  barrier->nodes[num_nodes - 1].parent = NULL;
+
+  barrier->num_nodes = num_nodes;
+  barrier->num_leaves = num_leaves;
+  barrier->expected = count;
+  atomic_init(&barrier->num_dropped, 0);
+  barrier->completion = completion;
+  barrier->completion_arg = arg;
+  atomic_init(&barrier->phase, 0);
+
+  fev_barrier_layout(barrier, count);
+
+  *barrier_ptr = barrier;
+  return 0;
+
+fail_nodes:
+  fev_aligned_free(barrier->nodes);
+
+fail_barrier:
+  fev_free(barrier);
+
+  return ret;
+}
+
+FEV_NONNULL(1) void fev_barrier_destroy(struct fev_barrier *barrier)
+{
+  fev_waiters_queue_fini(&barrier->wq);
+  fev_aligned_free(barrier->nodes);
+  fev_free(barrier);
+}
+
+/* Called by the last arriving fiber of the phase. */
+FEV_NONNULL(1) static void fev_barrier_complete(struct fev_barrier *barrier, uint32_t phase)
+{
+  barrier->expected -= atomic_exchange_explicit(&barrier->num_dropped, 0, memory_order_relaxed);
+  fev_barrier_layout(barrier, barrier->expected);
+
+  if (barrier->completion != NULL)
+    barrier->completion(barrier->completion_arg);
+
+  /*
+   * The release barrier publishes the new layout to the fibers arriving in the next phase and the
+   * writes of this phase to the waiters. A waiter either has seen the old phase and is already in
+   * the queue, or it will see the new one when rechecking under the queue's lock.
+   */
+  atomic_store_explicit(&barrier->phase, phase + 1, memory_order_release);
+  fev_waiters_queue_wake(&barrier->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                         /*callback_arg=*/NULL, /*direct_switch=*/false);
+}
+
+/* Spreads the fibers over the leaves, a fiber starts looking for a free slot at the same leaf. */
+FEV_NONNULL(1) static uint32_t fev_barrier_start_leaf(const struct fev_barrier *barrier)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  uint64_t hash;
+
+  if (barrier->num_leaves == 1 || cur_worker == NULL || cur_worker->cur_fiber == NULL)
+    return 0;
+
+  hash = (uint64_t)(uintptr_t)cur_worker->cur_fiber * UINT64_C(0x9e3779b97f4a7c15);
+  return (uint32_t)(hash >> 32) % barrier->num_leaves;
+}
+
+FEV_NONNULL(1) uint32_t fev_barrier_arrive(struct fev_barrier *barrier)
+{
+  struct fev_barrier_node *node;
+  uint32_t phase, index, count;
+
+  /* No fiber can arrive in the next phase before this one completes, thus the layout is stable. */
+  phase = atomic_load_explicit(&barrier->phase, memory_order_acquire);
+
+  /*
+   * Take a slot in a leaf. A leaf can be filled up concurrently, in which case the count overshoots
+   * the capacity. That is harmless, as the leaf has already been completed by another fiber.
+   */
+  index = fev_barrier_start_leaf(barrier);
+  for (;;) {
+    node = &barrier->nodes[index];
+    if (atomic_load_explicit(&node->count, memory_order_relaxed) < node->capacity) {
+      count = atomic_fetch_add_explicit(&node->count, 1, memory_order_acq_rel);
+      if (FEV_LIKELY(count < node->capacity))
+        break;
+    }
+    index = index + 1 == barrier->num_leaves ? 0 : index + 1;
+  }
+
+  /*
+   * Go up while this fiber fills up the nodes. The acq_rel operations form a chain, thus the fiber
+   * that completes the phase has seen the writes of all arriving fibers.
+   */
+  while (count + 1 == node->capacity) {
+    if (node->parent == NULL) {
+      fev_barrier_complete(barrier, phase);
+      break;
+    }
+
+    node = node->parent;
+    count = atomic_fetch_add_explicit(&node->count, 1, memory_order_acq_rel);
+    FEV_ASSERT(count < node->capacity);
+  }
+
+  return phase;
+}
+
+struct fev_barrier_wait_recheck_arg {
+  struct fev_barrier *barrier;
+  uint32_t token;
+};
+
+static bool fev_barrier_wait_recheck(void *arg)
+{
+  struct fev_barrier_wait_recheck_arg *recheck_arg = arg;
+  struct fev_barrier *barrier = recheck_arg->barrier;
+
+  return atomic_load_explicit(&barrier->phase, memory_order_relaxed) == recheck_arg->token;
+}
+
+FEV_NONNULL(1) void fev_barrier_wait(struct fev_barrier *barrier, uint32_t token)
+{
+  struct fev_barrier_wait_recheck_arg recheck_arg = {.barrier = barrier, .token = token};
+  int res;
+
+  /* Like fev_waitgroup_wait(), waiting for a barrier is not a cancellation point. */
+  while (atomic_load_explicit(&barrier->phase, memory_order_acquire) == token) {
+    res = fev_waiters_queue_wait(&barrier->wq, /*abs_time=*/NULL, /*cancelable=*/false,
+                                 &fev_barrier_wait_recheck, &recheck_arg);
+    (void)res;
+    FEV_ASSERT(res == 0);
+  }
+}
+
+FEV_NONNULL(1) void fev_barrier_arrive_and_wait(struct fev_barrier *barrier)
+{
+  fev_barrier_wait(barrier, fev_barrier_arrive(barrier));
+}
+
+FEV_NONNULL(1) void fev_barrier_arrive_and_drop(struct fev_barrier *barrier)
+{
+  /* Published to the completing fiber by the acq_rel chain of the arrival. */
+  atomic_fetch_add_explicit(&barrier->num_dropped, 1, memory_order_relaxed);
+  fev_barrier_arrive(barrier);
+}
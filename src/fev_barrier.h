@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_BARRIER_H
+#define FEV_BARRIER_H
+
+#include <fev/fev.h>
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "fev_waiters_queue_intf.h"
+
+/* Maximum number of arrivals counted by a leaf of the combining tree. */
+#define FEV_BARRIER_LEAF_SIZE 16
+
+/* Number of children of an inner node of the combining tree. */
+#define FEV_BARRIER_FAN_IN 4
+
+/*
+ * A node of the combining tree. Each node is on its own cache line, thus the arriving fibers
+ * contend only on their leaf and, less frequently, on the inner nodes.
+ */
+struct fev_barrier_node {
+  alignas(FEV_DCACHE_LINE_SIZE) _Atomic uint32_t count;
+
+  /*
+   * Number of arrivals (for a leaf) or completed children (for an inner node) that complete this
+   * node in the current phase. Written only by the completing fiber before the phase is advanced.
+   */
+  uint32_t capacity;
+
+  /* NULL for the root. */
+  struct fev_barrier_node *parent;
+};
+
+struct fev_barrier {
+  /* The leaves come first, then the inner nodes level by level, the root is the last node. */
+  struct fev_barrier_node *nodes;
+  uint32_t num_nodes;
+  uint32_t num_leaves;
+
+  /* Number of arrivals expected in the current phase. */
+  uint32_t expected;
+
+  /* Number of fibers that have dropped out in the current phase. */
+  _Atomic uint32_t num_dropped;
+
+  void (*completion)(void *arg);
+  void *completion_arg;
+
+  /* Incremented when a phase completes. */
+  _Atomic uint32_t phase;
+
+  /* Fibers waiting for `phase` to change. */
+  struct fev_waiters_queue wq;
+};
+
+#endif /* !FEV_BARRIER_H */
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+/*
+ * A message is written once to a slot of the ring and every subscriber reads it through its own
+ * cursor, thus sending doesn't depend on the number of subscribers. The senders never wait for the
+ * subscribers: the oldest message is overwritten and a subscriber that falls more than `capacity`
+ * messages behind skips the lost ones. A slot is read like a seqlock: the sequence number is read
+ * before and after the element, a change means that the slot has been overwritten in the meantime.
+ *
+ * Waiting works like in fev_chan.c: a waiting subscriber increments `num_waiting`, issues a full
+ * fence and checks `tail` again, a sender issues a full fence after updating `tail` and checks
+ * `num_waiting`. Then all waiting subscribers are released at once.
+ */
+
+#include "fev_broadcast.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_spinlock_impl.h"
+#include "fev_time.h"
+#include "fev_waiters_queue_impl.h"
+
+FEV_NONNULL(1) int fev_broadcast_create(struct fev_broadcast **broadcast_ptr, uint32_t capacity)
+{
+  struct fev_broadcast *broadcast;
+  int ret;
+
+  if (FEV_UNLIKELY(capacity == 0 || capacity > UINT32_C(1) << 31))
+    return -EINVAL;
+
+  broadcast = fev_aligned_alloc(alignof(struct fev_broadcast), sizeof(*broadcast));
+  if (FEV_UNLIKELY(broadcast == NULL))
+    return -ENOMEM;
+
+  broadcast->slots = fev_malloc((size_t)capacity * sizeof(*broadcast->slots));
+  if (FEV_UNLIKELY(broadcast->slots == NULL)) {
+    ret = -ENOMEM;
+    goto fail_broadcast;
+  }
+
+  ret = fev_spinlock_init(&broadcast->send_lock);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_slots;
+
+  ret = fev_waiters_queue_init(&broadcast->wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_send_lock;
+
+  for (uint32_t i = 0; i < capacity; i++) {
+    atomic_init(&broadcast->slots[i].seq, 0);
+    atomic_init(&broadcast->slots[i].elem, NULL);
+  }
+
+  broadcast->capacity = capacity;
+  atomic_init(&broadcast->tail, 0);
+  atomic_init(&broadcast->closed, false);
+  atomic_init(&broadcast->num_waiting, 0);
+
+  *broadcast_ptr = broadcast;
+  return 0;
+
+fail_send_lock:
+  fev_spinlock_fini(&broadcast->send_lock);
+
+fail_slots:
+  fev_free(broadcast->slots);
+
+fail_broadcast:
+  fev_aligned_free(broadcast);
+  return ret;
+}
+
+FEV_NONNULL(1) void fev_broadcast_destroy(struct fev_broadcast *broadcast)
+{
+  fev_waiters_queue_fini(&broadcast->wq);
+  fev_spinlock_fini(&broadcast->send_lock);
+  fev_free(broadcast->slots);
+  fev_aligned_free(broadcast);
+}
+
+FEV_NONNULL(1) void fev_broadcast_close(struct fev_broadcast *broadcast)
+{
+  /* The waiters recheck `closed` under the lock of the queue, thus they cannot miss it. */
+  atomic_store_explicit(&broadcast->closed, true, memory_order_seq_cst);
+
+  fev_waiters_queue_wake(&broadcast->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                         /*callback_arg=*/NULL, /*direct_switch=*/false);
+}
+
+FEV_NONNULL(1) bool fev_broadcast_is_closed(const struct fev_broadcast *broadcast)
+{
+  return atomic_load_explicit((atomic_bool *)&broadcast->closed, memory_order_acquire);
+}
+
+FEV_NONNULL(1) int fev_broadcast_send(struct fev_broadcast *broadcast, void *elem)
+{
+  struct fev_broadcast_slot *slot;
+  uint64_t seq;
+
+  if (FEV_UNLIKELY(atomic_load_explicit(&broadcast->closed, memory_order_acquire)))
+    return -EPIPE;
+
+  fev_spinlock_lock(&broadcast->send_lock);
+
+  seq = atomic_load_explicit(&broadcast->tail, memory_order_relaxed);
+  slot = &broadcast->slots[seq % broadcast->capacity];
+
+  /* Mark the slot as being written before the element is overwritten. */
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&slot->elem, elem, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+
+  atomic_store_explicit(&broadcast->tail, seq + 1, memory_order_release);
+
+  fev_spinlock_unlock(&broadcast->send_lock);
+
+  /* Release all waiting subscribers with one batch. */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&broadcast->num_waiting, memory_order_relaxed) != 0) {
+    fev_waiters_queue_wake(&broadcast->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+  }
+
+  return 0;
+}
+
+FEV_NONNULL(1, 2)
+int fev_broadcast_subscribe(struct fev_broadcast *broadcast, struct fev_broadcast_sub **sub_ptr)
+{
+  struct fev_broadcast_sub *sub;
+
+  sub = fev_malloc(sizeof(*sub));
+  if (FEV_UNLIKELY(sub == NULL))
+    return -ENOMEM;
+
+  sub->broadcast = broadcast;
+  sub->cursor = atomic_load_explicit(&broadcast->tail, memory_order_acquire);
+  sub->num_missed = 0;
+
+  *sub_ptr = sub;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_broadcast_unsubscribe(struct fev_broadcast_sub *sub) { fev_free(sub); }
+
+FEV_NONNULL(1) uint64_t fev_broadcast_sub_num_missed(const struct fev_broadcast_sub *sub)
+{
+  return sub->num_missed;
+}
+
+/* Moves `sub` past the messages that have been overwritten, at least past the current one. */
+FEV_NONNULL(1) static void fev_broadcast_skip_lost(struct fev_broadcast_sub *sub, uint64_t tail)
+{
+  uint64_t cursor = sub->cursor + 1;
+
+  if (tail - sub->cursor > sub->broadcast->capacity)
+    cursor = tail - sub->broadcast->capacity;
+
+  sub->num_missed += cursor - sub->cursor;
+  sub->cursor = cursor;
+}
+
+FEV_NONNULL(1, 2)
+static int fev_broadcast_try_recv_impl(struct fev_broadcast_sub *sub, void **elem_ptr)
+{
+  struct fev_broadcast *broadcast = sub->broadcast;
+  struct fev_broadcast_slot *slot;
+  uint64_t tail, seq1, seq2;
+  bool closed;
+  void *elem;
+
+  /* Load `closed` first, so that all messages sent before closing are seen. */
+  closed = atomic_load_explicit(&broadcast->closed, memory_order_acquire);
+  tail = atomic_load_explicit(&broadcast->tail, memory_order_acquire);
+
+  if (tail == sub->cursor)
+    return closed ? -EPIPE : -EAGAIN;
+
+  if (FEV_UNLIKELY(tail - sub->cursor > broadcast->capacity)) {
+    fev_broadcast_skip_lost(sub, tail);
+    return -EOVERFLOW;
+  }
+
+  slot = &broadcast->slots[sub->cursor % broadcast->capacity];
+  seq1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  elem = atomic_load_explicit(&slot->elem, memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  seq2 = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+  if (FEV_UNLIKELY(seq1 != sub->cursor + 1 || seq2 != seq1)) {
+    /* A sender has overwritten the message after `tail` was loaded. */
+    fev_broadcast_skip_lost(sub, atomic_load_explicit(&broadcast->tail, memory_order_acquire));
+    return -EOVERFLOW;
+  }
+
+  sub->cursor++;
+  *elem_ptr = elem;
+  return 0;
+}
+
+static bool fev_broadcast_recv_recheck(void *arg)
+{
+  struct fev_broadcast_sub *sub = arg;
+  struct fev_broadcast *broadcast = sub->broadcast;
+
+  return atomic_load_explicit(&broadcast->tail, memory_order_relaxed) == sub->cursor &&
+         !atomic_load_explicit(&broadcast->closed, memory_order_relaxed);
+}
+
+/* Common path of all receive functions, `abs_time` is NULL for no timeout. */
+FEV_NONNULL(1, 2)
+static int fev_broadcast_recv_until_impl(struct fev_broadcast_sub *sub, void **elem_ptr,
+                                         const struct timespec *abs_time)
+{
+  struct fev_broadcast *broadcast = sub->broadcast;
+  int res;
+
+  /* Fast path (if there is a message). */
+  res = fev_broadcast_try_recv_impl(sub, elem_ptr);
+  if (FEV_LIKELY(res != -EAGAIN))
+    return res;
+
+  /* Slow path. */
+  atomic_fetch_add_explicit(&broadcast->num_waiting, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  for (;;) {
+    res = fev_broadcast_try_recv_impl(sub, elem_ptr);
+    if (res != -EAGAIN)
+      break;
+
+    res = fev_waiters_queue_wait(&broadcast->wq, abs_time, /*cancelable=*/true,
+                                 &fev_broadcast_recv_recheck, sub);
+    if (res != 0 && res != -EAGAIN)
+      break;
+  }
+
+  atomic_fetch_sub_explicit(&broadcast->num_waiting, 1, memory_order_relaxed);
+
+  FEV_ASSERT(res == 0 || res == -EPIPE || res == -EOVERFLOW || res == -ETIMEDOUT ||
+             res == -ECANCELED || res == -ENOMEM);
+  return res;
+}
+
+FEV_NONNULL(1, 2) int fev_broadcast_recv(struct fev_broadcast_sub *sub, void **elem_ptr)
+{
+  return fev_broadcast_recv_until_impl(sub, elem_ptr, /*abs_time=*/NULL);
+}
+
+FEV_NONNULL(1, 2) int fev_broadcast_try_recv(struct fev_broadcast_sub *sub, void **elem_ptr)
+{
+  return fev_broadcast_try_recv_impl(sub, elem_ptr);
+}
+
+FEV_NONNULL(1, 2, 3)
+int fev_broadcast_recv_until(struct fev_broadcast_sub *sub, void **elem_ptr,
+                             const struct timespec *abs_time)
+{
+  return fev_broadcast_recv_until_impl(sub, elem_ptr, abs_time);
+}
+
+FEV_NONNULL(1, 2, 3)
+int fev_broadcast_recv_for(struct fev_broadcast_sub *sub, void **elem_ptr,
+                           const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_broadcast_recv_until(sub, elem_ptr, &abs_time);
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_BROADCAST_H
+#define FEV_BROADCAST_H
+
+#include <fev/fev.h>
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fev_spinlock_intf.h"
+#include "fev_waiters_queue_intf.h"
+
+struct fev_broadcast_slot {
+  /* Sequence number of the stored message plus 1, or 0 while the slot is being written. */
+  _Atomic uint64_t seq;
+
+  _Atomic(void *) elem;
+};
+
+struct fev_broadcast {
+  struct fev_broadcast_slot *slots;
+  uint32_t capacity;
+
+  /* Serializes the senders. */
+  struct fev_spinlock send_lock;
+
+  /* Sequence number of the next message. */
+  alignas(FEV_DCACHE_LINE_SIZE) _Atomic uint64_t tail;
+
+  atomic_bool closed;
+
+  /*
+   * Number of subscribers that are in the slow path and may be waiting, a sender wakes them up
+   * only if this is not 0.
+   */
+  alignas(FEV_DCACHE_LINE_SIZE) atomic_uint num_waiting;
+
+  /* Subscribers waiting for a new message. */
+  struct fev_waiters_queue wq;
+};
+
+struct fev_broadcast_sub {
+  struct fev_broadcast *broadcast;
+
+  /* Sequence number of the next message to receive. */
+  uint64_t cursor;
+
+  /* Number of messages overwritten before this subscriber has received them. */
+  uint64_t num_missed;
+};
+
+#endif /* !FEV_BROADCAST_H */
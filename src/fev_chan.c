@@ -0,0 +1,419 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_chan.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_bounded_mpmc_queue.h"
+#include "fev_compiler.h"
+#include "fev_time.h"
+#include "fev_waiters_queue_impl.h"
+
+/*
+ * A waiting fiber increments the number of senders (receivers), issues a full fence and retries
+ * the operation before waiting. The other side issues a full fence after its operation and then
+ * checks the number. Thus, either the waiting fiber sees the result of the operation or the other
+ * side sees the waiting fiber and wakes it up.
+ */
+
+FEV_NONNULL(1) int fev_chan_create(struct fev_chan **chan_ptr, uint32_t capacity)
+{
+  struct fev_chan *chan;
+  uint32_t queue_capacity;
+  int ret;
+
+  if (FEV_UNLIKELY(capacity == 0 || capacity > UINT32_C(1) << 31))
+    return -EINVAL;
+
+  /* The queue requires a power of 2, at least 2. */
+  queue_capacity = 2;
+  while (queue_capacity < capacity)
+    queue_capacity *= 2;
+
+  chan = fev_aligned_alloc(alignof(struct fev_chan), sizeof(*chan));
+  if (FEV_UNLIKELY(chan == NULL))
+    return -ENOMEM;
+
+  ret = fev_bounded_mpmc_queue_init(&chan->queue, queue_capacity);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_chan;
+
+  ret = fev_waiters_queue_init(&chan->send_wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_queue;
+
+  ret = fev_waiters_queue_init(&chan->recv_wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_send_wq;
+
+  atomic_init(&chan->closed, false);
+  atomic_init(&chan->num_senders, 0);
+  atomic_init(&chan->num_receivers, 0);
+
+  *chan_ptr = chan;
+  return 0;
+
+fail_send_wq:
+  fev_waiters_queue_fini(&chan->send_wq);
+
+fail_queue:
+  fev_bounded_mpmc_queue_fini(&chan->queue);
+
+fail_chan:
+  fev_aligned_free(chan);
+  return ret;
+}
+
+FEV_NONNULL(1) void fev_chan_destroy(struct fev_chan *chan)
+{
+  fev_waiters_queue_fini(&chan->recv_wq);
+  fev_waiters_queue_fini(&chan->send_wq);
+  fev_bounded_mpmc_queue_fini(&chan->queue);
+  fev_aligned_free(chan);
+}
+
+FEV_NONNULL(1) void fev_chan_close(struct fev_chan *chan)
+{
+  /* The waiters recheck `closed` under the lock of their queue, thus they cannot miss it. */
+  atomic_store_explicit(&chan->closed, true, memory_order_seq_cst);
+
+  fev_waiters_queue_wake(&chan->send_wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                         /*callback_arg=*/NULL, /*direct_switch=*/false);
+  fev_waiters_queue_wake(&chan->recv_wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                         /*callback_arg=*/NULL, /*direct_switch=*/false);
+}
+
+FEV_NONNULL(1) bool fev_chan_is_closed(const struct fev_chan *chan)
+{
+  return atomic_load_explicit((atomic_bool *)&chan->closed, memory_order_acquire);
+}
+
+/*
+ * Wakes up at most `max_waiters` fibers waiting in `wq` after `num_waiting` has been checked.
+ * `direct_switch` is as in fev_waiters_queue_wake().
+ */
+FEV_NONNULL(1, 2)
+static void fev_chan_wake(atomic_uint *num_waiting, struct fev_waiters_queue *wq,
+                          uint32_t max_waiters, bool direct_switch)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (FEV_LIKELY(atomic_load_explicit(num_waiting, memory_order_relaxed) == 0))
+    return;
+
+  fev_waiters_queue_wake(wq, max_waiters, /*callback=*/NULL, /*callback_arg=*/NULL, direct_switch);
+}
+
+FEV_NONNULL(1) void fev_chan_wake_receivers(struct fev_chan *chan, uint32_t max_waiters)
+{
+  fev_chan_wake(&chan->num_receivers, &chan->recv_wq, max_waiters, /*direct_switch=*/false);
+}
+
+FEV_NONNULL(1) void fev_chan_wake_senders(struct fev_chan *chan, uint32_t max_waiters)
+{
+  fev_chan_wake(&chan->num_senders, &chan->send_wq, max_waiters, /*direct_switch=*/false);
+}
+
+/* Pushes as many elements as possible without blocking and returns the number of pushed ones. */
+FEV_NONNULL(1, 2)
+static size_t fev_chan_push_n(struct fev_chan *chan, void *const *elems, size_t num_elems)
+{
+  size_t n = 0;
+
+  while (n < num_elems && fev_bounded_mpmc_queue_push(&chan->queue, elems[n]))
+    n++;
+
+  return n;
+}
+
+/* Pops as many elements as possible without blocking and returns the number of popped ones. */
+FEV_NONNULL(1, 2)
+static size_t fev_chan_pop_n(struct fev_chan *chan, void **elems, size_t num_elems)
+{
+  size_t n = 0;
+
+  while (n < num_elems && fev_bounded_mpmc_queue_pop(&chan->queue, &elems[n]))
+    n++;
+
+  return n;
+}
+
+/* State of a send or receive in the slow path, passed to the recheck functions. */
+struct fev_chan_op {
+  struct fev_chan *chan;
+  void **elems;
+  size_t num_elems;
+  size_t num_done;
+};
+
+/*
+ * Tries to send the elements, the result is stored in `op`. Returns false if some elements have
+ * been sent or if the channel is closed.
+ */
+FEV_NONNULL(1) static bool fev_chan_try_send_op(struct fev_chan_op *op)
+{
+  struct fev_chan *chan = op->chan;
+
+  if (FEV_UNLIKELY(atomic_load_explicit(&chan->closed, memory_order_acquire)))
+    return false;
+
+  op->num_done = fev_chan_push_n(chan, op->elems, op->num_elems);
+  return op->num_done == 0;
+}
+
+/*
+ * Tries to receive the elements, the result is stored in `op`. Returns false if some elements have
+ * been received or if the channel is closed and empty.
+ */
+FEV_NONNULL(1) static bool fev_chan_try_recv_op(struct fev_chan_op *op)
+{
+  struct fev_chan *chan = op->chan;
+
+  op->num_done = fev_chan_pop_n(chan, op->elems, op->num_elems);
+  if (op->num_done > 0)
+    return false;
+
+  if (FEV_LIKELY(!atomic_load_explicit(&chan->closed, memory_order_acquire)))
+    return true;
+
+  /* The elements sent before closing are visible now. */
+  op->num_done = fev_chan_pop_n(chan, op->elems, op->num_elems);
+  return false;
+}
+
+/*
+ * The recheck functions are called under the lock of a waiters queue, thus they must not wake up
+ * the other side, as this would take the lock of the other queue.
+ */
+
+static bool fev_chan_send_recheck(void *arg) { return fev_chan_try_send_op(arg); }
+
+static bool fev_chan_recv_recheck(void *arg) { return fev_chan_try_recv_op(arg); }
+
+FEV_NONNULL(1, 2)
+static ssize_t fev_chan_send_n_slow(struct fev_chan *chan, void *const *elems, size_t num_elems,
+                                    const struct timespec *abs_time)
+{
+  struct fev_chan_op op = {
+      .chan = chan, .elems = (void **)elems, .num_elems = num_elems, .num_done = 0};
+  int res = 0;
+
+  atomic_fetch_add_explicit(&chan->num_senders, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  for (;;) {
+    if (!fev_chan_try_send_op(&op))
+      break;
+
+    res = fev_waiters_queue_wait(&chan->send_wq, abs_time, /*cancelable=*/true,
+                                 &fev_chan_send_recheck, &op);
+    if (op.num_done > 0 || (res != 0 && res != -EAGAIN))
+      break;
+  }
+
+  atomic_fetch_sub_explicit(&chan->num_senders, 1, memory_order_relaxed);
+
+  if (op.num_done > 0) {
+    fev_chan_wake(&chan->num_receivers, &chan->recv_wq, (uint32_t)op.num_done,
+                  FEV_WAKE_DIRECT_SWITCH);
+    return (ssize_t)op.num_done;
+  }
+
+  if (atomic_load_explicit(&chan->closed, memory_order_acquire))
+    return -EPIPE;
+
+  FEV_ASSERT(res == -ETIMEDOUT || res == -ECANCELED || res == -ENOMEM);
+  return res;
+}
+
+FEV_NONNULL(1, 2)
+static ssize_t fev_chan_recv_n_slow(struct fev_chan *chan, void **elems, size_t num_elems,
+                                    const struct timespec *abs_time)
+{
+  struct fev_chan_op op = {.chan = chan, .elems = elems, .num_elems = num_elems, .num_done = 0};
+  int res = 0;
+
+  atomic_fetch_add_explicit(&chan->num_receivers, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+
+  for (;;) {
+    if (!fev_chan_try_recv_op(&op))
+      break;
+
+    res = fev_waiters_queue_wait(&chan->recv_wq, abs_time, /*cancelable=*/true,
+                                 &fev_chan_recv_recheck, &op);
+    if (op.num_done > 0 || (res != 0 && res != -EAGAIN))
+      break;
+  }
+
+  atomic_fetch_sub_explicit(&chan->num_receivers, 1, memory_order_relaxed);
+
+  if (op.num_done > 0) {
+    fev_chan_wake(&chan->num_senders, &chan->send_wq, (uint32_t)op.num_done,
+                  /*direct_switch=*/false);
+    return (ssize_t)op.num_done;
+  }
+
+  if (atomic_load_explicit(&chan->closed, memory_order_acquire))
+    return -EPIPE;
+
+  FEV_ASSERT(res == -ETIMEDOUT || res == -ECANCELED || res == -ENOMEM);
+  return res;
+}
+
+/* Common path of all send functions, `abs_time` is NULL for no timeout. */
+FEV_NONNULL(1, 2)
+static ssize_t fev_chan_send_n_until(struct fev_chan *chan, void *const *elems, size_t num_elems,
+                                     const struct timespec *abs_time)
+{
+  size_t n;
+
+  if (FEV_UNLIKELY(num_elems == 0))
+    return 0;
+
+  if (FEV_UNLIKELY(atomic_load_explicit(&chan->closed, memory_order_acquire)))
+    return -EPIPE;
+
+  /* Fast path (if the channel is not full). */
+  n = fev_chan_push_n(chan, elems, num_elems);
+  if (FEV_LIKELY(n > 0)) {
+    fev_chan_wake(&chan->num_receivers, &chan->recv_wq, (uint32_t)n, FEV_WAKE_DIRECT_SWITCH);
+    return (ssize_t)n;
+  }
+
+  /* Slow path. */
+  return fev_chan_send_n_slow(chan, elems, num_elems, abs_time);
+}
+
+/* Common path of all receive functions, `abs_time` is NULL for no timeout. */
+FEV_NONNULL(1, 2)
+static ssize_t fev_chan_recv_n_until(struct fev_chan *chan, void **elems, size_t num_elems,
+                                     const struct timespec *abs_time)
+{
+  size_t n;
+
+  if (FEV_UNLIKELY(num_elems == 0))
+    return 0;
+
+  /* Fast path (if the channel is not empty). */
+  n = fev_chan_pop_n(chan, elems, num_elems);
+  if (FEV_LIKELY(n > 0)) {
+    fev_chan_wake(&chan->num_senders, &chan->send_wq, (uint32_t)n, /*direct_switch=*/false);
+    return (ssize_t)n;
+  }
+
+  /* Slow path. */
+  return fev_chan_recv_n_slow(chan, elems, num_elems, abs_time);
+}
+
+FEV_NONNULL(1) int fev_chan_send(struct fev_chan *chan, void *elem)
+{
+  ssize_t res = fev_chan_send_n_until(chan, &elem, 1, /*abs_time=*/NULL);
+  return res < 0 ? (int)res : 0;
+}
+
+FEV_NONNULL(1) int fev_chan_try_send_nowake(struct fev_chan *chan, void *elem)
+{
+  if (FEV_UNLIKELY(atomic_load_explicit(&chan->closed, memory_order_acquire)))
+    return -EPIPE;
+
+  if (!fev_bounded_mpmc_queue_push(&chan->queue, elem))
+    return -EAGAIN;
+
+  return 0;
+}
+
+FEV_NONNULL(1) int fev_chan_try_send(struct fev_chan *chan, void *elem)
+{
+  int res = fev_chan_try_send_nowake(chan, elem);
+  if (res == 0)
+    fev_chan_wake_receivers(chan, /*max_waiters=*/1);
+  return res;
+}
+
+FEV_NONNULL(1, 3)
+int fev_chan_send_until(struct fev_chan *chan, void *elem, const struct timespec *abs_time)
+{
+  ssize_t res = fev_chan_send_n_until(chan, &elem, 1, abs_time);
+  return res < 0 ? (int)res : 0;
+}
+
+FEV_NONNULL(1, 3)
+int fev_chan_send_for(struct fev_chan *chan, void *elem, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_chan_send_until(chan, elem, &abs_time);
+}
+
+FEV_NONNULL(1, 2)
+ssize_t fev_chan_send_n(struct fev_chan *chan, void *const *elems, size_t num_elems)
+{
+  return fev_chan_send_n_until(chan, elems, num_elems, /*abs_time=*/NULL);
+}
+
+FEV_NONNULL(1, 2) int fev_chan_recv(struct fev_chan *chan, void **elem_ptr)
+{
+  ssize_t res = fev_chan_recv_n_until(chan, elem_ptr, 1, /*abs_time=*/NULL);
+  return res < 0 ? (int)res : 0;
+}
+
+FEV_NONNULL(1, 2) int fev_chan_try_recv_nowake(struct fev_chan *chan, void **elem_ptr)
+{
+  if (fev_bounded_mpmc_queue_pop(&chan->queue, elem_ptr))
+    return 0;
+
+  if (!atomic_load_explicit(&chan->closed, memory_order_acquire))
+    return -EAGAIN;
+
+  /* The elements sent before closing are visible now. */
+  if (fev_bounded_mpmc_queue_pop(&chan->queue, elem_ptr))
+    return 0;
+
+  return -EPIPE;
+}
+
+FEV_NONNULL(1, 2) int fev_chan_try_recv(struct fev_chan *chan, void **elem_ptr)
+{
+  int res = fev_chan_try_recv_nowake(chan, elem_ptr);
+  if (res == 0)
+    fev_chan_wake_senders(chan, /*max_waiters=*/1);
+  return res;
+}
+
+FEV_NONNULL(1, 2, 3)
+int fev_chan_recv_until(struct fev_chan *chan, void **elem_ptr, const struct timespec *abs_time)
+{
+  ssize_t res = fev_chan_recv_n_until(chan, elem_ptr, 1, abs_time);
+  return res < 0 ? (int)res : 0;
+}
+
+FEV_NONNULL(1, 2, 3)
+int fev_chan_recv_for(struct fev_chan *chan, void **elem_ptr, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_chan_recv_until(chan, elem_ptr, &abs_time);
+}
+
+FEV_NONNULL(1, 2) ssize_t fev_chan_recv_n(struct fev_chan *chan, void **elems, size_t num_elems)
+{
+  return fev_chan_recv_n_until(chan, elems, num_elems, /*abs_time=*/NULL);
+}
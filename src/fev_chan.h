@@ -0,0 +1,53 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_CHAN_H
+#define FEV_CHAN_H
+
+#include <fev/fev.h>
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fev_bounded_mpmc_queue.h"
+#include "fev_compiler.h"
+#include "fev_waiters_queue_intf.h"
+
+struct fev_chan {
+  struct fev_bounded_mpmc_queue queue;
+
+  atomic_bool closed;
+
+  /*
+   * Number of senders and receivers that are in the slow path and may be waiting. The other side
+   * wakes them up only if this is not 0, thus the fast path doesn't touch the waiters queues.
+   */
+  alignas(FEV_DCACHE_LINE_SIZE) atomic_uint num_senders;
+  alignas(FEV_DCACHE_LINE_SIZE) atomic_uint num_receivers;
+
+  /* Senders waiting for a free cell and receivers waiting for an element. */
+  struct fev_waiters_queue send_wq;
+  struct fev_waiters_queue recv_wq;
+};
+
+/*
+ * Like fev_chan_try_send() and fev_chan_try_recv(), but they don't wake up the other side, thus
+ * they can be called under the lock of a waiters queue. After a successful call, the other side
+ * must be woken up with fev_chan_wake_receivers() (fev_chan_wake_senders()).
+ */
+FEV_NONNULL(1) int fev_chan_try_send_nowake(struct fev_chan *chan, void *elem);
+FEV_NONNULL(1, 2) int fev_chan_try_recv_nowake(struct fev_chan *chan, void **elem_ptr);
+
+/* Wakes up at most `max_waiters` receivers (senders) if there are any. */
+FEV_NONNULL(1) void fev_chan_wake_receivers(struct fev_chan *chan, uint32_t max_waiters);
+FEV_NONNULL(1) void fev_chan_wake_senders(struct fev_chan *chan, uint32_t max_waiters);
+
+#endif /* !FEV_CHAN_H */
@@ -17,7 +17,7 @@
 #include "fev_alloc.h"
 #include "fev_assert.h"
 #include "fev_compiler.h"
-#include "fev_mutex_intf.h"
+#include "fev_mutex_impl.h"
 #include "fev_time.h"
 #include "fev_waiters_queue_impl.h"
 
@@ -46,38 +46,101 @@ FEV_NONNULL(1) void fev_cond_destroy(struct fev_cond *cond)
   fev_free(cond);
 }
 
+struct fev_cond_wait_recheck_arg {
+  struct fev_cond *cond;
+  struct fev_mutex *mutex;
+};
+
 static bool fev_cond_wait_recheck(void *arg)
 {
-  struct fev_mutex *mutex = arg;
-
-  fev_mutex_unlock(mutex);
+  struct fev_cond_wait_recheck_arg *recheck_arg = arg;
+  struct fev_cond *cond = recheck_arg->cond;
+  struct fev_mutex *mutex = recheck_arg->mutex;
+
+  /* Remember the mutex for fev_cond_notify_all(), unless the waiters use different mutexes. */
+  if (TAILQ_EMPTY(&cond->wq.nodes))
+    cond->mutex = mutex;
+  else if (cond->mutex != mutex)
+    cond->mutex = NULL;
+
+  /* The lock of the waiters queue is held, the fiber cannot be switched. */
+  fev_mutex_unlock_impl(mutex, /*direct_switch=*/false);
   return true;
 }
 
-FEV_NONNULL(1, 2) void fev_cond_wait(struct fev_cond *cond, struct fev_mutex *mutex)
+/*
+ * Waits for a notification. Returns 1 if the fiber was moved to the waiters queue of the mutex by
+ * fev_cond_notify_all() and then woken up by fev_mutex_unlock(), the mutex is held then.
+ */
+FEV_NONNULL(1, 2)
+static int fev_cond_wait_node(struct fev_cond *cond, struct fev_mutex *mutex,
+                              const struct timespec *abs_time, bool cancelable)
+{
+  struct fev_cond_wait_recheck_arg recheck_arg = {.cond = cond, .mutex = mutex};
+  struct fev_waiters_queue_node node;
+  int res;
+
+  res = fev_waiters_queue_wait_node(&cond->wq, &node, abs_time, cancelable,
+                                    &fev_cond_wait_recheck, &recheck_arg);
+  if (res == 0 && node.queue != &cond->wq) {
+    FEV_ASSERT(node.queue == &mutex->wq);
+    fev_mutex_owner_running(mutex);
+    return 1;
+  }
+
+  return res;
+}
+
+FEV_NONNULL(1, 2) int fev_cond_wait(struct fev_cond *cond, struct fev_mutex *mutex)
 {
-  int res = fev_waiters_queue_wait(&cond->wq, /*abs_time=*/NULL, &fev_cond_wait_recheck, mutex);
-  (void)res;
-  FEV_ASSERT(res == 0);
+  int res = fev_cond_wait_node(cond, mutex, /*abs_time=*/NULL, /*cancelable=*/true);
+  FEV_ASSERT(res == 1 || res == 0 || res == -ECANCELED);
+
+  if (res == 1)
+    return 0;
 
   fev_mutex_lock(mutex);
+  return res;
+}
+
+FEV_NONNULL(1, 2)
+void fev_cond_wait_uncancelable(struct fev_cond *cond, struct fev_mutex *mutex)
+{
+  int res = fev_cond_wait_node(cond, mutex, /*abs_time=*/NULL, /*cancelable=*/false);
+  FEV_ASSERT(res == 1 || res == 0);
+
+  if (res == 0)
+    fev_mutex_lock(mutex);
 }
 
 FEV_NONNULL(1, 2, 3)
 int fev_cond_wait_until(struct fev_cond *cond, struct fev_mutex *mutex,
                         const struct timespec *abs_time)
 {
-  int res = fev_waiters_queue_wait(&cond->wq, abs_time, &fev_cond_wait_recheck, mutex);
+  int res = fev_cond_wait_node(cond, mutex, abs_time, /*cancelable=*/true);
+
+  if (res == 1)
+    return 0;
 
   if (res == -ENOMEM || res == -ETIMEDOUT)
     return res;
 
+  /* Like a pthread cancellation point, return with the mutex reacquired. */
+  if (res == -ECANCELED)
+    goto canceled;
+
   /*
    * We were woken up by fev_cond_notify_one()/all() or spuriously, in both cases we need to
    * reacquire the mutex.
    */
   FEV_ASSERT(res == 0 || res == -EAGAIN);
-  return fev_mutex_try_lock_until(mutex, abs_time);
+  res = fev_mutex_try_lock_until(mutex, abs_time);
+  if (FEV_LIKELY(res != -ECANCELED))
+    return res;
+
+canceled:
+  fev_mutex_lock(mutex);
+  return -ECANCELED;
 }
 
 FEV_NONNULL(1, 2, 3)
@@ -92,11 +155,54 @@ int fev_cond_wait_for(struct fev_cond *cond, struct fev_mutex *mutex,
 
 FEV_NONNULL(1) void fev_cond_notify_one(struct fev_cond *cond)
 {
-  fev_waiters_queue_wake(&cond->wq, /*max_waiters=*/1, /*callback=*/NULL, /*callback_arg=*/NULL);
+  fev_waiters_queue_wake(&cond->wq, /*max_waiters=*/1, /*callback=*/NULL, /*callback_arg=*/NULL,
+                         /*direct_switch=*/false);
 }
 
+struct fev_cond_requeue_arg {
+  struct fev_cond *cond;
+  struct fev_mutex *mutex;
+  bool locked;
+};
+
+static bool fev_cond_requeue_prepare(void *arg)
+{
+  struct fev_cond_requeue_arg *requeue_arg = arg;
+
+  /* The waiters could have been replaced by ones using a different mutex in the meantime. */
+  if (requeue_arg->cond->mutex != requeue_arg->mutex)
+    return false;
+
+  requeue_arg->locked = fev_mutex_lock_for_requeue(requeue_arg->mutex);
+  return true;
+}
+
+/*
+ * Instead of waking all waiters, which would then mostly block on the mutex, the waiters are moved
+ * to the waiters queue of the mutex (like FUTEX_CMP_REQUEUE). fev_mutex_unlock() hands the mutex
+ * over to them one by one. If the mutex is not held, we lock it and unlock it right away to wake
+ * the first waiter.
+ */
 FEV_NONNULL(1) void fev_cond_notify_all(struct fev_cond *cond)
 {
-  fev_waiters_queue_wake(&cond->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
-                         /*callback_arg=*/NULL);
+  struct fev_cond_requeue_arg requeue_arg;
+  struct fev_mutex *mutex;
+
+  fev_waiters_queue_lock_lock(&cond->wq.lock);
+  mutex = TAILQ_EMPTY(&cond->wq.nodes) ? NULL : cond->mutex;
+  fev_waiters_queue_lock_unlock_and_wake(&cond->wq.lock);
+
+  if (mutex == NULL) {
+    fev_waiters_queue_wake(&cond->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+    return;
+  }
+
+  requeue_arg.cond = cond;
+  requeue_arg.mutex = mutex;
+  requeue_arg.locked = false;
+  fev_waiters_queue_requeue(&cond->wq, &mutex->wq, &fev_cond_requeue_prepare, &requeue_arg);
+
+  if (requeue_arg.locked)
+    fev_mutex_unlock(mutex);
 }
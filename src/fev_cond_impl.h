@@ -17,6 +17,7 @@
 
 FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT static inline int fev_cond_init(struct fev_cond *cond)
 {
+  cond->mutex = NULL;
   return fev_waiters_queue_init(&cond->wq);
 }
 
@@ -25,4 +26,7 @@ FEV_NONNULL(1) static inline void fev_cond_fini(struct fev_cond *cond)
   fev_waiters_queue_fini(&cond->wq);
 }
 
+/* Like fev_cond_wait(), but the wait is not a cancellation point. */
+FEV_NONNULL(1, 2) void fev_cond_wait_uncancelable(struct fev_cond *cond, struct fev_mutex *mutex);
+
 #endif /* !FEV_COND_IMPL_H */
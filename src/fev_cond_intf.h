@@ -16,6 +16,12 @@
 
 struct fev_cond {
   struct fev_waiters_queue wq;
+
+  /*
+   * The mutex used by the waiters or NULL if they use different mutexes, the waiters are moved to
+   * the waiters queue of this mutex by fev_cond_notify_all(). Protected by the lock of `wq`.
+   */
+  struct fev_mutex *mutex;
 };
 
 #endif /* !FEV_COND_INTF_H */
@@ -13,6 +13,7 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include "fev_alloc.h"
 #include "fev_assert.h"
@@ -20,9 +21,13 @@
 #include "fev_cond_impl.h"
 #include "fev_context.h"
 #include "fev_fiber_attr.h"
+#include "fev_fls.h"
 #include "fev_mutex_impl.h"
 #include "fev_sched_impl.h"
 #include "fev_stack.h"
+#include "fev_time.h"
+#include "fev_timers.h"
+#include "fev_waiter_impl.h"
 
 /* Fiber's entry point. */
 static void fev_fiber_start(void)
@@ -39,38 +44,18 @@ static void fev_fiber_start(void)
   FEV_UNREACHABLE();
 }
 
-FEV_NONNULL(1, 3)
-int fev_fiber_create(struct fev_fiber **fiber_ptr, struct fev_sched *sched,
-                     void *(*start_routine)(void *), void *arg, const struct fev_fiber_attr *attr)
+/*
+ * Allocates and initializes a fiber that is ready to be scheduled. The caller must update the
+ * number of fibers in the scheduler.
+ */
+FEV_NONNULL(1, 2, 4)
+static int fev_fiber_alloc(struct fev_fiber **fiber_ptr, void *(*start_routine)(void *), void *arg,
+                           const struct fev_fiber_attr *attr)
 {
-  struct fev_sched_worker *cur_worker;
   struct fev_fiber *fiber;
   unsigned ref_count;
-  bool schedule_in_cur_worker;
   int ret;
 
-  cur_worker = fev_cur_sched_worker;
-
-  if (FEV_UNLIKELY(sched == NULL && cur_worker == NULL))
-    return -EINVAL;
-
-  if (sched == NULL || (cur_worker != NULL && sched == cur_worker->sched)) {
-    sched = cur_worker->sched;
-    schedule_in_cur_worker = true;
-  } else {
-    /* TODO: Currently there is no support for scheduling in other schedulers that are running. */
-    if (fev_sched_is_running(sched))
-      return -EINVAL;
-    schedule_in_cur_worker = false;
-  }
-
-  if (attr == NULL)
-    attr = &fev_fiber_create_default_attr;
-
-  /* Joinable fibers can only be created in the same scheduler. */
-  if (!schedule_in_cur_worker && !attr->detached)
-    return -EINVAL;
-
   fiber = fev_malloc(sizeof(*fiber));
   if (FEV_UNLIKELY(fiber == NULL))
     return -ENOMEM;
@@ -89,6 +74,7 @@ int fev_fiber_create(struct fev_fiber **fiber_ptr, struct fev_sched *sched,
     fiber->user_stack = false;
   }
 
+  fiber->stackless = false;
   fiber->start_routine = start_routine;
   fiber->arg = arg;
   fiber->return_value = NULL;
@@ -108,18 +94,15 @@ int fev_fiber_create(struct fev_fiber **fiber_ptr, struct fev_sched *sched,
 
   fiber->flags = attr->detached ? 0 : FEV_FIBER_JOINABLE;
 
+  fev_fls_init(fiber);
+
   /* Number of refs, the fiber itself + joiner (if not detached). */
   ref_count = attr->detached ? 1 : 2;
   atomic_init(&fiber->ref_count, ref_count);
 
-  /* Necessary bookkeeping for the scheduler. */
-  atomic_fetch_add_explicit(&sched->num_fibers, 1, memory_order_relaxed);
-
-  /* Schedule the fiber. */
-  if (schedule_in_cur_worker)
-    fev_wake_one(cur_worker, fiber);
-  else
-    fev_sched_put(sched, fiber);
+  atomic_init(&fiber->canceled, false);
+  atomic_init(&fiber->cancel_waiter, NULL);
+  atomic_init(&fiber->park_state, 0);
 
   *fiber_ptr = fiber;
   return 0;
@@ -137,6 +120,81 @@ fail_fiber:
   return ret;
 }
 
+/* Frees a fiber allocated by fev_fiber_alloc() that has never been scheduled. */
+FEV_NONNULL(1) static void fev_fiber_free_unscheduled(struct fev_fiber *fiber)
+{
+  fev_mutex_fini(&fiber->mutex);
+  fev_cond_fini(&fiber->cond);
+
+  if (!fiber->user_stack)
+    fev_stack_free(fiber->stack_addr, fiber->total_stack_size);
+
+  fev_free(fiber);
+}
+
+/*
+ * Resolves the scheduler where new fibers are created. Sets `schedule_in_cur_worker` if the fibers
+ * can be pushed to the current worker.
+ */
+FEV_NONNULL(1, 3)
+int fev_fiber_get_sched(struct fev_sched **sched_ptr, const struct fev_fiber_attr *attr,
+                        bool *schedule_in_cur_worker)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  struct fev_sched *sched = *sched_ptr;
+
+  if (FEV_UNLIKELY(sched == NULL && cur_worker == NULL))
+    return -EINVAL;
+
+  if (sched == NULL || (cur_worker != NULL && sched == cur_worker->sched)) {
+    *sched_ptr = cur_worker->sched;
+    *schedule_in_cur_worker = true;
+  } else {
+    /* TODO: Currently there is no support for scheduling in other schedulers that are running. */
+    if (fev_sched_is_running(sched))
+      return -EINVAL;
+    *schedule_in_cur_worker = false;
+  }
+
+  /* Joinable fibers can only be created in the same scheduler. */
+  if (!*schedule_in_cur_worker && !attr->detached)
+    return -EINVAL;
+
+  return 0;
+}
+
+FEV_NONNULL(1, 3)
+int fev_fiber_create(struct fev_fiber **fiber_ptr, struct fev_sched *sched,
+                     void *(*start_routine)(void *), void *arg, const struct fev_fiber_attr *attr)
+{
+  struct fev_fiber *fiber;
+  bool schedule_in_cur_worker;
+  int ret;
+
+  if (attr == NULL)
+    attr = &fev_fiber_create_default_attr;
+
+  ret = fev_fiber_get_sched(&sched, attr, &schedule_in_cur_worker);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  ret = fev_fiber_alloc(&fiber, start_routine, arg, attr);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  /* Necessary bookkeeping for the scheduler. */
+  atomic_fetch_add_explicit(&sched->num_fibers, 1, memory_order_relaxed);
+
+  /* Schedule the fiber. */
+  if (schedule_in_cur_worker)
+    fev_wake_one(fev_cur_sched_worker, fiber);
+  else
+    fev_sched_put(sched, fiber);
+
+  *fiber_ptr = fiber;
+  return 0;
+}
+
 FEV_NONNULL(2)
 int fev_fiber_spawn(struct fev_sched *sched, void *(*start_routine)(void *), void *arg)
 {
@@ -144,6 +202,55 @@ int fev_fiber_spawn(struct fev_sched *sched, void *(*start_routine)(void *), voi
   return fev_fiber_create(&fiber, sched, start_routine, arg, &fev_fiber_spawn_default_attr);
 }
 
+FEV_NONNULL(2)
+int fev_fiber_spawn_n(struct fev_sched *sched, void *(*start_routine)(void *), void *const *args,
+                      uint32_t num_fibers)
+{
+  const struct fev_fiber_attr *attr = &fev_fiber_spawn_default_attr;
+  fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
+  struct fev_fiber *fiber;
+  bool schedule_in_cur_worker;
+  int ret;
+
+  ret = fev_fiber_get_sched(&sched, attr, &schedule_in_cur_worker);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  if (FEV_UNLIKELY(num_fibers == 0))
+    return 0;
+
+  /* Allocate all fibers first, so that either all or none of them are spawned. */
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    ret = fev_fiber_alloc(&fiber, start_routine, args != NULL ? args[i] : NULL, attr);
+    if (FEV_UNLIKELY(ret != 0))
+      goto fail;
+
+    STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
+  }
+
+  atomic_fetch_add_explicit(&sched->num_fibers, num_fibers, memory_order_relaxed);
+
+  /* Push all fibers at once and wake up the waiting workers at most once. */
+  if (schedule_in_cur_worker) {
+    fev_wake_stq(fev_cur_sched_worker, &fibers, num_fibers);
+  } else {
+    while ((fiber = STAILQ_FIRST(&fibers)) != NULL) {
+      STAILQ_REMOVE_HEAD(&fibers, stq_entry);
+      fev_sched_put(sched, fiber);
+    }
+  }
+
+  return 0;
+
+fail:
+  while ((fiber = STAILQ_FIRST(&fibers)) != NULL) {
+    STAILQ_REMOVE_HEAD(&fibers, stq_entry);
+    fev_fiber_free_unscheduled(fiber);
+  }
+
+  return ret;
+}
+
 FEV_NONNULL(1) static void fev_fiber_release(struct fev_fiber *fiber)
 {
   unsigned ref_count;
@@ -193,6 +300,9 @@ FEV_NORETURN void fev_fiber_exit(void *return_value)
   cur_fiber = cur_worker->cur_fiber;
   FEV_ASSERT(cur_fiber != NULL);
 
+  /* Destroy fiber-local values, the destructors may block. */
+  fev_fls_fini(cur_fiber);
+
   /*
    * Set the return value and notify the joiner. This must be executed here, that is within a fiber
    * context, as we may have to wait for the mutex.
@@ -274,7 +384,8 @@ FEV_NONNULL(1) int fev_fiber_join(struct fev_fiber *fiber, void **return_value_p
       break;
     }
 
-    fev_cond_wait(&fiber->cond, &fiber->mutex);
+    /* Joining is not a cancellation point, a canceled fiber can still join its children. */
+    fev_cond_wait_uncancelable(&fiber->cond, &fiber->mutex);
   }
 
   if (return_value_ptr != NULL)
@@ -286,6 +397,40 @@ FEV_NONNULL(1) int fev_fiber_join(struct fev_fiber *fiber, void **return_value_p
   return 0;
 }
 
+FEV_NONNULL(1) int fev_fiber_cancel(struct fev_fiber *fiber)
+{
+  enum fev_waiter_wake_result result = FEV_WAITER_FAILED;
+  struct fev_waiter *waiter;
+
+  /* fev_fiber_cancel() can be only called from another fiber, as we may have to wake it up. */
+  if (fev_cur_sched_worker == NULL)
+    return -EINVAL;
+
+  /*
+   * The store must not be reordered with the following exchange, see
+   * fev_waiter_publish_cancel().
+   */
+  atomic_store_explicit(&fiber->canceled, true, memory_order_seq_cst);
+
+  waiter = atomic_exchange_explicit(&fiber->cancel_waiter, FEV_FIBER_CANCELING,
+                                    memory_order_seq_cst);
+
+  /* Another fiber is canceling the fiber right now, it will take care of the waiter. */
+  if (waiter == FEV_FIBER_CANCELING)
+    return 0;
+
+  if (waiter != NULL)
+    result = fev_waiter_wake(waiter, FEV_WAITER_CANCELED);
+
+  /* From now on, the fiber can leave fev_waiter_wait() and the waiter may be invalid. */
+  atomic_store_explicit(&fiber->cancel_waiter, NULL, memory_order_release);
+
+  if (result == FEV_WAITER_SET_AND_WAKE_UP)
+    fev_cur_wake_one(fiber);
+
+  return 0;
+}
+
 void fev_yield(void)
 {
   struct fev_sched_worker *cur_worker;
@@ -301,3 +446,61 @@ void fev_yield(void)
   fev_context_switch_and_call(cur_fiber, &fev_cur_wake_one, &cur_fiber->context,
                               &cur_worker->context);
 }
+
+FEV_NONNULL(1) void fev_cur_switch_to(struct fev_fiber *fiber)
+{
+  struct fev_sched_worker *cur_worker;
+  struct fev_fiber *cur_fiber;
+
+  cur_worker = fev_cur_sched_worker;
+  FEV_ASSERT(cur_worker != NULL);
+
+  /*
+   * A stackless fiber doesn't have its own stack to switch from or to. Also, go through the
+   * scheduler once in a while.
+   */
+  cur_fiber = cur_worker->cur_fiber;
+  if (FEV_UNLIKELY(cur_fiber == NULL || cur_fiber->stackless || fiber->stackless ||
+                   cur_worker->num_direct_switches >= FEV_MAX_DIRECT_SWITCHES)) {
+    fev_wake_one(cur_worker, fiber);
+    return;
+  }
+
+  /*
+   * `fiber` becomes running and the current fiber runnable, thus fev_cur_wake_one() called after
+   * the switch accounts for `fiber` in the number of runnable fibers.
+   */
+  cur_worker->cur_fiber = fiber;
+  cur_worker->num_direct_switches++;
+  fev_context_switch_and_call(cur_fiber, &fev_cur_wake_one, &cur_fiber->context, &fiber->context);
+}
+
+FEV_NONNULL(1) int fev_sleep_until(const struct timespec *abs_time)
+{
+  struct fev_waiter waiter;
+  int res;
+
+  waiter.fiber = fev_cur_fiber();
+  waiter.cancelable = true;
+  waiter.parent = NULL;
+
+  /* Only the timer or fev_fiber_cancel() can wake us up, retry on spurious wake ups. */
+  do {
+    atomic_store_explicit(&waiter.state, FEV_WAITER_NONE, memory_order_relaxed);
+    res = fev_timed_wait(&waiter, abs_time);
+  } while (res == -EAGAIN);
+
+  if (FEV_LIKELY(res == -ETIMEDOUT))
+    return 0;
+
+  FEV_ASSERT(res == -ECANCELED || res == -ENOMEM);
+  return res;
+}
+
+FEV_NONNULL(1) int fev_sleep_for(const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_sleep_until(&abs_time);
+}
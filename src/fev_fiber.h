@@ -15,13 +15,28 @@
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <queue.h>
 
+#include "fev_compiler.h"
 #include "fev_cond_intf.h"
 #include "fev_context.h"
 #include "fev_mutex_intf.h"
 
+struct fev_waiter;
+
+/* Number of fiber-local values that are stored inline in the fiber. */
+#ifndef FEV_FLS_INLINE_KEYS
+#define FEV_FLS_INLINE_KEYS 4u
+#endif
+
+/*
+ * Stored in `cancel_waiter` while fev_fiber_cancel() is waking the fiber up. The waiter cannot be
+ * unpublished until the cancelling fiber is done with it.
+ */
+#define FEV_FIBER_CANCELING ((struct fev_waiter *)1)
+
 /* Fiber flags */
 enum {
   /* The fiber has exited. */
@@ -43,7 +58,10 @@ struct fev_fiber {
   /* Fiber's arch-specific context (registers, PC etc.). */
   struct fev_context context;
 
-  /* Stack address and its total size (usable and guard size). */
+  /*
+   * Stack address and its total size (usable and guard size). For stackless fibers, the stack is
+   * borrowed from the worker and is NULL if the fiber is not in the middle of a resume.
+   */
   void *stack_addr;
   size_t total_stack_size;
 
@@ -53,6 +71,9 @@ struct fev_fiber {
    */
   bool user_stack;
 
+  /* If true, the fiber is embedded in struct fev_stackless (see fev_stackless.h). */
+  bool stackless;
+
   /* The start routine of the fiber and its argument and return value. */
   void *(*start_routine)(void *);
   void *arg;
@@ -67,9 +88,38 @@ struct fev_fiber {
 
   /* Number of refs, the fiber itself + joiner (if not detached). */
   atomic_uint ref_count;
+
+  /*
+   * Set by fev_fiber_cancel(). `cancel_waiter` is the cancelable waiter the fiber is parked in,
+   * NULL or FEV_FIBER_CANCELING (see fev_waiter_wait()).
+   */
+  atomic_bool canceled;
+  _Atomic(struct fev_waiter *) cancel_waiter;
+
+  /* The permit of fev_park() or the waiter of the parked fiber (see fev_park.c). */
+  _Atomic uintptr_t park_state;
+
+  /*
+   * Fiber-local values. Keys below FEV_FLS_INLINE_KEYS index `fls_inline`, the rest index
+   * `fls_values`, which is allocated on the first fev_fls_set() of such a key.
+   */
+  void *fls_inline[FEV_FLS_INLINE_KEYS];
+  void **fls_values;
+  uint32_t fls_num_values;
 };
 
 typedef STAILQ_HEAD(fev_fiber_stq_head, fev_fiber) fev_fiber_stq_head_t;
 typedef TAILQ_HEAD(fev_fiber_tq_head, fev_fiber) fev_fiber_tq_head_t;
 
+/*
+ * Resolves the scheduler where new fibers are created. Sets `schedule_in_cur_worker` if the fibers
+ * can be pushed to the current worker.
+ */
+FEV_NONNULL(1, 3)
+int fev_fiber_get_sched(struct fev_sched **sched_ptr, const struct fev_fiber_attr *attr,
+                        bool *schedule_in_cur_worker);
+
+/* Gives a stackless fiber a stack to run on, called by the scheduler before switching to it. */
+FEV_NONNULL(1) void fev_stackless_prepare(struct fev_fiber *fiber);
+
 #endif /* !FEV_FIBER_H */
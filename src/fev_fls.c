@@ -0,0 +1,169 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_fls.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_sched_impl.h"
+
+static_assert(FEV_FLS_KEYS_MAX > FEV_FLS_INLINE_KEYS,
+              "FEV_FLS_KEYS_MAX must be greater than FEV_FLS_INLINE_KEYS");
+
+/*
+ * Keys are never deleted, thus a key is just an index. A destructor is stored before the key is
+ * returned to the user, the values of the key can be set only after that.
+ */
+static void (*fev_fls_destructors[FEV_FLS_KEYS_MAX])(void *value);
+static atomic_uint fev_fls_num_keys;
+
+FEV_NONNULL(1) int fev_fls_key_create(fev_fls_key_t *key_ptr, void (*destructor)(void *value))
+{
+  unsigned key = atomic_load_explicit(&fev_fls_num_keys, memory_order_relaxed);
+
+  do {
+    if (FEV_UNLIKELY(key >= FEV_FLS_KEYS_MAX))
+      return -EAGAIN;
+  } while (!atomic_compare_exchange_weak_explicit(&fev_fls_num_keys, &key, key + 1,
+                                                  memory_order_relaxed, memory_order_relaxed));
+
+  fev_fls_destructors[key] = destructor;
+  *key_ptr = key;
+  return 0;
+}
+
+void *fev_fls_get(fev_fls_key_t key)
+{
+  struct fev_sched_worker *cur_worker;
+  struct fev_fiber *cur_fiber;
+  uint32_t index;
+
+  cur_worker = fev_cur_sched_worker;
+  if (FEV_UNLIKELY(cur_worker == NULL))
+    return NULL;
+
+  cur_fiber = cur_worker->cur_fiber;
+  FEV_ASSERT(cur_fiber != NULL);
+
+  if (FEV_LIKELY(key < FEV_FLS_INLINE_KEYS))
+    return cur_fiber->fls_inline[key];
+
+  index = key - FEV_FLS_INLINE_KEYS;
+  return index < cur_fiber->fls_num_values ? cur_fiber->fls_values[index] : NULL;
+}
+
+FEV_NONNULL(1)
+FEV_WARN_UNUSED_RESULT static int fev_fls_grow(struct fev_fiber *fiber, uint32_t min_num_values)
+{
+  uint32_t num_values;
+  void **values;
+
+  /* Grow geometrically, but don't exceed the number of possible keys. */
+  num_values = 2 * fiber->fls_num_values;
+  if (num_values < min_num_values)
+    num_values = min_num_values;
+  if (num_values > FEV_FLS_KEYS_MAX - FEV_FLS_INLINE_KEYS)
+    num_values = FEV_FLS_KEYS_MAX - FEV_FLS_INLINE_KEYS;
+
+  values = fev_realloc(fiber->fls_values, num_values * sizeof(*values));
+  if (FEV_UNLIKELY(values == NULL))
+    return -ENOMEM;
+
+  memset(&values[fiber->fls_num_values], 0,
+         (num_values - fiber->fls_num_values) * sizeof(*values));
+
+  fiber->fls_values = values;
+  fiber->fls_num_values = num_values;
+  return 0;
+}
+
+int fev_fls_set(fev_fls_key_t key, void *value)
+{
+  struct fev_sched_worker *cur_worker;
+  struct fev_fiber *cur_fiber;
+  uint32_t index;
+  int ret;
+
+  cur_worker = fev_cur_sched_worker;
+  if (FEV_UNLIKELY(cur_worker == NULL))
+    return -EINVAL;
+
+  cur_fiber = cur_worker->cur_fiber;
+  FEV_ASSERT(cur_fiber != NULL);
+
+  if (FEV_LIKELY(key < FEV_FLS_INLINE_KEYS)) {
+    cur_fiber->fls_inline[key] = value;
+    return 0;
+  }
+
+  if (FEV_UNLIKELY(key >= FEV_FLS_KEYS_MAX))
+    return -EINVAL;
+
+  /* Slow path, the value is stored on the heap. */
+  index = key - FEV_FLS_INLINE_KEYS;
+  if (index >= cur_fiber->fls_num_values) {
+    /* Unset values are NULL anyway. */
+    if (value == NULL)
+      return 0;
+
+    ret = fev_fls_grow(cur_fiber, index + 1);
+    if (FEV_UNLIKELY(ret != 0))
+      return ret;
+  }
+
+  cur_fiber->fls_values[index] = value;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_fls_fini(struct fev_fiber *fiber)
+{
+  for (int i = 0; i < FEV_FLS_DESTRUCTOR_ITERATIONS; i++) {
+    bool called = false;
+
+    /* The number of values is reloaded, since a destructor can set a value of a new key. */
+    for (uint32_t key = 0; key < FEV_FLS_INLINE_KEYS + fiber->fls_num_values; key++) {
+      void (*destructor)(void *value);
+      void **slot;
+      void *value;
+
+      if (key < FEV_FLS_INLINE_KEYS)
+        slot = &fiber->fls_inline[key];
+      else
+        slot = &fiber->fls_values[key - FEV_FLS_INLINE_KEYS];
+
+      value = *slot;
+      if (value == NULL)
+        continue;
+
+      *slot = NULL;
+
+      destructor = fev_fls_destructors[key];
+      if (destructor != NULL) {
+        destructor(value);
+        called = true;
+      }
+    }
+
+    if (!called)
+      break;
+  }
+
+  fev_free(fiber->fls_values);
+  fiber->fls_values = NULL;
+  fiber->fls_num_values = 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_FLS_H
+#define FEV_FLS_H
+
+#include <string.h>
+
+#include "fev_compiler.h"
+#include "fev_fiber.h"
+
+/* TODO: Move it to config. */
+#ifndef FEV_FLS_KEYS_MAX
+#define FEV_FLS_KEYS_MAX 1024u
+#endif
+
+/* Number of passes over the values, as the destructors can set values again. */
+#define FEV_FLS_DESTRUCTOR_ITERATIONS 4
+
+FEV_NONNULL(1) static inline void fev_fls_init(struct fev_fiber *fiber)
+{
+  memset(fiber->fls_inline, 0, sizeof(fiber->fls_inline));
+  fiber->fls_values = NULL;
+  fiber->fls_num_values = 0;
+}
+
+/*
+ * Calls the destructors of the non-null values and frees the values array. This must be called
+ * within the fiber, as the destructors may block.
+ */
+FEV_NONNULL(1) void fev_fls_fini(struct fev_fiber *fiber);
+
+#endif /* !FEV_FLS_H */
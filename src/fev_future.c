@@ -0,0 +1,237 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include <fev/fev.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_arch.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_sched_impl.h"
+#include "fev_time.h"
+#include "fev_timers.h"
+#include "fev_waiter_impl.h"
+
+/*
+ * The state of a future is one word: one of the values below or a pointer to the waiter of the
+ * fiber that is waiting for the future. A waiter is aligned to at least 4 bytes, thus the values
+ * don't collide with pointers.
+ */
+enum {
+  /* The future is not set and nobody waits. */
+  FEV_FUTURE_EMPTY = 0,
+
+  /* The future is set. */
+  FEV_FUTURE_SET = 1,
+
+  /*
+   * The future is being set and fev_future_set() is waking up the waiter. The waiter can be
+   * allocated on the stack, thus the waiting fiber cannot return until the state becomes
+   * FEV_FUTURE_SET.
+   */
+  FEV_FUTURE_WAKING = 2,
+};
+
+static_assert(_Alignof(struct fev_waiter) > FEV_FUTURE_WAKING, "Waiter pointers collide");
+static_assert(sizeof(_Atomic uintptr_t) == sizeof(uintptr_t), "Invalid atomic uintptr_t size");
+
+/* The state is declared as a plain uintptr_t in the public header, which can be used from C++. */
+FEV_NONNULL(1) static inline _Atomic uintptr_t *fev_future_state(const struct fev_future *future)
+{
+  return (_Atomic uintptr_t *)&future->state;
+}
+
+FEV_NONNULL(1) void fev_future_init(struct fev_future *future)
+{
+  atomic_init(fev_future_state(future), FEV_FUTURE_EMPTY);
+}
+
+FEV_NONNULL(1) bool fev_future_is_set(const struct fev_future *future)
+{
+  return atomic_load_explicit(fev_future_state(future), memory_order_acquire) == FEV_FUTURE_SET;
+}
+
+FEV_NONNULL(1) void fev_future_set(struct fev_future *future)
+{
+  _Atomic uintptr_t *state = fev_future_state(future);
+  enum fev_waiter_wake_result result;
+  struct fev_waiter *waiter;
+  struct fev_fiber *fiber;
+  uintptr_t expected;
+
+  /* Fast path, nobody waits. The release barrier publishes the writes done before. */
+  expected = FEV_FUTURE_EMPTY;
+  if (atomic_compare_exchange_strong_explicit(state, &expected, FEV_FUTURE_SET,
+                                              memory_order_release, memory_order_acquire)) {
+    return;
+  }
+
+  /* The future can be set only once. */
+  FEV_ASSERT(expected != FEV_FUTURE_SET && expected != FEV_FUTURE_WAKING);
+
+  /*
+   * A fiber is waiting. Lock the waiter by changing the state to FEV_FUTURE_WAKING, unless the
+   * fiber unregisters the waiter in the meantime.
+   */
+  for (;;) {
+    if (expected == FEV_FUTURE_EMPTY) {
+      if (atomic_compare_exchange_strong_explicit(state, &expected, FEV_FUTURE_SET,
+                                                  memory_order_release, memory_order_acquire)) {
+        return;
+      }
+    } else if (atomic_compare_exchange_strong_explicit(state, &expected, FEV_FUTURE_WAKING,
+                                                       memory_order_acquire,
+                                                       memory_order_acquire)) {
+      break;
+    }
+  }
+
+  waiter = (struct fev_waiter *)expected;
+  fiber = waiter->fiber;
+  result = fev_waiter_wake(waiter, FEV_WAITER_READY);
+
+  /* From now on, the waiting fiber can return and the waiter may be invalid. */
+  atomic_store_explicit(state, FEV_FUTURE_SET, memory_order_release);
+
+  if (result == FEV_WAITER_SET_AND_WAKE_UP)
+    fev_cur_wake_one(fiber);
+}
+
+/* Removes `waiter` from `future`, waits for fev_future_set() that is accessing the waiter. */
+FEV_NONNULL(1, 2)
+static void fev_future_unregister(struct fev_future *future, struct fev_waiter *waiter)
+{
+  _Atomic uintptr_t *state = fev_future_state(future);
+  uintptr_t expected = (uintptr_t)waiter;
+
+  if (atomic_compare_exchange_strong_explicit(state, &expected, FEV_FUTURE_EMPTY,
+                                              memory_order_acquire, memory_order_acquire)) {
+    return;
+  }
+
+  while (expected == FEV_FUTURE_WAKING) {
+    fev_pause();
+    expected = atomic_load_explicit(state, memory_order_acquire);
+  }
+
+  FEV_ASSERT(expected == FEV_FUTURE_SET);
+}
+
+/* Returns the index of the first set future or -1. */
+FEV_NONNULL(1)
+static int fev_future_find_set(struct fev_future *const *futures, size_t num_futures)
+{
+  for (size_t i = 0; i < num_futures; i++) {
+    if (fev_future_is_set(futures[i]))
+      return (int)i;
+  }
+  return -1;
+}
+
+FEV_NONNULL(1)
+static int fev_future_wait_any_until(struct fev_future *const *futures, size_t num_futures,
+                                     const struct timespec *abs_time)
+{
+  struct fev_waiter waiter;
+  size_t num_registered;
+  int index, res;
+
+  if (FEV_UNLIKELY(num_futures == 0 || num_futures > INT_MAX))
+    return -EINVAL;
+
+  waiter.fiber = fev_cur_fiber();
+  waiter.cancelable = true;
+  waiter.parent = NULL;
+
+  for (;;) {
+    index = fev_future_find_set(futures, num_futures);
+    if (index >= 0)
+      return index;
+
+    /*
+     * Prepare waiter. The stores can be relaxed, as the waiter is published with a release barrier
+     * below.
+     */
+    atomic_store_explicit(&waiter.state, FEV_WAITER_NONE, memory_order_relaxed);
+
+    /* Register the waiter in all futures, stop if one of them is already set. */
+    for (num_registered = 0; num_registered < num_futures; num_registered++) {
+      _Atomic uintptr_t *state = fev_future_state(futures[num_registered]);
+      uintptr_t expected = FEV_FUTURE_EMPTY;
+
+      if (!atomic_compare_exchange_strong_explicit(state, &expected, (uintptr_t)&waiter,
+                                                   memory_order_release, memory_order_acquire)) {
+        /* At most one fiber can wait for a future. */
+        FEV_ASSERT(expected == FEV_FUTURE_SET);
+        break;
+      }
+    }
+
+    if (num_registered == num_futures) {
+      if (abs_time == NULL) {
+        enum fev_waiter_wake_reason reason = fev_waiter_wait(&waiter);
+        res = reason == FEV_WAITER_CANCELED ? -ECANCELED : 0;
+      } else {
+        res = fev_timed_wait(&waiter, abs_time);
+      }
+    } else {
+      res = 0;
+    }
+
+    for (size_t i = 0; i < num_registered; i++)
+      fev_future_unregister(futures[i], &waiter);
+
+    if (FEV_UNLIKELY(res == -ECANCELED || (FEV_TIMED_WAIT_CAN_RETURN_ENOMEM && res == -ENOMEM)))
+      return res;
+
+    index = fev_future_find_set(futures, num_futures);
+    if (index >= 0)
+      return index;
+
+    if (res == -ETIMEDOUT)
+      return res;
+
+    /* Spurious wake up, try again. */
+    FEV_ASSERT(res == -EAGAIN);
+  }
+}
+
+FEV_NONNULL(1) int fev_future_wait(struct fev_future *future)
+{
+  int res = fev_future_wait_any_until(&future, 1, /*abs_time=*/NULL);
+  return res < 0 ? res : 0;
+}
+
+FEV_NONNULL(1, 2)
+int fev_future_wait_until(struct fev_future *future, const struct timespec *abs_time)
+{
+  int res = fev_future_wait_any_until(&future, 1, abs_time);
+  return res < 0 ? res : 0;
+}
+
+FEV_NONNULL(1, 2)
+int fev_future_wait_for(struct fev_future *future, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_future_wait_until(future, &abs_time);
+}
+
+FEV_NONNULL(1) int fev_future_wait_any(struct fev_future *const *futures, size_t num_futures)
+{
+  return fev_future_wait_any_until(futures, num_futures, /*abs_time=*/NULL);
+}
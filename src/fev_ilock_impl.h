@@ -20,6 +20,7 @@
 
 #include "fev_compiler.h"
 #include "fev_fiber.h"
+#include "fev_mcs_lock_impl.h"
 #include "fev_sched_impl.h"
 #include "fev_spinlock_impl.h"
 #include "fev_thr_mutex.h"
@@ -35,6 +36,11 @@
 #define fev_ilock_lock_fini fev_spinlock_fini
 #define fev_ilock_lock_lock fev_spinlock_lock
 #define fev_ilock_lock_unlock fev_spinlock_unlock
+#elif defined(FEV_ILOCK_LOCK_MCS)
+#define fev_ilock_lock_init fev_mcs_lock_init
+#define fev_ilock_lock_fini fev_mcs_lock_fini
+#define fev_ilock_lock_lock fev_mcs_lock_lock
+#define fev_ilock_lock_unlock fev_mcs_lock_unlock
 #endif
 
 FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT static inline int fev_ilock_init(struct fev_ilock *ilock)
@@ -70,6 +76,18 @@ FEV_NONNULL(1) static inline bool fev_ilock_lock(struct fev_ilock *ilock)
   return fev_ilock_lock_slow(ilock);
 }
 
+/*
+ * Tries to lock the internal lock without blocking, returns true on success. Unlike
+ * fev_ilock_lock(), it can be called from the scheduler context, where there is no fiber to block.
+ */
+FEV_NONNULL(1) static inline bool fev_ilock_try_lock(struct fev_ilock *ilock)
+{
+  unsigned expected = 0;
+
+  return atomic_compare_exchange_strong_explicit(&ilock->state, &expected, 1, memory_order_acquire,
+                                                 memory_order_relaxed);
+}
+
 /*
  * Unlocks the internal lock and returns the next fiber in the waiters queue, i.e. the fiber that
  * now owns the lock and should be woken up by the caller, or returns NULL if there is no such
@@ -16,6 +16,7 @@
 #include <queue.h>
 
 #include "fev_compiler.h"
+#include "fev_mcs_lock_intf.h"
 #include "fev_spinlock_intf.h"
 #include "fev_thr_mutex.h"
 
@@ -23,9 +24,11 @@
 typedef struct fev_thr_mutex fev_ilock_lock_t;
 #elif defined(FEV_ILOCK_LOCK_SPINLOCK)
 typedef struct fev_spinlock fev_ilock_lock_t;
+#elif defined(FEV_ILOCK_LOCK_MCS)
+typedef struct fev_mcs_lock fev_ilock_lock_t;
 #else
-#error Wrong lock strategy for ilock selected, define either FEV_ILOCK_LOCK_MUTEX or \
-        FEV_ILOCK_LOCK_SPINLOCK.
+#error Wrong lock strategy for ilock selected, define either FEV_ILOCK_LOCK_MUTEX, \
+        FEV_ILOCK_LOCK_SPINLOCK or FEV_ILOCK_LOCK_MCS.
 #endif
 
 /* Internal lock. It is used to implement higher-level primitives. */
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_latch.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_waiters_queue_impl.h"
+
+FEV_NONNULL(1) int fev_latch_create(struct fev_latch **latch_ptr, uint32_t count)
+{
+  struct fev_latch *latch;
+  int ret;
+
+  latch = fev_malloc(sizeof(*latch));
+  if (FEV_UNLIKELY(latch == NULL))
+    return -ENOMEM;
+
+  ret = fev_waiters_queue_init(&latch->wq);
+  if (FEV_UNLIKELY(ret != 0)) {
+    fev_free(latch);
+    return ret;
+  }
+
+  atomic_init(&latch->count, count);
+
+  *latch_ptr = latch;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_latch_destroy(struct fev_latch *latch)
+{
+  fev_waiters_queue_fini(&latch->wq);
+  fev_free(latch);
+}
+
+FEV_NONNULL(1) void fev_latch_count_down(struct fev_latch *latch, uint32_t n)
+{
+  uint32_t count;
+
+  if (FEV_UNLIKELY(n == 0))
+    return;
+
+  /*
+   * The release part publishes the writes done before to the waiters, the acquire part orders the
+   * wake up after the writes of the fibers that have counted down before.
+   */
+  count = atomic_fetch_sub_explicit(&latch->count, n, memory_order_acq_rel);
+  FEV_ASSERT(count >= n);
+
+  /*
+   * A waiter either has seen a non-zero count and is already in the queue, or it will see 0 when
+   * rechecking under the queue's lock. All waiters are released at once.
+   */
+  if (count == n) {
+    fev_waiters_queue_wake(&latch->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+  }
+}
+
+FEV_NONNULL(1) bool fev_latch_try_wait(const struct fev_latch *latch)
+{
+  return atomic_load_explicit(&latch->count, memory_order_acquire) == 0;
+}
+
+static bool fev_latch_wait_recheck(void *arg)
+{
+  struct fev_latch *latch = arg;
+
+  return atomic_load_explicit(&latch->count, memory_order_relaxed) != 0;
+}
+
+FEV_NONNULL(1) void fev_latch_wait(struct fev_latch *latch)
+{
+  int res;
+
+  if (fev_latch_try_wait(latch))
+    return;
+
+  /* Like fev_waitgroup_wait(), waiting for a latch is not a cancellation point. */
+  res = fev_waiters_queue_wait(&latch->wq, /*abs_time=*/NULL, /*cancelable=*/false,
+                               &fev_latch_wait_recheck, latch);
+  (void)res;
+  FEV_ASSERT(res == 0);
+
+  /* Synchronize with the fibers that have counted down. */
+  atomic_thread_fence(memory_order_acquire);
+}
+
+FEV_NONNULL(1) void fev_latch_arrive_and_wait(struct fev_latch *latch, uint32_t n)
+{
+  fev_latch_count_down(latch, n);
+  fev_latch_wait(latch);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_LATCH_H
+#define FEV_LATCH_H
+
+#include <fev/fev.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "fev_waiters_queue_intf.h"
+
+struct fev_latch {
+  /* Number of arrivals left. */
+  _Atomic uint32_t count;
+
+  /* Fibers waiting for `count` to drop to 0. */
+  struct fev_waiters_queue wq;
+};
+
+#endif /* !FEV_LATCH_H */
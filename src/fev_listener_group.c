@@ -0,0 +1,362 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+
+/*
+ * The listeners join the same SO_REUSEPORT group in the order they start listening, thus the
+ * index returned by the steering program is the index of a listener in `listeners`. The program
+ * belongs to the group, it is enough to attach it to one of the listeners.
+ */
+
+#include "fev_listener_group.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+
+/* The time an acceptor waits for resources (e.g. file descriptors) to be released. */
+#define FEV_LISTENER_GROUP_BACKOFF_NS 10000000
+
+/* The handler is copied, thus the group can be destroyed before the connection fiber runs. */
+struct fev_listener_group_conn {
+  void (*handler)(struct fev_socket *socket, void *arg);
+  void *handler_arg;
+  struct fev_socket *socket;
+};
+
+FEV_NONNULL(1, 2)
+static int fev_listener_group_open(struct fev_socket *socket, const struct sockaddr *address,
+                                   socklen_t address_len, int backlog)
+{
+  int ret;
+
+  ret = fev_socket_open(socket, address->sa_family, SOCK_STREAM, 0);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  ret = fev_socket_set_opt(socket, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int));
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  ret = fev_socket_bind(socket, address, address_len);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  return fev_socket_listen(socket, backlog);
+}
+
+/*
+ * Steers connections to the listener of the receiving CPU. A failure is not an error, the kernel
+ * falls back to hashing the connections.
+ */
+FEV_NONNULL(1) static void fev_listener_group_attach_steering(struct fev_listener_group *group)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+  struct sock_filter code[] = {
+      /* A = the CPU that has received the connection */
+      {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+      /* A = A % num_listeners */
+      {BPF_ALU | BPF_MOD | BPF_K, 0, 0, group->num_listeners},
+      /* return A */
+      {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  struct sock_fprog prog = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+
+  if (group->num_listeners > 1) {
+    (void)fev_socket_set_opt(group->listeners[0].socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                             &prog, sizeof(prog));
+  }
+#else
+  (void)group;
+#endif
+}
+
+FEV_NONNULL(1, 3)
+int fev_listener_group_create(struct fev_listener_group **group_ptr, uint32_t num_listeners,
+                              const struct sockaddr *address, socklen_t address_len, int backlog)
+{
+  struct fev_listener_group *group;
+  struct sockaddr_storage bound_address;
+  socklen_t bound_address_len;
+  uint32_t num_created = 0;
+  int ret;
+
+  if (FEV_UNLIKELY(num_listeners == 0))
+    return -EINVAL;
+
+  group = fev_malloc(sizeof(*group));
+  if (FEV_UNLIKELY(group == NULL))
+    return -ENOMEM;
+
+  group->listeners = fev_malloc((size_t)num_listeners * sizeof(*group->listeners));
+  if (FEV_UNLIKELY(group->listeners == NULL)) {
+    ret = -ENOMEM;
+    goto fail_group;
+  }
+
+  group->num_listeners = num_listeners;
+  group->handler = NULL;
+  group->handler_arg = NULL;
+  atomic_init(&group->stopping, false);
+
+  for (; num_created < num_listeners; num_created++) {
+    struct fev_listener *listener = &group->listeners[num_created];
+
+    listener->group = group;
+    listener->acceptor = NULL;
+
+    ret = fev_socket_create(&listener->socket);
+    if (FEV_UNLIKELY(ret != 0))
+      goto fail_listeners;
+
+    ret = fev_listener_group_open(listener->socket, address, address_len, backlog);
+    if (FEV_UNLIKELY(ret != 0)) {
+      fev_socket_close(listener->socket);
+      fev_socket_destroy(listener->socket);
+      goto fail_listeners;
+    }
+
+    /* The other listeners must use the port chosen for the first one if the port is 0. */
+    if (num_created == 0) {
+      bound_address_len = sizeof(bound_address);
+      if (FEV_UNLIKELY(getsockname(fev_socket_native_handle(listener->socket),
+                                   (struct sockaddr *)&bound_address, &bound_address_len) != 0)) {
+        ret = -errno;
+        fev_socket_close(listener->socket);
+        fev_socket_destroy(listener->socket);
+        goto fail_listeners;
+      }
+      address = (const struct sockaddr *)&bound_address;
+      address_len = bound_address_len;
+    }
+  }
+
+  fev_listener_group_attach_steering(group);
+
+  *group_ptr = group;
+  return 0;
+
+fail_listeners:
+  while (num_created-- > 0) {
+    fev_socket_close(group->listeners[num_created].socket);
+    fev_socket_destroy(group->listeners[num_created].socket);
+  }
+  fev_free(group->listeners);
+
+fail_group:
+  fev_free(group);
+  return ret;
+}
+
+FEV_NONNULL(1) void fev_listener_group_destroy(struct fev_listener_group *group)
+{
+  for (uint32_t i = 0; i < group->num_listeners; i++) {
+    FEV_ASSERT(group->listeners[i].acceptor == NULL);
+    fev_socket_close(group->listeners[i].socket);
+    fev_socket_destroy(group->listeners[i].socket);
+  }
+
+  fev_free(group->listeners);
+  fev_free(group);
+}
+
+FEV_NONNULL(1) FEV_PURE
+uint32_t fev_listener_group_num_listeners(const struct fev_listener_group *group)
+{
+  return group->num_listeners;
+}
+
+FEV_NONNULL(1) FEV_PURE
+struct fev_socket *fev_listener_group_listener(const struct fev_listener_group *group,
+                                               uint32_t index)
+{
+  FEV_ASSERT(index < group->num_listeners);
+  return group->listeners[index].socket;
+}
+
+static void *fev_listener_group_serve(void *arg)
+{
+  struct fev_listener_group_conn conn = *(struct fev_listener_group_conn *)arg;
+
+  fev_free(arg);
+  conn.handler(conn.socket, conn.handler_arg);
+  return NULL;
+}
+
+/* Hands `socket` over to a new fiber, which is created on the current worker. */
+FEV_NONNULL(1, 2)
+static int fev_listener_group_spawn(struct fev_listener_group *group, struct fev_socket *socket)
+{
+  struct fev_listener_group_conn *conn;
+  int ret;
+
+  conn = fev_malloc(sizeof(*conn));
+  if (FEV_UNLIKELY(conn == NULL))
+    return -ENOMEM;
+
+  conn->handler = group->handler;
+  conn->handler_arg = group->handler_arg;
+  conn->socket = socket;
+
+  ret = fev_fiber_spawn(/*sched=*/NULL, &fev_listener_group_serve, conn);
+  if (FEV_UNLIKELY(ret != 0))
+    fev_free(conn);
+
+  return ret;
+}
+
+/* Returns true if the acceptor can go on after `err`, waits a bit if resources are exhausted. */
+static bool fev_listener_group_recover(int err)
+{
+  const struct timespec backoff = {.tv_sec = 0, .tv_nsec = FEV_LISTENER_GROUP_BACKOFF_NS};
+
+  switch (err) {
+  /* The connection has failed before it was accepted. */
+  case -ECONNABORTED:
+  case -EHOSTUNREACH:
+  case -ENETDOWN:
+  case -ENETUNREACH:
+  case -EPERM:
+  case -EPROTO:
+    return true;
+
+  case -EMFILE:
+  case -ENFILE:
+  case -ENOBUFS:
+  case -ENOMEM:
+    return fev_sleep_for(&backoff) != -ECANCELED;
+
+  default:
+    return false;
+  }
+}
+
+/*
+ * Accepts a connection into `*socket_ptr` and hands it over to a new fiber. The socket object is
+ * reused by the next call if accepting fails.
+ */
+FEV_NONNULL(1, 2)
+static int fev_listener_group_accept_one(struct fev_listener *listener,
+                                         struct fev_socket **socket_ptr)
+{
+  int ret;
+
+  if (*socket_ptr == NULL) {
+    ret = fev_socket_create(socket_ptr);
+    if (FEV_UNLIKELY(ret != 0))
+      return ret;
+  }
+
+  ret = fev_socket_accept(listener->socket, *socket_ptr, /*address=*/NULL, /*address_len=*/NULL);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  ret = fev_listener_group_spawn(listener->group, *socket_ptr);
+  if (FEV_UNLIKELY(ret != 0)) {
+    /* The connection is dropped, the socket can be reused. */
+    fev_socket_close(*socket_ptr);
+    return ret;
+  }
+
+  *socket_ptr = NULL;
+  return 0;
+}
+
+static void *fev_listener_group_accept(void *arg)
+{
+  struct fev_listener *listener = arg;
+  struct fev_socket *socket = NULL;
+  int ret;
+
+  do {
+    ret = fev_listener_group_accept_one(listener, &socket);
+  } while (FEV_LIKELY(ret == 0) || fev_listener_group_recover(ret));
+
+  if (socket != NULL)
+    fev_socket_destroy(socket);
+
+  if (atomic_load(&listener->group->stopping))
+    return NULL;
+  return (void *)(intptr_t)ret;
+}
+
+FEV_NONNULL(1, 2)
+int fev_listener_group_start(struct fev_listener_group *group,
+                             void (*handler)(struct fev_socket *socket, void *arg), void *arg)
+{
+  int ret;
+
+  group->handler = handler;
+  group->handler_arg = arg;
+
+  for (uint32_t i = 0; i < group->num_listeners; i++) {
+    struct fev_listener *listener = &group->listeners[i];
+
+    FEV_ASSERT(listener->acceptor == NULL);
+
+    ret = fev_fiber_create(&listener->acceptor, /*sched=*/NULL, &fev_listener_group_accept,
+                           listener, /*attr=*/NULL);
+    if (FEV_UNLIKELY(ret != 0)) {
+      listener->acceptor = NULL;
+      fev_listener_group_stop(group);
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+FEV_NONNULL(1) int fev_listener_group_stop(struct fev_listener_group *group)
+{
+  void *value;
+  int ret = 0;
+
+  atomic_store(&group->stopping, true);
+
+  /*
+   * Shutting down a listener fails the pending accept. Canceling alone is not enough, socket
+   * operations are not cancellation points with the io_uring poller.
+   */
+  for (uint32_t i = 0; i < group->num_listeners; i++)
+    shutdown(fev_socket_native_handle(group->listeners[i].socket), SHUT_RD);
+
+  for (uint32_t i = 0; i < group->num_listeners; i++) {
+    struct fev_listener *listener = &group->listeners[i];
+
+    if (listener->acceptor != NULL)
+      fev_fiber_cancel(listener->acceptor);
+  }
+
+  for (uint32_t i = 0; i < group->num_listeners; i++) {
+    struct fev_listener *listener = &group->listeners[i];
+
+    if (listener->acceptor == NULL)
+      continue;
+
+    fev_fiber_join(listener->acceptor, &value);
+    listener->acceptor = NULL;
+
+    if (ret == 0)
+      ret = (int)(intptr_t)value;
+  }
+
+  return ret;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+
+#ifndef FEV_LISTENER_GROUP_H
+#define FEV_LISTENER_GROUP_H
+
+#include <fev/fev.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct fev_listener {
+  struct fev_listener_group *group;
+  struct fev_socket *socket;
+
+  /* The acceptor fiber, NULL if the group is not started. */
+  struct fev_fiber *acceptor;
+};
+
+struct fev_listener_group {
+  struct fev_listener *listeners;
+  uint32_t num_listeners;
+
+  void (*handler)(struct fev_socket *socket, void *arg);
+  void *handler_arg;
+
+  /* Set by fev_listener_group_stop(), the acceptors don't report the errors caused by stopping. */
+  atomic_bool stopping;
+};
+
+#endif /* !FEV_LISTENER_GROUP_H */
@@ -0,0 +1,13 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_mcs_lock_intf.h"
+
+_Thread_local struct fev_mcs_lock_node fev_mcs_lock_nodes[FEV_MCS_LOCK_MAX_NESTING];
+_Thread_local unsigned fev_mcs_lock_depth;
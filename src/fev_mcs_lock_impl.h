@@ -0,0 +1,120 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_MCS_LOCK_IMPL_H
+#define FEV_MCS_LOCK_IMPL_H
+
+#include "fev_mcs_lock_intf.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fev_arch.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_thr.h"
+
+FEV_NONNULL(1) static inline int fev_mcs_lock_init(struct fev_mcs_lock *lock)
+{
+  atomic_init(&lock->tail, NULL);
+  lock->owner = NULL;
+  return 0;
+}
+
+FEV_NONNULL(1) static inline void fev_mcs_lock_fini(struct fev_mcs_lock *lock)
+{
+  (void)lock;
+}
+
+FEV_NONNULL(1) static inline void fev_mcs_lock_backoff(unsigned *spins)
+{
+  if (++*spins < FEV_MCS_LOCK_SPINS_BEFORE_YIELD) {
+    fev_pause();
+  } else {
+    *spins = 0;
+    fev_thr_yield();
+  }
+}
+
+FEV_RETURNS_NONNULL static inline struct fev_mcs_lock_node *fev_mcs_lock_node_get(void)
+{
+  struct fev_mcs_lock_node *node;
+
+  FEV_ASSERT(fev_mcs_lock_depth < FEV_MCS_LOCK_MAX_NESTING);
+  node = &fev_mcs_lock_nodes[fev_mcs_lock_depth++];
+
+  atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&node->waiting, true, memory_order_relaxed);
+  return node;
+}
+
+FEV_NONNULL(1) static inline bool fev_mcs_lock_try_lock(struct fev_mcs_lock *lock)
+{
+  struct fev_mcs_lock_node *node, *expected = NULL;
+
+  if (atomic_load_explicit(&lock->tail, memory_order_relaxed) != NULL)
+    return false;
+
+  node = fev_mcs_lock_node_get();
+  if (!atomic_compare_exchange_strong_explicit(&lock->tail, &expected, node, memory_order_acquire,
+                                               memory_order_relaxed)) {
+    fev_mcs_lock_depth--;
+    return false;
+  }
+
+  lock->owner = node;
+  return true;
+}
+
+FEV_NONNULL(1) static inline void fev_mcs_lock_lock(struct fev_mcs_lock *lock)
+{
+  struct fev_mcs_lock_node *node, *prev;
+  unsigned spins = 0;
+
+  node = fev_mcs_lock_node_get();
+
+  /* The release barrier publishes the initialization of the node to the predecessor. */
+  prev = atomic_exchange_explicit(&lock->tail, node, memory_order_acq_rel);
+  if (prev != NULL) {
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+    while (atomic_load_explicit(&node->waiting, memory_order_acquire))
+      fev_mcs_lock_backoff(&spins);
+  }
+
+  lock->owner = node;
+}
+
+FEV_NONNULL(1) static inline void fev_mcs_lock_unlock(struct fev_mcs_lock *lock)
+{
+  struct fev_mcs_lock_node *node = lock->owner, *next, *expected;
+  unsigned spins = 0;
+
+  /* The locks must be released in the reverse order. */
+  FEV_ASSERT(fev_mcs_lock_depth > 0 && node == &fev_mcs_lock_nodes[fev_mcs_lock_depth - 1]);
+
+  next = atomic_load_explicit(&node->next, memory_order_acquire);
+  if (next == NULL) {
+    expected = node;
+    if (atomic_compare_exchange_strong_explicit(&lock->tail, &expected, NULL, memory_order_release,
+                                                memory_order_relaxed)) {
+      fev_mcs_lock_depth--;
+      return;
+    }
+
+    /* A successor has swapped the tail, but has not linked itself yet. */
+    while ((next = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+      fev_mcs_lock_backoff(&spins);
+  }
+
+  atomic_store_explicit(&next->waiting, false, memory_order_release);
+  fev_mcs_lock_depth--;
+}
+
+#endif /* !FEV_MCS_LOCK_IMPL_H */
@@ -0,0 +1,53 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_MCS_LOCK_INTF_H
+#define FEV_MCS_LOCK_INTF_H
+
+#include <fev/fev.h>
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * MCS queued spinlock. Each waiter spins on its own node, thus the lock doesn't thrash a single
+ * cache line under contention, and the lock is granted in FIFO order. Like Linux's qspinlock, the
+ * nodes are taken from a small per-thread pool, so that the lock has the same interface as
+ * fev_spinlock. The locks must be released in the reverse order of acquisition on a thread, and a
+ * fiber must not switch to another fiber while holding one (switching to the scheduler that
+ * releases the lock, as fev_ilock does, is fine).
+ */
+
+/* Maximum number of MCS locks held by a thread at the same time. */
+#define FEV_MCS_LOCK_MAX_NESTING 8
+
+/*
+ * Number of spins after which a waiter yields the CPU. Unlike in a kernel, the thread that holds
+ * the lock or is next in the queue can be preempted, and then the waiters would burn their time
+ * slices.
+ */
+#define FEV_MCS_LOCK_SPINS_BEFORE_YIELD 128
+
+struct fev_mcs_lock_node {
+  alignas(FEV_DCACHE_LINE_SIZE) _Atomic(struct fev_mcs_lock_node *) next;
+  atomic_bool waiting;
+};
+
+struct fev_mcs_lock {
+  _Atomic(struct fev_mcs_lock_node *) tail;
+
+  /* The node of the owner, accessed only by the owner. */
+  struct fev_mcs_lock_node *owner;
+};
+
+extern _Thread_local struct fev_mcs_lock_node fev_mcs_lock_nodes[FEV_MCS_LOCK_MAX_NESTING];
+extern _Thread_local unsigned fev_mcs_lock_depth;
+
+#endif /* !FEV_MCS_LOCK_INTF_H */
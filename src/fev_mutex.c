@@ -16,8 +16,11 @@
 #include <stdint.h>
 
 #include "fev_alloc.h"
+#include "fev_arch.h"
 #include "fev_assert.h"
 #include "fev_compiler.h"
+#include "fev_sched_impl.h"
+#include "fev_stackless.h"
 #include "fev_time.h"
 #include "fev_waiters_queue_impl.h"
 
@@ -53,6 +56,60 @@ FEV_NONNULL(1) bool fev_mutex_try_lock(struct fev_mutex *mutex)
                                                  memory_order_acquire, memory_order_relaxed);
 }
 
+/* Upper bound of the number of spins in fev_mutex_spin(). */
+#define FEV_MUTEX_MAX_SPINS 100
+
+/*
+ * Spins for a while before parking, as the critical sections are usually short and parking costs
+ * two context switches. Spinning makes sense only if the mutex is held by a running fiber, thus
+ * we stop as soon as some fiber is parked on the mutex (the mutex will be handed over to it) or
+ * the mutex was handed over to a fiber that has not been scheduled yet. We also don't spin if
+ * there is only one worker or some runnable fibers are waiting for a worker, since the worker can
+ * do something useful instead.
+ *
+ * Like glibc's adaptive mutexes, the spin limit adapts to the moving average of the number of
+ * spins that were needed to acquire the mutex. Returns true if the mutex was acquired.
+ */
+FEV_NONNULL(1) static bool fev_mutex_spin(struct fev_mutex *mutex)
+{
+  struct fev_sched *sched = fev_cur_sched_worker->sched;
+  unsigned spins, max_spins, avg_spins, state;
+  uint32_t num_run_fibers;
+  bool success = false;
+
+  if (sched->num_workers == 1)
+    return false;
+
+  num_run_fibers = atomic_load_explicit(&sched->num_run_fibers, memory_order_relaxed);
+  if (num_run_fibers > sched->num_workers)
+    return false;
+
+  avg_spins = atomic_load_explicit(&mutex->spins, memory_order_relaxed);
+  max_spins = 2 * avg_spins + 10;
+  if (max_spins > FEV_MUTEX_MAX_SPINS)
+    max_spins = FEV_MUTEX_MAX_SPINS;
+
+  for (spins = 0; spins < max_spins; spins++) {
+    fev_pause();
+
+    state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+    if (state == 0) {
+      success = fev_mutex_try_lock(mutex);
+      if (success)
+        break;
+    } else if (state != 1) {
+      /* Some fibers are parked or the owner is not running. */
+      break;
+    }
+  }
+
+  /* The update is racy, but the average is only a hint. */
+  avg_spins = (unsigned)((int)avg_spins + ((int)spins - (int)avg_spins) / 8);
+  atomic_store_explicit(&mutex->spins, avg_spins, memory_order_relaxed);
+
+  return success;
+}
+
 static bool fev_mutex_lock_recheck(void *arg)
 {
   struct fev_mutex *mutex = arg;
@@ -86,10 +143,32 @@ FEV_NONNULL(1) void fev_mutex_lock(struct fev_mutex *mutex)
   if (FEV_LIKELY(success))
     return;
 
-  /* Slow path. */
-  res = fev_waiters_queue_wait(&mutex->wq, /*abs_time=*/NULL, &fev_mutex_lock_recheck, mutex);
+  if (fev_mutex_spin(mutex))
+    return;
+
+  /* Slow path. Locking a mutex is not a cancellation point. */
+  res = fev_waiters_queue_wait(&mutex->wq, /*abs_time=*/NULL, /*cancelable=*/false,
+                               &fev_mutex_lock_recheck, mutex);
   (void)res;
   FEV_ASSERT(res == 0);
+
+  fev_mutex_owner_running(mutex);
+}
+
+FEV_NONNULL(1) int fev_stackless_mutex_lock(struct fev_mutex *mutex)
+{
+  bool success;
+
+  /* Fast path (if the mutex is not held). */
+  success = fev_mutex_try_lock(mutex);
+  if (FEV_LIKELY(success))
+    return 0;
+
+  if (fev_mutex_spin(mutex))
+    return 0;
+
+  /* Slow path. The mutex is handed over to us when we are woken up. */
+  return fev_stackless_wait_queue(&mutex->wq, &fev_mutex_lock_recheck, mutex);
 }
 
 FEV_NONNULL(1, 2)
@@ -97,10 +176,17 @@ static int fev_mutex_try_lock_until_slow(struct fev_mutex *mutex, const struct t
 {
   int res;
 
+  if (fev_mutex_spin(mutex))
+    return 0;
+
   do {
-    res = fev_waiters_queue_wait(&mutex->wq, abs_time, &fev_mutex_lock_recheck, mutex);
+    res = fev_waiters_queue_wait(&mutex->wq, abs_time, /*cancelable=*/true,
+                                 &fev_mutex_lock_recheck, mutex);
   } while (res == -EAGAIN);
 
+  if (res == 0)
+    fev_mutex_owner_running(mutex);
+
   return res;
 }
 
@@ -145,14 +231,14 @@ static void fev_mutex_unlock_callback(void *arg, uint32_t num_woken, bool is_emp
     atomic_store_explicit(&mutex->state, 0, memory_order_relaxed);
   } else if (is_empty) {
     /*
-     * One waiter was woken, but now the waiters queue is empty. Thus, set the state to 1 (locked,
-     * no waiters).
+     * One waiter was woken, but now the waiters queue is empty. Thus, set the state to 3 (locked,
+     * no waiters, owner not running), the woken waiter changes it to 1 once it runs.
      */
-    atomic_store_explicit(&mutex->state, 1, memory_order_relaxed);
+    atomic_store_explicit(&mutex->state, 3, memory_order_relaxed);
   }
 }
 
-FEV_NONNULL(1) void fev_mutex_unlock(struct fev_mutex *mutex)
+FEV_NONNULL(1) void fev_mutex_unlock_impl(struct fev_mutex *mutex, bool direct_switch)
 {
   unsigned expected, desired;
   bool success;
@@ -165,6 +251,23 @@ FEV_NONNULL(1) void fev_mutex_unlock(struct fev_mutex *mutex)
   if (FEV_LIKELY(success))
     return;
 
+  /*
+   * The mutex was handed over to a stackless fiber, which doesn't update the state when it is
+   * resumed.
+   */
+  if (expected == 3) {
+    success = atomic_compare_exchange_strong_explicit(&mutex->state, &expected, desired,
+                                                      memory_order_release, memory_order_relaxed);
+    if (success)
+      return;
+  }
+
   /* Slow path. */
-  fev_waiters_queue_wake(&mutex->wq, /*max_waiters=*/1, &fev_mutex_unlock_callback, mutex);
+  fev_waiters_queue_wake(&mutex->wq, /*max_waiters=*/1, &fev_mutex_unlock_callback, mutex,
+                         direct_switch);
+}
+
+FEV_NONNULL(1) void fev_mutex_unlock(struct fev_mutex *mutex)
+{
+  fev_mutex_unlock_impl(mutex, FEV_WAKE_DIRECT_SWITCH);
 }
@@ -13,6 +13,7 @@
 #include "fev_mutex_intf.h"
 
 #include <stdatomic.h>
+#include <stdbool.h>
 
 #include "fev_compiler.h"
 #include "fev_waiters_queue_impl.h"
@@ -24,6 +25,7 @@ FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT static inline int fev_mutex_init(struct fe
     return ret;
 
   atomic_init(&mutex->state, 0);
+  atomic_init(&mutex->spins, 0);
   return 0;
 }
 
@@ -32,4 +34,43 @@ FEV_NONNULL(1) static inline void fev_mutex_fini(struct fev_mutex *mutex)
   fev_waiters_queue_fini(&mutex->wq);
 }
 
+/*
+ * fev_mutex_unlock() for internal use. `direct_switch` must be false if the calling fiber cannot
+ * be switched at this point, see fev_cur_switch_to().
+ */
+FEV_NONNULL(1) void fev_mutex_unlock_impl(struct fev_mutex *mutex, bool direct_switch);
+
+/*
+ * Called by a woken waiter, the mutex was handed over to it. Update the state from 3 (locked, no
+ * waiters, owner not running) to 1 (locked, no waiters), so that other fibers can spin again.
+ */
+FEV_NONNULL(1) static inline void fev_mutex_owner_running(struct fev_mutex *mutex)
+{
+  unsigned expected = 3;
+  atomic_compare_exchange_strong_explicit(&mutex->state, &expected, 1, memory_order_relaxed,
+                                          memory_order_relaxed);
+}
+
+/*
+ * Called with the lock of the waiters queue held before some waiters are moved to the queue.
+ * Updates the state to 2 (locked, some waiters), so that fev_mutex_unlock() wakes them up. If the
+ * mutex is not held, it is locked on behalf of the caller and true is returned. The caller must
+ * then unlock the mutex after moving the waiters, which hands it over to the first of them.
+ */
+FEV_NONNULL(1) static inline bool fev_mutex_lock_for_requeue(struct fev_mutex *mutex)
+{
+  unsigned state = atomic_load_explicit(&mutex->state, memory_order_relaxed);
+
+  for (;;) {
+    if (state == 0) {
+      if (atomic_compare_exchange_weak_explicit(&mutex->state, &state, 2, memory_order_acquire,
+                                                memory_order_relaxed))
+        return true;
+    } else if (atomic_compare_exchange_weak_explicit(&mutex->state, &state, 2,
+                                                     memory_order_relaxed, memory_order_relaxed)) {
+      return false;
+    }
+  }
+}
+
 #endif /* !FEV_MUTEX_IMPL_H */
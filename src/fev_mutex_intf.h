@@ -22,9 +22,14 @@ struct fev_mutex {
    * 0 - unlocked
    * 1 - locked, no waiters
    * 2 - locked, some waiters
+   * 3 - locked, no waiters, but the mutex was handed over to a woken waiter that is not running
+   *     yet (spinning is pointless then)
    */
   atomic_uint state;
 
+  /* Moving average of the number of spins needed to acquire the mutex, see fev_mutex_spin(). */
+  atomic_uint spins;
+
   struct fev_waiters_queue wq;
 };
 
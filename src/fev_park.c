@@ -0,0 +1,234 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include <fev/fev.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <queue.h>
+
+#include "fev_arch.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_fiber.h"
+#include "fev_sched_impl.h"
+#include "fev_timers.h"
+#include "fev_waiter_impl.h"
+
+/*
+ * The park state of a fiber is one word: one of the values below or a pointer to the waiter of the
+ * parked fiber, similarly to the state of a future (see fev_future.c). Unlike a future, the permit
+ * is consumed by fev_park() and the state goes back to FEV_PARK_EMPTY.
+ */
+enum {
+  /* There is no permit and the fiber is not parked. */
+  FEV_PARK_EMPTY = 0,
+
+  /* There is a permit, the next fev_park() returns immediately. */
+  FEV_PARK_NOTIFIED = 1,
+
+  /*
+   * fev_unpark() is waking up the parked fiber. The waiter is allocated on the stack, thus the
+   * fiber cannot return from fev_park() until the state becomes FEV_PARK_NOTIFIED.
+   */
+  FEV_PARK_WAKING = 2,
+};
+
+static_assert(_Alignof(struct fev_waiter) > FEV_PARK_WAKING, "Waiter pointers collide");
+
+struct fev_fiber *fev_fiber_self(void)
+{
+  struct fev_fiber *fiber = fev_cur_fiber();
+  FEV_ASSERT(fiber != NULL);
+  return fiber;
+}
+
+/* Consumes the permit, the acquire barrier pairs with the release in fev_unpark_one(). */
+FEV_NONNULL(1) static void fev_park_consume(struct fev_fiber *fiber)
+{
+  uintptr_t state;
+
+  state = atomic_exchange_explicit(&fiber->park_state, FEV_PARK_EMPTY, memory_order_acquire);
+  FEV_ASSERT(state == FEV_PARK_NOTIFIED);
+  (void)state;
+}
+
+/* Removes `waiter` from the park state, waits for fev_unpark() that is accessing the waiter. */
+FEV_NONNULL(1, 2)
+static void fev_park_unregister(struct fev_fiber *fiber, struct fev_waiter *waiter)
+{
+  uintptr_t expected = (uintptr_t)waiter;
+
+  if (atomic_compare_exchange_strong_explicit(&fiber->park_state, &expected, FEV_PARK_EMPTY,
+                                              memory_order_acquire, memory_order_acquire)) {
+    return;
+  }
+
+  while (expected == FEV_PARK_WAKING) {
+    fev_pause();
+    expected = atomic_load_explicit(&fiber->park_state, memory_order_acquire);
+  }
+
+  FEV_ASSERT(expected == FEV_PARK_NOTIFIED);
+}
+
+FEV_NONNULL(1) static bool fev_park_has_permit(struct fev_fiber *fiber)
+{
+  return atomic_load_explicit(&fiber->park_state, memory_order_relaxed) == FEV_PARK_NOTIFIED;
+}
+
+int fev_park(bool (*recheck)(void *arg), void *arg, const struct timespec *abs_time)
+{
+  struct fev_fiber *fiber = fev_cur_fiber();
+  struct fev_waiter waiter;
+  uintptr_t expected;
+  int res;
+
+  FEV_ASSERT(fiber != NULL && !fiber->stackless);
+
+  waiter.fiber = fiber;
+  waiter.cancelable = true;
+  waiter.parent = NULL;
+
+  for (;;) {
+    if (fev_park_has_permit(fiber)) {
+      fev_park_consume(fiber);
+      return 0;
+    }
+
+    if (recheck != NULL && !recheck(arg))
+      return 0;
+
+    /*
+     * Prepare waiter. The stores can be relaxed, as the waiter is published with a release barrier
+     * below.
+     */
+    atomic_store_explicit(&waiter.state, FEV_WAITER_NONE, memory_order_relaxed);
+
+    /*
+     * Publish the waiter. If fev_unpark() has been called since the recheck, the permit is there
+     * and we return without waiting, thus no wake up is lost.
+     */
+    expected = FEV_PARK_EMPTY;
+    if (!atomic_compare_exchange_strong_explicit(&fiber->park_state, &expected,
+                                                 (uintptr_t)&waiter, memory_order_release,
+                                                 memory_order_relaxed)) {
+      /* Only the fiber itself can park. */
+      FEV_ASSERT(expected == FEV_PARK_NOTIFIED);
+      fev_park_consume(fiber);
+      return 0;
+    }
+
+    if (abs_time == NULL) {
+      enum fev_waiter_wake_reason reason = fev_waiter_wait(&waiter);
+      res = reason == FEV_WAITER_CANCELED ? -ECANCELED : 0;
+    } else {
+      res = fev_timed_wait(&waiter, abs_time);
+    }
+
+    fev_park_unregister(fiber, &waiter);
+
+    /* The permit is kept for the next fev_park(), if the wait has failed. */
+    if (FEV_UNLIKELY(res == -ECANCELED || (FEV_TIMED_WAIT_CAN_RETURN_ENOMEM && res == -ENOMEM)))
+      return res;
+
+    /* The fiber might have been unparked just after the timeout. */
+    if (fev_park_has_permit(fiber)) {
+      fev_park_consume(fiber);
+      return 0;
+    }
+
+    if (res == -ETIMEDOUT)
+      return res;
+
+    /* Spurious wake up, try again. */
+    FEV_ASSERT(res == -EAGAIN);
+  }
+}
+
+/*
+ * Gives a permit to `fiber`. Returns the fiber if it was parked and the caller must wake it up or
+ * NULL otherwise.
+ */
+FEV_NONNULL(1) static struct fev_fiber *fev_unpark_one(struct fev_fiber *fiber)
+{
+  _Atomic uintptr_t *state = &fiber->park_state;
+  enum fev_waiter_wake_result result;
+  struct fev_waiter *waiter;
+  uintptr_t expected;
+
+  expected = atomic_load_explicit(state, memory_order_relaxed);
+
+  for (;;) {
+    if (expected == FEV_PARK_EMPTY || expected == FEV_PARK_NOTIFIED) {
+      /*
+       * The fiber is not parked, leave a permit. Even if there is a permit already, the release
+       * barrier publishes the writes done before.
+       */
+      if (atomic_compare_exchange_weak_explicit(state, &expected, FEV_PARK_NOTIFIED,
+                                                memory_order_release, memory_order_relaxed)) {
+        return NULL;
+      }
+    } else if (expected == FEV_PARK_WAKING) {
+      /* Another fiber is unparking the fiber, the permit will be set soon. */
+      fev_pause();
+      expected = atomic_load_explicit(state, memory_order_relaxed);
+    } else if (atomic_compare_exchange_weak_explicit(state, &expected, FEV_PARK_WAKING,
+                                                     memory_order_acquire, memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  waiter = (struct fev_waiter *)expected;
+  FEV_ASSERT(waiter->fiber == fiber);
+  result = fev_waiter_wake(waiter, FEV_WAITER_READY);
+
+  /* From now on, the parked fiber can return and the waiter may be invalid. */
+  atomic_store_explicit(state, FEV_PARK_NOTIFIED, memory_order_release);
+
+  return result == FEV_WAITER_SET_AND_WAKE_UP ? fiber : NULL;
+}
+
+FEV_NONNULL(1) void fev_unpark(struct fev_fiber *fiber)
+{
+  fiber = fev_unpark_one(fiber);
+  if (fiber != NULL)
+    fev_cur_wake_one(fiber);
+}
+
+FEV_NONNULL(1) void fev_yield_to(struct fev_fiber *fiber)
+{
+  fiber = fev_unpark_one(fiber);
+  if (fiber != NULL)
+    fev_cur_switch_to(fiber);
+}
+
+void fev_unpark_n(struct fev_fiber *const *fibers, size_t num_fibers)
+{
+  fev_fiber_stq_head_t woken = STAILQ_HEAD_INITIALIZER(woken);
+  uint32_t num_woken = 0;
+  struct fev_fiber *fiber;
+
+  for (size_t i = 0; i < num_fibers; i++) {
+    /* A fiber is returned at most once, even if it is passed many times. */
+    fiber = fev_unpark_one(fibers[i]);
+    if (fiber != NULL) {
+      STAILQ_INSERT_TAIL(&woken, fiber, stq_entry);
+      num_woken++;
+    }
+  }
+
+  if (num_woken > 0)
+    fev_cur_wake_stq(&woken, num_woken);
+}
@@ -27,11 +27,91 @@
 #include "fev_qsbr.h"
 #include "fev_sched_impl.h"
 #include "fev_socket.h"
+#include "fev_spinlock_impl.h"
 #include "fev_time.h"
 #include "fev_timers.h"
 #include "fev_util.h"
 #include "fev_waiter_impl.h"
 
+#ifdef FEV_EPOLL_PER_WORKER
+
+/* The data of the shared instance registered in the instance of a worker. */
+#define FEV_POLLER_SHARED_TAG ((uintptr_t)2)
+
+FEV_NONNULL(1, 2)
+int fev_poller_register(const struct fev_sched_worker *worker, struct fev_socket *socket,
+                        enum fev_poller_flag flag)
+{
+  struct epoll_event event;
+  int epoll_fd, op, ret;
+
+  FEV_ASSERT((int)flag == EPOLLIN || (int)flag == EPOLLOUT);
+
+  fev_spinlock_lock(&socket->epoll_lock);
+
+  FEV_ASSERT((socket->epoll_events & flag) == 0);
+
+  /* The socket is registered in the instance of the first worker that waits on it. */
+  if (socket->epoll_events == 0) {
+    epoll_fd = worker->poller_data.epoll_fd;
+    op = EPOLL_CTL_ADD;
+    event.events = EPOLLRDHUP | EPOLLHUP | EPOLLET | flag;
+  } else {
+    epoll_fd = atomic_load_explicit(&socket->epoll_fd, memory_order_relaxed);
+    op = EPOLL_CTL_MOD;
+    event.events = socket->epoll_events | flag;
+  }
+  event.data.ptr = socket;
+
+  ret = epoll_ctl(epoll_fd, op, socket->fd, &event);
+  if (FEV_LIKELY(ret == 0)) {
+    atomic_store_explicit(&socket->epoll_fd, epoll_fd, memory_order_relaxed);
+    socket->epoll_events = event.events;
+  } else {
+    ret = -errno;
+  }
+
+  fev_spinlock_unlock(&socket->epoll_lock);
+  return ret;
+}
+
+FEV_NONNULL(1, 2)
+void fev_poller_migrate(const struct fev_sched_worker *worker, struct fev_socket *socket)
+{
+  struct epoll_event event;
+  int old_epoll_fd, new_epoll_fd;
+  int ret;
+
+  if (!fev_spinlock_try_lock(&socket->epoll_lock))
+    return;
+
+  old_epoll_fd = atomic_load_explicit(&socket->epoll_fd, memory_order_relaxed);
+  new_epoll_fd = worker->poller_data.epoll_fd;
+  if (socket->epoll_events == 0 || old_epoll_fd == new_epoll_fd)
+    goto out;
+
+  /*
+   * Add the socket to the new instance first. epoll_ctl() queues the socket if it is already
+   * ready, thus no event is lost. An event reported by both instances is only a spurious wake up.
+   */
+  event.events = socket->epoll_events;
+  event.data.ptr = socket;
+  ret = epoll_ctl(new_epoll_fd, EPOLL_CTL_ADD, socket->fd, &event);
+  if (FEV_UNLIKELY(ret != 0))
+    goto out;
+
+  ret = epoll_ctl(old_epoll_fd, EPOLL_CTL_DEL, socket->fd, NULL);
+  (void)ret;
+  FEV_ASSERT(ret == 0);
+
+  atomic_store_explicit(&socket->epoll_fd, new_epoll_fd, memory_order_relaxed);
+
+out:
+  fev_spinlock_unlock(&socket->epoll_lock);
+}
+
+#else /* !FEV_EPOLL_PER_WORKER */
+
 FEV_NONNULL(1, 2)
 int fev_poller_register(const struct fev_sched_worker *worker, struct fev_socket *socket,
                         enum fev_poller_flag flag)
@@ -60,6 +140,8 @@ int fev_poller_register(const struct fev_sched_worker *worker, struct fev_socket
   return FEV_LIKELY(ret == 0) ? 0 : -errno;
 }
 
+#endif /* FEV_EPOLL_PER_WORKER */
+
 FEV_NONNULL(1, 2)
 void fev_poller_set_timeout(const struct fev_timers_bucket *bucket, const struct timespec *abs_time)
 {
@@ -116,6 +198,26 @@ FEV_NONNULL(1) static struct fev_fiber *fev_process_timer_fd(void *ptr)
   return fiber;
 }
 
+/* Wakes up the fev_select() waiter registered in `end`, if any. */
+FEV_NONNULL(1, 2, 3)
+static void fev_process_select_waiter(struct fev_socket_end *end, fev_fiber_stq_head_t *fibers,
+                                      uint32_t *num_fibers)
+{
+  struct fev_waiter *waiter;
+  struct fev_fiber *fiber;
+
+  waiter = fev_socket_end_take_select_waiter(end);
+  if (FEV_LIKELY(waiter == NULL))
+    return;
+
+  /* The waiter can be gone once it is woken up. */
+  fiber = waiter->fiber;
+  if (fev_waiter_wake(waiter, FEV_WAITER_READY) == FEV_WAITER_SET_AND_WAKE_UP) {
+    STAILQ_INSERT_TAIL(fibers, fiber, stq_entry);
+    (*num_fibers)++;
+  }
+}
+
 FEV_NONNULL(1, 2, 3)
 static void fev_process_socket(const struct epoll_event *event, fev_fiber_stq_head_t *fibers,
                                uint32_t *num_fibers)
@@ -137,6 +239,7 @@ static void fev_process_socket(const struct epoll_event *event, fev_fiber_stq_he
       STAILQ_INSERT_TAIL(fibers, waiter->fiber, stq_entry);
       (*num_fibers)++;
     }
+    fev_process_select_waiter(&socket->read_end, fibers, num_fibers);
   }
 
   if ((events & EPOLLOUT) != 0 || error) {
@@ -146,6 +249,7 @@ static void fev_process_socket(const struct epoll_event *event, fev_fiber_stq_he
       STAILQ_INSERT_TAIL(fibers, waiter->fiber, stq_entry);
       (*num_fibers)++;
     }
+    fev_process_select_waiter(&socket->write_end, fibers, num_fibers);
   }
 }
 
@@ -155,15 +259,19 @@ FEV_COLD FEV_NOINLINE FEV_NORETURN static void fev_fatal_epoll(void)
   abort();
 }
 
-FEV_NONNULL(1) void fev_poller_process(struct fev_sched_worker *worker, int timeout)
+/* Waits for events on `epoll_fd` and adds the fibers to wake up to `fibers`. */
+FEV_NONNULL(1, 3, 4)
+static void fev_poller_poll(const struct fev_poller *poller, int epoll_fd,
+                            fev_fiber_stq_head_t *fibers, uint32_t *num_fibers, int timeout)
 {
   struct epoll_event events[FEV_POLLER_MAX_EVENTS];
-  struct fev_worker_poller_data *poller_data = &worker->poller_data;
-  fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
-  uint32_t num_fibers = 0;
   int n;
 
-  n = epoll_wait(poller_data->epoll_fd, events, FEV_POLLER_MAX_EVENTS, timeout);
+#ifndef FEV_EPOLL_PER_WORKER
+  (void)poller;
+#endif
+
+  n = epoll_wait(epoll_fd, events, FEV_POLLER_MAX_EVENTS, timeout);
 
   if (FEV_UNLIKELY(n < 0)) {
     fev_fatal_epoll();
@@ -178,17 +286,77 @@ FEV_NONNULL(1) void fev_poller_process(struct fev_sched_worker *worker, int time
       continue;
     }
 
+#ifdef FEV_EPOLL_PER_WORKER
+    if (FEV_UNLIKELY((uintptr_t)ptr == FEV_POLLER_SHARED_TAG)) {
+      /* The shared instance has timer or event fd events, it doesn't contain itself. */
+      fev_poller_poll(poller, poller->epoll_fd, fibers, num_fibers, /*timeout=*/0);
+      continue;
+    }
+#endif
+
     if (FEV_UNLIKELY((uintptr_t)ptr & 1)) {
       struct fev_fiber *fiber = fev_process_timer_fd(ptr);
 
       if (fiber != NULL) {
-        STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
-        num_fibers++;
+        STAILQ_INSERT_TAIL(fibers, fiber, stq_entry);
+        (*num_fibers)++;
       }
     } else {
-      fev_process_socket(&events[i], &fibers, &num_fibers);
+      fev_process_socket(&events[i], fibers, num_fibers);
     }
   }
+}
+
+#ifdef FEV_EPOLL_PER_WORKER
+/*
+ * Waits until an instance of any worker has events and polls the instances that have them. The
+ * instances are registered level-triggered, thus an instance that still has events after this is
+ * reported again.
+ */
+FEV_NONNULL(1, 2, 3)
+static void fev_poller_poll_sleep(const struct fev_sched *sched, fev_fiber_stq_head_t *fibers,
+                                  uint32_t *num_fibers, int timeout)
+{
+  const struct fev_poller *poller = &sched->poller;
+  struct epoll_event events[FEV_POLLER_MAX_EVENTS];
+  int n;
+
+  n = epoll_wait(poller->sleep_epoll_fd, events, FEV_POLLER_MAX_EVENTS, timeout);
+
+  if (FEV_UNLIKELY(n < 0)) {
+    fev_fatal_epoll();
+    FEV_UNREACHABLE();
+  }
+
+  for (int i = 0; i < n; i++) {
+    uint32_t index = events[i].data.u32;
+
+    FEV_ASSERT(index < sched->num_workers);
+    fev_poller_poll(poller, sched->workers[index].poller_data.epoll_fd, fibers, num_fibers,
+                    /*timeout=*/0);
+  }
+}
+#endif
+
+FEV_NONNULL(1) void fev_poller_process(struct fev_sched_worker *worker, int timeout)
+{
+  struct fev_worker_poller_data *poller_data = &worker->poller_data;
+  fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
+  struct fev_sched *sched = worker->sched;
+  uint32_t num_fibers = 0;
+
+#ifdef FEV_EPOLL_PER_WORKER
+  /*
+   * A busy worker checks only its own instance. Only one worker sleeps in the poller, it must see
+   * the sockets of the workers sleeping on the semaphore too.
+   */
+  if (timeout == 0)
+    fev_poller_poll(&sched->poller, poller_data->epoll_fd, &fibers, &num_fibers, timeout);
+  else
+    fev_poller_poll_sleep(sched, &fibers, &num_fibers, timeout);
+#else
+  fev_poller_poll(&sched->poller, poller_data->epoll_fd, &fibers, &num_fibers, timeout);
+#endif
 
   if (num_fibers > 0)
     fev_wake_stq(worker, &fibers, num_fibers);
@@ -243,6 +411,61 @@ fail:
   return ret;
 }
 
+#ifdef FEV_EPOLL_PER_WORKER
+/* Creates the epoll instances of the workers, the shared instance must be created before. */
+FEV_COLD FEV_NONNULL(1) static int fev_poller_create_worker_fds(struct fev_sched *sched)
+{
+  struct fev_poller *poller = &sched->poller;
+  struct epoll_event event;
+  uint32_t n;
+  int ret;
+
+  poller->sleep_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (FEV_UNLIKELY(poller->sleep_epoll_fd < 0))
+    return -errno;
+
+  for (n = 0; n < sched->num_workers; n++) {
+    int fd = epoll_create1(EPOLL_CLOEXEC);
+    if (FEV_UNLIKELY(fd < 0)) {
+      ret = -errno;
+      goto fail;
+    }
+
+    /* Level-triggered, the shared instance is ready until a worker has polled it. */
+    event.events = EPOLLIN;
+    event.data.ptr = (void *)FEV_POLLER_SHARED_TAG;
+    ret = epoll_ctl(fd, EPOLL_CTL_ADD, poller->epoll_fd, &event);
+    if (FEV_UNLIKELY(ret != 0)) {
+      ret = -errno;
+      close(fd);
+      goto fail;
+    }
+
+    /* Level-triggered, see fev_poller_poll_sleep(). */
+    event.events = EPOLLIN;
+    event.data.u64 = 0;
+    event.data.u32 = n;
+    ret = epoll_ctl(poller->sleep_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    if (FEV_UNLIKELY(ret != 0)) {
+      ret = -errno;
+      close(fd);
+      goto fail;
+    }
+
+    sched->workers[n].poller_data.epoll_fd = fd;
+  }
+
+  return 0;
+
+fail:
+  while (n-- > 0)
+    close(sched->workers[n].poller_data.epoll_fd);
+
+  close(poller->sleep_epoll_fd);
+  return ret;
+}
+#endif
+
 FEV_COLD FEV_NONNULL(1) int fev_poller_init(struct fev_sched *sched)
 {
   struct epoll_event ev;
@@ -273,18 +496,32 @@ FEV_COLD FEV_NONNULL(1) int fev_poller_init(struct fev_sched *sched)
   if (FEV_UNLIKELY(ret != 0))
     goto fail_event_fd;
 
+#ifdef FEV_EPOLL_PER_WORKER
+  ret = fev_poller_create_worker_fds(sched);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_timer_fds;
+#endif
+
   fev_qsbr_init_global(&poller->sockets_global_qsbr, sched->num_workers);
   atomic_init(&poller->num_sockets_to_free, 0);
 
   for (uint32_t i = 0; i < sched->num_workers; i++) {
     struct fev_worker_poller_data *poller_data = &sched->workers[i].poller_data;
+#ifndef FEV_EPOLL_PER_WORKER
     poller_data->epoll_fd = poller->epoll_fd;
+#endif
     poller_data->event_fd = poller->event_fd;
     fev_qsbr_init_local(&poller_data->sockets_local_qsbr);
   }
 
   return 0;
 
+#ifdef FEV_EPOLL_PER_WORKER
+fail_timer_fds:
+  for (size_t i = 0; i < FEV_TIMERS_BUCKETS; i++)
+    close(sched->timers.buckets[i].poller_data.timer_fd);
+#endif
+
 fail_event_fd:
   close(poller->event_fd);
 
@@ -303,6 +540,13 @@ FEV_COLD FEV_NONNULL(1) void fev_poller_fini(struct fev_sched *sched)
 
   fev_poller_free_remaining_sockets(poller);
 
+#ifdef FEV_EPOLL_PER_WORKER
+  for (uint32_t i = 0; i < sched->num_workers; i++)
+    close(sched->workers[i].poller_data.epoll_fd);
+
+  close(poller->sleep_epoll_fd);
+#endif
+
   for (size_t i = 0; i < FEV_TIMERS_BUCKETS; i++) {
     bucket = &timers->buckets[i];
     close(bucket->poller_data.timer_fd);
@@ -32,9 +32,18 @@ enum fev_poller_flag {
   FEV_POLLER_OUT = EPOLLOUT,
 };
 
+/*
+ * With FEV_EPOLL_PER_WORKER, `epoll_fd` of the poller contains only the timer fds and the event fd.
+ * Each worker has its own epoll instance with the sockets registered by the worker and the shared
+ * instance, thus a worker checking its instance sees the timers too. A worker going to sleep in the
+ * poller waits on `sleep_epoll_fd`, which contains the instances of all workers.
+ */
 struct fev_poller {
   int epoll_fd;
   int event_fd;
+#ifdef FEV_EPOLL_PER_WORKER
+  int sleep_epoll_fd;
+#endif
 
   struct fev_qsbr_global sockets_global_qsbr;
   _Atomic uint32_t num_sockets_to_free;
@@ -58,6 +67,16 @@ FEV_NONNULL(1, 2)
 int fev_poller_register(const struct fev_sched_worker *worker, struct fev_socket *socket,
                         enum fev_poller_flag flag);
 
+#ifdef FEV_EPOLL_PER_WORKER
+/*
+ * Moves a registered socket to the epoll instance of `worker`, e.g. after the waiting fiber has
+ * been stolen. The socket stays in the old instance if the move fails or the socket is being
+ * registered concurrently.
+ */
+FEV_NONNULL(1, 2)
+void fev_poller_migrate(const struct fev_sched_worker *worker, struct fev_socket *socket);
+#endif
+
 FEV_NONNULL(1, 2)
 void fev_poller_set_timeout(const struct fev_timers_bucket *bucket,
                             const struct timespec *abs_time);
@@ -109,16 +109,45 @@ FEV_NONNULL(1) static struct fev_fiber *fev_process_timer_event(struct fev_timer
   return fiber;
 }
 
-FEV_NONNULL(1) static struct fev_fiber *fev_process_socket(struct fev_socket *socket, short filter)
+/* Wakes up the fev_select() waiter registered in `end`, if any. */
+FEV_NONNULL(1) static struct fev_fiber *fev_process_select_waiter(struct fev_socket_end *end)
 {
   struct fev_waiter *waiter;
+  struct fev_fiber *fiber;
+
+  waiter = fev_socket_end_take_select_waiter(end);
+  if (FEV_LIKELY(waiter == NULL))
+    return NULL;
+
+  /* The waiter can be gone once it is woken up. */
+  fiber = waiter->fiber;
+  return fev_waiter_wake(waiter, FEV_WAITER_READY) == FEV_WAITER_SET_AND_WAKE_UP ? fiber : NULL;
+}
+
+FEV_NONNULL(1, 3, 4)
+static void fev_process_socket(struct fev_socket *socket, short filter,
+                               fev_fiber_stq_head_t *fibers, uint32_t *num_fibers)
+{
+  struct fev_socket_end *end;
+  struct fev_waiter *waiter;
+  struct fev_fiber *fiber;
   enum fev_waiter_wake_result result;
 
   FEV_ASSERT(filter == EVFILT_READ || filter == EVFILT_WRITE);
-  waiter = filter == EVFILT_READ ? &socket->read_end.waiter : &socket->write_end.waiter;
+  end = filter == EVFILT_READ ? &socket->read_end : &socket->write_end;
+  waiter = &end->waiter;
 
   result = fev_waiter_wake(waiter, FEV_WAITER_READY);
-  return result == FEV_WAITER_SET_AND_WAKE_UP ? waiter->fiber : NULL;
+  if (result == FEV_WAITER_SET_AND_WAKE_UP) {
+    STAILQ_INSERT_TAIL(fibers, waiter->fiber, stq_entry);
+    (*num_fibers)++;
+  }
+
+  fiber = fev_process_select_waiter(end);
+  if (fiber != NULL) {
+    STAILQ_INSERT_TAIL(fibers, fiber, stq_entry);
+    (*num_fibers)++;
+  }
 }
 
 FEV_COLD FEV_NOINLINE FEV_NORETURN static void fev_fatal_kevent(void)
@@ -155,15 +184,14 @@ void fev_poller_process(struct fev_sched_worker *worker, const struct timespec *
         continue;
 
       fiber = fev_process_timer_event((void *)event->ident);
+      if (fiber != NULL) {
+        STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
+        num_fibers++;
+      }
     } else {
       FEV_ASSERT(event->filter == EVFILT_READ || event->filter == EVFILT_WRITE);
 
-      fiber = fev_process_socket(event->udata, event->filter);
-    }
-
-    if (fiber != NULL) {
-      STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
-      num_fibers++;
+      fev_process_socket(event->udata, event->filter, &fibers, &num_fibers);
     }
   }
 
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+/*
+ * Grace periods are detected at the quiescent states of the workers: a worker that is between two
+ * fibers can't be in a read-side critical section. Each grace period has an epoch, the workers
+ * acknowledge it in the scheduler loop. A sleeping worker is offline and doesn't have to run
+ * anything, the worker that starts a grace period acknowledges the epoch on its behalf. Exactly one
+ * party moves the epoch of a worker forward, thus `num_remaining` is decremented once per worker.
+ */
+
+#include "fev_rcu_impl.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fev/fev.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_sched_impl.h"
+#include "fev_spinlock_impl.h"
+#include "fev_util.h"
+#include "fev_waiter_impl.h"
+
+struct fev_rcu_call_entry {
+  struct fev_rcu_entry entry;
+  void *ptr;
+  void (*free_fn)(void *ptr);
+};
+
+struct fev_rcu_sync_entry {
+  struct fev_rcu_entry entry;
+  struct fev_waiter waiter;
+};
+
+FEV_COLD FEV_NONNULL(1) int fev_rcu_init(struct fev_sched *sched)
+{
+  struct fev_rcu *rcu = &sched->rcu;
+  int ret;
+
+  ret = fev_spinlock_init(&rcu->lock);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  atomic_init(&rcu->epoch, 0);
+  atomic_init(&rcu->num_remaining, 0);
+  rcu->in_progress = false;
+  rcu->cur = NULL;
+  rcu->next = NULL;
+
+  /* The workers become online when they start running. */
+  for (uint32_t i = 0; i < sched->num_workers; i++)
+    atomic_init(&sched->workers[i].rcu_data.epoch, FEV_RCU_OFFLINE);
+
+  return 0;
+}
+
+static void fev_rcu_run_list(struct fev_rcu_entry *cur)
+{
+  while (cur != NULL) {
+    struct fev_rcu_entry *next = cur->next;
+    cur->func(cur);
+    cur = next;
+  }
+}
+
+/*
+ * Nobody can access the protected objects anymore, run the remaining callbacks. Only the entries
+ * of fev_rcu_call() can be left, fev_rcu_synchronize() blocks a fiber.
+ */
+FEV_COLD FEV_NONNULL(1) void fev_rcu_fini(struct fev_sched *sched)
+{
+  struct fev_rcu *rcu = &sched->rcu;
+
+  fev_rcu_run_list(rcu->cur);
+  fev_rcu_run_list(rcu->next);
+  fev_spinlock_fini(&rcu->lock);
+}
+
+/* Returns true if this was the last acknowledgement of the epoch. */
+FEV_NONNULL(1) static bool fev_rcu_dec_remaining(struct fev_rcu *rcu)
+{
+  uint32_t num_remaining;
+
+  num_remaining = atomic_fetch_sub_explicit(&rcu->num_remaining, 1, memory_order_acq_rel);
+  FEV_ASSERT(num_remaining > 0);
+  return num_remaining == 1;
+}
+
+/* Acknowledges the epoch on behalf of an offline worker, returns true if that was the last ack. */
+FEV_NONNULL(1, 2)
+static bool fev_rcu_ack_offline(struct fev_rcu *rcu, struct fev_worker_rcu_data *rcu_data,
+                                uint32_t epoch)
+{
+  uint32_t worker_epoch = atomic_load(&rcu_data->epoch);
+
+  while ((worker_epoch & FEV_RCU_OFFLINE) != 0 && worker_epoch != (epoch | FEV_RCU_OFFLINE)) {
+    if (atomic_compare_exchange_weak(&rcu_data->epoch, &worker_epoch, epoch | FEV_RCU_OFFLINE))
+      return fev_rcu_dec_remaining(rcu);
+  }
+
+  return false;
+}
+
+/*
+ * Starts a grace period for the entries in `next`, must be called with the lock held. Returns true
+ * if the grace period has already ended, i.e. all workers were offline.
+ */
+FEV_NONNULL(1) static bool fev_rcu_start(struct fev_sched *sched)
+{
+  struct fev_rcu *rcu = &sched->rcu;
+  uint32_t epoch;
+  bool ended = false;
+
+  FEV_ASSERT(rcu->cur == NULL);
+  FEV_ASSERT(rcu->next != NULL);
+
+  rcu->cur = rcu->next;
+  rcu->next = NULL;
+  rcu->in_progress = true;
+
+  epoch = (atomic_load_explicit(&rcu->epoch, memory_order_relaxed) + 1) & ~FEV_RCU_OFFLINE;
+  atomic_store_explicit(&rcu->num_remaining, sched->num_workers, memory_order_relaxed);
+  atomic_store(&rcu->epoch, epoch);
+
+  for (uint32_t i = 0; i < sched->num_workers; i++)
+    ended |= fev_rcu_ack_offline(rcu, &sched->workers[i].rcu_data, epoch);
+
+  return ended;
+}
+
+/* Runs the callbacks of the ended grace period and starts the next one if needed. */
+FEV_NONNULL(1) static void fev_rcu_end(struct fev_sched *sched)
+{
+  struct fev_rcu *rcu = &sched->rcu;
+  struct fev_rcu_entry *cur;
+  bool ended;
+
+  /*
+   * The callbacks run in the scheduler, not in a fiber. Clear the last run fiber, so that waking
+   * primitives don't switch from it, see fev_cur_switch_to().
+   */
+  fev_cur_sched_worker->cur_fiber = NULL;
+
+  do {
+    fev_spinlock_lock(&rcu->lock);
+    cur = rcu->cur;
+    rcu->cur = NULL;
+    ended = false;
+    if (rcu->next != NULL)
+      ended = fev_rcu_start(sched);
+    else
+      rcu->in_progress = false;
+    fev_spinlock_unlock(&rcu->lock);
+
+    fev_rcu_run_list(cur);
+  } while (ended);
+}
+
+FEV_NONNULL(1) void fev_rcu_ack(struct fev_sched_worker *worker, uint32_t epoch)
+{
+  struct fev_sched *sched = worker->sched;
+
+  /* The worker is online, only the worker itself can change its epoch. */
+  atomic_store_explicit(&worker->rcu_data.epoch, epoch, memory_order_relaxed);
+
+  if (fev_rcu_dec_remaining(&sched->rcu))
+    fev_rcu_end(sched);
+}
+
+FEV_NONNULL(1) bool fev_rcu_offline(struct fev_sched_worker *worker)
+{
+  struct fev_worker_rcu_data *rcu_data = &worker->rcu_data;
+  struct fev_sched *sched = worker->sched;
+  uint32_t epoch;
+
+  epoch = atomic_load_explicit(&rcu_data->epoch, memory_order_relaxed);
+  FEV_ASSERT((epoch & FEV_RCU_OFFLINE) == 0);
+  atomic_store(&rcu_data->epoch, epoch | FEV_RCU_OFFLINE);
+
+  /*
+   * A grace period could have started before the worker became offline, but the starting worker
+   * may have seen it online. Pairs with the store of the epoch and the load in
+   * fev_rcu_ack_offline().
+   */
+  epoch = atomic_load(&sched->rcu.epoch);
+  if (FEV_LIKELY(!fev_rcu_ack_offline(&sched->rcu, rcu_data, epoch)))
+    return true;
+
+  fev_rcu_end(sched);
+  fev_rcu_online(worker);
+  return false;
+}
+
+FEV_NONNULL(1) void fev_rcu_online(struct fev_sched_worker *worker)
+{
+  struct fev_worker_rcu_data *rcu_data = &worker->rcu_data;
+  struct fev_sched *sched = worker->sched;
+  uint32_t worker_epoch, epoch;
+
+  worker_epoch = atomic_load_explicit(&rcu_data->epoch, memory_order_relaxed);
+  do {
+    FEV_ASSERT((worker_epoch & FEV_RCU_OFFLINE) != 0);
+    epoch = atomic_load(&sched->rcu.epoch);
+  } while (!atomic_compare_exchange_weak(&rcu_data->epoch, &worker_epoch, epoch));
+
+  /* The worker hasn't run any fiber since it became offline, it can acknowledge the epoch. */
+  if ((worker_epoch & ~FEV_RCU_OFFLINE) != epoch && fev_rcu_dec_remaining(&sched->rcu))
+    fev_rcu_end(sched);
+}
+
+FEV_NONNULL(1) static void fev_rcu_add(struct fev_rcu_entry *entry)
+{
+  struct fev_sched_worker *worker = fev_cur_sched_worker;
+  struct fev_sched *sched;
+  struct fev_rcu *rcu;
+  bool ended = false;
+
+  FEV_ASSERT(worker != NULL);
+  sched = worker->sched;
+  rcu = &sched->rcu;
+
+  fev_spinlock_lock(&rcu->lock);
+  entry->next = rcu->next;
+  rcu->next = entry;
+  if (!rcu->in_progress)
+    ended = fev_rcu_start(sched);
+  fev_spinlock_unlock(&rcu->lock);
+
+  /* The current worker runs this fiber, it is online and hasn't acknowledged the new epoch. */
+  FEV_ASSERT(!ended);
+  (void)ended;
+}
+
+FEV_NONNULL(1) static void fev_rcu_call_func(struct fev_rcu_entry *entry)
+{
+  struct fev_rcu_call_entry *call_entry = FEV_CONTAINER_OF(entry, struct fev_rcu_call_entry, entry);
+
+  call_entry->free_fn(call_entry->ptr);
+  fev_free(call_entry);
+}
+
+int fev_rcu_call(void *ptr, void (*free_fn)(void *ptr))
+{
+  struct fev_rcu_call_entry *call_entry;
+
+  call_entry = fev_malloc(sizeof(*call_entry));
+  if (FEV_UNLIKELY(call_entry == NULL))
+    return -ENOMEM;
+
+  call_entry->entry.func = &fev_rcu_call_func;
+  call_entry->ptr = ptr;
+  call_entry->free_fn = free_fn;
+
+  fev_rcu_add(&call_entry->entry);
+  return 0;
+}
+
+FEV_NONNULL(1) static void fev_rcu_sync_func(struct fev_rcu_entry *entry)
+{
+  struct fev_rcu_sync_entry *sync_entry = FEV_CONTAINER_OF(entry, struct fev_rcu_sync_entry, entry);
+  struct fev_fiber *fiber = sync_entry->waiter.fiber;
+
+  /* The waiter is on the stack of the fiber, it is not accessed after the wake. */
+  if (fev_waiter_wake(&sync_entry->waiter, FEV_WAITER_READY) == FEV_WAITER_SET_AND_WAKE_UP)
+    fev_cur_wake_one(fiber);
+}
+
+void fev_rcu_synchronize(void)
+{
+  struct fev_rcu_sync_entry sync_entry;
+  struct fev_waiter *waiter = &sync_entry.waiter;
+  enum fev_waiter_wake_reason reason;
+
+  sync_entry.entry.func = &fev_rcu_sync_func;
+
+  /* The wait is not cancelable, the entry must stay valid until the callback has run. */
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);
+  waiter->fiber = fev_cur_fiber();
+  waiter->cancelable = false;
+  waiter->parent = NULL;
+
+  fev_rcu_add(&sync_entry.entry);
+
+  reason = fev_waiter_wait(waiter);
+  FEV_ASSERT(reason == FEV_WAITER_READY);
+  (void)reason;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_RCU_IMPL_H
+#define FEV_RCU_IMPL_H
+
+#include "fev_rcu_intf.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fev_compiler.h"
+#include "fev_sched_intf.h"
+
+FEV_COLD FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT int fev_rcu_init(struct fev_sched *sched);
+
+FEV_COLD FEV_NONNULL(1) void fev_rcu_fini(struct fev_sched *sched);
+
+FEV_NONNULL(1) void fev_rcu_ack(struct fev_sched_worker *worker, uint32_t epoch);
+
+/*
+ * Called before the worker goes to sleep. Returns false if the worker has ended a grace period
+ * and stays online, the callbacks could have woken up some fibers.
+ */
+FEV_NONNULL(1) bool fev_rcu_offline(struct fev_sched_worker *worker);
+
+/* Called after the worker wakes up, before it runs any fiber. */
+FEV_NONNULL(1) void fev_rcu_online(struct fev_sched_worker *worker);
+
+/*
+ * Called by an online worker between running fibers, acknowledges the current epoch. This is only
+ * two loads if nothing has changed.
+ */
+FEV_NONNULL(1) static inline void fev_rcu_quiescent(struct fev_sched_worker *worker)
+{
+  uint32_t epoch;
+
+  epoch = atomic_load_explicit(&worker->sched->rcu.epoch, memory_order_acquire);
+  if (FEV_LIKELY(atomic_load_explicit(&worker->rcu_data.epoch, memory_order_relaxed) == epoch))
+    return;
+
+  fev_rcu_ack(worker, epoch);
+}
+
+#endif /* !FEV_RCU_IMPL_H */
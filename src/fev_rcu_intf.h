@@ -0,0 +1,54 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_RCU_INTF_H
+#define FEV_RCU_INTF_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "fev_spinlock_intf.h"
+
+/* Set in the epoch of a worker that doesn't run fibers (e.g. it sleeps). */
+#define FEV_RCU_OFFLINE (UINT32_C(1) << 31)
+
+struct fev_rcu_entry {
+  struct fev_rcu_entry *next;
+  void (*func)(struct fev_rcu_entry *entry);
+};
+
+struct fev_rcu {
+  /* Current epoch, a grace period ends when all workers acknowledge it. */
+  _Atomic uint32_t epoch;
+
+  /* Number of workers that haven't acknowledged the current epoch yet. */
+  _Atomic uint32_t num_remaining;
+
+  /* Protects the fields below. */
+  struct fev_spinlock lock;
+
+  bool in_progress;
+
+  /* Entries waiting for the current grace period. */
+  struct fev_rcu_entry *cur;
+
+  /* Entries waiting for the next grace period. */
+  struct fev_rcu_entry *next;
+};
+
+struct fev_worker_rcu_data {
+  /*
+   * The last epoch acknowledged by the worker, possibly with FEV_RCU_OFFLINE. Only the worker
+   * changes an online epoch, an offline one can be acknowledged by others.
+   */
+  _Atomic uint32_t epoch;
+};
+
+#endif /* !FEV_RCU_INTF_H */
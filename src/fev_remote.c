@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+/*
+ * A thread that is not a worker cannot touch the run queues, the waiters queues or the timers, as
+ * these assume to be used from a worker (e.g. the ilock blocks the calling fiber). Instead, it
+ * pushes an entry to a lock-free stack in the scheduler and interrupts the poller. The workers
+ * check the stack after every poller check, a running worker picks the entry up on its next check
+ * and a sleeping one is woken up by the interrupt.
+ *
+ * Only the push that finds the stack empty interrupts the poller. The entries pushed later are
+ * taken together with the first one, thus one interrupt is enough for the whole batch.
+ */
+
+#include "fev_remote_impl.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "fev_compiler.h"
+#include "fev_poller.h"
+#include "fev_sched_impl.h"
+
+FEV_NONNULL(1, 2) void fev_remote_push(struct fev_sched *sched, struct fev_remote_entry *entry)
+{
+  struct fev_remote *remote = &sched->remote;
+  struct fev_remote_entry *head;
+
+  head = atomic_load_explicit(&remote->head, memory_order_relaxed);
+  do {
+    entry->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&remote->head, &head, entry,
+                                                  memory_order_release, memory_order_relaxed));
+
+  /* The stack was not empty, a worker has already been interrupted for it. */
+  if (head != NULL)
+    return;
+
+  fev_poller_interrupt(&sched->poller);
+}
+
+FEV_NONNULL(1) void fev_remote_run(struct fev_sched_worker *worker)
+{
+  struct fev_remote_entry *cur, *next, *prev = NULL;
+
+  cur = atomic_exchange_explicit(&worker->sched->remote.head, NULL, memory_order_acquire);
+
+  /* Run the entries in the order they were submitted. */
+  while (cur != NULL) {
+    next = cur->next;
+    cur->next = prev;
+    prev = cur;
+    cur = next;
+  }
+
+  /* The entry can be submitted again as soon as its function starts. */
+  while (prev != NULL) {
+    next = prev->next;
+    prev->func(prev);
+    prev = next;
+  }
+}
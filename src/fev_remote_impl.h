@@ -0,0 +1,46 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_REMOTE_IMPL_H
+#define FEV_REMOTE_IMPL_H
+
+#include "fev_remote_intf.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "fev_compiler.h"
+#include "fev_sched_intf.h"
+
+FEV_NONNULL(1) static inline void fev_remote_init(struct fev_remote *remote)
+{
+  atomic_init(&remote->head, NULL);
+}
+
+/*
+ * Submits `entry` to `sched`, can be called from any thread. The entry must stay valid until its
+ * function is called.
+ */
+FEV_NONNULL(1, 2) void fev_remote_push(struct fev_sched *sched, struct fev_remote_entry *entry);
+
+FEV_NONNULL(1) void fev_remote_run(struct fev_sched_worker *worker);
+
+/*
+ * Called by a worker after checking the poller, runs the submitted entries. This is only one load
+ * if nothing has been submitted.
+ */
+FEV_NONNULL(1) static inline void fev_remote_check(struct fev_sched_worker *worker)
+{
+  if (FEV_LIKELY(atomic_load_explicit(&worker->sched->remote.head, memory_order_relaxed) == NULL))
+    return;
+
+  fev_remote_run(worker);
+}
+
+#endif /* !FEV_REMOTE_IMPL_H */
@@ -0,0 +1,29 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_REMOTE_INTF_H
+#define FEV_REMOTE_INTF_H
+
+#include <stdatomic.h>
+
+/*
+ * Work submitted to the scheduler by threads that are not its workers. The entries are run by a
+ * worker in the scheduler context, where fibers can be woken up as usual.
+ */
+struct fev_remote_entry {
+  struct fev_remote_entry *next;
+  void (*func)(struct fev_remote_entry *entry);
+};
+
+struct fev_remote {
+  /* Lock-free stack of submitted entries, taken at once by a worker. */
+  _Atomic(struct fev_remote_entry *) head;
+};
+
+#endif /* !FEV_REMOTE_INTF_H */
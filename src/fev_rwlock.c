@@ -0,0 +1,320 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_rwlock.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_mutex_impl.h"
+#include "fev_os.h"
+#include "fev_sched_impl.h"
+#include "fev_time.h"
+#include "fev_waiters_queue_impl.h"
+
+/*
+ * Readers and writers synchronize Dekker-style: a reader increments its slot and then checks
+ * `writers`, a writer increments `writers` and then sums the slots. Both use sequentially
+ * consistent operations, thus at least one of them sees the other.
+ */
+
+FEV_NONNULL(1) int fev_rwlock_create(struct fev_rwlock **rwlock_ptr)
+{
+  struct fev_rwlock *rwlock;
+  uint32_t num_slots;
+  int ret;
+
+  /* One slot per processor (the default number of workers), rounded up to a power of 2. */
+  num_slots = 1;
+  while (num_slots < fev_get_num_processors() && num_slots < UINT32_C(1) << 16)
+    num_slots *= 2;
+
+  rwlock = fev_aligned_alloc(FEV_DCACHE_LINE_SIZE,
+                             sizeof(*rwlock) + (size_t)num_slots * sizeof(rwlock->slots[0]));
+  if (FEV_UNLIKELY(rwlock == NULL))
+    return -ENOMEM;
+
+  ret = fev_mutex_init(&rwlock->writer_mutex);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_rwlock;
+
+  ret = fev_waiters_queue_init(&rwlock->readers_wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_writer_mutex;
+
+  ret = fev_waiters_queue_init(&rwlock->writer_wq);
+  if (FEV_UNLIKELY(ret != 0))
+    goto fail_readers_wq;
+
+  atomic_init(&rwlock->writers, 0);
+  rwlock->num_slots = num_slots;
+  for (uint32_t i = 0; i < num_slots; i++)
+    atomic_init(&rwlock->slots[i].readers, 0);
+
+  *rwlock_ptr = rwlock;
+  return 0;
+
+fail_readers_wq:
+  fev_waiters_queue_fini(&rwlock->readers_wq);
+
+fail_writer_mutex:
+  fev_mutex_fini(&rwlock->writer_mutex);
+
+fail_rwlock:
+  fev_aligned_free(rwlock);
+  return ret;
+}
+
+FEV_NONNULL(1) void fev_rwlock_destroy(struct fev_rwlock *rwlock)
+{
+  fev_waiters_queue_fini(&rwlock->writer_wq);
+  fev_waiters_queue_fini(&rwlock->readers_wq);
+  fev_mutex_fini(&rwlock->writer_mutex);
+  fev_aligned_free(rwlock);
+}
+
+/* Returns the slot of the current worker. */
+FEV_NONNULL(1) static struct fev_rwlock_slot *fev_rwlock_cur_slot(struct fev_rwlock *rwlock)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  uint32_t index;
+
+  FEV_ASSERT(cur_worker != NULL);
+
+  index = (uint32_t)(cur_worker - cur_worker->sched->workers);
+  return &rwlock->slots[index & (rwlock->num_slots - 1)];
+}
+
+/*
+ * Readers
+ */
+
+FEV_NONNULL(1, 2)
+static void fev_rwlock_leave_slot(struct fev_rwlock *rwlock, struct fev_rwlock_slot *slot)
+{
+  atomic_fetch_sub_explicit(&slot->readers, 1, memory_order_seq_cst);
+
+  /*
+   * A writer may be waiting for us. If it has incremented `writers` after our decrement, it will
+   * see the decrement. Otherwise, we see the writer and wake it up, so it can recheck the readers.
+   */
+  if (FEV_UNLIKELY(atomic_load_explicit(&rwlock->writers, memory_order_seq_cst) != 0)) {
+    fev_waiters_queue_wake(&rwlock->writer_wq, /*max_waiters=*/1, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+  }
+}
+
+FEV_NONNULL(1) bool fev_rwlock_try_read_lock(struct fev_rwlock *rwlock)
+{
+  struct fev_rwlock_slot *slot = fev_rwlock_cur_slot(rwlock);
+
+  atomic_fetch_add_explicit(&slot->readers, 1, memory_order_seq_cst);
+  if (FEV_LIKELY(atomic_load_explicit(&rwlock->writers, memory_order_seq_cst) == 0))
+    return true;
+
+  /* A writer holds or waits for the lock, back off. We haven't switched, the slot is the same. */
+  fev_rwlock_leave_slot(rwlock, slot);
+  return false;
+}
+
+static bool fev_rwlock_read_lock_recheck(void *arg)
+{
+  struct fev_rwlock *rwlock = arg;
+
+  return atomic_load_explicit(&rwlock->writers, memory_order_relaxed) != 0;
+}
+
+FEV_NONNULL(1)
+static int fev_rwlock_read_lock_slow(struct fev_rwlock *rwlock, const struct timespec *abs_time,
+                                     bool cancelable)
+{
+  int res;
+
+  do {
+    res = fev_waiters_queue_wait(&rwlock->readers_wq, abs_time, cancelable,
+                                 &fev_rwlock_read_lock_recheck, rwlock);
+    if (FEV_UNLIKELY(res != 0 && res != -EAGAIN))
+      return res;
+
+    /* Another writer may have come in the meantime. */
+  } while (!fev_rwlock_try_read_lock(rwlock));
+
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_rwlock_read_lock(struct fev_rwlock *rwlock)
+{
+  int res;
+
+  /* Fast path (if no writer holds or waits for the lock). */
+  if (FEV_LIKELY(fev_rwlock_try_read_lock(rwlock)))
+    return;
+
+  /* Slow path. Like locking a mutex, this is not a cancellation point. */
+  res = fev_rwlock_read_lock_slow(rwlock, /*abs_time=*/NULL, /*cancelable=*/false);
+  (void)res;
+  FEV_ASSERT(res == 0);
+}
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_read_lock_until(struct fev_rwlock *rwlock, const struct timespec *abs_time)
+{
+  if (FEV_LIKELY(fev_rwlock_try_read_lock(rwlock)))
+    return 0;
+
+  return fev_rwlock_read_lock_slow(rwlock, abs_time, /*cancelable=*/true);
+}
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_read_lock_for(struct fev_rwlock *rwlock, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  if (FEV_LIKELY(fev_rwlock_try_read_lock(rwlock)))
+    return 0;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_rwlock_read_lock_slow(rwlock, &abs_time, /*cancelable=*/true);
+}
+
+FEV_NONNULL(1) void fev_rwlock_read_unlock(struct fev_rwlock *rwlock)
+{
+  /* The fiber might have migrated, this can be another slot than the one used for locking. */
+  fev_rwlock_leave_slot(rwlock, fev_rwlock_cur_slot(rwlock));
+}
+
+/*
+ * Writers
+ */
+
+FEV_NONNULL(1) static bool fev_rwlock_has_readers(struct fev_rwlock *rwlock)
+{
+  long sum = 0;
+
+  for (uint32_t i = 0; i < rwlock->num_slots; i++)
+    sum += atomic_load_explicit(&rwlock->slots[i].readers, memory_order_seq_cst);
+
+  /*
+   * Every reader that holds the lock has incremented a slot before we incremented `writers`, thus
+   * we see the increment and the sum cannot be 0. Without a writer counted in `writers`, we can see
+   * the decrement of a migrated reader, but not its increment, so the sum can be negative.
+   */
+  return sum != 0;
+}
+
+static bool fev_rwlock_write_lock_recheck(void *arg)
+{
+  return fev_rwlock_has_readers(arg);
+}
+
+/* Removes the writer from `writers`, wakes up the readers if it was the last one. */
+FEV_NONNULL(1) static void fev_rwlock_writer_leave(struct fev_rwlock *rwlock)
+{
+  if (atomic_fetch_sub_explicit(&rwlock->writers, 1, memory_order_seq_cst) == 1) {
+    fev_waiters_queue_wake(&rwlock->readers_wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+  }
+}
+
+/* Waits until all readers leave, the caller must hold `writer_mutex`. */
+FEV_NONNULL(1)
+static int fev_rwlock_wait_for_readers(struct fev_rwlock *rwlock, const struct timespec *abs_time,
+                                       bool cancelable)
+{
+  int res;
+
+  while (fev_rwlock_has_readers(rwlock)) {
+    res = fev_waiters_queue_wait(&rwlock->writer_wq, abs_time, cancelable,
+                                 &fev_rwlock_write_lock_recheck, rwlock);
+    if (FEV_UNLIKELY(res != 0 && res != -EAGAIN))
+      return res;
+  }
+
+  return 0;
+}
+
+FEV_NONNULL(1) bool fev_rwlock_try_write_lock(struct fev_rwlock *rwlock)
+{
+  /* Don't bother the readers if we are going to fail anyway. */
+  if (fev_rwlock_has_readers(rwlock))
+    return false;
+
+  atomic_fetch_add_explicit(&rwlock->writers, 1, memory_order_seq_cst);
+
+  if (FEV_UNLIKELY(!fev_mutex_try_lock(&rwlock->writer_mutex)))
+    goto fail;
+
+  if (FEV_UNLIKELY(fev_rwlock_has_readers(rwlock))) {
+    fev_mutex_unlock(&rwlock->writer_mutex);
+    goto fail;
+  }
+
+  return true;
+
+fail:
+  fev_rwlock_writer_leave(rwlock);
+  return false;
+}
+
+FEV_NONNULL(1) void fev_rwlock_write_lock(struct fev_rwlock *rwlock)
+{
+  int res;
+
+  atomic_fetch_add_explicit(&rwlock->writers, 1, memory_order_seq_cst);
+  fev_mutex_lock(&rwlock->writer_mutex);
+
+  res = fev_rwlock_wait_for_readers(rwlock, /*abs_time=*/NULL, /*cancelable=*/false);
+  (void)res;
+  FEV_ASSERT(res == 0);
+}
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_write_lock_until(struct fev_rwlock *rwlock, const struct timespec *abs_time)
+{
+  int res;
+
+  atomic_fetch_add_explicit(&rwlock->writers, 1, memory_order_seq_cst);
+
+  res = fev_mutex_try_lock_until(&rwlock->writer_mutex, abs_time);
+  if (FEV_UNLIKELY(res != 0))
+    goto fail;
+
+  res = fev_rwlock_wait_for_readers(rwlock, abs_time, /*cancelable=*/true);
+  if (FEV_UNLIKELY(res != 0)) {
+    fev_mutex_unlock(&rwlock->writer_mutex);
+    goto fail;
+  }
+
+  return 0;
+
+fail:
+  fev_rwlock_writer_leave(rwlock);
+  return res;
+}
+
+FEV_NONNULL(1, 2)
+int fev_rwlock_try_write_lock_for(struct fev_rwlock *rwlock, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_rwlock_try_write_lock_until(rwlock, &abs_time);
+}
+
+FEV_NONNULL(1) void fev_rwlock_write_unlock(struct fev_rwlock *rwlock)
+{
+  fev_mutex_unlock(&rwlock->writer_mutex);
+  fev_rwlock_writer_leave(rwlock);
+}
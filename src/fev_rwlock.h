@@ -0,0 +1,53 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_RWLOCK_H
+#define FEV_RWLOCK_H
+
+#include <fev/fev.h>
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "fev_mutex_intf.h"
+#include "fev_waiters_queue_intf.h"
+
+/*
+ * Number of readers that have entered the lock through one worker. A fiber can migrate to another
+ * worker while holding the lock and leave through another slot, thus a single slot can become
+ * negative, only the sum of all slots is meaningful.
+ */
+struct fev_rwlock_slot {
+  alignas(FEV_DCACHE_LINE_SIZE) atomic_long readers;
+};
+
+struct fev_rwlock {
+  /*
+   * Number of writers holding or waiting for the lock. New readers back off while it is not 0,
+   * which gives writers preference.
+   */
+  alignas(FEV_DCACHE_LINE_SIZE) atomic_uint writers;
+
+  /* Serializes writers. */
+  struct fev_mutex writer_mutex;
+
+  /* Readers waiting for `writers` to drop to 0. */
+  struct fev_waiters_queue readers_wq;
+
+  /* The writer holding `writer_mutex` waiting for the readers to leave. */
+  struct fev_waiters_queue writer_wq;
+
+  /* Number of slots, a power of 2. */
+  uint32_t num_slots;
+
+  struct fev_rwlock_slot slots[];
+};
+
+#endif /* !FEV_RWLOCK_H */
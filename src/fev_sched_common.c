@@ -19,7 +19,10 @@
 #include "fev_compiler.h"
 #include "fev_os.h"
 #include "fev_poller.h"
+#include "fev_rcu_impl.h"
+#include "fev_remote_impl.h"
 #include "fev_sched_attr.h"
+#include "fev_stackless.h"
 #include "fev_thr.h"
 #include "fev_thr_sem.h"
 
@@ -62,7 +65,10 @@ FEV_NONNULL(1) void fev_sched_wake_all_workers(struct fev_sched *sched)
 FEV_COLD FEV_NONNULL(1) static void fev_sched_work_start(struct fev_sched_worker *cur_worker)
 {
   fev_cur_sched_worker = cur_worker;
+  fev_rcu_online(cur_worker);
   fev_sched_work(cur_worker);
+  fev_rcu_offline(cur_worker);
+  fev_stackless_worker_fini();
 }
 
 FEV_COLD FEV_NONNULL(1) static void *fev_sched_thread_proc(void *arg)
@@ -155,12 +161,37 @@ FEV_COLD FEV_NONNULL(1) int fev_sched_create(struct fev_sched **sched_ptr,
     return ret;
   }
 
+  ret = fev_rcu_init(sched);
+  if (FEV_UNLIKELY(ret != 0)) {
+    fev_sched_fini(sched);
+    fev_aligned_free(sched);
+    return ret;
+  }
+
+  fev_remote_init(&sched->remote);
+
   *sched_ptr = sched;
   return 0;
 }
 
 FEV_COLD FEV_NONNULL(1) void fev_sched_destroy(struct fev_sched *sched)
 {
+  fev_rcu_fini(sched);
   fev_sched_fini(sched);
   fev_aligned_free(sched);
 }
+
+FEV_NONNULL(1) uint32_t fev_sched_get_num_workers(const struct fev_sched *sched)
+{
+  return sched->num_workers;
+}
+
+uint32_t fev_cur_worker_index(void)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+
+  if (FEV_UNLIKELY(cur_worker == NULL))
+    return UINT32_MAX;
+
+  return (uint32_t)(cur_worker - cur_worker->sched->workers);
+}
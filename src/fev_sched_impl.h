@@ -77,6 +77,42 @@ static inline void fev_cur_wake_stq(fev_fiber_stq_head_t *fibers, uint32_t num_f
   fev_wake_stq(fev_cur_sched_worker, fibers, num_fibers);
 }
 
+/* Whether the primitives that support it switch directly to a woken fiber. */
+#ifdef FEV_DIRECT_SWITCH_ON_WAKE
+#define FEV_WAKE_DIRECT_SWITCH true
+#else
+#define FEV_WAKE_DIRECT_SWITCH false
+#endif
+
+/*
+ * Maximum number of consecutive direct switches on a worker. After that, the woken fiber goes to
+ * the run queue, so that fibers handing off to each other don't starve the rest of the run queue,
+ * the poller and the timers.
+ */
+#define FEV_MAX_DIRECT_SWITCHES 64
+
+/*
+ * Wakes up `fiber` and switches to it right away, skipping the run queue. The current fiber is
+ * pushed to the run queue after its context is saved. If not called from a stackful fiber (or the
+ * target is stackless), the fiber is just woken up. This must be called only when the current fiber
+ * could yield, i.e. without any waiters queue lock held and without registered waiters.
+ */
+FEV_NONNULL(1) void fev_cur_switch_to(struct fev_fiber *fiber);
+
+/*
+ * Like fev_cur_wake_stq(), but if `direct_switch` is true and there is only one fiber, switches to
+ * it with fev_cur_switch_to().
+ */
+FEV_NONNULL(1)
+static inline void fev_cur_wake_stq_or_switch(fev_fiber_stq_head_t *fibers, uint32_t num_fibers,
+                                              bool direct_switch)
+{
+  if (direct_switch && num_fibers == 1)
+    fev_cur_switch_to(STAILQ_FIRST(fibers));
+  else
+    fev_cur_wake_stq(fibers, num_fibers);
+}
+
 FEV_NONNULL(1) static inline bool fev_sched_is_running(struct fev_sched *sched)
 {
   return sched->start_sem != NULL;
@@ -84,4 +120,18 @@ FEV_NONNULL(1) static inline bool fev_sched_is_running(struct fev_sched *sched)
 
 static inline struct fev_fiber *fev_cur_fiber(void) { return fev_cur_sched_worker->cur_fiber; }
 
+/* Switches from the scheduler to the fiber, called in fev_sched_work(). */
+FEV_NONNULL(1, 2)
+static inline void fev_switch_to_fiber(struct fev_sched_worker *worker, struct fev_fiber *fiber)
+{
+  worker->cur_fiber = fiber;
+  worker->num_direct_switches = 0;
+
+  /* A stackless fiber that is not in the middle of a resume needs a stack to run on. */
+  if (FEV_UNLIKELY(fiber->stack_addr == NULL))
+    fev_stackless_prepare(fiber);
+
+  fev_context_switch(&worker->context, &fiber->context);
+}
+
 #endif /* !FEV_SCHED_IMPL_H */
@@ -26,6 +26,8 @@
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
+#include "fev_rcu_impl.h"
+#include "fev_remote_impl.h"
 #include "fev_thr_mutex.h"
 #include "fev_thr_sem.h"
 
@@ -84,8 +86,7 @@ FEV_HOT FEV_NOINLINE FEV_NONNULL(1) void fev_sched_work(struct fev_sched_worker
   goto get_fiber;
 
 switch_to_fiber:
-  cur_worker->cur_fiber = cur_fiber;
-  fev_context_switch(&cur_worker->context, &cur_fiber->context);
+  fev_switch_to_fiber(cur_worker, cur_fiber);
 
   backoff = atomic_fetch_sub_explicit(&sched->poller_backoff, 1, memory_order_relaxed);
   if (FEV_UNLIKELY(backoff == 1))
@@ -98,6 +99,8 @@ get_fiber:;
 
 check_poller:
   fev_poller_check(cur_worker);
+  fev_remote_check(cur_worker);
+  fev_rcu_quiescent(cur_worker);
 
   if (atomic_load_explicit(&sched->fallback_queue_len, memory_order_relaxed) > 0)
     fev_move_from_fallback(sched);
@@ -114,6 +117,9 @@ check_poller:
 
   /* Wait. */
 
+  if (FEV_UNLIKELY(!fev_rcu_offline(cur_worker)))
+    goto check_poller;
+
   atomic_fetch_add(&sched->num_waiting, 1);
 
 #ifdef FEV_POLLER_IO_URING
@@ -130,6 +136,7 @@ check_poller:
 #endif
 
   atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+  fev_rcu_online(cur_worker);
 
   goto get_fiber;
 
@@ -17,14 +17,21 @@
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
+#include "fev_rcu_intf.h"
+#include "fev_remote_intf.h"
 #include "fev_thr_mutex.h"
 #include "fev_thr_sem.h"
 #include "fev_timers.h"
 
 struct fev_sched_worker {
   alignas(FEV_DCACHE_LINE_SIZE) struct fev_fiber *cur_fiber;
+
+  /* Number of direct switches since the scheduler last ran a fiber, see fev_cur_switch_to(). */
+  uint32_t num_direct_switches;
+
   struct fev_context context;
   struct fev_worker_poller_data poller_data;
+  struct fev_worker_rcu_data rcu_data;
   struct fev_sched *sched;
 };
 
@@ -45,6 +52,8 @@ struct fev_sched {
 
   struct fev_poller poller;
   struct fev_timers timers;
+  struct fev_rcu rcu;
+  struct fev_remote remote;
 
   struct fev_thr_sem sem;
 
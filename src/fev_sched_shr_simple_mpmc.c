@@ -23,6 +23,8 @@
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
+#include "fev_rcu_impl.h"
+#include "fev_remote_impl.h"
 #include "fev_simple_mpmc_pool.h"
 #include "fev_simple_mpmc_queue.h"
 #include "fev_thr_sem.h"
@@ -45,8 +47,7 @@ FEV_HOT FEV_NOINLINE FEV_NONNULL(1) void fev_sched_work(struct fev_sched_worker
   goto get_fiber;
 
 switch_to_fiber:
-  cur_worker->cur_fiber = cur_fiber;
-  fev_context_switch(&cur_worker->context, &cur_fiber->context);
+  fev_switch_to_fiber(cur_worker, cur_fiber);
 
   backoff = atomic_fetch_sub_explicit(&sched->poller_backoff, 1, memory_order_relaxed);
   if (FEV_UNLIKELY(backoff == 1))
@@ -62,6 +63,8 @@ get_fiber:;
 
 check_poller:
   fev_poller_check(cur_worker);
+  fev_remote_check(cur_worker);
+  fev_rcu_quiescent(cur_worker);
 
   num_run_fibers = atomic_load_explicit(&sched->num_run_fibers, memory_order_relaxed);
   atomic_store_explicit(&sched->poller_backoff, num_run_fibers, memory_order_relaxed);
@@ -75,6 +78,9 @@ check_poller:
 
   /* Wait. */
 
+  if (FEV_UNLIKELY(!fev_rcu_offline(cur_worker)))
+    goto check_poller;
+
   atomic_fetch_add(&sched->num_waiting, 1);
 
 #ifdef FEV_POLLER_IO_URING
@@ -91,6 +97,7 @@ check_poller:
 #endif
 
   atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+  fev_rcu_online(cur_worker);
 
   goto get_fiber;
 
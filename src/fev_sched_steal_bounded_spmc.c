@@ -26,6 +26,8 @@
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
+#include "fev_rcu_impl.h"
+#include "fev_remote_impl.h"
 #include "fev_thr_mutex.h"
 #include "fev_thr_sem.h"
 #include "fev_util.h"
@@ -141,8 +143,7 @@ FEV_HOT FEV_NOINLINE FEV_NONNULL(1) void fev_sched_work(struct fev_sched_worker
   goto get_local;
 
 switch_to_fiber:
-  cur_worker->cur_fiber = cur_fiber;
-  fev_context_switch(&cur_worker->context, &cur_fiber->context);
+  fev_switch_to_fiber(cur_worker, cur_fiber);
 
   if (FEV_UNLIKELY(backoff == 0))
     goto get_global;
@@ -156,6 +157,8 @@ get_local:;
 
 get_global:
   fev_poller_check(cur_worker);
+  fev_remote_check(cur_worker);
+  fev_rcu_quiescent(cur_worker);
 
   if (atomic_load_explicit(&sched->fallback_queue_len, memory_order_relaxed) > 0)
     fev_move_from_fallback(cur_worker);
@@ -191,6 +194,9 @@ get_global:
 
   /* Try to sleep. */
 
+  if (FEV_UNLIKELY(!fev_rcu_offline(cur_worker)))
+    goto get_global;
+
   bool poller_waiting = atomic_exchange(&sched->poller_waiting, true);
 
   num_waiting = atomic_fetch_add(&sched->num_waiting, 1);
@@ -200,12 +206,14 @@ get_global:
     if (!poller_waiting)
       atomic_store(&sched->poller_waiting, false);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
     goto get_global;
   }
 
 #ifdef FEV_POLLER_IO_URING
   fev_poller_wait(cur_worker);
   atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+  fev_rcu_online(cur_worker);
   backoff = fev_bounded_spmc_queue_size(run_queue);
   goto get_local;
 #else
@@ -214,6 +222,7 @@ get_global:
 
     atomic_store_explicit(&sched->poller_waiting, false, memory_order_relaxed);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
 
     backoff = fev_bounded_spmc_queue_size(&cur_worker->run_queue);
     goto get_local;
@@ -221,6 +230,7 @@ get_global:
     fev_poller_quiescent(cur_worker);
     fev_thr_sem_wait(&sched->sem);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
     goto get_global;
   }
 #endif
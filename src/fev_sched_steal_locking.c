@@ -24,6 +24,8 @@
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
+#include "fev_rcu_impl.h"
+#include "fev_remote_impl.h"
 #include "fev_spinlock_impl.h"
 #include "fev_thr_mutex.h"
 #include "fev_thr_sem.h"
@@ -115,8 +117,7 @@ FEV_HOT FEV_NOINLINE FEV_NONNULL(1) void fev_sched_work(struct fev_sched_worker
   goto get_local;
 
 switch_to_fiber:
-  cur_worker->cur_fiber = cur_fiber;
-  fev_context_switch(&cur_worker->context, &cur_fiber->context);
+  fev_switch_to_fiber(cur_worker, cur_fiber);
 
   if (backoff == 0)
     goto get_global;
@@ -139,6 +140,8 @@ get_local:
 
 get_global:
   fev_poller_check(cur_worker);
+  fev_remote_check(cur_worker);
+  fev_rcu_quiescent(cur_worker);
 
   backoff = atomic_load_explicit(&run_queue->size, memory_order_relaxed);
   if (backoff > 0)
@@ -171,6 +174,9 @@ get_global:
 
   /* Try to sleep. */
 
+  if (FEV_UNLIKELY(!fev_rcu_offline(cur_worker)))
+    goto get_global;
+
   bool poller_waiting = atomic_exchange(&sched->poller_waiting, true);
 
   num_waiting = atomic_fetch_add(&sched->num_waiting, 1);
@@ -180,12 +186,14 @@ get_global:
     if (!poller_waiting)
       atomic_store(&sched->poller_waiting, false);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
     goto get_global;
   }
 
 #ifdef FEV_POLLER_IO_URING
   fev_poller_wait(cur_worker);
   atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+  fev_rcu_online(cur_worker);
   backoff = atomic_load_explicit(&run_queue->size, memory_order_relaxed);
   goto get_local;
 #else
@@ -194,6 +202,7 @@ get_global:
 
     atomic_store_explicit(&sched->poller_waiting, false, memory_order_relaxed);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
 
     backoff = atomic_load_explicit(&run_queue->size, memory_order_relaxed);
     goto get_local;
@@ -201,6 +210,7 @@ get_global:
     fev_poller_quiescent(cur_worker);
     fev_thr_sem_wait(&sched->sem);
     atomic_fetch_sub_explicit(&sched->num_waiting, 1, memory_order_relaxed);
+    fev_rcu_online(cur_worker);
     goto get_global;
   }
 #endif
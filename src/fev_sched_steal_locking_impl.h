@@ -20,6 +20,7 @@
 #include "fev_assert.h"
 #include "fev_compiler.h"
 #include "fev_fiber.h"
+#include "fev_mcs_lock_impl.h"
 #include "fev_spinlock_impl.h"
 #include "fev_thr_mutex.h"
 
@@ -35,6 +36,12 @@
 #define fev_sched_run_queue_lock fev_spinlock_lock
 #define fev_sched_run_queue_try_lock fev_spinlock_try_lock
 #define fev_sched_run_queue_unlock fev_spinlock_unlock
+#elif defined(FEV_SCHED_STEAL_LOCKING_LOCK_MCS)
+#define fev_sched_run_queue_lock_init fev_mcs_lock_init
+#define fev_sched_run_queue_lock_fini fev_mcs_lock_fini
+#define fev_sched_run_queue_lock fev_mcs_lock_lock
+#define fev_sched_run_queue_try_lock fev_mcs_lock_try_lock
+#define fev_sched_run_queue_unlock fev_mcs_lock_unlock
 #endif
 
 FEV_NONNULL(1, 2)
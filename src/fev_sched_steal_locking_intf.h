@@ -16,7 +16,10 @@
 
 #include "fev_context.h"
 #include "fev_fiber.h"
+#include "fev_mcs_lock_intf.h"
 #include "fev_poller.h"
+#include "fev_rcu_intf.h"
+#include "fev_remote_intf.h"
 #include "fev_spinlock_intf.h"
 #include "fev_thr_mutex.h"
 #include "fev_thr_sem.h"
@@ -26,9 +29,12 @@
 typedef struct fev_thr_mutex fev_sched_run_queue_lock_t;
 #elif defined(FEV_SCHED_STEAL_LOCKING_LOCK_SPINLOCK)
 typedef struct fev_spinlock fev_sched_run_queue_lock_t;
+#elif defined(FEV_SCHED_STEAL_LOCKING_LOCK_MCS)
+typedef struct fev_mcs_lock fev_sched_run_queue_lock_t;
 #else
 #error Wrong lock strategy for sched stealing locking selected, define either \
-        FEV_SCHED_STEAL_LOCKING_LOCK_MUTEX or FEV_SCHED_STEAL_LOCKING_LOCK_SPINLOCK.
+        FEV_SCHED_STEAL_LOCKING_LOCK_MUTEX, FEV_SCHED_STEAL_LOCKING_LOCK_SPINLOCK or \
+        FEV_SCHED_STEAL_LOCKING_LOCK_MCS.
 #endif
 
 struct fev_sched_run_queue {
@@ -39,8 +45,13 @@ struct fev_sched_run_queue {
 
 struct fev_sched_worker {
   alignas(FEV_DCACHE_LINE_SIZE) struct fev_fiber *cur_fiber;
+
+  /* Number of direct switches since the scheduler last ran a fiber, see fev_cur_switch_to(). */
+  uint32_t num_direct_switches;
+
   struct fev_context context;
   struct fev_worker_poller_data poller_data;
+  struct fev_worker_rcu_data rcu_data;
   struct fev_sched *sched;
   uint32_t rnd;
 
@@ -62,6 +73,8 @@ struct fev_sched {
 
   struct fev_poller poller;
   struct fev_timers timers;
+  struct fev_rcu rcu;
+  struct fev_remote remote;
 
   struct fev_thr_sem sem;
 
@@ -0,0 +1,424 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include <fev/fev.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_chan.h"
+#include "fev_compiler.h"
+#include "fev_cond_intf.h"
+#include "fev_mutex_impl.h"
+#include "fev_sched_impl.h"
+#include "fev_sem.h"
+#include "fev_socket.h"
+#include "fev_time.h"
+#include "fev_timers.h"
+#include "fev_waiter_impl.h"
+#include "fev_waiters_queue_impl.h"
+
+/*
+ * fev_select() registers a waiter in each source, the waiters share the claim word of one parent
+ * waiter (see `parent` in struct fev_waiter). The fiber waits on the parent, the first source that
+ * manages to claim it wakes the fiber up, the wake ups of the other sources fail as if the fiber
+ * was not waiting. If a source is ready during the registration, the fiber claims the parent
+ * itself and doesn't wait.
+ */
+
+/* Number of registrations that are kept on the stack. */
+#define FEV_SELECT_NUM_INLINE_ENTRIES 8
+
+struct fev_select_entry {
+  /* Only the waiter is used by socket cases. */
+  struct fev_waiters_queue_node node;
+
+  /* Is the node in a waiters queue (or the waiter registered in a socket)? */
+  bool registered;
+};
+
+struct fev_select {
+  struct fev_select_case *cases;
+  struct fev_select_entry *entries;
+  struct fev_waiter parent;
+
+  /* Index of the case that is being registered. */
+  size_t cur;
+
+  /* Index of the case that was ready during the registration or -1. */
+  int claimed;
+};
+
+/* Claims the parent for the current case, fails if another source has woken the fiber up. */
+FEV_NONNULL(1) static bool fev_select_claim(struct fev_select *select)
+{
+  if (!fev_waiter_set_reason(&select->parent, FEV_WAITER_READY))
+    return false;
+
+  select->claimed = (int)select->cur;
+  return true;
+}
+
+/*
+ * The recheck functions are called under the lock of a waiters queue. Like in fev_sem_wait() or
+ * fev_chan_recv(), they return true if the fiber should wait. If the source is ready, they claim
+ * the parent and perform the operation.
+ */
+
+static bool fev_select_sem_recheck(void *arg)
+{
+  struct fev_select *select = arg;
+  struct fev_sem *sem = select->cases[select->cur].sem;
+
+  /* Like fev_sem_wait(), don't overtake the fibers that are already waiting. */
+  if (sem->value <= 0 || !TAILQ_EMPTY(&sem->wq.nodes))
+    return true;
+
+  if (fev_select_claim(select))
+    sem->value--;
+
+  return false;
+}
+
+static bool fev_select_recv_recheck(void *arg)
+{
+  struct fev_select *select = arg;
+  struct fev_select_case *c = &select->cases[select->cur];
+  struct fev_chan *chan = c->chan;
+
+  if (fev_bounded_mpmc_queue_size(&chan->queue) == 0 &&
+      !atomic_load_explicit(&chan->closed, memory_order_acquire)) {
+    return true;
+  }
+
+  /* The size is only a hint, -EAGAIN is handled like a spurious wake up. */
+  if (fev_select_claim(select))
+    c->result = fev_chan_try_recv_nowake(chan, &c->elem);
+
+  return false;
+}
+
+static bool fev_select_send_recheck(void *arg)
+{
+  struct fev_select *select = arg;
+  struct fev_select_case *c = &select->cases[select->cur];
+  struct fev_chan *chan = c->chan;
+
+  if (fev_bounded_mpmc_queue_size(&chan->queue) > chan->queue.buffer_mask &&
+      !atomic_load_explicit(&chan->closed, memory_order_acquire)) {
+    return true;
+  }
+
+  if (fev_select_claim(select))
+    c->result = fev_chan_try_send_nowake(chan, c->elem);
+
+  return false;
+}
+
+/* Checks the cases, returns the mutex of the condition variable cases via `mutex_ptr`. */
+FEV_NONNULL(1, 3)
+static int fev_select_check_cases(const struct fev_select_case *cases, size_t num_cases,
+                                  struct fev_mutex **mutex_ptr)
+{
+  struct fev_mutex *mutex = NULL;
+
+  if (FEV_UNLIKELY(num_cases == 0 || num_cases > INT_MAX))
+    return -EINVAL;
+
+  for (size_t i = 0; i < num_cases; i++) {
+    const struct fev_select_case *c = &cases[i];
+
+    switch (c->op) {
+    case FEV_SELECT_READ:
+    case FEV_SELECT_WRITE:
+    case FEV_SELECT_RECV:
+    case FEV_SELECT_SEND:
+    case FEV_SELECT_SEM_WAIT:
+      break;
+
+    case FEV_SELECT_COND_WAIT:
+      if (FEV_UNLIKELY(c->mutex == NULL || (mutex != NULL && c->mutex != mutex)))
+        return -EINVAL;
+      mutex = c->mutex;
+      break;
+
+    default:
+      return -EINVAL;
+    }
+  }
+
+  *mutex_ptr = mutex;
+  return 0;
+}
+
+/*
+ * Registers the current case. Returns 0 on success (also if the case was ready) or a negative error
+ * code.
+ */
+FEV_NONNULL(1) static int fev_select_register(struct fev_select *select)
+{
+  struct fev_select_case *c = &select->cases[select->cur];
+  struct fev_select_entry *entry = &select->entries[select->cur];
+  struct fev_fiber *fiber = select->parent.fiber;
+  struct fev_waiter *waiter;
+  int ret;
+
+  switch (c->op) {
+  case FEV_SELECT_READ:
+  case FEV_SELECT_WRITE:
+    /* The stores are published by the store of the waiter in fev_socket_select_register(). */
+    waiter = &entry->node.waiter;
+    atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);
+    waiter->fiber = fiber;
+    waiter->cancelable = false;
+    waiter->parent = &select->parent;
+
+    ret = fev_socket_select_register(c->socket, c->op == FEV_SELECT_WRITE, waiter);
+    if (FEV_UNLIKELY(ret < 0))
+      return ret;
+
+    entry->registered = true;
+    if (ret > 0)
+      fev_select_claim(select);
+    return 0;
+
+  case FEV_SELECT_RECV:
+    /* See fev_chan.c, the senders wake up the receivers only if they see them. */
+    atomic_fetch_add_explicit(&c->chan->num_receivers, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    entry->registered =
+        fev_waiters_queue_push(&c->chan->recv_wq, &entry->node, fiber, /*cancelable=*/false,
+                               &select->parent, &fev_select_recv_recheck, select);
+    return 0;
+
+  case FEV_SELECT_SEND:
+    atomic_fetch_add_explicit(&c->chan->num_senders, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    entry->registered =
+        fev_waiters_queue_push(&c->chan->send_wq, &entry->node, fiber, /*cancelable=*/false,
+                               &select->parent, &fev_select_send_recheck, select);
+    return 0;
+
+  case FEV_SELECT_SEM_WAIT:
+    entry->registered =
+        fev_waiters_queue_push(&c->sem->wq, &entry->node, fiber, /*cancelable=*/false,
+                               &select->parent, &fev_select_sem_recheck, select);
+    return 0;
+
+  case FEV_SELECT_COND_WAIT:
+    /* The mutex is still locked, thus the notifications sent after checking the predicate count. */
+    entry->registered =
+        fev_waiters_queue_push(&c->cond->wq, &entry->node, fiber, /*cancelable=*/false,
+                               &select->parent, /*recheck=*/NULL, /*recheck_arg=*/NULL);
+    return 0;
+  }
+
+  FEV_UNREACHABLE();
+}
+
+/*
+ * Unregisters the case `index` after fev_select_register() has been called for it. Returns true if
+ * the case has woken up the fiber.
+ */
+FEV_NONNULL(1) static bool fev_select_unregister(struct fev_select *select, size_t index)
+{
+  struct fev_select_case *c = &select->cases[index];
+  struct fev_select_entry *entry = &select->entries[index];
+
+  switch (c->op) {
+  case FEV_SELECT_READ:
+  case FEV_SELECT_WRITE:
+    if (entry->registered)
+      fev_socket_select_unregister(c->socket, c->op == FEV_SELECT_WRITE, &entry->node.waiter);
+    break;
+
+  case FEV_SELECT_RECV:
+    if (entry->registered)
+      fev_waiters_queue_remove(&c->chan->recv_wq, &entry->node);
+    atomic_fetch_sub_explicit(&c->chan->num_receivers, 1, memory_order_relaxed);
+    break;
+
+  case FEV_SELECT_SEND:
+    if (entry->registered)
+      fev_waiters_queue_remove(&c->chan->send_wq, &entry->node);
+    atomic_fetch_sub_explicit(&c->chan->num_senders, 1, memory_order_relaxed);
+    break;
+
+  case FEV_SELECT_SEM_WAIT:
+    if (entry->registered)
+      fev_waiters_queue_remove(&c->sem->wq, &entry->node);
+    break;
+
+  case FEV_SELECT_COND_WAIT:
+    if (entry->registered)
+      fev_waiters_queue_remove(&c->cond->wq, &entry->node);
+    break;
+  }
+
+  /* Nobody accesses the waiter now, FEV_WAITER_WON is set only if the case claimed the parent. */
+  return entry->registered && (atomic_load_explicit(&entry->node.waiter.state,
+                                                    memory_order_relaxed) &
+                               FEV_WAITER_WON) != 0;
+}
+
+/*
+ * Finishes the case `index` that has won. Returns 0 or -EAGAIN if the fiber was woken up
+ * spuriously.
+ */
+FEV_NONNULL(1) static int fev_select_finish(struct fev_select *select, int index)
+{
+  struct fev_select_case *c = &select->cases[index];
+
+  switch (c->op) {
+  case FEV_SELECT_RECV:
+    if (index == select->claimed) {
+      if (c->result == 0)
+        fev_chan_wake_senders(c->chan, /*max_waiters=*/1);
+    } else {
+      c->result = fev_chan_try_recv(c->chan, &c->elem);
+    }
+    return c->result == -EAGAIN ? -EAGAIN : 0;
+
+  case FEV_SELECT_SEND:
+    if (index == select->claimed) {
+      if (c->result == 0)
+        fev_chan_wake_receivers(c->chan, /*max_waiters=*/1);
+    } else {
+      c->result = fev_chan_try_send(c->chan, c->elem);
+    }
+    return c->result == -EAGAIN ? -EAGAIN : 0;
+
+  default:
+    /* A semaphore hands the unit over to the woken fiber, the other sources are just ready. */
+    c->result = 0;
+    return 0;
+  }
+}
+
+FEV_NONNULL(1)
+static int fev_select_common(struct fev_select_case *cases, size_t num_cases,
+                             const struct timespec *abs_time)
+{
+  struct fev_select_entry inline_entries[FEV_SELECT_NUM_INLINE_ENTRIES];
+  struct fev_select select;
+  struct fev_waiter *parent = &select.parent;
+  struct fev_mutex *mutex;
+  size_t num_registered;
+  int winner, res;
+
+  res = fev_select_check_cases(cases, num_cases, &mutex);
+  if (FEV_UNLIKELY(res != 0))
+    return res;
+
+  select.cases = cases;
+  select.entries = inline_entries;
+  if (num_cases > FEV_SELECT_NUM_INLINE_ENTRIES) {
+    select.entries = fev_malloc(num_cases * sizeof(*select.entries));
+    if (FEV_UNLIKELY(select.entries == NULL))
+      return -ENOMEM;
+  }
+
+  parent->fiber = fev_cur_fiber();
+  parent->cancelable = true;
+  parent->parent = NULL;
+
+  for (;;) {
+    bool waited = false;
+
+    /*
+     * Prepare the parent. The stores can be relaxed, as the registrations are published with
+     * release barriers below.
+     */
+    atomic_store_explicit(&parent->state, FEV_WAITER_NONE, memory_order_relaxed);
+    select.claimed = -1;
+
+    /* Register the cases, stop if a source is ready or has already woken us up. */
+    res = 0;
+    for (num_registered = 0; num_registered < num_cases; num_registered++) {
+      select.cur = num_registered;
+      res = fev_select_register(&select);
+      if (FEV_UNLIKELY(res != 0))
+        break;
+
+      if (fev_waiter_load_reason(parent) != FEV_WAITER_NONE) {
+        num_registered++;
+        break;
+      }
+    }
+
+    if (res == 0 && num_registered == num_cases &&
+        fev_waiter_load_reason(parent) == FEV_WAITER_NONE) {
+      /* The waiters are registered, the fiber cannot be switched. */
+      if (mutex != NULL)
+        fev_mutex_unlock_impl(mutex, /*direct_switch=*/false);
+      waited = true;
+
+      if (abs_time == NULL) {
+        res = fev_waiter_wait(parent) == FEV_WAITER_CANCELED ? -ECANCELED : 0;
+      } else {
+        res = fev_timed_wait(parent, abs_time);
+      }
+    }
+
+    winner = select.claimed;
+    for (size_t i = 0; i < num_registered; i++) {
+      if (fev_select_unregister(&select, i)) {
+        FEV_ASSERT(winner < 0);
+        winner = (int)i;
+      }
+    }
+
+    if (waited && mutex != NULL)
+      fev_mutex_lock(mutex);
+
+    /* The won case must be finished even if the wait has failed, a semaphore unit is ours. */
+    if (winner >= 0 && fev_select_finish(&select, winner) == 0) {
+      res = winner;
+      break;
+    }
+
+    if (FEV_UNLIKELY(res != 0 && res != -EAGAIN))
+      break;
+
+    /* Spurious wake up, try again. */
+  }
+
+  if (select.entries != inline_entries)
+    fev_free(select.entries);
+
+  return res;
+}
+
+FEV_NONNULL(1) int fev_select(struct fev_select_case *cases, size_t num_cases)
+{
+  return fev_select_common(cases, num_cases, /*abs_time=*/NULL);
+}
+
+FEV_NONNULL(1, 3)
+int fev_select_until(struct fev_select_case *cases, size_t num_cases,
+                     const struct timespec *abs_time)
+{
+  return fev_select_common(cases, num_cases, abs_time);
+}
+
+FEV_NONNULL(1, 3)
+int fev_select_for(struct fev_select_case *cases, size_t num_cases,
+                   const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_select_until(cases, num_cases, &abs_time);
+}
@@ -10,16 +10,43 @@
 #include "fev_sem.h"
 
 #include <errno.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include <queue.h>
+
 #include "fev_alloc.h"
 #include "fev_assert.h"
 #include "fev_compiler.h"
+#include "fev_remote_impl.h"
+#include "fev_sched_impl.h"
+#include "fev_stackless.h"
 #include "fev_time.h"
+#include "fev_util.h"
 #include "fev_waiters_queue_impl.h"
 
+/* Runs in a worker, adds the units posted from outside of the scheduler. */
+FEV_NONNULL(1) static void fev_sem_remote_post(struct fev_remote_entry *entry)
+{
+  struct fev_sem *sem = FEV_CONTAINER_OF(entry, struct fev_sem, remote_entry);
+  uint32_t n;
+
+  /* The entry can be submitted again from now on. */
+  n = atomic_exchange_explicit(&sem->num_remote_units, 0, memory_order_acquire);
+  FEV_ASSERT(n > 0);
+
+  /*
+   * This is the scheduler context, there is no fiber that could block on the lock. If the lock is
+   * held, the units are given back and the entry is submitted again, unless a post has done it.
+   */
+  if (FEV_UNLIKELY(!fev_waiters_queue_try_wake_units(&sem->wq, &sem->value, n))) {
+    if (atomic_fetch_add_explicit(&sem->num_remote_units, n, memory_order_release) == 0)
+      fev_remote_push(fev_cur_sched_worker->sched, &sem->remote_entry);
+  }
+}
+
 FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT static int fev_sem_init(struct fev_sem *sem, int32_t value)
 {
   int ret = fev_waiters_queue_init(&sem->wq);
@@ -27,6 +54,8 @@ FEV_NONNULL(1) FEV_WARN_UNUSED_RESULT static int fev_sem_init(struct fev_sem *se
     return ret;
 
   sem->value = value;
+  atomic_init(&sem->num_remote_units, 0);
+  sem->remote_entry.func = &fev_sem_remote_post;
   return 0;
 }
 
@@ -57,11 +86,15 @@ FEV_NONNULL(1) void fev_sem_destroy(struct fev_sem *sem)
   fev_free(sem);
 }
 
+/*
+ * The waiters are served in FIFO order, a fiber doesn't take units if some fibers are already
+ * waiting. Otherwise, a waiter of fev_sem_wait_n() could be starved by smaller requests.
+ */
 static bool fev_sem_wait_recheck(void *arg)
 {
   struct fev_sem *sem = arg;
 
-  if (sem->value > 0) {
+  if (sem->value > 0 && TAILQ_EMPTY(&sem->wq.nodes)) {
     sem->value--;
     return false;
   }
@@ -69,11 +102,71 @@ static bool fev_sem_wait_recheck(void *arg)
   return true;
 }
 
-FEV_NONNULL(1) void fev_sem_wait(struct fev_sem *sem)
+struct fev_sem_wait_n_recheck_arg {
+  struct fev_sem *sem;
+  struct fev_waiters_queue_node *node;
+  uint32_t n;
+};
+
+static bool fev_sem_wait_n_recheck(void *arg)
 {
-  int res = fev_waiters_queue_wait(&sem->wq, /*abs_time=*/NULL, &fev_sem_wait_recheck, sem);
-  (void)res;
-  FEV_ASSERT(res == 0);
+  struct fev_sem_wait_n_recheck_arg *recheck_arg = arg;
+  struct fev_sem *sem = recheck_arg->sem;
+  uint32_t n = recheck_arg->n;
+
+  if (sem->value >= (int32_t)n && TAILQ_EMPTY(&sem->wq.nodes)) {
+    sem->value -= (int32_t)n;
+    return false;
+  }
+
+  recheck_arg->node->count = n;
+  return true;
+}
+
+FEV_NONNULL(1)
+static int fev_sem_wait_n_until(struct fev_sem *sem, uint32_t n, const struct timespec *abs_time)
+{
+  struct fev_sem_wait_n_recheck_arg recheck_arg;
+  struct fev_waiters_queue_node node;
+  int res;
+
+  if (FEV_UNLIKELY(n > INT32_MAX))
+    return -EINVAL;
+
+  recheck_arg.sem = sem;
+  recheck_arg.node = &node;
+  recheck_arg.n = n;
+
+  do {
+    res = fev_waiters_queue_wait_node(&sem->wq, &node, abs_time, /*cancelable=*/true,
+                                      &fev_sem_wait_n_recheck, &recheck_arg);
+    if (res == 0)
+      return 0;
+
+    /* We might have been blocking smaller requests, which can be satisfied now. */
+    fev_waiters_queue_wake_units(&sem->wq, &sem->value, /*units=*/0,
+                                 /*direct_switch=*/false);
+  } while (res == -EAGAIN);
+
+  return res;
+}
+
+FEV_NONNULL(1) int fev_sem_wait(struct fev_sem *sem)
+{
+  int res = fev_waiters_queue_wait(&sem->wq, /*abs_time=*/NULL, /*cancelable=*/true,
+                                   &fev_sem_wait_recheck, sem);
+  FEV_ASSERT(res == 0 || res == -ECANCELED);
+  return res;
+}
+
+FEV_NONNULL(1) int fev_sem_wait_n(struct fev_sem *sem, uint32_t n)
+{
+  return fev_sem_wait_n_until(sem, n, /*abs_time=*/NULL);
+}
+
+FEV_NONNULL(1) int fev_stackless_sem_wait(struct fev_sem *sem)
+{
+  return fev_stackless_wait_queue(&sem->wq, &fev_sem_wait_recheck, sem);
 }
 
 FEV_NONNULL(1, 2) int fev_sem_wait_until(struct fev_sem *sem, const struct timespec *abs_time)
@@ -81,7 +174,8 @@ FEV_NONNULL(1, 2) int fev_sem_wait_until(struct fev_sem *sem, const struct times
   int res;
 
   do {
-    res = fev_waiters_queue_wait(&sem->wq, abs_time, &fev_sem_wait_recheck, sem);
+    res = fev_waiters_queue_wait(&sem->wq, abs_time, /*cancelable=*/true, &fev_sem_wait_recheck,
+                                 sem);
   } while (res == -EAGAIN);
 
   return res;
@@ -95,19 +189,26 @@ FEV_NONNULL(1, 2) int fev_sem_wait_for(struct fev_sem *sem, const struct timespe
   return fev_sem_wait_until(sem, &abs_time);
 }
 
-static void fev_sem_post_callback(void *arg, uint32_t num_woken, bool is_empty)
+FEV_NONNULL(1) void fev_sem_post(struct fev_sem *sem)
 {
-  struct fev_sem *sem = arg;
-
-  (void)is_empty;
-
-  FEV_ASSERT(num_woken <= 1);
+  fev_waiters_queue_wake_units(&sem->wq, &sem->value, /*units=*/1, FEV_WAKE_DIRECT_SWITCH);
+}
 
-  if (num_woken == 0)
-    sem->value++;
+FEV_NONNULL(1) void fev_sem_post_n(struct fev_sem *sem, uint32_t n)
+{
+  fev_waiters_queue_wake_units(&sem->wq, &sem->value, n, FEV_WAKE_DIRECT_SWITCH);
 }
 
-FEV_NONNULL(1) void fev_sem_post(struct fev_sem *sem)
+FEV_NONNULL(1, 2) void fev_sem_post_from_thread(struct fev_sem *sem, struct fev_sched *sched)
 {
-  fev_waiters_queue_wake(&sem->wq, /*max_waiters=*/1, &fev_sem_post_callback, sem);
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+
+  if (cur_worker != NULL && cur_worker->sched == sched) {
+    fev_sem_post(sem);
+    return;
+  }
+
+  /* Only the first pending post submits the entry, the next ones are added together with it. */
+  if (atomic_fetch_add_explicit(&sem->num_remote_units, 1, memory_order_release) == 0)
+    fev_remote_push(sched, &sem->remote_entry);
 }
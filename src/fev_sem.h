@@ -12,13 +12,19 @@
 
 #include <fev/fev.h>
 
+#include <stdatomic.h>
 #include <stdint.h>
 
+#include "fev_remote_intf.h"
 #include "fev_waiters_queue_intf.h"
 
 struct fev_sem {
   int32_t value;
   struct fev_waiters_queue wq;
+
+  /* Units posted from outside of the scheduler, see fev_sem_post_from_thread(). */
+  _Atomic uint32_t num_remote_units;
+  struct fev_remote_entry remote_entry;
 };
 
 #endif /* !FEV_SEM_H */
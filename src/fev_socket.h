@@ -12,10 +12,27 @@
 
 #include <fev/fev.h>
 
+#include <stdbool.h>
+
+#include "fev_compiler.h"
+#include "fev_waiter_intf.h"
+
 #ifdef FEV_POLLER_IO_URING
 #include "fev_socket_io_uring.h"
 #else
 #include "fev_socket_reactor.h"
 #endif
 
+/*
+ * Registers `waiter` of fev_select() in the read or write end of `socket`. The waiter must be
+ * prepared by the caller. Returns 1 if the end is ready already, 0 if it is not, or a negative
+ * error code. The waiter must be unregistered unless an error is returned.
+ */
+FEV_NONNULL(1, 3)
+int fev_socket_select_register(struct fev_socket *socket, bool write, struct fev_waiter *waiter);
+
+/* Unregisters `waiter`, waits for the poller if it is waking the waiter up right now. */
+FEV_NONNULL(1, 3)
+void fev_socket_select_unregister(struct fev_socket *socket, bool write, struct fev_waiter *waiter);
+
 #endif /* !FEV_SOCKET_H */
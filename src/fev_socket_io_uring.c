@@ -316,3 +316,61 @@ ssize_t fev_socket_try_write_until(struct fev_socket *socket, const void *buffer
   fev_timespec_abs_to_rel(&rel_time, abs_time);
   return fev_socket_try_write_for(socket, buffer, size, &rel_time);
 }
+
+/* The stackless fibers cannot wait for the submitted operations, see fev.h. */
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_accept(struct fev_socket *socket, struct fev_socket *new_socket,
+                                struct sockaddr *address, socklen_t *address_len)
+{
+  (void)socket;
+  (void)new_socket;
+  (void)address;
+  (void)address_len;
+  return -ENOSYS;
+}
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_connect(struct fev_socket *socket, struct sockaddr *address,
+                                 socklen_t address_len)
+{
+  (void)socket;
+  (void)address;
+  (void)address_len;
+  return -ENOSYS;
+}
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_read(struct fev_socket *socket, void *buffer, size_t size)
+{
+  (void)socket;
+  (void)buffer;
+  (void)size;
+  return -ENOSYS;
+}
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_write(struct fev_socket *socket, const void *buffer, size_t size)
+{
+  (void)socket;
+  (void)buffer;
+  (void)size;
+  return -ENOSYS;
+}
+
+FEV_NONNULL(1, 3)
+int fev_socket_select_register(struct fev_socket *socket, bool write, struct fev_waiter *waiter)
+{
+  (void)socket;
+  (void)write;
+  (void)waiter;
+  return -ENOSYS;
+}
+
+FEV_NONNULL(1, 3)
+void fev_socket_select_unregister(struct fev_socket *socket, bool write, struct fev_waiter *waiter)
+{
+  (void)socket;
+  (void)write;
+  (void)waiter;
+}
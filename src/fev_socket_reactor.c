@@ -11,7 +11,9 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <sys/ioctl.h>
@@ -20,11 +22,14 @@
 #include <unistd.h>
 
 #include "fev_alloc.h"
+#include "fev_arch.h"
 #include "fev_assert.h"
 #include "fev_compiler.h"
 #include "fev_fiber.h"
 #include "fev_poller.h"
 #include "fev_sched_intf.h"
+#include "fev_spinlock_impl.h"
+#include "fev_stackless.h"
 #include "fev_time.h"
 #include "fev_timers.h"
 #include "fev_waiter_impl.h"
@@ -60,6 +65,12 @@ FEV_NONNULL(1) void fev_socket_init(struct fev_socket *socket)
 {
   memset(socket, 0, sizeof(*socket));
   socket->fd = -1;
+
+#ifdef FEV_EPOLL_PER_WORKER
+  fev_spinlock_init(&socket->epoll_lock);
+  atomic_init(&socket->epoll_fd, -1);
+  socket->epoll_events = 0;
+#endif
 }
 
 FEV_NONNULL(1) int fev_socket_create(struct fev_socket **socket_ptr)
@@ -137,6 +148,35 @@ FEV_NONNULL(1) int fev_socket_listen(struct fev_socket *socket, int backlog)
   return FEV_LIKELY(ret == 0) ? 0 : -errno;
 }
 
+/*
+ * Registers `end` in the poller before the first wait. With FEV_EPOLL_PER_WORKER, a socket waited
+ * on from another worker (e.g. by a stolen fiber) is moved to the instance of that worker.
+ */
+FEV_NONNULL(1, 2, 3)
+static inline int fev_socket_end_arm(const struct fev_sched_worker *worker,
+                                     struct fev_socket *socket, struct fev_socket_end *end,
+                                     enum fev_poller_flag flag)
+{
+  int err;
+
+  if (FEV_UNLIKELY(!end->active)) {
+    err = fev_poller_register(worker, socket, flag);
+    if (FEV_UNLIKELY(err != 0))
+      return err;
+    end->active = true;
+    return 0;
+  }
+
+#ifdef FEV_EPOLL_PER_WORKER
+  if (FEV_UNLIKELY(atomic_load_explicit(&socket->epoll_fd, memory_order_relaxed) !=
+                   worker->poller_data.epoll_fd)) {
+    fev_poller_migrate(worker, socket);
+  }
+#endif
+
+  return 0;
+}
+
 #define FEV_SOCKET_ACCEPT_OP                                                                       \
   int ret = fev_accept_nonblock(socket->fd, address, address_len);                                 \
   if (FEV_LIKELY(ret >= 0)) {                                                                      \
@@ -163,6 +203,16 @@ FEV_NONNULL(1) int fev_socket_listen(struct fev_socket *socket, int backlog)
     return n;                                                                                      \
   err = -errno;
 
+/*
+ * The poller marks the socket on a hang-up, but some data or the end of the stream can be still
+ * pending. The operation is tried once more, thus a read returns 0 instead of an error.
+ */
+#define FEV_SOCKET_CHECK_ERROR(op)                                                                 \
+  if (FEV_UNLIKELY(socket->error != 0)) {                                                          \
+    op;                                                                                            \
+    return err == -EAGAIN ? -ECONNRESET : err;                                                     \
+  }
+
 #define FEV_GEN_SOCKET_OP(end, flag, op)                                                           \
   struct fev_sched_worker *cur_worker;                                                             \
   struct fev_waiter *waiter;                                                                       \
@@ -170,7 +220,7 @@ FEV_NONNULL(1) int fev_socket_listen(struct fev_socket *socket, int backlog)
                                                                                                    \
   waiter = &(end)->waiter;                                                                         \
                                                                                                    \
-  atomic_store_explicit(&waiter->reason, FEV_WAITER_NONE, memory_order_relaxed);                   \
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);                    \
                                                                                                    \
   op;                                                                                              \
                                                                                                    \
@@ -179,23 +229,21 @@ FEV_NONNULL(1) int fev_socket_listen(struct fev_socket *socket, int backlog)
                                                                                                    \
   cur_worker = fev_cur_sched_worker;                                                               \
   waiter->fiber = cur_worker->cur_fiber;                                                           \
+  waiter->cancelable = true;                                                                       \
                                                                                                    \
-  if (FEV_UNLIKELY(!(end)->active)) {                                                              \
-    err = fev_poller_register(cur_worker, socket, flag);                                           \
-    if (FEV_UNLIKELY(err != 0))                                                                    \
-      return err;                                                                                  \
-    (end)->active = true;                                                                          \
-  }                                                                                                \
+  err = fev_socket_end_arm(cur_worker, socket, (end), flag);                                       \
+  if (FEV_UNLIKELY(err != 0))                                                                      \
+    return err;                                                                                    \
                                                                                                    \
   for (;;) {                                                                                       \
-    FEV_ASSERT(atomic_load(&waiter->do_wake) == 0);                                                \
+    FEV_ASSERT((atomic_load(&waiter->state) & FEV_WAITER_PARKED) == 0);                            \
                                                                                                    \
-    if (FEV_UNLIKELY(socket->error != 0))                                                          \
-      return -ECONNRESET;                                                                          \
+    FEV_SOCKET_CHECK_ERROR(op);                                                                    \
                                                                                                    \
-    fev_waiter_wait(waiter);                                                                       \
+    if (FEV_UNLIKELY(fev_waiter_wait(waiter) == FEV_WAITER_CANCELED))                              \
+      return -ECANCELED;                                                                           \
                                                                                                    \
-    atomic_store_explicit(&waiter->reason, FEV_WAITER_NONE, memory_order_relaxed);                 \
+    atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);                  \
                                                                                                    \
     op;                                                                                            \
                                                                                                    \
@@ -228,6 +276,103 @@ ssize_t fev_socket_write(struct fev_socket *socket, const void *buffer, size_t s
   FEV_GEN_SOCKET_OP(&socket->write_end, FEV_POLLER_OUT, FEV_SOCKET_WRITE_OP);
 }
 
+#define FEV_GEN_STACKLESS_SOCKET_OP(end, flag, op, stackless_op)                                  \
+  struct fev_sched_worker *cur_worker;                                                             \
+  struct fev_waiter *waiter;                                                                       \
+  int err;                                                                                         \
+                                                                                                   \
+  waiter = &(end)->waiter;                                                                         \
+                                                                                                   \
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);                    \
+                                                                                                   \
+  op;                                                                                              \
+                                                                                                   \
+  if (FEV_UNLIKELY(err != -EAGAIN))                                                                \
+    return err;                                                                                    \
+                                                                                                   \
+  cur_worker = fev_cur_sched_worker;                                                               \
+  waiter->fiber = cur_worker->cur_fiber;                                                           \
+                                                                                                   \
+  err = fev_socket_end_arm(cur_worker, socket, (end), flag);                                       \
+  if (FEV_UNLIKELY(err != 0))                                                                      \
+    return err;                                                                                    \
+                                                                                                   \
+  FEV_SOCKET_CHECK_ERROR(op);                                                                      \
+                                                                                                   \
+  return fev_stackless_wait_socket(waiter, stackless_op);
+
+static ssize_t fev_stackless_socket_accept_retry(const struct fev_stackless_socket_op *op)
+{
+  return fev_stackless_socket_accept(op->socket, op->new_socket, op->buffer, op->address_len);
+}
+
+static ssize_t fev_stackless_socket_connect_retry(const struct fev_stackless_socket_op *op)
+{
+  return fev_stackless_socket_connect(op->socket, op->buffer, (socklen_t)op->size);
+}
+
+static ssize_t fev_stackless_socket_read_retry(const struct fev_stackless_socket_op *op)
+{
+  return fev_stackless_socket_read(op->socket, op->buffer, op->size);
+}
+
+static ssize_t fev_stackless_socket_write_retry(const struct fev_stackless_socket_op *op)
+{
+  return fev_stackless_socket_write(op->socket, op->buffer, op->size);
+}
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_accept(struct fev_socket *socket, struct fev_socket *new_socket,
+                                struct sockaddr *address, socklen_t *address_len)
+{
+  FEV_GEN_STACKLESS_SOCKET_OP(&socket->read_end, FEV_POLLER_IN, FEV_SOCKET_ACCEPT_OP,
+                              (&(struct fev_stackless_socket_op){
+                                  .retry = &fev_stackless_socket_accept_retry,
+                                  .socket = socket,
+                                  .new_socket = new_socket,
+                                  .buffer = address,
+                                  .address_len = address_len,
+                              }));
+}
+
+FEV_NONNULL(1, 2)
+int fev_stackless_socket_connect(struct fev_socket *socket, struct sockaddr *address,
+                                 socklen_t address_len)
+{
+  FEV_GEN_STACKLESS_SOCKET_OP(&socket->write_end, FEV_POLLER_OUT, FEV_SOCKET_CONNECT_OP,
+                              (&(struct fev_stackless_socket_op){
+                                  .retry = &fev_stackless_socket_connect_retry,
+                                  .socket = socket,
+                                  .buffer = address,
+                                  .size = address_len,
+                              }));
+}
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_read(struct fev_socket *socket, void *buffer, size_t size)
+{
+  FEV_GEN_STACKLESS_SOCKET_OP(&socket->read_end, FEV_POLLER_IN, FEV_SOCKET_READ_OP,
+                              (&(struct fev_stackless_socket_op){
+                                  .retry = &fev_stackless_socket_read_retry,
+                                  .socket = socket,
+                                  .buffer = buffer,
+                                  .size = size,
+                              }));
+}
+
+FEV_NONNULL(1, 2)
+ssize_t fev_stackless_socket_write(struct fev_socket *socket, const void *buffer, size_t size)
+{
+  /* The buffer is passed back to this function only, thus casting away const is fine. */
+  FEV_GEN_STACKLESS_SOCKET_OP(&socket->write_end, FEV_POLLER_OUT, FEV_SOCKET_WRITE_OP,
+                              (&(struct fev_stackless_socket_op){
+                                  .retry = &fev_stackless_socket_write_retry,
+                                  .socket = socket,
+                                  .buffer = (void *)buffer,
+                                  .size = size,
+                              }));
+}
+
 #define FEV_GET_ABS_TIME                                                                           \
   struct timespec ts, *abs_time = &ts;                                                             \
   fev_get_abs_time_since_now(abs_time, rel_time);
@@ -239,7 +384,7 @@ ssize_t fev_socket_write(struct fev_socket *socket, const void *buffer, size_t s
                                                                                                    \
   waiter = &(end)->waiter;                                                                         \
                                                                                                    \
-  atomic_store_explicit(&waiter->reason, FEV_WAITER_NONE, memory_order_relaxed);                   \
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);                    \
                                                                                                    \
   op;                                                                                              \
                                                                                                    \
@@ -248,33 +393,30 @@ ssize_t fev_socket_write(struct fev_socket *socket, const void *buffer, size_t s
                                                                                                    \
   cur_worker = fev_cur_sched_worker;                                                               \
   waiter->fiber = cur_worker->cur_fiber;                                                           \
+  waiter->cancelable = true;                                                                       \
                                                                                                    \
-  if (FEV_UNLIKELY(!(end)->active)) {                                                              \
-    err = fev_poller_register(cur_worker, socket, flag);                                           \
-    if (FEV_UNLIKELY(err != 0))                                                                    \
-      return err;                                                                                  \
-    (end)->active = true;                                                                          \
-  }                                                                                                \
+  err = fev_socket_end_arm(cur_worker, socket, (end), flag);                                       \
+  if (FEV_UNLIKELY(err != 0))                                                                      \
+    return err;                                                                                    \
                                                                                                    \
   time_op;                                                                                         \
                                                                                                    \
   for (;;) {                                                                                       \
-    FEV_ASSERT(atomic_load(&waiter->do_wake) == 0);                                                \
+    FEV_ASSERT((atomic_load(&waiter->state) & FEV_WAITER_PARKED) == 0);                            \
                                                                                                    \
-    if (FEV_UNLIKELY(socket->error != 0))                                                          \
-      return -ECONNRESET;                                                                          \
+    FEV_SOCKET_CHECK_ERROR(op);                                                                    \
                                                                                                    \
     res = fev_timed_wait(waiter, abs_time);                                                        \
                                                                                                    \
     if (FEV_UNLIKELY(FEV_TIMED_WAIT_CAN_RETURN_ENOMEM && res == -ENOMEM))                          \
       return -ENOMEM;                                                                              \
                                                                                                    \
-    if (FEV_UNLIKELY(res == -ETIMEDOUT))                                                           \
-      return -ETIMEDOUT;                                                                           \
+    if (FEV_UNLIKELY(res == -ETIMEDOUT || res == -ECANCELED))                                      \
+      return res;                                                                                  \
                                                                                                    \
     FEV_ASSERT(res == 0 || res == -EAGAIN);                                                        \
                                                                                                    \
-    atomic_store_explicit(&waiter->reason, FEV_WAITER_NONE, memory_order_relaxed);                 \
+    atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);                  \
                                                                                                    \
     op;                                                                                            \
                                                                                                    \
@@ -342,3 +484,62 @@ ssize_t fev_socket_try_write_for(struct fev_socket *socket, const void *buffer,
   FEV_GEN_SOCKET_OP_TIMEOUT(&socket->write_end, FEV_POLLER_OUT, FEV_SOCKET_WRITE_OP,
                             FEV_GET_ABS_TIME);
 }
+
+FEV_NONNULL(1, 3)
+int fev_socket_select_register(struct fev_socket *socket, bool write, struct fev_waiter *waiter)
+{
+  struct fev_socket_end *end = write ? &socket->write_end : &socket->read_end;
+  struct pollfd pollfd;
+  int ret;
+
+  ret = fev_socket_end_arm(fev_cur_sched_worker, socket, end,
+                           write ? FEV_POLLER_OUT : FEV_POLLER_IN);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  /*
+   * The poller handles an event and then loads `select_waiter`. If it loads NULL, the event has
+   * happened before this store and poll() below sees the socket ready.
+   */
+  FEV_ASSERT(atomic_load(&end->select_waiter) == NULL);
+  atomic_store_explicit(&end->select_waiter, waiter, memory_order_seq_cst);
+
+  if (FEV_UNLIKELY(socket->error != 0))
+    return 1;
+
+  pollfd.fd = socket->fd;
+  pollfd.events = write ? POLLOUT : POLLIN;
+  pollfd.revents = 0;
+
+  ret = poll(&pollfd, 1, /*timeout=*/0);
+  if (FEV_UNLIKELY(ret < 0)) {
+    ret = -errno;
+    fev_socket_select_unregister(socket, write, waiter);
+    return ret;
+  }
+
+  return ret > 0;
+}
+
+FEV_NONNULL(1, 3)
+void fev_socket_select_unregister(struct fev_socket *socket, bool write, struct fev_waiter *waiter)
+{
+  struct fev_socket_end *end = write ? &socket->write_end : &socket->read_end;
+  struct fev_waiter *registered;
+
+  registered = atomic_exchange_explicit(&end->select_waiter, NULL, memory_order_acquire);
+  if (registered == waiter)
+    return;
+
+  /*
+   * The poller has taken the waiter, it sets the reason and clears FEV_WAITER_WAKING after the last
+   * access.
+   */
+  FEV_ASSERT(registered == NULL);
+  for (;;) {
+    unsigned state = atomic_load_explicit(&waiter->state, memory_order_acquire);
+    if ((state & FEV_WAITER_REASON_MASK) != FEV_WAITER_NONE && (state & FEV_WAITER_WAKING) == 0)
+      break;
+    fev_pause();
+  }
+}
@@ -10,14 +10,25 @@
 #ifndef FEV_SOCKET_REACTOR_H
 #define FEV_SOCKET_REACTOR_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "fev_compiler.h"
 #include "fev_qsbr.h"
+#include "fev_spinlock_intf.h"
 #include "fev_waiter_intf.h"
 
 struct fev_socket_end {
   struct fev_waiter waiter;
   bool active;
+
+  /*
+   * The waiter registered by fev_select(). The poller takes it with an exchange, thus only one
+   * poller can wake the waiter and fev_select() knows whether it has to wait for the poller.
+   */
+  _Atomic(struct fev_waiter *) select_waiter;
 };
 
 struct fev_socket {
@@ -26,6 +37,29 @@ struct fev_socket {
   int fd;
   unsigned error;
   struct fev_qsbr_entry qsbr_entry;
+
+#ifdef FEV_EPOLL_PER_WORKER
+  /*
+   * The epoll instance of the worker the socket is registered in and the registered events (0 if
+   * the socket is not registered yet). The lock serializes fev_poller_register() and
+   * fev_poller_migrate(), `epoll_fd` is also read without the lock to check if the socket has to be
+   * migrated.
+   */
+  struct fev_spinlock epoll_lock;
+  _Atomic int epoll_fd;
+  uint32_t epoll_events;
+#endif
 };
 
+/* Takes the waiter registered by fev_select() in `end`, returns NULL if there is none. */
+FEV_NONNULL(1)
+static inline struct fev_waiter *fev_socket_end_take_select_waiter(struct fev_socket_end *end)
+{
+  /* Pairs with the store in fev_socket_select_register(). */
+  if (FEV_LIKELY(atomic_load_explicit(&end->select_waiter, memory_order_seq_cst) == NULL))
+    return NULL;
+
+  return atomic_exchange_explicit(&end->select_waiter, NULL, memory_order_acquire);
+}
+
 #endif /* !FEV_SOCKET_REACTOR_H */
@@ -0,0 +1,371 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+/*
+ * Stackless fibers.
+ *
+ * A stackless fiber doesn't own a stack. Each time it is scheduled, the worker lends it a stack and
+ * calls the resume routine. If the routine wants to wait, it arms a wait (see fev_stackless_*()
+ * functions returning -EINPROGRESS) and returns. Then, we switch back to the scheduler, give the
+ * stack back to the worker and enable wake ups as fev_waiter_wait() does. Thus, a waiting stackless
+ * fiber costs only the size of struct fev_stackless, which makes them suitable for running C++20
+ * coroutines, which keep their state in their own frames.
+ *
+ * The resume routine runs on a real stack, so it still can block, for example on an ilock in
+ * fev_waiters_queue_wake(). In that case, the fiber keeps the stack until the resume routine
+ * returns, and the worker allocates a new one for the next stackless fiber.
+ */
+
+#include "fev_stackless.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_context.h"
+#include "fev_fiber_attr.h"
+#include "fev_fls.h"
+#include "fev_sched_impl.h"
+#include "fev_stack.h"
+#include "fev_time.h"
+#include "fev_util.h"
+#include "fev_waiter_impl.h"
+#include "fev_waiters_queue_impl.h"
+
+#define FEV_STACKLESS_STACK_SIZE (FEV_DEFAULT_STACK_SIZE + FEV_DEFAULT_GUARD_SIZE)
+
+/* The stack that is lent to stackless fibers run by this worker thread. */
+static _Thread_local void *fev_stackless_stack;
+
+FEV_COLD FEV_NOINLINE FEV_NORETURN static void fev_stackless_oom(void)
+{
+  fputs("Failed to allocate a stack to run a stackless fiber\n", stderr);
+  abort();
+}
+
+static struct fev_stackless *fev_cur_stackless(void)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  struct fev_fiber *cur_fiber;
+
+  if (FEV_UNLIKELY(cur_worker == NULL))
+    return NULL;
+
+  cur_fiber = cur_worker->cur_fiber;
+  if (FEV_UNLIKELY(cur_fiber == NULL || !cur_fiber->stackless))
+    return NULL;
+
+  return FEV_CONTAINER_OF(cur_fiber, struct fev_stackless, fiber);
+}
+
+/*
+ * Called before resuming the fiber, finishes the wait armed in the previous resume. Returns false
+ * if the fiber has to wait again, in that case the resume routine must not be called.
+ */
+FEV_NONNULL(1) static bool fev_stackless_finish_wait(struct fev_stackless *stackless)
+{
+  enum fev_waiter_wake_reason reason;
+  ssize_t res;
+  int ret;
+
+  switch (stackless->wait) {
+  case FEV_STACKLESS_WAIT_NONE:
+    return true;
+
+  case FEV_STACKLESS_WAIT_YIELD:
+    stackless->result = 0;
+    break;
+
+  case FEV_STACKLESS_WAIT_QUEUE:
+    reason = fev_waiter_wake_reason(stackless->waiter);
+    (void)reason;
+    FEV_ASSERT(reason == FEV_WAITER_READY);
+
+    /* The node should have been removed by fev_waiters_queue_wake(). */
+    FEV_ASSERT(stackless->node.deleted);
+
+    stackless->result = 0;
+    break;
+
+  case FEV_STACKLESS_WAIT_SOCKET:
+    (void)fev_waiter_wake_reason(stackless->waiter);
+
+    /* This arms the wait again if the socket is still not ready. */
+    res = stackless->socket_op.retry(&stackless->socket_op);
+    if (res == -EINPROGRESS)
+      return false;
+
+    stackless->result = res;
+    break;
+
+  case FEV_STACKLESS_WAIT_SLEEP:
+    reason = fev_waiter_wake_reason(stackless->waiter);
+    ret = fev_timed_wait_end(&stackless->sleep.timer, reason);
+    if (ret == -EAGAIN) {
+      /* Spurious wake up, sleep again. */
+      ret = fev_stackless_sleep_until(&stackless->sleep.timer.abs_time);
+      if (ret == -EINPROGRESS)
+        return false;
+    } else {
+      FEV_ASSERT(ret == -ETIMEDOUT);
+      ret = 0;
+    }
+
+    stackless->result = ret;
+    break;
+  }
+
+  stackless->wait = FEV_STACKLESS_WAIT_NONE;
+  return true;
+}
+
+/* Executed in the scheduler context after the resume routine has returned. */
+FEV_NONNULL(1) static void fev_stackless_post(struct fev_stackless *stackless)
+{
+  struct fev_sched_worker *cur_worker;
+  struct fev_sched *sched;
+
+  cur_worker = fev_cur_sched_worker;
+  FEV_ASSERT(cur_worker != NULL);
+
+  sched = cur_worker->sched;
+
+  /*
+   * Give the stack back to the worker. This must be done before enabling wake ups, since the fiber
+   * can be scheduled on another worker right after that.
+   */
+  if (fev_stackless_stack == NULL)
+    fev_stackless_stack = stackless->fiber.stack_addr;
+  else
+    fev_stack_free(stackless->fiber.stack_addr, stackless->fiber.total_stack_size);
+  stackless->fiber.stack_addr = NULL;
+
+  atomic_fetch_sub_explicit(&sched->num_run_fibers, 1, memory_order_relaxed);
+
+  switch (stackless->wait) {
+  case FEV_STACKLESS_WAIT_NONE:
+    fev_free(stackless);
+    atomic_fetch_sub_explicit(&sched->num_fibers, 1, memory_order_relaxed);
+    break;
+
+  case FEV_STACKLESS_WAIT_YIELD:
+    fev_wake_one(fev_cur_sched_worker, &stackless->fiber);
+    break;
+
+  default:
+    fev_waiter_enable_wake_ups(stackless->waiter);
+    break;
+  }
+}
+
+/* Entry point of a stackless fiber, called on a stack lent by the worker. */
+static void fev_stackless_start(void)
+{
+  struct fev_fiber *cur_fiber = fev_cur_sched_worker->cur_fiber;
+  struct fev_stackless *stackless;
+
+  /* The worker has switched to this stack to run a stackless fiber, unlike fev_cur_stackless(). */
+  FEV_ASSERT(cur_fiber != NULL && cur_fiber->stackless);
+  stackless = FEV_CONTAINER_OF(cur_fiber, struct fev_stackless, fiber);
+
+  if (fev_stackless_finish_wait(stackless)) {
+    stackless->resume_routine(stackless->arg);
+
+    /* The fiber is going to exit if it is not waiting. */
+    if (stackless->wait == FEV_STACKLESS_WAIT_NONE)
+      fev_fls_fini(&stackless->fiber);
+  }
+
+  /*
+   * The current worker may be different than the one that started the fiber, since the fiber could
+   * have blocked in the resume routine, hence we need to reload it.
+   */
+  fev_context_switch_and_call(stackless, &fev_stackless_post, &stackless->fiber.context,
+                              &fev_cur_sched_worker->context);
+
+  FEV_UNREACHABLE();
+}
+
+FEV_NONNULL(1) void fev_stackless_prepare(struct fev_fiber *fiber)
+{
+  void *stack = fev_stackless_stack;
+
+  FEV_ASSERT(fiber->stackless);
+
+  if (FEV_LIKELY(stack != NULL)) {
+    fev_stackless_stack = NULL;
+  } else {
+    int ret = fev_stack_alloc(&stack, FEV_DEFAULT_STACK_SIZE, FEV_DEFAULT_GUARD_SIZE);
+    if (FEV_UNLIKELY(ret != 0))
+      fev_stackless_oom();
+  }
+
+  fiber->stack_addr = stack;
+  fiber->total_stack_size = FEV_STACKLESS_STACK_SIZE;
+  fev_context_init(&fiber->context, stack, FEV_STACKLESS_STACK_SIZE, &fev_stackless_start);
+}
+
+void fev_stackless_worker_fini(void)
+{
+  if (fev_stackless_stack != NULL) {
+    fev_stack_free(fev_stackless_stack, FEV_STACKLESS_STACK_SIZE);
+    fev_stackless_stack = NULL;
+  }
+}
+
+FEV_NONNULL(2)
+int fev_stackless_spawn(struct fev_sched *sched, void (*resume_routine)(void *), void *arg)
+{
+  struct fev_stackless *stackless;
+  bool schedule_in_cur_worker;
+  int ret;
+
+  /* Stackless fibers are always detached. */
+  ret = fev_fiber_get_sched(&sched, &fev_fiber_spawn_default_attr, &schedule_in_cur_worker);
+  if (FEV_UNLIKELY(ret != 0))
+    return ret;
+
+  stackless = fev_malloc(sizeof(*stackless));
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -ENOMEM;
+
+  /* The stack and the context are set up in fev_stackless_prepare(). */
+  stackless->fiber.stack_addr = NULL;
+  stackless->fiber.total_stack_size = 0;
+  stackless->fiber.user_stack = false;
+  stackless->fiber.stackless = true;
+  stackless->fiber.start_routine = NULL;
+  stackless->fiber.arg = NULL;
+  stackless->fiber.return_value = NULL;
+  stackless->fiber.flags = 0;
+  atomic_init(&stackless->fiber.ref_count, 1);
+  atomic_init(&stackless->fiber.canceled, false);
+  atomic_init(&stackless->fiber.cancel_waiter, NULL);
+  atomic_init(&stackless->fiber.park_state, 0);
+  fev_fls_init(&stackless->fiber);
+
+  stackless->resume_routine = resume_routine;
+  stackless->arg = arg;
+  stackless->wait = FEV_STACKLESS_WAIT_NONE;
+  stackless->waiter = NULL;
+  stackless->result = 0;
+
+  /* Necessary bookkeeping for the scheduler. */
+  atomic_fetch_add_explicit(&sched->num_fibers, 1, memory_order_relaxed);
+
+  /* Schedule the fiber. */
+  if (schedule_in_cur_worker)
+    fev_wake_one(fev_cur_sched_worker, &stackless->fiber);
+  else
+    fev_sched_put(sched, &stackless->fiber);
+
+  return 0;
+}
+
+ssize_t fev_stackless_result(void)
+{
+  struct fev_stackless *stackless = fev_cur_stackless();
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -EINVAL;
+
+  return stackless->result;
+}
+
+int fev_stackless_yield(void)
+{
+  struct fev_stackless *stackless = fev_cur_stackless();
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -EINVAL;
+
+  stackless->wait = FEV_STACKLESS_WAIT_YIELD;
+  return -EINPROGRESS;
+}
+
+/* Arms a wait on `waiter`, wake ups are enabled in fev_stackless_post(). */
+FEV_NONNULL(1, 3)
+static void fev_stackless_arm(struct fev_stackless *stackless, enum fev_stackless_wait wait,
+                              struct fev_waiter *waiter)
+{
+  FEV_ASSERT((atomic_load(&waiter->state) & FEV_WAITER_PARKED) == 0);
+  FEV_ASSERT(waiter->fiber == &stackless->fiber);
+
+  stackless->wait = wait;
+  stackless->waiter = waiter;
+}
+
+FEV_NONNULL(1, 2)
+int fev_stackless_wait_queue(struct fev_waiters_queue *queue, bool (*recheck)(void *arg),
+                             void *recheck_arg)
+{
+  struct fev_stackless *stackless = fev_cur_stackless();
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -EINVAL;
+
+  /* Stackless fibers have no handle that could be passed to fev_fiber_cancel(). */
+  if (!fev_waiters_queue_push(queue, &stackless->node, &stackless->fiber, /*cancelable=*/false,
+                              /*parent=*/NULL, recheck, recheck_arg))
+    return 0;
+
+  fev_stackless_arm(stackless, FEV_STACKLESS_WAIT_QUEUE, &stackless->node.waiter);
+  return -EINPROGRESS;
+}
+
+FEV_NONNULL(1, 2)
+int fev_stackless_wait_socket(struct fev_waiter *waiter, const struct fev_stackless_socket_op *op)
+{
+  struct fev_stackless *stackless = fev_cur_stackless();
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -EINVAL;
+
+  stackless->socket_op = *op;
+  fev_stackless_arm(stackless, FEV_STACKLESS_WAIT_SOCKET, waiter);
+  return -EINPROGRESS;
+}
+
+FEV_NONNULL(1) int fev_stackless_sleep_until(const struct timespec *abs_time)
+{
+  struct fev_stackless *stackless;
+  struct fev_waiter *waiter;
+  struct timespec time;
+  int ret;
+
+  stackless = fev_cur_stackless();
+  if (FEV_UNLIKELY(stackless == NULL))
+    return -EINVAL;
+
+  /* `abs_time` may point to our timer, when we are called from fev_stackless_finish_wait(). */
+  time = *abs_time;
+
+  waiter = &stackless->sleep.waiter;
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);
+  waiter->fiber = &stackless->fiber;
+  waiter->cancelable = false;
+  waiter->parent = NULL;
+
+  ret = fev_timed_wait_begin(&stackless->sleep.timer, waiter, &time);
+  if (FEV_UNLIKELY(FEV_TIMERS_ADD_CAN_FAIL && ret < 0))
+    return ret;
+
+  fev_stackless_arm(stackless, FEV_STACKLESS_WAIT_SLEEP, waiter);
+  return -EINPROGRESS;
+}
+
+FEV_NONNULL(1) int fev_stackless_sleep_for(const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_stackless_sleep_until(&abs_time);
+}
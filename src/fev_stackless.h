@@ -0,0 +1,100 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_STACKLESS_H
+#define FEV_STACKLESS_H
+
+#include <fev/fev.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "fev_compiler.h"
+#include "fev_fiber.h"
+#include "fev_timers.h"
+#include "fev_waiter_intf.h"
+#include "fev_waiters_queue_intf.h"
+
+/* What a stackless fiber is waiting for after its resume routine has returned. */
+enum fev_stackless_wait {
+  /* Nothing, the fiber has finished. */
+  FEV_STACKLESS_WAIT_NONE,
+
+  /* The fiber has yielded. */
+  FEV_STACKLESS_WAIT_YIELD,
+
+  /* The fiber is waiting in a waiters queue (mutex, semaphore). */
+  FEV_STACKLESS_WAIT_QUEUE,
+
+  /* The fiber is waiting for a socket to become ready. */
+  FEV_STACKLESS_WAIT_SOCKET,
+
+  /* The fiber is sleeping. */
+  FEV_STACKLESS_WAIT_SLEEP,
+};
+
+/*
+ * A socket operation that is retried when the socket becomes ready. `buffer` and `size` are the
+ * address and its length for accept and connect.
+ */
+struct fev_stackless_socket_op {
+  ssize_t (*retry)(const struct fev_stackless_socket_op *op);
+  struct fev_socket *socket;
+  struct fev_socket *new_socket;
+  void *buffer;
+  size_t size;
+  socklen_t *address_len;
+};
+
+struct fev_stackless {
+  /* Must be the first member, the scheduler sees only this. */
+  struct fev_fiber fiber;
+
+  void (*resume_routine)(void *arg);
+  void *arg;
+
+  /* What the fiber is waiting for and the waiter that will be woken up. */
+  enum fev_stackless_wait wait;
+  struct fev_waiter *waiter;
+
+  union {
+    struct fev_waiters_queue_node node;
+    struct fev_stackless_socket_op socket_op;
+    struct {
+      struct fev_waiter waiter;
+      struct fev_timer timer;
+    } sleep;
+  };
+
+  /* Result of the last operation that returned -EINPROGRESS. */
+  ssize_t result;
+};
+
+/*
+ * Appends the current stackless fiber to `queue`, unless `recheck` returns false. Returns 0 if the
+ * fiber doesn't have to wait, -EINPROGRESS if it will be resumed after being woken up or -EINVAL
+ * if the current fiber is not stackless.
+ */
+FEV_NONNULL(1, 2)
+int fev_stackless_wait_queue(struct fev_waiters_queue *queue, bool (*recheck)(void *arg),
+                             void *recheck_arg);
+
+/*
+ * Makes the current stackless fiber wait on the socket's `waiter`. `op` will be retried before the
+ * fiber is resumed. Returns -EINPROGRESS or -EINVAL if the current fiber is not stackless.
+ */
+FEV_NONNULL(1, 2)
+int fev_stackless_wait_socket(struct fev_waiter *waiter, const struct fev_stackless_socket_op *op);
+
+/* Frees the stack kept by the current worker thread, called when the worker stops. */
+void fev_stackless_worker_fini(void);
+
+#endif /* !FEV_STACKLESS_H */
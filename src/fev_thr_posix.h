@@ -12,6 +12,7 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 
 #include "fev_assert.h"
@@ -44,4 +45,6 @@ FEV_NONNULL(1) static inline int fev_thr_cancel(struct fev_thr *thr)
   return -ret;
 }
 
+static inline void fev_thr_yield(void) { sched_yield(); }
+
 #endif /* !FEV_THR_POSIX_H */
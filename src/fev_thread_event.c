@@ -0,0 +1,256 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include <fev/fev.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_arch.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_remote_impl.h"
+#include "fev_sched_impl.h"
+#include "fev_time.h"
+#include "fev_timers.h"
+#include "fev_util.h"
+#include "fev_waiter_impl.h"
+
+/*
+ * The state of an event is one word like the state of a future (see fev_future.c): one of the
+ * values below or a pointer to the waiter of the waiting fiber. Unlike a future, an event can be
+ * set from any thread and can be reset.
+ */
+enum {
+  /* The event is not set and nobody waits. */
+  FEV_THREAD_EVENT_EMPTY = 0,
+
+  /* The event is set. */
+  FEV_THREAD_EVENT_SET = 1,
+
+  /*
+   * fev_thread_event_set() is waking up the waiter. The waiter is allocated on the stack, thus the
+   * waiting fiber cannot return until the state becomes FEV_THREAD_EVENT_SET.
+   */
+  FEV_THREAD_EVENT_WAKING = 2,
+};
+
+static_assert(_Alignof(struct fev_waiter) > FEV_THREAD_EVENT_WAKING, "Waiter pointers collide");
+
+struct fev_thread_event {
+  _Atomic uintptr_t state;
+
+  /* The scheduler of the waiting fiber, written before the waiter is published. */
+  struct fev_sched *sched;
+
+  /* The fiber to wake up, passed to a worker if the event is set outside of the scheduler. */
+  struct fev_fiber *fiber;
+  struct fev_remote_entry remote_entry;
+};
+
+FEV_NONNULL(1) static void fev_thread_event_remote_wake(struct fev_remote_entry *entry)
+{
+  struct fev_thread_event *event = FEV_CONTAINER_OF(entry, struct fev_thread_event, remote_entry);
+
+  /* The fiber can return and the event can be destroyed right after the wake. */
+  fev_cur_wake_one(event->fiber);
+}
+
+FEV_NONNULL(1) int fev_thread_event_create(struct fev_thread_event **event_ptr)
+{
+  struct fev_thread_event *event;
+
+  event = fev_malloc(sizeof(*event));
+  if (FEV_UNLIKELY(event == NULL))
+    return -ENOMEM;
+
+  atomic_init(&event->state, FEV_THREAD_EVENT_EMPTY);
+  event->sched = NULL;
+  event->fiber = NULL;
+  event->remote_entry.func = &fev_thread_event_remote_wake;
+
+  *event_ptr = event;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_thread_event_destroy(struct fev_thread_event *event)
+{
+  FEV_ASSERT(atomic_load(&event->state) <= FEV_THREAD_EVENT_SET);
+  fev_free(event);
+}
+
+FEV_NONNULL(1) bool fev_thread_event_is_set(const struct fev_thread_event *event)
+{
+  return atomic_load_explicit(&event->state, memory_order_acquire) == FEV_THREAD_EVENT_SET;
+}
+
+FEV_NONNULL(1) void fev_thread_event_reset(struct fev_thread_event *event)
+{
+  uintptr_t expected = FEV_THREAD_EVENT_SET;
+
+  /* Nothing to do if the event is not set, a waiting fiber stays registered. */
+  atomic_compare_exchange_strong_explicit(&event->state, &expected, FEV_THREAD_EVENT_EMPTY,
+                                          memory_order_relaxed, memory_order_relaxed);
+}
+
+FEV_NONNULL(1) void fev_thread_event_set(struct fev_thread_event *event)
+{
+  struct fev_sched_worker *cur_worker;
+  enum fev_waiter_wake_result result;
+  struct fev_waiter *waiter;
+  struct fev_sched *sched;
+  struct fev_fiber *fiber;
+  uintptr_t expected;
+
+  /*
+   * Lock the waiter by changing the state to FEV_THREAD_EVENT_WAKING, unless nobody waits or the
+   * event is already set. The release barrier publishes the writes done before.
+   */
+  expected = atomic_load_explicit(&event->state, memory_order_relaxed);
+  for (;;) {
+    if (expected == FEV_THREAD_EVENT_SET) {
+      return;
+    } else if (expected == FEV_THREAD_EVENT_WAKING) {
+      /* Another thread is setting the event, the state will be set soon. */
+      fev_pause();
+      expected = atomic_load_explicit(&event->state, memory_order_relaxed);
+    } else if (expected == FEV_THREAD_EVENT_EMPTY) {
+      if (atomic_compare_exchange_weak_explicit(&event->state, &expected, FEV_THREAD_EVENT_SET,
+                                                memory_order_release, memory_order_relaxed)) {
+        return;
+      }
+    } else if (atomic_compare_exchange_weak_explicit(&event->state, &expected,
+                                                     FEV_THREAD_EVENT_WAKING, memory_order_acquire,
+                                                     memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  waiter = (struct fev_waiter *)expected;
+  fiber = waiter->fiber;
+  sched = event->sched;
+  result = fev_waiter_wake(waiter, FEV_WAITER_READY);
+
+  /* From now on, the waiting fiber can return and the waiter may be invalid. */
+  atomic_store_explicit(&event->state, FEV_THREAD_EVENT_SET, memory_order_release);
+
+  if (result != FEV_WAITER_SET_AND_WAKE_UP)
+    return;
+
+  cur_worker = fev_cur_sched_worker;
+  if (cur_worker != NULL && cur_worker->sched == sched) {
+    fev_cur_wake_one(fiber);
+    return;
+  }
+
+  /* The fiber stays blocked until a worker runs the entry, thus the event is still valid then. */
+  event->fiber = fiber;
+  fev_remote_push(sched, &event->remote_entry);
+}
+
+/* Removes `waiter` from `event`, waits for fev_thread_event_set() that is accessing the waiter. */
+FEV_NONNULL(1, 2)
+static void fev_thread_event_unregister(struct fev_thread_event *event, struct fev_waiter *waiter)
+{
+  uintptr_t expected = (uintptr_t)waiter;
+
+  if (atomic_compare_exchange_strong_explicit(&event->state, &expected, FEV_THREAD_EVENT_EMPTY,
+                                              memory_order_acquire, memory_order_acquire)) {
+    return;
+  }
+
+  while (expected == FEV_THREAD_EVENT_WAKING) {
+    fev_pause();
+    expected = atomic_load_explicit(&event->state, memory_order_acquire);
+  }
+
+  FEV_ASSERT(expected == FEV_THREAD_EVENT_SET);
+}
+
+FEV_NONNULL(1)
+static int fev_thread_event_wait_impl(struct fev_thread_event *event,
+                                      const struct timespec *abs_time)
+{
+  struct fev_waiter waiter;
+  uintptr_t expected;
+  int res;
+
+  waiter.fiber = fev_cur_fiber();
+  waiter.cancelable = true;
+  waiter.parent = NULL;
+
+  FEV_ASSERT(waiter.fiber != NULL && !waiter.fiber->stackless);
+
+  for (;;) {
+    if (fev_thread_event_is_set(event))
+      return 0;
+
+    /*
+     * Prepare waiter. The stores can be relaxed, as the waiter is published with a release barrier
+     * below.
+     */
+    atomic_store_explicit(&waiter.state, FEV_WAITER_NONE, memory_order_relaxed);
+    event->sched = fev_cur_sched_worker->sched;
+
+    expected = FEV_THREAD_EVENT_EMPTY;
+    if (!atomic_compare_exchange_strong_explicit(&event->state, &expected, (uintptr_t)&waiter,
+                                                 memory_order_release, memory_order_acquire)) {
+      /* At most one fiber can wait for an event. */
+      FEV_ASSERT(expected == FEV_THREAD_EVENT_SET);
+      return 0;
+    }
+
+    if (abs_time == NULL) {
+      enum fev_waiter_wake_reason reason = fev_waiter_wait(&waiter);
+      res = reason == FEV_WAITER_CANCELED ? -ECANCELED : 0;
+    } else {
+      res = fev_timed_wait(&waiter, abs_time);
+    }
+
+    fev_thread_event_unregister(event, &waiter);
+
+    if (FEV_UNLIKELY(res == -ECANCELED || (FEV_TIMED_WAIT_CAN_RETURN_ENOMEM && res == -ENOMEM)))
+      return res;
+
+    /* The event might have been set just after the timeout. */
+    if (fev_thread_event_is_set(event))
+      return 0;
+
+    if (res == -ETIMEDOUT)
+      return res;
+
+    /* Spurious wake up (e.g. the event has been reset in the meantime), try again. */
+    FEV_ASSERT(res == 0 || res == -EAGAIN);
+  }
+}
+
+FEV_NONNULL(1) int fev_thread_event_wait(struct fev_thread_event *event)
+{
+  return fev_thread_event_wait_impl(event, /*abs_time=*/NULL);
+}
+
+FEV_NONNULL(1, 2)
+int fev_thread_event_wait_until(struct fev_thread_event *event, const struct timespec *abs_time)
+{
+  return fev_thread_event_wait_impl(event, abs_time);
+}
+
+FEV_NONNULL(1, 2)
+int fev_thread_event_wait_for(struct fev_thread_event *event, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_thread_event_wait_until(event, &abs_time);
+}
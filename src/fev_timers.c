@@ -159,13 +159,13 @@ static bool fev_timers_process(struct fev_timers_bucket *bucket, struct fev_time
    * 2. The poller handles the timeout event and wakes up the fiber X with reason set to
    *    FEV_TIMED_OUT_CHECK. The fiber X is now ready to run.
    * 3. The fiber Y adds an earlier timer and the timer becomes the min element. The fiber Y calls
-   *    fev_waiter_wait(), but the worker A is scheduled away just before setting do_wake in
-   *    fev_waiter_enable_wake_ups().
+   *    fev_waiter_wait(), but the worker A is scheduled away just before setting FEV_WAITER_PARKED
+   *    in fev_waiter_enable_wake_ups().
    * 4. The poller handles the timeout event, gets the pointer to the timer of the fiber Y and the
    *    worker B is scheduled away.
    * 5. The fiber X is now scheduled, it processes the timers and tries to wake the fiber Y, but it
-   *    manages only to set the reason to FEV_TIMED_OUT_NO_CHECK without updating do_wake from 1 to
-   *    0 (because the worker A in step 3 hasn't updated the do_wake yet).
+   *    only sets the reason to FEV_TIMED_OUT_NO_CHECK without waking the fiber (because the worker
+   *    A in step 3 hasn't set FEV_WAITER_PARKED yet).
    * 6. The worker A is now scheduled. It notices that the reason is set and thus it wakes up the
    *    fiber Y. The fiber Y is now ready to run.
    * 7. The fiber Y is now scheduled. Since its timer was deleted before setting the reason to
@@ -218,47 +218,55 @@ static bool fev_timers_process(struct fev_timers_bucket *bucket, struct fev_time
   return expired;
 }
 
-FEV_NONNULL(1, 2)
+FEV_NONNULL(1, 2, 3)
 FEV_WARN_UNUSED_RESULT
-int fev_timed_wait(struct fev_waiter *waiter, const struct timespec *abs_time)
+int fev_timed_wait_begin(struct fev_timer *timer, struct fev_waiter *waiter,
+                         const struct timespec *abs_time)
 {
-  struct fev_sched *sched;
-  struct fev_timers *timers;
   struct fev_timers_bucket *bucket;
-  enum fev_waiter_wake_reason reason;
   int ret;
-  bool expired;
-
-  sched = fev_cur_sched_worker->sched;
-  timers = &sched->timers;
 
   /* This should be set by the caller. */
-  FEV_ASSERT(atomic_load(&waiter->do_wake) == 0);
+  FEV_ASSERT((atomic_load(&waiter->state) & FEV_WAITER_PARKED) == 0);
 
-  bucket = fev_timers_find_bucket(timers, waiter);
+  bucket = fev_timers_find_bucket(&fev_cur_sched_worker->sched->timers, waiter);
 
-  struct fev_timer timer = {
-      .abs_time = *abs_time,
-      .waiter = waiter,
-  };
+  timer->abs_time = *abs_time;
+  timer->waiter = waiter;
 
   /* Add the timer. This can block for some time. */
-  ret = fev_timers_add(bucket, &timer);
+  ret = fev_timers_add(bucket, timer);
   if (FEV_UNLIKELY(FEV_TIMERS_ADD_CAN_FAIL && ret < 0)) {
     /* No error except ENOMEM is possible. */
     FEV_ASSERT(ret == -ENOMEM);
     return ret;
   }
 
-  reason = fev_waiter_wait(waiter);
+  return 0;
+}
+
+FEV_NONNULL(1)
+FEV_WARN_UNUSED_RESULT
+int fev_timed_wait_end(struct fev_timer *timer, enum fev_waiter_wake_reason reason)
+{
+  struct fev_timers_bucket *bucket;
+  bool expired;
+
   FEV_ASSERT(reason != FEV_WAITER_NONE);
 
+  bucket = fev_timers_find_bucket(&fev_cur_sched_worker->sched->timers, timer->waiter);
+
   /* Most ops won't timeout probably, thus this case is likely. */
   if (FEV_LIKELY(reason == FEV_WAITER_READY)) {
-    fev_timers_del(bucket, &timer);
+    fev_timers_del(bucket, timer);
     return 0;
   }
 
+  if (FEV_UNLIKELY(reason == FEV_WAITER_CANCELED)) {
+    fev_timers_del(bucket, timer);
+    return -ECANCELED;
+  }
+
   if (FEV_LIKELY(reason == FEV_WAITER_TIMED_OUT_NO_CHECK)) {
     /*
      * The timer must have been deleted by fev_timers_process(), which is the only function that can
@@ -269,10 +277,26 @@ int fev_timed_wait(struct fev_waiter *waiter, const struct timespec *abs_time)
 
   FEV_ASSERT(reason == FEV_WAITER_TIMED_OUT_CHECK);
 
-  expired = fev_timers_process(bucket, &timer);
+  expired = fev_timers_process(bucket, timer);
   return expired ? -ETIMEDOUT : -EAGAIN;
 }
 
+FEV_NONNULL(1, 2)
+FEV_WARN_UNUSED_RESULT
+int fev_timed_wait(struct fev_waiter *waiter, const struct timespec *abs_time)
+{
+  struct fev_timer timer;
+  enum fev_waiter_wake_reason reason;
+  int ret;
+
+  ret = fev_timed_wait_begin(&timer, waiter, abs_time);
+  if (FEV_UNLIKELY(FEV_TIMERS_ADD_CAN_FAIL && ret < 0))
+    return ret;
+
+  reason = fev_waiter_wait(waiter);
+  return fev_timed_wait_end(&timer, reason);
+}
+
 FEV_COLD FEV_NONNULL(1) int fev_timers_init(struct fev_timers *timers)
 {
   struct fev_timers_bucket *buckets = timers->buckets;
@@ -16,6 +16,7 @@
 #include <stdbool.h>
 
 #include "fev_compiler.h"
+#include "fev_mcs_lock_impl.h"
 #include "fev_spinlock_impl.h"
 #include "fev_thr_mutex.h"
 #include "fev_time.h"
@@ -37,6 +38,14 @@ typedef struct fev_spinlock fev_timers_bucket_min_lock_t;
 #define fev_timers_bucket_min_lock fev_spinlock_lock
 #define fev_timers_bucket_min_unlock fev_spinlock_unlock
 
+#elif defined(FEV_TIMERS_MIN_LOCK_MCS)
+
+typedef struct fev_mcs_lock fev_timers_bucket_min_lock_t;
+#define fev_timers_bucket_min_lock_init fev_mcs_lock_init
+#define fev_timers_bucket_min_lock_fini fev_mcs_lock_fini
+#define fev_timers_bucket_min_lock fev_mcs_lock_lock
+#define fev_timers_bucket_min_unlock fev_mcs_lock_unlock
+
 #endif
 
 #if defined(FEV_TIMERS_BINHEAP)
@@ -99,4 +108,18 @@ FEV_NONNULL(1, 2)
 FEV_WARN_UNUSED_RESULT
 int fev_timed_wait(struct fev_waiter *waiter, const struct timespec *abs_time);
 
+/*
+ * fev_timed_wait() split into two parts, for fibers that cannot wait in the middle of a function
+ * (stackless fibers). fev_timed_wait_begin() adds `timer` that will wake up `waiter` at `abs_time`,
+ * fev_timed_wait_end() is called after the waiter has been woken up with `reason`.
+ */
+FEV_NONNULL(1, 2, 3)
+FEV_WARN_UNUSED_RESULT
+int fev_timed_wait_begin(struct fev_timer *timer, struct fev_waiter *waiter,
+                         const struct timespec *abs_time);
+
+FEV_NONNULL(1)
+FEV_WARN_UNUSED_RESULT
+int fev_timed_wait_end(struct fev_timer *timer, enum fev_waiter_wake_reason reason);
+
 #endif /* !FEV_TIMERS_H */
@@ -16,59 +16,184 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "fev_arch.h"
 #include "fev_assert.h"
 #include "fev_compiler.h"
 #include "fev_context.h"
 #include "fev_fiber.h"
 #include "fev_sched_impl.h"
 
+/* Returns the reason that has been set in `waiter`, or FEV_WAITER_NONE. */
+FEV_NONNULL(1) static inline unsigned fev_waiter_load_reason(struct fev_waiter *waiter)
+{
+  return atomic_load_explicit(&waiter->state, memory_order_relaxed) & FEV_WAITER_REASON_MASK;
+}
+
 /* Allows the fiber in the passed waiter to be woken up. */
 FEV_NONNULL(1) static inline void fev_waiter_enable_wake_ups(struct fev_waiter *waiter)
 {
-  struct fev_fiber *fiber = NULL;
-  unsigned reason;
+  /* The waiter can be gone right after the CAS below. */
+  struct fev_fiber *fiber = waiter->fiber;
+  unsigned state;
 
   /*
    * We are in the scheduler context (worker thread). The fiber's context is saved and therefore we
-   * can now allow wake ups (they will restore the context). We synchronize with the store to
-   * `wait_for_post` in fev_waiter_wait(), so that the worker that will wake up the fiber won't see
-   * trash. Secondly, we need to make sure that the following load is not reordered before this
-   * store. Otherwise, the fiber could be not woken up.
+   * can now allow wake ups (they will restore the context). The release barrier publishes the
+   * context to the waker that clears the flag. If a waker has set the reason before, it has left
+   * the waking up to us and nobody else accesses the waiter.
    */
-  atomic_store_explicit(&waiter->do_wake, 1, memory_order_seq_cst);
+  state = atomic_load_explicit(&waiter->state, memory_order_relaxed);
+  do {
+    FEV_ASSERT((state & FEV_WAITER_PARKED) == 0);
+
+    if ((state & FEV_WAITER_REASON_MASK) != FEV_WAITER_NONE) {
+      fev_cur_wake_one(fiber);
+      return;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(&waiter->state, &state, FEV_WAITER_PARKED,
+                                                  memory_order_release, memory_order_relaxed));
+}
+
+/* Tries to set the reason of `waiter` that is not parked yet, returns true on success. */
+FEV_NONNULL(1)
+static inline bool fev_waiter_set_reason(struct fev_waiter *waiter,
+                                         enum fev_waiter_wake_reason reason)
+{
+  unsigned expected = FEV_WAITER_NONE;
+
+  /* The caller should not pass FEV_WAITER_NONE. */
+  FEV_ASSERT(reason != FEV_WAITER_NONE);
+
+  return atomic_compare_exchange_strong_explicit(&waiter->state, &expected, reason,
+                                                 memory_order_relaxed, memory_order_relaxed);
+}
+
+/*
+ * Sets the reason of a waiter that is not a fev_select() registration with a single CAS, unless
+ * another reason has been set before. If the fiber is parked, the caller must wake it up
+ * (FEV_WAITER_SET_AND_WAKE_UP). Otherwise, the fiber may return from fev_waiter_wait() right after
+ * the CAS, thus the caller must not access the waiter anymore.
+ */
+FEV_NONNULL(1)
+static inline enum fev_waiter_wake_result fev_waiter_claim(struct fev_waiter *waiter,
+                                                           enum fev_waiter_wake_reason reason)
+{
+  unsigned state;
 
   /*
-   * Some worker may have already updated `reason` before the previous store, but failed to update
-   * the `do_wake`. Thus, we must check it again. The load can be relaxed, since the following
-   * writes have the release semantics.
+   * The acquire part synchronizes with fev_waiter_enable_wake_ups(), the release part publishes
+   * the writes done before to the woken up fiber.
    */
-  reason = atomic_load_explicit(&waiter->reason, memory_order_relaxed);
-  if (reason != 0) {
-    unsigned do_wake;
-
-    /*
-     * Try to wake up the fiber. We may compete with another worker that is trying to exchange
-     * `do_wake` right now.
-     */
-    do_wake = atomic_exchange_explicit(&waiter->do_wake, 0, memory_order_acq_rel);
-    if (do_wake) {
-      atomic_store_explicit(&waiter->wake_reason, reason, memory_order_relaxed);
-
-      fiber = waiter->fiber;
-    }
+  state = atomic_load_explicit(&waiter->state, memory_order_relaxed);
+  do {
+    FEV_ASSERT((state & ~(unsigned)(FEV_WAITER_REASON_MASK | FEV_WAITER_PARKED)) == 0);
+
+    if (FEV_UNLIKELY((state & FEV_WAITER_REASON_MASK) != FEV_WAITER_NONE))
+      return FEV_WAITER_FAILED;
+  } while (FEV_UNLIKELY(!atomic_compare_exchange_weak_explicit(
+      &waiter->state, &state, reason, memory_order_acq_rel, memory_order_relaxed)));
+
+  return (state & FEV_WAITER_PARKED) != 0 ? FEV_WAITER_SET_AND_WAKE_UP : FEV_WAITER_SET_ONLY;
+}
+
+/*
+ * Wakes up the parent of a fev_select() registration. Fails if the registration has been woken up
+ * before or another registration has claimed the parent.
+ */
+FEV_NONNULL(1)
+static inline enum fev_waiter_wake_result
+fev_waiter_wake_registration(struct fev_waiter *waiter, enum fev_waiter_wake_reason reason)
+{
+  enum fev_waiter_wake_result result;
+  unsigned expected = FEV_WAITER_NONE;
+
+  if (!atomic_compare_exchange_strong_explicit(&waiter->state, &expected,
+                                               reason | FEV_WAITER_WAKING, memory_order_relaxed,
+                                               memory_order_relaxed)) {
+    return FEV_WAITER_FAILED;
   }
 
+  FEV_ASSERT(waiter->parent->parent == NULL);
+  result = fev_waiter_claim(waiter->parent, reason);
+
+  /*
+   * Tell fev_select() whether this registration has won. It waits for FEV_WAITER_WAKING to be
+   * cleared before the registration goes away, see fev_socket_select_unregister().
+   */
+  atomic_store_explicit(&waiter->state, reason | (result != FEV_WAITER_FAILED ? FEV_WAITER_WON : 0),
+                        memory_order_release);
+  return result;
+}
+
+FEV_NONNULL(1)
+static inline enum fev_waiter_wake_result fev_waiter_wake(struct fev_waiter *waiter,
+                                                          enum fev_waiter_wake_reason reason)
+{
+  /* The caller should not pass FEV_WAITER_NONE. */
+  FEV_ASSERT(reason != FEV_WAITER_NONE);
+
+  if (FEV_LIKELY(waiter->parent == NULL))
+    return fev_waiter_claim(waiter, reason);
+
+  return fev_waiter_wake_registration(waiter, reason);
+}
+
+/*
+ * Publishes `waiter` in `fiber`, so that fev_fiber_cancel() can wake the fiber up. If the fiber has
+ * been already canceled, the reason is set here and the fiber will be woken up by
+ * fev_waiter_enable_wake_ups() just after the switch.
+ */
+FEV_NONNULL(1, 2)
+static inline void fev_waiter_publish_cancel(struct fev_fiber *fiber, struct fev_waiter *waiter)
+{
+  struct fev_waiter *expected = NULL;
+
   /*
-   * The fiber can be woken up just after the store to `do_wake`. Thus, we need to make sure that
-   * the woken up fiber won't return and cause a stack-use-after-return bug, since the waiter is
-   * accessed after that store to `do_wake` here. To do that, the fiber will spin until
-   * `wait_for_post` is 0. The release barrier ensures that no access above is reordered after the
-   * store to `wait_for_post` here.
+   * fev_fiber_cancel() might be still finishing with the previous waiter, wait for it. This must be
+   * sequentially consistent with the following load of `canceled` and the store to `canceled` in
+   * fev_fiber_cancel(). Either fev_fiber_cancel() sees the waiter or we see the flag.
    */
-  atomic_store_explicit(&waiter->wait_for_post, 0, memory_order_release);
+  while (FEV_UNLIKELY(!atomic_compare_exchange_weak_explicit(
+      &fiber->cancel_waiter, &expected, waiter, memory_order_seq_cst, memory_order_relaxed))) {
+    FEV_ASSERT(expected == NULL || expected == FEV_FIBER_CANCELING);
+    expected = NULL;
+    fev_pause();
+  }
 
-  if (fiber != NULL)
-    fev_cur_wake_one(fiber);
+  if (FEV_UNLIKELY(atomic_load_explicit(&fiber->canceled, memory_order_seq_cst)))
+    fev_waiter_wake(waiter, FEV_WAITER_CANCELED);
+}
+
+/*
+ * Unpublishes `waiter`. Spins if fev_fiber_cancel() is accessing the waiter right now, as the
+ * waiter can be allocated on the stack. The waiter is already unpublished if fev_fiber_cancel() has
+ * finished with it.
+ */
+FEV_NONNULL(1, 2)
+static inline void fev_waiter_unpublish_cancel(struct fev_fiber *fiber, struct fev_waiter *waiter)
+{
+  struct fev_waiter *expected = waiter;
+
+  while (FEV_UNLIKELY(!atomic_compare_exchange_weak_explicit(
+      &fiber->cancel_waiter, &expected, NULL, memory_order_acquire, memory_order_acquire))) {
+    if (expected == NULL)
+      break;
+
+    FEV_ASSERT(expected == waiter || expected == FEV_FIBER_CANCELING);
+    expected = waiter;
+    fev_pause();
+  }
+}
+
+/* Called by a woken up fiber, returns the reason of the wake up. */
+FEV_NONNULL(1) static inline unsigned fev_waiter_wake_reason(struct fev_waiter *waiter)
+{
+  unsigned reason;
+
+  /* Synchronize with the waker. */
+  reason = atomic_load_explicit(&waiter->state, memory_order_acquire) & FEV_WAITER_REASON_MASK;
+  FEV_ASSERT(reason != FEV_WAITER_NONE);
+  return reason;
 }
 
 /* Waits on a waiter, returns the reason of a wake up. */
@@ -79,7 +204,7 @@ FEV_NONNULL(1) static inline unsigned fev_waiter_wait(struct fev_waiter *waiter)
   struct fev_fiber *fiber;
 
   /* This should be set by the caller. */
-  FEV_ASSERT(atomic_load(&waiter->do_wake) == 0);
+  FEV_ASSERT((atomic_load(&waiter->state) & FEV_WAITER_PARKED) == 0);
 
   fiber = waiter->fiber;
   FEV_ASSERT(fiber != NULL);
@@ -92,67 +217,16 @@ FEV_NONNULL(1) static inline unsigned fev_waiter_wait(struct fev_waiter *waiter)
 
   atomic_fetch_sub_explicit(&sched->num_run_fibers, 1, memory_order_relaxed);
 
-  /*
-   * This store must happen before updating `do_wake` in the post operation. Otherwise, the fiber
-   * can be woken up and see `wait_for_post` as 0, and then leave the following loop and
-   * therefore overwrite the content of the waiter causing stack-use-after-return.
-   */
-  atomic_store_explicit(&waiter->wait_for_post, 1, memory_order_relaxed);
+  if (waiter->cancelable)
+    fev_waiter_publish_cancel(fiber, waiter);
 
   fev_context_switch_and_call(waiter, &fev_waiter_enable_wake_ups, &fiber->context,
                               &cur_worker->context);
 
-  /* Spin until fev_waiter_enable_wake_ups() and fev_waiter_wake() are done. */
-  while (FEV_UNLIKELY(atomic_load_explicit(&waiter->wait, memory_order_acquire) != 0)) {
-    atomic_fetch_sub_explicit(&sched->num_run_fibers, 1, memory_order_relaxed);
-
-    /*
-     * Reload the current worker, since we switched to the scheduler and the fiber may be scheduled
-     * on a different worker.
-     */
-    cur_worker = fev_cur_sched_worker;
-    fev_context_switch_and_call(fiber, &fev_cur_wake_one, &fiber->context, &cur_worker->context);
-  }
-
-  return atomic_load_explicit(&waiter->wake_reason, memory_order_acquire);
-}
-
-FEV_NONNULL(1)
-static inline enum fev_waiter_wake_result fev_waiter_wake(struct fev_waiter *waiter,
-                                                          enum fev_waiter_wake_reason reason)
-{
-  unsigned expected;
-  bool success;
-
-  /* The caller should not pass FEV_WAITER_NONE. */
-  FEV_ASSERT(reason != FEV_WAITER_NONE);
-
-  /* Assure that the waiter's state is valid. */
-  FEV_ASSERT(atomic_load(&waiter->reason) <= FEV_WAITER_TIMED_OUT_NO_CHECK);
-  FEV_ASSERT(atomic_load(&waiter->do_wake) <= 1);
-
-  expected = FEV_WAITER_NONE;
-  success = atomic_compare_exchange_strong_explicit(&waiter->reason, &expected, reason,
-                                                    memory_order_relaxed, memory_order_relaxed);
-  if (FEV_LIKELY(success)) {
-    enum fev_waiter_wake_result result;
-    unsigned do_wake;
-
-    /* We have set the reason, try to wake up then. */
-    do_wake = atomic_exchange_explicit(&waiter->do_wake, 0, memory_order_acq_rel);
-    if (FEV_LIKELY(do_wake != 0)) {
-      atomic_store_explicit(&waiter->wake_reason, reason, memory_order_relaxed);
-
-      result = FEV_WAITER_SET_AND_WAKE_UP;
-    } else {
-      result = FEV_WAITER_SET_ONLY;
-    }
-
-    atomic_store_explicit(&waiter->wait_for_wake, 0, memory_order_release);
-    return result;
-  }
+  if (waiter->cancelable)
+    fev_waiter_unpublish_cancel(fiber, waiter);
 
-  return FEV_WAITER_FAILED;
+  return fev_waiter_wake_reason(waiter);
 }
 
 #endif /* !FEV_WAITER_IMPL_H */
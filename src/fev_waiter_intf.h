@@ -11,6 +11,7 @@
 #define FEV_WAITER_INTF_H
 
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 struct fev_fiber;
@@ -22,8 +23,8 @@ enum fev_waiter_wake_result {
 
   /*
    * We managed to set wake reason, but someone else will wake up the fiber. This can happen when a
-   * fiber wants to be woken up, but it is switching to scheduler right now and hasn't set `do_wake`
-   * flag yet. In that case, it will be woken up just after the switch (see
+   * fiber wants to be woken up, but it is switching to scheduler right now and hasn't set the
+   * FEV_WAITER_PARKED flag yet. In that case, it will be woken up just after the switch (see
    * fev_waiter_enable_wake_ups()).
    */
   FEV_WAITER_SET_ONLY,
@@ -50,49 +51,63 @@ enum fev_waiter_wake_reason {
    * by a fiber that is processing timers and thus we don't have to check them again.
    */
   FEV_WAITER_TIMED_OUT_NO_CHECK,
+
+  /* The fiber has been canceled by fev_fiber_cancel(). */
+  FEV_WAITER_CANCELED,
 };
 
-struct fev_waiter {
+/* Flags of the state of a waiter, the low bits hold the reason. */
+enum {
+  FEV_WAITER_REASON_MASK = 0x7,
+
   /*
-   * Reason (socket ready, timeout, etc.) that was set in attempt to wake up the fiber. The callers
-   * of fev_waiter_wait() should set this to FEV_WAITER_NONE to indicate that we are ready to wait
-   * for some events. Then, the event handlers will try to update it if the value is still
-   * FEV_WAITER_NONE. If the handler succeeds, it will try to wake up the stored fiber.
+   * The context of the fiber has been saved by fev_waiter_enable_wake_ups(). The waker that sets
+   * the reason clears this flag in the same CAS and wakes up the fiber.
    */
-  atomic_uint reason;
-
-  /* Must the stored fiber be woken up after setting `reason`? */
-  atomic_uint do_wake;
+  FEV_WAITER_PARKED = 0x8,
 
   /*
-   * Reason of wake up that is set by the worker that managed to change `do_wake` from 1 to 0. This
-   * differs from `reason`, since `reason` can be updated by waiters (e.g. by fev_waiter_wait()) and
-   * handlers (by fev_waiter_wake()). It is possible that `reason` is FEV_WAITER_NONE after a wake
-   * up. In comparison, `wake_reason` should never be FEV_WAITER_NONE after a wake up.
+   * Only in fev_select() registrations: the waker has set the reason and is still trying to claim
+   * the parent, the registration must not go away.
    */
-  atomic_uint wake_reason;
+  FEV_WAITER_WAKING = 0x10,
+
+  /* Only in fev_select() registrations: the registration has claimed the parent. */
+  FEV_WAITER_WON = 0x20,
+};
 
+struct fev_waiter {
   /*
-   * Should a woken up fiber wait for some operations to finish?
-   * A waiter can be allocated on the stack. In such case the woken up fiber cannot return from
-   * fev_waiter_wait() while procedures that hold references to the waiter are still alive,
-   * otherwise stack-use-after-return bugs are possible. To overcome this problem, we will spin in
-   * fev_waiter_wait() until the procedures have finished, that is when `wait_for_post` and
-   * `wait_for_wake` are both 0 (or equivalently `wait` is 0).
+   * The reason (socket ready, timeout, etc.) and the flags above packed into one word. The callers
+   * of fev_waiter_wait() should set this to FEV_WAITER_NONE to indicate that we are ready to wait
+   * for some events. Then, an event handler sets the reason with a CAS if it is still
+   * FEV_WAITER_NONE, and if FEV_WAITER_PARKED was set, it wakes up the stored fiber.
+   *
+   * A waiter can be allocated on the stack, thus the woken up fiber cannot return from
+   * fev_waiter_wait() while others still access the waiter. Here, both the waker and
+   * fev_waiter_enable_wake_ups() access the waiter last with their CAS of the state, and the fiber
+   * can run only after one of them has done it. The exception is a waker that has set the reason
+   * and is responsible for waking up the fiber, but the fiber cannot run until it is woken up.
    */
-  union {
-    struct {
-      /* If 1, the woken fiber will wait for fev_waiter_enable_wake_ups() to finish. */
-      _Atomic uint8_t wait_for_post;
-
-      /* If 1, the woken fiber will wait for fev_waiter_wake() to finish. */
-      _Atomic uint8_t wait_for_wake;
-    };
-    _Atomic uint16_t wait;
-  };
+  atomic_uint state;
 
   /* The fiber that must be woken up. */
   struct fev_fiber *fiber;
+
+  /*
+   * If true, fev_waiter_wait() publishes the waiter in the fiber, so that fev_fiber_cancel() can
+   * wake the fiber up with FEV_WAITER_CANCELED.
+   */
+  bool cancelable;
+
+  /*
+   * If not NULL, the waiter is one of many registrations of a fiber in fev_select() and `parent` is
+   * the waiter the fiber waits on. The reason of `parent` is the claim word shared by all
+   * registrations: fev_waiter_wake() sets the reason of this waiter and then tries to set the
+   * reason of `parent`, only the first registration to succeed wakes up the fiber. Then, this
+   * waiter gets FEV_WAITER_WON to tell fev_select() which registration has won.
+   */
+  struct fev_waiter *parent;
 };
 
 #endif /* !FEV_WAITER_INTF_H */
@@ -24,14 +24,44 @@
 #include "fev_compiler.h"
 #include "fev_fiber.h"
 #include "fev_ilock_impl.h"
+#include "fev_mcs_lock_impl.h"
 #include "fev_time.h"
 #include "fev_timers.h"
 #include "fev_waiter_impl.h"
 
+/*
+ * The lock of a waiters queue is held only for short critical sections, in which the fiber doesn't
+ * block. fev_waiters_queue_lock_unlock() returns the fiber that should be woken up by the caller or
+ * NULL, only the ilock can return a fiber.
+ */
+#if defined(FEV_WAITERS_QUEUE_LOCK_ILOCK)
+#define fev_waiters_queue_lock_init fev_ilock_init
+#define fev_waiters_queue_lock_fini fev_ilock_fini
+#define fev_waiters_queue_lock_lock fev_ilock_lock
+#define fev_waiters_queue_lock_try_lock fev_ilock_try_lock
+#define fev_waiters_queue_lock_unlock fev_ilock_unlock
+#define fev_waiters_queue_lock_unlock_and_wake fev_ilock_unlock_and_wake
+#elif defined(FEV_WAITERS_QUEUE_LOCK_MCS)
+FEV_NONNULL(1)
+FEV_WARN_UNUSED_RESULT static inline struct fev_fiber *
+fev_waiters_queue_mcs_unlock(struct fev_mcs_lock *lock)
+{
+  fev_mcs_lock_unlock(lock);
+  return NULL;
+}
+
+#define fev_waiters_queue_lock_init fev_mcs_lock_init
+#define fev_waiters_queue_lock_fini fev_mcs_lock_fini
+#define fev_waiters_queue_lock_lock fev_mcs_lock_lock
+#define fev_waiters_queue_lock_try_lock fev_mcs_lock_try_lock
+#define fev_waiters_queue_lock_unlock fev_waiters_queue_mcs_unlock
+#define fev_waiters_queue_lock_unlock_and_wake fev_mcs_lock_unlock
+#endif
+
 FEV_NONNULL(1)
 FEV_WARN_UNUSED_RESULT static inline int fev_waiters_queue_init(struct fev_waiters_queue *queue)
 {
-  int ret = fev_ilock_init(&queue->lock);
+  int ret = fev_waiters_queue_lock_init(&queue->lock);
   if (FEV_UNLIKELY(ret != 0))
     return ret;
 
@@ -41,15 +71,82 @@ FEV_WARN_UNUSED_RESULT static inline int fev_waiters_queue_init(struct fev_waite
 
 FEV_NONNULL(1) static inline void fev_waiters_queue_fini(struct fev_waiters_queue *queue)
 {
-  fev_ilock_fini(&queue->lock);
+  fev_waiters_queue_lock_fini(&queue->lock);
 }
 
-FEV_NONNULL(1)
-static inline int fev_waiters_queue_wait(struct fev_waiters_queue *queue,
-                                         const struct timespec *abs_time,
-                                         bool (*recheck)(void *arg), void *recheck_arg)
+/*
+ * Prepares the waiter of `node` for `fiber` and appends the node to `queue`, unless `recheck`
+ * returns false. Returns true if the node was appended and the fiber should wait. `parent` is the
+ * waiter of fev_select() or NULL.
+ */
+FEV_NONNULL(1, 2, 3)
+static inline bool fev_waiters_queue_push(struct fev_waiters_queue *queue,
+                                          struct fev_waiters_queue_node *node,
+                                          struct fev_fiber *fiber, bool cancelable,
+                                          struct fev_waiter *parent, bool (*recheck)(void *arg),
+                                          void *recheck_arg)
+{
+  struct fev_waiter *waiter = &node->waiter;
+
+  /*
+   * Prepare waiter. Stores here can be relaxed, as unlocking the queue will issue a release
+   * barrier, and the waiter won't be accessed outside of that critical section.
+   */
+  atomic_store_explicit(&waiter->state, FEV_WAITER_NONE, memory_order_relaxed);
+  waiter->fiber = fiber;
+  waiter->cancelable = cancelable;
+  waiter->parent = parent;
+  node->queue = queue;
+  node->count = 1;
+
+  fev_waiters_queue_lock_lock(&queue->lock);
+
+  if (recheck != NULL) {
+    bool do_wait = recheck(recheck_arg);
+    if (!do_wait) {
+      fev_waiters_queue_lock_unlock_and_wake(&queue->lock);
+      return false;
+    }
+  }
+
+  TAILQ_INSERT_TAIL(&queue->nodes, node, tq_entry);
+  node->deleted = false;
+
+  fev_waiters_queue_lock_unlock_and_wake(&queue->lock);
+  return true;
+}
+
+/*
+ * Removes `node` from `queue` (or from the queue it was moved to) unless fev_waiters_queue_wake()
+ * has removed it already. After this, nobody accesses the node.
+ */
+FEV_NONNULL(1, 2)
+static inline void fev_waiters_queue_remove(struct fev_waiters_queue *queue,
+                                            struct fev_waiters_queue_node *node)
+{
+  struct fev_waiters_queue *target;
+
+  fev_waiters_queue_lock_lock(&queue->lock);
+  target = node->queue;
+  if (target == queue && !node->deleted)
+    TAILQ_REMOVE(&queue->nodes, node, tq_entry);
+  fev_waiters_queue_lock_unlock_and_wake(&queue->lock);
+
+  /* The node was moved, it cannot be moved again. */
+  if (target != queue)
+    fev_waiters_queue_remove(target, node);
+}
+
+/*
+ * Like fev_waiters_queue_wait(), but uses `node` provided by the caller, which can then check
+ * `node->queue` to find out whether the node was moved by fev_waiters_queue_requeue().
+ */
+FEV_NONNULL(1, 2)
+static inline int fev_waiters_queue_wait_node(struct fev_waiters_queue *queue,
+                                              struct fev_waiters_queue_node *node,
+                                              const struct timespec *abs_time, bool cancelable,
+                                              bool (*recheck)(void *arg), void *recheck_arg)
 {
-  struct fev_waiters_queue_node node;
   struct fev_sched_worker *cur_worker;
   struct fev_fiber *cur_fiber;
   struct fev_waiter *waiter;
@@ -64,37 +161,21 @@ static inline int fev_waiters_queue_wait(struct fev_waiters_queue *queue,
   cur_fiber = cur_worker->cur_fiber;
   FEV_ASSERT(cur_fiber != NULL);
 
-  /*
-   * Prepare waiter. Stores here can be relaxed, as fev_ilock_unlock_and_wake() will issue a release
-   * barrier, and the waiter won't be accessed outside of that critical section.
-   */
-  waiter = &node.waiter;
-  atomic_store_explicit(&waiter->reason, FEV_WAITER_NONE, memory_order_relaxed);
-  atomic_store_explicit(&waiter->do_wake, 0, memory_order_relaxed);
-  atomic_store_explicit(&waiter->wait_for_wake, 1, memory_order_relaxed);
-  waiter->fiber = cur_fiber;
-
-  fev_ilock_lock(&queue->lock);
-
-  if (recheck != NULL) {
-    bool do_wait = recheck(recheck_arg);
-    if (!do_wait) {
-      fev_ilock_unlock_and_wake(&queue->lock);
-      return 0;
-    }
-  }
-
-  TAILQ_INSERT_TAIL(&queue->nodes, &node, tq_entry);
-  node.deleted = false;
+  if (!fev_waiters_queue_push(queue, node, cur_fiber, cancelable, /*parent=*/NULL, recheck,
+                              recheck_arg))
+    return 0;
 
-  fev_ilock_unlock_and_wake(&queue->lock);
+  waiter = &node->waiter;
 
   /* Wait. */
   if (abs_time == NULL) {
     enum fev_waiter_wake_reason reason;
 
     reason = fev_waiter_wait(waiter);
-    (void)reason;
+    if (FEV_UNLIKELY(reason == FEV_WAITER_CANCELED)) {
+      res = -ECANCELED;
+      goto not_ready;
+    }
 
     FEV_ASSERT(reason == FEV_WAITER_READY);
   } else {
@@ -104,32 +185,43 @@ static inline int fev_waiters_queue_wait(struct fev_waiters_queue *queue,
   }
 
   /* The node should have been removed by fev_waiters_queue_wake(). */
-  FEV_ASSERT(node.deleted);
+  FEV_ASSERT(node->deleted);
 
   return 0;
 
 not_ready:
-  FEV_ASSERT(res == -EAGAIN || res == -ENOMEM || res == -ETIMEDOUT);
+  FEV_ASSERT(res == -EAGAIN || res == -ENOMEM || res == -ETIMEDOUT || res == -ECANCELED);
 
   /* Remove the node if necessary. */
-  fev_ilock_lock(&queue->lock);
-  if (!node.deleted)
-    TAILQ_REMOVE(&queue->nodes, &node, tq_entry);
-  fev_ilock_unlock_and_wake(&queue->lock);
+  fev_waiters_queue_remove(queue, node);
 
   return res;
 }
 
+/*
+ * Waits in `queue` until woken up by fev_waiters_queue_wake(), unless `recheck` returns false. If
+ * `cancelable` is true, the wait fails with ECANCELED when the fiber is canceled.
+ */
+FEV_NONNULL(1)
+static inline int fev_waiters_queue_wait(struct fev_waiters_queue *queue,
+                                         const struct timespec *abs_time, bool cancelable,
+                                         bool (*recheck)(void *arg), void *recheck_arg)
+{
+  struct fev_waiters_queue_node node;
+  return fev_waiters_queue_wait_node(queue, &node, abs_time, cancelable, recheck, recheck_arg);
+}
+
 /*
  * Wakes at most `max_waiters` that are waiting in `queue`. If `callback` is not null, it will be
  * called with `callback_arg`, the number of woken waiters and a flag whether the waiters queue is
- * empty now.
+ * empty now. If `direct_switch` is true and only one fiber is woken, the worker switches to it,
+ * see fev_cur_switch_to().
  */
 FEV_NONNULL(1)
 static inline void fev_waiters_queue_wake(struct fev_waiters_queue *queue, uint32_t max_waiters,
                                           void (*callback)(void *arg, uint32_t num_fibers,
                                                            bool is_empty),
-                                          void *callback_arg)
+                                          void *callback_arg, bool direct_switch)
 {
   /* Fibers that we have to wake up. */
   fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
@@ -138,14 +230,14 @@ static inline void fev_waiters_queue_wake(struct fev_waiters_queue *queue, uint3
   /*
    * Number of waiters that are going to be woken up in result of this call. This includes the
    * waiters that we have to wake up (i.e. the list above) and the waiters that will be woken up by
-   * fev_waiter_enable_wake_ups() (this happens when we manage to set the wake up reason, but not
-   * `do_wake` flag).
+   * fev_waiter_enable_wake_ups() (this happens when we manage to set the wake up reason before the
+   * fiber is parked).
    */
   uint32_t num_woken = 0;
 
   struct fev_fiber *fiber;
 
-  fev_ilock_lock(&queue->lock);
+  fev_waiters_queue_lock_lock(&queue->lock);
 
   while (num_woken < max_waiters) {
     struct fev_waiter *waiter;
@@ -187,10 +279,151 @@ static inline void fev_waiters_queue_wake(struct fev_waiters_queue *queue, uint3
   }
 
   /*
-   * Unlock the ilock and wake the fiber that is trying to access this waiters queue right now, if
+   * Unlock the queue and wake the fiber that is trying to access this waiters queue right now, if
    * any.
    */
-  fiber = fev_ilock_unlock(&queue->lock);
+  fiber = fev_waiters_queue_lock_unlock(&queue->lock);
+  if (fiber != NULL) {
+    STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
+    num_fibers++;
+  }
+
+  if (num_fibers > 0)
+    fev_cur_wake_stq_or_switch(&fibers, num_fibers, direct_switch);
+}
+
+/* The body of fev_waiters_queue_wake_units(), the lock of `queue` must be held. */
+FEV_NONNULL(1, 2)
+static inline void fev_waiters_queue_wake_units_and_unlock(struct fev_waiters_queue *queue,
+                                                           int32_t *value, uint32_t units,
+                                                           bool direct_switch)
+{
+  fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
+  struct fev_waiters_queue_node *node;
+  uint32_t num_fibers = 0;
+  struct fev_fiber *fiber;
+  int64_t available;
+
+  available = (int64_t)*value + units;
+
+  while ((node = TAILQ_FIRST(&queue->nodes)) != NULL && (int64_t)node->count <= available) {
+    struct fev_waiter *waiter = &node->waiter;
+    enum fev_waiter_wake_result result;
+    uint32_t count = node->count;
+
+    TAILQ_REMOVE(&queue->nodes, node, tq_entry);
+    node->deleted = true;
+
+    /*
+     * The waiter could have timed out or been canceled, then it doesn't take the units. Otherwise,
+     * the fiber may return as soon as the reason is set, the node must not be accessed anymore.
+     */
+    result = fev_waiter_wake(waiter, FEV_WAITER_READY);
+    if (result == FEV_WAITER_FAILED)
+      continue;
+
+    available -= count;
+
+    if (result == FEV_WAITER_SET_AND_WAKE_UP) {
+      STAILQ_INSERT_TAIL(&fibers, waiter->fiber, stq_entry);
+      num_fibers++;
+    }
+  }
+
+  FEV_ASSERT(available <= INT32_MAX);
+  *value = (int32_t)available;
+
+  fiber = fev_waiters_queue_lock_unlock(&queue->lock);
+  if (fiber != NULL) {
+    STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
+    num_fibers++;
+  }
+
+  if (num_fibers > 0)
+    fev_cur_wake_stq_or_switch(&fibers, num_fibers, direct_switch);
+}
+
+/*
+ * Adds `units` to `*value`, which is protected by the lock of `queue`, and hands the units over to
+ * the waiters in FIFO order, as long as the first waiter needs no more units than are available.
+ * The woken waiters are pushed to the run queue at once, `direct_switch` is as in
+ * fev_waiters_queue_wake().
+ */
+FEV_NONNULL(1, 2)
+static inline void fev_waiters_queue_wake_units(struct fev_waiters_queue *queue, int32_t *value,
+                                                uint32_t units, bool direct_switch)
+{
+  fev_waiters_queue_lock_lock(&queue->lock);
+  fev_waiters_queue_wake_units_and_unlock(queue, value, units, direct_switch);
+}
+
+/*
+ * Like fev_waiters_queue_wake_units(), but gives up if the lock is held and returns false, then
+ * `*value` is not changed. It doesn't block, thus it can be called from the scheduler context.
+ */
+FEV_NONNULL(1, 2)
+static inline bool fev_waiters_queue_try_wake_units(struct fev_waiters_queue *queue,
+                                                    int32_t *value, uint32_t units)
+{
+  if (!fev_waiters_queue_lock_try_lock(&queue->lock))
+    return false;
+
+  fev_waiters_queue_wake_units_and_unlock(queue, value, units, /*direct_switch=*/false);
+  return true;
+}
+
+/*
+ * Moves the waiters of `queue` to the end of `target` without waking them up, they will be woken up
+ * by fev_waiters_queue_wake() on `target`. `prepare` is called with `prepare_arg` and both locks
+ * held before the first waiter is moved. If it returns false, the waiters are woken up instead, as
+ * are the waiters of fev_select(). The lock of `queue` must be always taken before the lock of
+ * `target`. Returns the number of moved waiters.
+ */
+FEV_NONNULL(1, 2, 3)
+static inline uint32_t fev_waiters_queue_requeue(struct fev_waiters_queue *queue,
+                                                 struct fev_waiters_queue *target,
+                                                 bool (*prepare)(void *arg), void *prepare_arg)
+{
+  fev_fiber_stq_head_t fibers = STAILQ_HEAD_INITIALIZER(fibers);
+  struct fev_waiters_queue_node *node;
+  uint32_t num_fibers = 0, num_moved = 0;
+  bool prepared = false, move = false;
+  struct fev_fiber *fiber;
+
+  fev_waiters_queue_lock_lock(&queue->lock);
+  fev_waiters_queue_lock_lock(&target->lock);
+
+  while ((node = TAILQ_FIRST(&queue->nodes)) != NULL) {
+    struct fev_waiter *waiter = &node->waiter;
+
+    TAILQ_REMOVE(&queue->nodes, node, tq_entry);
+
+    if (waiter->parent == NULL && !prepared) {
+      move = prepare(prepare_arg);
+      prepared = true;
+    }
+
+    if (waiter->parent != NULL || !move) {
+      node->deleted = true;
+      if (fev_waiter_wake(waiter, FEV_WAITER_READY) == FEV_WAITER_SET_AND_WAKE_UP) {
+        STAILQ_INSERT_TAIL(&fibers, waiter->fiber, stq_entry);
+        num_fibers++;
+      }
+      continue;
+    }
+
+    TAILQ_INSERT_TAIL(&target->nodes, node, tq_entry);
+    node->queue = target;
+    num_moved++;
+  }
+
+  fiber = fev_waiters_queue_lock_unlock(&target->lock);
+  if (fiber != NULL) {
+    STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
+    num_fibers++;
+  }
+
+  fiber = fev_waiters_queue_lock_unlock(&queue->lock);
   if (fiber != NULL) {
     STAILQ_INSERT_TAIL(&fibers, fiber, stq_entry);
     num_fibers++;
@@ -198,6 +431,8 @@ static inline void fev_waiters_queue_wake(struct fev_waiters_queue *queue, uint3
 
   if (num_fibers > 0)
     fev_cur_wake_stq(&fibers, num_fibers);
+
+  return num_moved;
 }
 
 #endif /* !FEV_WAITERS_QUEUE_IMPL_H */
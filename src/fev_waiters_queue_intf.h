@@ -11,20 +11,43 @@
 #define FEV_WAITERS_QUEUE_INTF_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <queue.h>
 
 #include "fev_ilock_intf.h"
+#include "fev_mcs_lock_intf.h"
 #include "fev_waiter_intf.h"
 
+#if defined(FEV_WAITERS_QUEUE_LOCK_ILOCK)
+typedef struct fev_ilock fev_waiters_queue_lock_t;
+#elif defined(FEV_WAITERS_QUEUE_LOCK_MCS)
+typedef struct fev_mcs_lock fev_waiters_queue_lock_t;
+#else
+#error Wrong lock strategy for waiters queue selected, define either \
+        FEV_WAITERS_QUEUE_LOCK_ILOCK or FEV_WAITERS_QUEUE_LOCK_MCS.
+#endif
+
 struct fev_waiters_queue_node {
   struct fev_waiter waiter;
   TAILQ_ENTRY(fev_waiters_queue_node) tq_entry;
   bool deleted;
+
+  /*
+   * The queue the node was pushed to, or the queue it was moved to by fev_waiters_queue_requeue().
+   * Protected by the lock of the former queue.
+   */
+  struct fev_waiters_queue *queue;
+
+  /*
+   * Number of units the waiter needs, see fev_waiters_queue_wake_units(). It is 1 unless changed by
+   * the recheck function.
+   */
+  uint32_t count;
 };
 
 struct fev_waiters_queue {
-  struct fev_ilock lock;
+  fev_waiters_queue_lock_t lock;
   TAILQ_HEAD(, fev_waiters_queue_node) nodes;
 };
 
@@ -0,0 +1,126 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include "fev_waitgroup.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_time.h"
+#include "fev_waiters_queue_impl.h"
+
+FEV_NONNULL(1) int fev_waitgroup_create(struct fev_waitgroup **waitgroup_ptr)
+{
+  struct fev_waitgroup *waitgroup;
+  int ret;
+
+  waitgroup = fev_malloc(sizeof(*waitgroup));
+  if (FEV_UNLIKELY(waitgroup == NULL))
+    return -ENOMEM;
+
+  ret = fev_waiters_queue_init(&waitgroup->wq);
+  if (FEV_UNLIKELY(ret != 0)) {
+    fev_free(waitgroup);
+    return ret;
+  }
+
+  atomic_init(&waitgroup->value, 0);
+
+  *waitgroup_ptr = waitgroup;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_waitgroup_destroy(struct fev_waitgroup *waitgroup)
+{
+  fev_waiters_queue_fini(&waitgroup->wq);
+  fev_free(waitgroup);
+}
+
+FEV_NONNULL(1) void fev_waitgroup_add(struct fev_waitgroup *waitgroup, int32_t delta)
+{
+  int value;
+
+  /*
+   * The release part publishes the writes of a finished fiber to the waiters, the acquire part
+   * orders the wake up after the writes of the fibers that have finished before.
+   */
+  value = atomic_fetch_add_explicit(&waitgroup->value, delta, memory_order_acq_rel) + delta;
+  FEV_ASSERT(value >= 0);
+
+  /*
+   * A waiter either has seen a non-zero value and is already in the queue, or it will see 0 when
+   * rechecking under the queue's lock.
+   */
+  if (value == 0 && delta != 0) {
+    fev_waiters_queue_wake(&waitgroup->wq, /*max_waiters=*/UINT32_MAX, /*callback=*/NULL,
+                           /*callback_arg=*/NULL, /*direct_switch=*/false);
+  }
+}
+
+FEV_NONNULL(1) void fev_waitgroup_done(struct fev_waitgroup *waitgroup)
+{
+  fev_waitgroup_add(waitgroup, -1);
+}
+
+static bool fev_waitgroup_wait_recheck(void *arg)
+{
+  struct fev_waitgroup *waitgroup = arg;
+
+  return atomic_load_explicit(&waitgroup->value, memory_order_relaxed) != 0;
+}
+
+FEV_NONNULL(1) void fev_waitgroup_wait(struct fev_waitgroup *waitgroup)
+{
+  int res;
+
+  /* Fast path, all fibers have finished. */
+  if (atomic_load_explicit(&waitgroup->value, memory_order_acquire) == 0)
+    return;
+
+  /* Like fev_fiber_join(), waiting for a group is not a cancellation point. */
+  res = fev_waiters_queue_wait(&waitgroup->wq, /*abs_time=*/NULL, /*cancelable=*/false,
+                               &fev_waitgroup_wait_recheck, waitgroup);
+  (void)res;
+  FEV_ASSERT(res == 0);
+
+  /* Synchronize with the fibers that have finished. */
+  atomic_thread_fence(memory_order_acquire);
+}
+
+FEV_NONNULL(1, 2)
+int fev_waitgroup_wait_until(struct fev_waitgroup *waitgroup, const struct timespec *abs_time)
+{
+  int res;
+
+  if (atomic_load_explicit(&waitgroup->value, memory_order_acquire) == 0)
+    return 0;
+
+  do {
+    res = fev_waiters_queue_wait(&waitgroup->wq, abs_time, /*cancelable=*/false,
+                                 &fev_waitgroup_wait_recheck, waitgroup);
+  } while (res == -EAGAIN);
+
+  atomic_thread_fence(memory_order_acquire);
+  return res;
+}
+
+FEV_NONNULL(1, 2)
+int fev_waitgroup_wait_for(struct fev_waitgroup *waitgroup, const struct timespec *rel_time)
+{
+  struct timespec abs_time;
+
+  fev_get_abs_time_since_now(&abs_time, rel_time);
+  return fev_waitgroup_wait_until(waitgroup, &abs_time);
+}
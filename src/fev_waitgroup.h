@@ -0,0 +1,27 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#ifndef FEV_WAITGROUP_H
+#define FEV_WAITGROUP_H
+
+#include <fev/fev.h>
+
+#include <stdatomic.h>
+
+#include "fev_waiters_queue_intf.h"
+
+struct fev_waitgroup {
+  /* Number of pending fibers (or other units of work). */
+  atomic_int value;
+
+  /* Fibers waiting for `value` to drop to 0. */
+  struct fev_waiters_queue wq;
+};
+
+#endif /* !FEV_WAITGROUP_H */
@@ -0,0 +1,166 @@
+/*
+ * Copyright 2020 Patryk Stefanski
+ *
+ * Licensed under the Apache License, Version 2.0, <LICENSE-APACHE or
+ * http://apache.org/licenses/LICENSE-2.0> or the MIT license <LICENSE-MIT or
+ * http://opensource.org/licenses/MIT>, at your option. This file may not be
+ * copied, modified, or distributed except according to those terms.
+ */
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fev/fev.h>
+
+#include "fev_alloc.h"
+#include "fev_assert.h"
+#include "fev_compiler.h"
+#include "fev_sched_impl.h"
+
+struct fev_worker_local {
+  struct fev_sched *sched;
+  uint32_t num_workers;
+
+  /* Size of a slot rounded up to the cache line size. */
+  size_t stride;
+
+  char *slots;
+};
+
+FEV_NONNULL(1, 2)
+int fev_worker_local_create(struct fev_worker_local **worker_local_ptr, struct fev_sched *sched,
+                            size_t size)
+{
+  struct fev_worker_local *worker_local;
+  uint32_t num_workers = sched->num_workers;
+  size_t stride;
+
+  /* Keep the size of all slots (plus the alignment) from overflowing. */
+  if (FEV_UNLIKELY(size == 0 || size > SIZE_MAX / 2 / num_workers))
+    return -EINVAL;
+
+  stride = (size + FEV_DCACHE_LINE_SIZE - 1) & ~(size_t)(FEV_DCACHE_LINE_SIZE - 1);
+
+  worker_local = fev_malloc(sizeof(*worker_local));
+  if (FEV_UNLIKELY(worker_local == NULL))
+    return -ENOMEM;
+
+  worker_local->slots = fev_aligned_alloc(FEV_DCACHE_LINE_SIZE, num_workers * stride);
+  if (FEV_UNLIKELY(worker_local->slots == NULL)) {
+    fev_free(worker_local);
+    return -ENOMEM;
+  }
+
+  memset(worker_local->slots, 0, num_workers * stride);
+
+  worker_local->sched = sched;
+  worker_local->num_workers = num_workers;
+  worker_local->stride = stride;
+
+  *worker_local_ptr = worker_local;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_worker_local_destroy(struct fev_worker_local *worker_local)
+{
+  fev_aligned_free(worker_local->slots);
+  fev_free(worker_local);
+}
+
+FEV_NONNULL(1) void *fev_worker_local_at(struct fev_worker_local *worker_local, uint32_t index)
+{
+  FEV_ASSERT(index < worker_local->num_workers);
+  return worker_local->slots + index * worker_local->stride;
+}
+
+FEV_NONNULL(1) void *fev_worker_local_get(struct fev_worker_local *worker_local)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  struct fev_sched *sched = worker_local->sched;
+
+  if (FEV_UNLIKELY(cur_worker == NULL || cur_worker->sched != sched))
+    return NULL;
+
+  return fev_worker_local_at(worker_local, (uint32_t)(cur_worker - sched->workers));
+}
+
+struct fev_counter_shard {
+  alignas(FEV_DCACHE_LINE_SIZE) _Atomic uint64_t value;
+};
+
+struct fev_counter {
+  struct fev_sched *sched;
+  uint32_t num_workers;
+
+  /*
+   * One shard per worker, written only by its worker. The last shard is shared by the threads
+   * outside of the scheduler and is updated with atomic RMW operations.
+   */
+  struct fev_counter_shard *shards;
+};
+
+FEV_NONNULL(1, 2) int fev_counter_create(struct fev_counter **counter_ptr, struct fev_sched *sched)
+{
+  struct fev_counter *counter;
+  uint32_t num_shards = sched->num_workers + 1;
+
+  counter = fev_malloc(sizeof(*counter));
+  if (FEV_UNLIKELY(counter == NULL))
+    return -ENOMEM;
+
+  counter->shards = fev_aligned_alloc(FEV_DCACHE_LINE_SIZE, num_shards * sizeof(*counter->shards));
+  if (FEV_UNLIKELY(counter->shards == NULL)) {
+    fev_free(counter);
+    return -ENOMEM;
+  }
+
+  for (uint32_t i = 0; i < num_shards; i++)
+    atomic_init(&counter->shards[i].value, 0);
+
+  counter->sched = sched;
+  counter->num_workers = sched->num_workers;
+
+  *counter_ptr = counter;
+  return 0;
+}
+
+FEV_NONNULL(1) void fev_counter_destroy(struct fev_counter *counter)
+{
+  fev_aligned_free(counter->shards);
+  fev_free(counter);
+}
+
+FEV_NONNULL(1) void fev_counter_add(struct fev_counter *counter, uint64_t value)
+{
+  struct fev_sched_worker *cur_worker = fev_cur_sched_worker;
+  struct fev_sched *sched = counter->sched;
+  _Atomic uint64_t *shard;
+
+  if (FEV_UNLIKELY(cur_worker == NULL || cur_worker->sched != sched)) {
+    shard = &counter->shards[counter->num_workers].value;
+    atomic_fetch_add_explicit(shard, value, memory_order_relaxed);
+    return;
+  }
+
+  /*
+   * The fiber cannot be migrated here and only this worker writes the shard, thus a plain add is
+   * enough. The relaxed load and store only make the concurrent reads well-defined.
+   */
+  shard = &counter->shards[cur_worker - sched->workers].value;
+  atomic_store_explicit(shard, atomic_load_explicit(shard, memory_order_relaxed) + value,
+                        memory_order_relaxed);
+}
+
+FEV_NONNULL(1) uint64_t fev_counter_read(const struct fev_counter *counter)
+{
+  uint64_t sum = 0;
+
+  for (uint32_t i = 0; i <= counter->num_workers; i++)
+    sum += atomic_load_explicit(&counter->shards[i].value, memory_order_relaxed);
+
+  return sum;
+}
@@ -0,0 +1,165 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_workers;
+static uint32_t num_fibers;
+static uint32_t num_phases;
+
+static struct fev_latch *start_latch;
+static struct fev_barrier *barrier;
+
+/* Number of fibers that have arrived in each phase and the number of fibers expected in it. */
+static _Atomic uint32_t *arrived;
+static uint32_t *expected;
+
+/* Incremented only by the completion, which runs exclusively. */
+static uint32_t num_completed;
+
+/* Even fibers take part in all phases, odd fibers drop out in the phase returned here. */
+static uint32_t last_phase(uint32_t index)
+{
+  return index % 2 == 0 ? num_phases : index / 2 % num_phases;
+}
+
+static void complete(void *arg)
+{
+  uint32_t value;
+
+  CHECK(arg == &num_completed, "The completion argument is incorrect");
+  CHECK(num_completed < num_phases, "Too many phases have completed");
+
+  value = atomic_load(&arrived[num_completed]);
+  CHECK(value == expected[num_completed],
+        "Not all fibers have arrived: phase=%" PRIu32 " arrived=%" PRIu32 " expected=%" PRIu32,
+        num_completed, value, expected[num_completed]);
+
+  num_completed++;
+}
+
+static void *work(void *arg)
+{
+  uint32_t index = (uint32_t)(uintptr_t)arg;
+  uint32_t last = last_phase(index);
+  uint32_t value, token;
+
+  fev_latch_arrive_and_wait(start_latch, 1);
+  CHECK(fev_latch_try_wait(start_latch), "The latch has not been released");
+
+  for (uint32_t phase = 0; phase < num_phases; phase++) {
+    atomic_fetch_add(&arrived[phase], 1);
+
+    if (phase == last) {
+      fev_barrier_arrive_and_drop(barrier);
+      return NULL;
+    }
+
+    /* Mix both ways of waiting. */
+    if (index % 4 < 2) {
+      fev_barrier_arrive_and_wait(barrier);
+    } else {
+      token = fev_barrier_arrive(barrier);
+      fev_yield();
+      fev_barrier_wait(barrier, token);
+    }
+
+    value = atomic_load(&arrived[phase]);
+    CHECK(value == expected[phase],
+          "The barrier released too early: phase=%" PRIu32 " arrived=%" PRIu32
+          " expected=%" PRIu32,
+          phase, value, expected[phase]);
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)i, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  CHECK(num_completed == num_phases,
+        "Not all phases have completed: completed=%" PRIu32 " expected=%" PRIu32, num_completed,
+        num_phases);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_phases>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_phases = parse_uint32_t(argv[3], "num_phases", &(uint32_t){1});
+
+  arrived = malloc((size_t)num_phases * sizeof(*arrived));
+  CHECK(arrived != NULL, "Allocating memory for arrivals failed");
+
+  expected = calloc(num_phases, sizeof(*expected));
+  CHECK(expected != NULL, "Allocating memory for expected arrivals failed");
+
+  for (uint32_t phase = 0; phase < num_phases; phase++)
+    atomic_init(&arrived[phase], 0);
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    for (uint32_t phase = 0; phase < num_phases && phase <= last_phase(i); phase++)
+      expected[phase]++;
+  }
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_latch_create(&start_latch, num_fibers);
+  CHECK(err == 0, "Creating latch failed: err=%i", err);
+
+  err = fev_barrier_create(&barrier, num_fibers, &complete, &num_completed);
+  CHECK(err == 0, "Creating barrier failed: err=%i", err);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_barrier_destroy(barrier);
+  fev_latch_destroy(start_latch);
+  fev_sched_destroy(sched);
+  free(expected);
+  free(arrived);
+
+  return 0;
+}
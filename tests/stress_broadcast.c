@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_workers;
+static uint32_t num_subscribers;
+static uint32_t num_messages;
+static uint32_t capacity;
+
+static struct fev_broadcast *broadcast;
+
+static void *publish(void *arg)
+{
+  int res;
+
+  (void)arg;
+
+  /* The messages are the sequence numbers plus 1, thus they are never NULL. */
+  for (uint32_t i = 1; i <= num_messages; i++) {
+    res = fev_broadcast_send(broadcast, (void *)(uintptr_t)i);
+    CHECK(res == 0, "Sending failed: err=%i", res);
+
+    if (i % 16 == 0)
+      fev_yield();
+  }
+
+  fev_broadcast_close(broadcast);
+  return NULL;
+}
+
+static void *receive(void *arg)
+{
+  struct fev_broadcast_sub *sub = arg;
+  uint64_t num_received = 0, num_missed;
+  void *elem;
+  int res;
+
+  for (;;) {
+    res = fev_broadcast_recv(sub, &elem);
+    if (res == -EPIPE)
+      break;
+    if (res == -EOVERFLOW)
+      continue;
+    CHECK(res == 0, "Receiving failed: err=%i", res);
+
+    /* The messages are received in order, only the skipped ones can be missing. */
+    num_received++;
+    num_missed = fev_broadcast_sub_num_missed(sub);
+    CHECK((uintptr_t)elem == num_received + num_missed,
+          "The message is incorrect: message=%" PRIuPTR " received=%" PRIu64 " missed=%" PRIu64,
+          (uintptr_t)elem, num_received, num_missed);
+
+    /* Let the sender get ahead from time to time. */
+    if (num_received % 7 == 0)
+      fev_yield();
+  }
+
+  num_missed = fev_broadcast_sub_num_missed(sub);
+  CHECK(num_received + num_missed == num_messages,
+        "Not all messages were received: received=%" PRIu64 " missed=%" PRIu64
+        " expected=%" PRIu32,
+        num_received, num_missed, num_messages);
+
+  if (capacity >= num_messages)
+    CHECK(num_missed == 0, "Messages were missed: missed=%" PRIu64, num_missed);
+
+  fev_broadcast_unsubscribe(sub);
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_broadcast_sub *sub;
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  fibers = malloc(((size_t)num_subscribers + 1) * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  /* Subscribe before anything is sent. */
+  for (uint32_t i = 0; i < num_subscribers; i++) {
+    err = fev_broadcast_subscribe(broadcast, &sub);
+    CHECK(err == 0, "Subscribing failed: err=%i", err);
+
+    err = fev_fiber_create(&fibers[i], NULL, &receive, sub, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  err = fev_fiber_create(&fibers[num_subscribers], NULL, &publish, NULL, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  for (uint32_t i = 0; i <= num_subscribers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_subscribers> <num_messages> <capacity>",
+        argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_subscribers = parse_uint32_t(argv[2], "num_subscribers", &(uint32_t){1});
+  num_messages = parse_uint32_t(argv[3], "num_messages", &(uint32_t){1});
+  capacity = parse_uint32_t(argv[4], "capacity", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_broadcast_create(&broadcast, capacity);
+  CHECK(err == 0, "Creating broadcast failed: err=%i", err);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_broadcast_destroy(broadcast);
+  fev_sched_destroy(sched);
+
+  return 0;
+}
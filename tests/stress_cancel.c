@@ -0,0 +1,180 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_rounds;
+
+static struct fev_sem *sem;
+static struct fev_cond *cond;
+static struct fev_mutex *mutex;
+static _Atomic uint64_t num_ops;
+
+/* Blocks in random cancellation points until canceled, returns the number of finished ops. */
+static void *work(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 1000};
+  uintptr_t ops = 0;
+  uint32_t r;
+  int ret;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (;;) {
+    r = FEV_RANDOM_NEXT(r);
+    switch (r % 5) {
+    case 0:
+      ret = fev_sem_wait(sem);
+      if (ret == 0)
+        fev_sem_post(sem);
+      break;
+
+    case 1:
+      ret = fev_sem_wait_for(sem, &rel_time);
+      if (ret == 0)
+        fev_sem_post(sem);
+      else if (ret == -ETIMEDOUT)
+        ret = 0;
+      break;
+
+    case 2:
+      fev_mutex_lock(mutex);
+      if (r & 8)
+        fev_cond_notify_all(cond);
+      else
+        fev_cond_notify_one(cond);
+      ret = fev_cond_wait(cond, mutex);
+      fev_mutex_unlock(mutex);
+      break;
+
+    case 3: {
+      struct fev_select_case cases[2] = {
+          {.op = FEV_SELECT_SEM_WAIT, .sem = sem},
+          {.op = FEV_SELECT_COND_WAIT, .cond = cond, .mutex = mutex},
+      };
+
+      fev_mutex_lock(mutex);
+      ret = fev_select_for(cases, 2, &rel_time);
+      fev_mutex_unlock(mutex);
+      if (ret == 0)
+        fev_sem_post(sem);
+      if (ret >= 0 || ret == -ETIMEDOUT)
+        ret = 0;
+      break;
+    }
+
+    default:
+      ret = fev_sleep_for(&rel_time);
+      break;
+    }
+
+    if (ret == -ECANCELED)
+      break;
+
+    CHECK(ret == 0, "Blocking call failed: err=%i", ret);
+    ops++;
+  }
+
+  atomic_fetch_add(&num_ops, ops);
+
+  return (void *)ops;
+}
+
+static void *test(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 100 * 1000};
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  err = fev_sem_create(&sem, 1);
+  CHECK(err == 0, "Creating sem failed with: err=%i", err);
+
+  err = fev_cond_create(&cond);
+  CHECK(err == 0, "Creating cond failed with: err=%i", err);
+
+  err = fev_mutex_create(&mutex);
+  CHECK(err == 0, "Creating mutex failed with: err=%i", err);
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t round = 0; round < num_rounds; round++) {
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)rand(), NULL);
+      CHECK(err == 0, "Creating fiber failed: err=%i", err);
+    }
+
+    /* Let some fibers block, cancel either right away or after a while. */
+    if (round % 2 == 1) {
+      err = fev_sleep_for(&rel_time);
+      CHECK(err == 0, "Sleeping failed: err=%i", err);
+    }
+
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      err = fev_fiber_cancel(fibers[i]);
+      CHECK(err == 0, "Canceling fiber failed: err=%i", err);
+    }
+
+    /* Joining with canceled fibers must not hang. */
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      err = fev_fiber_join(fibers[i], NULL);
+      CHECK(err == 0, "Joining fiber failed: err=%i", err);
+    }
+  }
+
+  free(fibers);
+
+  fev_mutex_destroy(mutex);
+  fev_cond_destroy(cond);
+  fev_sem_destroy(sem);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_rounds>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_rounds = parse_uint32_t(argv[3], "num_rounds", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  printf("num_ops: %" PRIu64 "\n", atomic_load(&num_ops));
+
+  return 0;
+}
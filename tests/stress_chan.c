@@ -0,0 +1,215 @@
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+#define BATCH_SIZE 8
+
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+static uint32_t capacity;
+
+static struct fev_chan *chan;
+static _Atomic uint64_t sum_sent;
+static _Atomic uint64_t sum_received;
+static _Atomic uint64_t num_timeouts;
+
+static void *producer(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 1000};
+  void *elems[BATCH_SIZE];
+  uint64_t sum = 0, timeouts = 0;
+  uint32_t r;
+  ssize_t n;
+  int ret;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (uint32_t i = 0; i < num_iterations;) {
+    uintptr_t value = i % 1000 + 1;
+
+    r = FEV_RANDOM_NEXT(r);
+    switch (r % 4) {
+    case 0:
+      ret = fev_chan_send(chan, (void *)value);
+      CHECK(ret == 0, "fev_chan_send() failed: err=%i", ret);
+      break;
+
+    case 1:
+      ret = fev_chan_try_send(chan, (void *)value);
+      if (ret == -EAGAIN) {
+        fev_yield();
+        continue;
+      }
+      CHECK(ret == 0, "fev_chan_try_send() failed: err=%i", ret);
+      break;
+
+    case 2:
+      ret = fev_chan_send_for(chan, (void *)value, &rel_time);
+      if (ret == -ETIMEDOUT) {
+        timeouts++;
+        continue;
+      }
+      CHECK(ret == 0, "fev_chan_send_for() failed: err=%i", ret);
+      break;
+
+    default:
+      for (uint32_t j = 0; j < BATCH_SIZE; j++)
+        elems[j] = (void *)value;
+      n = fev_chan_send_n(chan, elems, BATCH_SIZE);
+      CHECK(n > 0 && n <= BATCH_SIZE, "fev_chan_send_n() failed: err=%zi", n);
+      sum += (uint64_t)value * (uint64_t)(n - 1);
+      break;
+    }
+
+    sum += value;
+    i++;
+  }
+
+  atomic_fetch_add(&sum_sent, sum);
+  atomic_fetch_add(&num_timeouts, timeouts);
+
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 1000};
+  void *elems[BATCH_SIZE];
+  uint64_t sum = 0;
+  uint32_t r;
+  ssize_t n;
+  void *elem;
+  int ret;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (;;) {
+    r = FEV_RANDOM_NEXT(r);
+    switch (r % 3) {
+    case 0:
+      ret = fev_chan_recv(chan, &elem);
+      break;
+
+    case 1:
+      ret = fev_chan_recv_for(chan, &elem, &rel_time);
+      if (ret == -ETIMEDOUT)
+        continue;
+      break;
+
+    default:
+      n = fev_chan_recv_n(chan, elems, BATCH_SIZE);
+      ret = n < 0 ? (int)n : 0;
+      for (ssize_t j = 0; j < n; j++)
+        sum += (uintptr_t)elems[j];
+      break;
+    }
+
+    if (ret == -EPIPE)
+      break;
+
+    CHECK(ret == 0, "Receiving failed: err=%i", ret);
+
+    if (r % 3 != 2)
+      sum += (uintptr_t)elem;
+  }
+
+  atomic_fetch_add(&sum_received, sum);
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **producers, **consumers;
+  int err;
+
+  (void)arg;
+
+  err = fev_chan_create(&chan, capacity);
+  CHECK(err == 0, "Creating channel failed with: err=%i", err);
+
+  producers = malloc((size_t)num_fibers * sizeof(*producers));
+  CHECK(producers != NULL, "Allocating memory for fibers failed");
+
+  consumers = malloc((size_t)num_fibers * sizeof(*consumers));
+  CHECK(consumers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&consumers[i], NULL, &consumer, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+    err = fev_fiber_create(&producers[i], NULL, &producer, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(producers[i], NULL);
+
+  /* The consumers drain the channel and stop. */
+  fev_chan_close(chan);
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(consumers[i], NULL);
+
+  err = fev_chan_send(chan, NULL);
+  CHECK(err == -EPIPE, "Sending to closed channel should fail: err=%i", err);
+
+  free(consumers);
+  free(producers);
+
+  fev_chan_destroy(chan);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  uint64_t sent, received;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_iterations> <capacity>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+  capacity = parse_uint32_t(argv[4], "capacity", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  sent = atomic_load(&sum_sent);
+  received = atomic_load(&sum_received);
+  printf("sent: %" PRIu64 ", received: %" PRIu64 ", num_timeouts: %" PRIu64 "\n", sent, received,
+         atomic_load(&num_timeouts));
+
+  return sent != received;
+}
@@ -0,0 +1,147 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_rounds;
+
+static struct fev_cond *cond;
+static struct fev_mutex *mutex;
+static uint32_t num_arrived;
+static uint32_t generation;
+static uint64_t counter;
+
+/*
+ * A barrier built on fev_cond_notify_all(). The last fiber of a round notifies the others, either
+ * with the mutex held (the waiters are moved to the mutex) or after unlocking it (the mutex is
+ * handed over to the first waiter). Every other fiber waits with a timeout to mix in timed out
+ * waiters that are moved to the mutex.
+ */
+static void *work(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 10 * 1000};
+  uintptr_t index = (uintptr_t)arg;
+  uint32_t gen;
+  int res;
+
+  for (uint32_t round = 0; round < num_rounds; round++) {
+    fev_mutex_lock(mutex);
+
+    counter++;
+    gen = generation;
+
+    if (++num_arrived == num_fibers) {
+      num_arrived = 0;
+      generation++;
+
+      if (round % 2 == 0) {
+        fev_cond_notify_all(cond);
+        fev_mutex_unlock(mutex);
+      } else {
+        fev_mutex_unlock(mutex);
+        fev_cond_notify_all(cond);
+      }
+      continue;
+    }
+
+    while (gen == generation) {
+      if (index % 2 == 0) {
+        res = fev_cond_wait(cond, mutex);
+        CHECK(res == 0, "Waiting for condition variable failed: err=%i", res);
+      } else {
+        res = fev_cond_wait_for(cond, mutex, &rel_time);
+        CHECK(res == 0 || res == -ETIMEDOUT, "Waiting for condition variable failed: err=%i",
+              res);
+
+        /* The mutex is not reacquired on timeout. */
+        if (res == -ETIMEDOUT)
+          fev_mutex_lock(mutex);
+      }
+    }
+
+    fev_mutex_unlock(mutex);
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  uint64_t expected;
+  int err;
+
+  (void)arg;
+
+  err = fev_cond_create(&cond);
+  CHECK(err == 0, "Creating condition variable failed: err=%i", err);
+
+  err = fev_mutex_create(&mutex);
+  CHECK(err == 0, "Creating mutex failed: err=%i", err);
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)i, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  expected = (uint64_t)num_fibers * num_rounds;
+  CHECK(counter == expected,
+        "The counter value is incorrect: counter=%" PRIu64 " expected=%" PRIu64, counter,
+        expected);
+  CHECK(generation == num_rounds, "The generation is incorrect: generation=%" PRIu32,
+        generation);
+
+  fev_mutex_destroy(mutex);
+  fev_cond_destroy(cond);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_rounds>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_rounds = parse_uint32_t(argv[3], "num_rounds", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  return 0;
+}
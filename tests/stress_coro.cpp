@@ -0,0 +1,247 @@
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <fev/fev++.hpp>
+
+#include "util.h"
+
+// Coroutines and stackful fibers contend on the same mutex and semaphore, so the locks are handed
+// over between both kinds of fibers. Then coroutines echo messages over sockets.
+
+#define NUM_SEM_UNITS 2
+#define MESSAGE_SIZE 64
+
+static std::uint32_t num_fibers;
+static std::uint32_t num_coroutines;
+static std::uint32_t num_iterations;
+
+static fev::mutex *mutex;
+static fev::semaphore *sem;
+
+// Posted by each coroutine when it finishes, the coroutines cannot be joined.
+static fev::semaphore *done;
+
+// Protected by `mutex`.
+static std::uint64_t counter;
+
+static std::atomic<std::uint32_t> num_in_section;
+
+static std::uint64_t final_counter;
+static std::atomic<std::uint64_t> bytes_echoed;
+
+#if defined(FEV_POLLER_EPOLL) || defined(FEV_POLLER_KQUEUE)
+static fev::socket *listener;
+static sockaddr_in listener_address;
+#endif
+
+static void enter_section()
+{
+  std::uint32_t n = num_in_section.fetch_add(1) + 1;
+  CHECK(n <= NUM_SEM_UNITS, "Too many fibers in the section: %" PRIu32, n);
+}
+
+static void leave_section() { num_in_section.fetch_sub(1); }
+
+static void work()
+{
+  for (std::uint32_t i = 0; i < num_iterations; i++) {
+    mutex->lock();
+    counter++;
+    if (i % 4 == 0)
+      fev::this_fiber::yield();
+    mutex->unlock();
+
+    sem->wait();
+    enter_section();
+    fev::this_fiber::yield();
+    leave_section();
+    sem->post();
+  }
+}
+
+// Some increments hold the mutex across a suspension, thus the waiters pile up.
+static fev::task<std::uint64_t> locked_increment(bool suspend)
+{
+  co_await mutex->async_lock();
+  std::uint64_t value = ++counter;
+  if (suspend)
+    co_await fev::this_coroutine::yield();
+  mutex->unlock();
+  co_return value;
+}
+
+static fev::task<> work_coro()
+{
+  for (std::uint32_t i = 0; i < num_iterations; i++) {
+    std::uint64_t value = co_await locked_increment(i % 4 == 0);
+    CHECK(value > 0, "The value is incorrect");
+
+    co_await sem->async_wait();
+    enter_section();
+    co_await fev::this_coroutine::yield();
+    leave_section();
+    sem->post();
+
+    if (i % 16 == 0)
+      co_await fev::this_coroutine::sleep_for(std::chrono::microseconds{1});
+  }
+
+  done->post();
+}
+
+#if defined(FEV_POLLER_EPOLL) || defined(FEV_POLLER_KQUEUE)
+static fev::task<> echo(fev::socket socket)
+{
+  std::uint8_t buffer[MESSAGE_SIZE];
+  std::uint64_t total = 0;
+  std::size_t n;
+
+  while ((n = co_await socket.async_read(buffer, sizeof(buffer))) > 0) {
+    for (std::size_t written = 0; written < n;)
+      written += co_await socket.async_write(buffer + written, n - written);
+    total += n;
+  }
+
+  bytes_echoed.fetch_add(total);
+  done->post();
+}
+
+static fev::task<> accept_all()
+{
+  for (std::uint32_t i = 0; i < num_coroutines; i++) {
+    fev::socket socket = co_await listener->async_accept();
+    fev::co_spawn(echo(std::move(socket)));
+  }
+
+  done->post();
+}
+
+static fev::task<> client()
+{
+  std::uint8_t out[MESSAGE_SIZE], in[MESSAGE_SIZE];
+  fev::socket socket{};
+
+  socket.open(AF_INET, SOCK_STREAM, 0);
+  co_await socket.async_connect(reinterpret_cast<sockaddr *>(&listener_address),
+                                sizeof(listener_address));
+
+  for (std::uint32_t i = 0; i < num_iterations; i++) {
+    for (std::size_t j = 0; j < sizeof(out); j++)
+      out[j] = static_cast<std::uint8_t>(i + j);
+
+    for (std::size_t written = 0; written < sizeof(out);)
+      written += co_await socket.async_write(out + written, sizeof(out) - written);
+
+    for (std::size_t received = 0; received < sizeof(in);) {
+      std::size_t n = co_await socket.async_read(in + received, sizeof(in) - received);
+      CHECK(n > 0, "The connection has been closed");
+      received += n;
+    }
+
+    for (std::size_t j = 0; j < sizeof(in); j++)
+      CHECK(in[j] == out[j], "The echo is incorrect: message=%" PRIu32 " index=%zu", i, j);
+  }
+
+  done->post();
+}
+
+static void echo_test()
+{
+  socklen_t address_len = sizeof(listener_address);
+  fev::socket socket{};
+
+  socket.open(AF_INET, SOCK_STREAM, 0);
+
+  listener_address.sin_family = AF_INET;
+  listener_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener_address.sin_port = 0;
+  socket.bind(reinterpret_cast<sockaddr *>(&listener_address), sizeof(listener_address));
+  socket.listen(static_cast<int>(num_coroutines));
+
+  int err = getsockname(socket.native_handle(), reinterpret_cast<sockaddr *>(&listener_address),
+                        &address_len);
+  CHECK(err == 0, "Getting socket name failed");
+
+  listener = &socket;
+
+  fev::co_spawn(accept_all());
+  for (std::uint32_t i = 0; i < num_coroutines; i++)
+    fev::co_spawn(client());
+
+  // The acceptor, the clients and the echo coroutines.
+  done->wait(num_coroutines * 2 + 1);
+
+  listener = nullptr;
+}
+#endif
+
+static void test()
+{
+  fev::mutex test_mutex;
+  fev::semaphore test_sem{NUM_SEM_UNITS};
+  fev::semaphore test_done{0};
+  std::vector<fev::fiber> fibers;
+
+  mutex = &test_mutex;
+  sem = &test_sem;
+  done = &test_done;
+
+  for (std::uint32_t i = 0; i < num_coroutines; i++)
+    fev::co_spawn(work_coro());
+
+  for (std::uint32_t i = 0; i < num_fibers; i++)
+    fibers.emplace_back(&work);
+
+  for (auto &fiber : fibers)
+    fiber.join();
+
+  done->wait(num_coroutines);
+
+  test_mutex.lock();
+  final_counter = counter;
+  test_mutex.unlock();
+
+#if defined(FEV_POLLER_EPOLL) || defined(FEV_POLLER_KQUEUE)
+  echo_test();
+#endif
+}
+
+int main(int argc, char **argv)
+{
+  std::uint32_t num_workers, min_value = 1;
+  std::uint64_t expected;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_coroutines> <num_iterations>",
+        argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &min_value);
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &min_value);
+  num_coroutines = parse_uint32_t(argv[3], "num_coroutines", &min_value);
+  num_iterations = parse_uint32_t(argv[4], "num_iterations", &min_value);
+
+  fev::sched_attr sched_attr{};
+  sched_attr.set_num_workers(num_workers);
+
+  fev::sched sched{sched_attr};
+  fev::fiber::spawn(sched, &test);
+  sched.run();
+
+  expected = static_cast<std::uint64_t>(num_fibers + num_coroutines) * num_iterations;
+  std::printf("counter: %" PRIu64 ", echoed: %" PRIu64 "\n", final_counter, bytes_echoed.load());
+  CHECK(final_counter == expected, "The counter is incorrect: expected=%" PRIu64, expected);
+
+#if defined(FEV_POLLER_EPOLL) || defined(FEV_POLLER_KQUEUE)
+  expected = static_cast<std::uint64_t>(num_coroutines) * num_iterations * MESSAGE_SIZE;
+  CHECK(bytes_echoed.load() == expected, "The number of bytes is incorrect: expected=%" PRIu64,
+        expected);
+#endif
+
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+/* Enough keys to use both the inline and the heap-allocated values. */
+#define NUM_KEYS 12
+
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+
+static fev_fls_key_t keys[NUM_KEYS];
+static atomic_uint_fast64_t num_destroyed;
+
+static void destroy(void *value)
+{
+  free(value);
+  atomic_fetch_add(&num_destroyed, 1);
+}
+
+static void *work(void *arg)
+{
+  uintptr_t id = (uintptr_t)arg;
+  int err;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    for (uint32_t k = 0; k < NUM_KEYS; k++) {
+      uintptr_t *value = fev_fls_get(keys[k]);
+
+      if (i == 0) {
+        CHECK(value == NULL, "Value is set before the first fev_fls_set()");
+
+        value = malloc(sizeof(*value));
+        CHECK(value != NULL, "Allocating memory for value failed");
+        *value = id * NUM_KEYS + k;
+
+        err = fev_fls_set(keys[k], value);
+        CHECK(err == 0, "Setting value failed: err=%i", err);
+      } else {
+        CHECK(value != NULL && *value == id * NUM_KEYS + k, "Wrong value of fiber %" PRIuPTR, id);
+      }
+    }
+
+    /* Let other fibers run on this worker. */
+    fev_yield();
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  for (uint32_t k = 0; k < NUM_KEYS; k++) {
+    err = fev_fls_key_create(&keys[k], &destroy);
+    CHECK(err == 0, "Creating key failed: err=%i", err);
+  }
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)i, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint64_t expected;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_iterations>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  expected = (uint64_t)num_fibers * NUM_KEYS;
+  printf("destroyed: %" PRIu64 ", expected: %" PRIu64 "\n", (uint64_t)atomic_load(&num_destroyed),
+         expected);
+
+  return 0;
+}
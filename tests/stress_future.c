@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_rounds;
+
+static struct fev_future *futures;
+static struct fev_future **future_ptrs;
+static uint64_t *values;
+
+/* Sets the future after a random number of yields. */
+static void *work(void *arg)
+{
+  uint32_t index = (uint32_t)(uintptr_t)arg;
+  uint32_t r = FEV_RANDOM_NEXT(index + 1);
+
+  for (uint32_t i = 0; i < r % 4; i++)
+    fev_yield();
+
+  values[index] = (uint64_t)index * 3 + 1;
+  fev_future_set(&futures[index]);
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 10, .tv_nsec = 0};
+  int err;
+
+  (void)arg;
+
+  futures = malloc((size_t)num_fibers * sizeof(*futures));
+  CHECK(futures != NULL, "Allocating memory for futures failed");
+
+  future_ptrs = malloc((size_t)num_fibers * sizeof(*future_ptrs));
+  CHECK(future_ptrs != NULL, "Allocating memory for futures failed");
+
+  values = malloc((size_t)num_fibers * sizeof(*values));
+  CHECK(values != NULL, "Allocating memory for values failed");
+
+  for (uint32_t round = 0; round < num_rounds; round++) {
+    uint32_t num_left = num_fibers;
+
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      fev_future_init(&futures[i]);
+      future_ptrs[i] = &futures[i];
+      values[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      err = fev_fiber_spawn(NULL, &work, (void *)(uintptr_t)i);
+      CHECK(err == 0, "Creating fiber failed: err=%i", err);
+    }
+
+    switch (round % 3) {
+    case 0:
+      for (uint32_t i = 0; i < num_fibers; i++) {
+        err = fev_future_wait(&futures[i]);
+        CHECK(err == 0, "fev_future_wait() failed: err=%i", err);
+      }
+      break;
+
+    case 1:
+      for (uint32_t i = 0; i < num_fibers; i++) {
+        err = fev_future_wait_for(&futures[i], &rel_time);
+        CHECK(err == 0, "fev_future_wait_for() failed: err=%i", err);
+      }
+      break;
+
+    default:
+      /* Wait for any future and remove it from the array until no future is left. */
+      while (num_left > 0) {
+        err = fev_future_wait_any(future_ptrs, num_left);
+        CHECK(err >= 0 && (uint32_t)err < num_left, "fev_future_wait_any() failed: err=%i", err);
+        future_ptrs[err] = future_ptrs[--num_left];
+      }
+      break;
+    }
+
+    for (uint32_t i = 0; i < num_fibers; i++) {
+      CHECK(fev_future_is_set(&futures[i]), "Future %" PRIu32 " is not set", i);
+      CHECK(values[i] == (uint64_t)i * 3 + 1, "Value of future %" PRIu32 " is not visible", i);
+    }
+  }
+
+  free(values);
+  free(future_ptrs);
+  free(futures);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_rounds>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_rounds = parse_uint32_t(argv[3], "num_rounds", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  return 0;
+}
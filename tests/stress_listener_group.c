@@ -0,0 +1,156 @@
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_listeners;
+static uint32_t num_connections;
+static uint32_t num_messages;
+
+static struct fev_listener_group *group;
+static struct sockaddr_in listener_address;
+
+static _Atomic uint32_t num_served;
+static _Atomic uint64_t bytes_echoed;
+static _Atomic uint64_t bytes_sent;
+
+/* Echoes a connection, see echo_serve(). */
+static void echo(struct fev_socket *socket, void *arg)
+{
+  CHECK(arg == &num_served, "The handler argument is incorrect");
+
+  atomic_fetch_add(&bytes_echoed, echo_serve(socket));
+  atomic_fetch_add(&num_served, 1);
+}
+
+/* Sends messages of random sizes, see echo_client(). */
+static void *client(void *arg)
+{
+  uint32_t seed = (uint32_t)(uintptr_t)arg;
+
+  atomic_fetch_add(&bytes_sent, echo_client(&listener_address, num_messages, seed));
+  return NULL;
+}
+
+static void open_group(void)
+{
+  socklen_t address_len = sizeof(listener_address);
+  struct fev_socket *listener;
+  int err;
+
+  listener_address.sin_family = AF_INET;
+  listener_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener_address.sin_port = 0;
+
+  err = fev_listener_group_create(&group, num_listeners, (struct sockaddr *)&listener_address,
+                                  sizeof(listener_address), (int)num_connections);
+  CHECK(err == 0, "Creating listener group failed: err=%i", err);
+
+  CHECK(fev_listener_group_num_listeners(group) == num_listeners,
+        "The number of listeners is incorrect");
+
+  /* All listeners must share the port chosen for the first one. */
+  listener = fev_listener_group_listener(group, 0);
+  err = getsockname(fev_socket_native_handle(listener), (struct sockaddr *)&listener_address,
+                    &address_len);
+  CHECK(err == 0, "Getting socket name failed");
+
+  for (uint32_t i = 1; i < num_listeners; i++) {
+    struct sockaddr_in address;
+
+    address_len = sizeof(address);
+    listener = fev_listener_group_listener(group, i);
+    err = getsockname(fev_socket_native_handle(listener), (struct sockaddr *)&address,
+                      &address_len);
+    CHECK(err == 0, "Getting socket name failed");
+    CHECK(address.sin_port == listener_address.sin_port, "The port is incorrect: listener=%" PRIu32,
+          i);
+  }
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **clients;
+  int err;
+
+  (void)arg;
+
+  open_group();
+
+  err = fev_listener_group_start(group, &echo, &num_served);
+  CHECK(err == 0, "Starting listener group failed: err=%i", err);
+
+  clients = malloc((size_t)num_connections * sizeof(*clients));
+  CHECK(clients != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_connections; i++) {
+    err = fev_fiber_create(&clients[i], NULL, &client, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_connections; i++)
+    fev_fiber_join(clients[i], NULL);
+
+  free(clients);
+
+  err = fev_listener_group_stop(group);
+  CHECK(err == 0, "Stopping listener group failed: err=%i", err);
+
+  fev_listener_group_destroy(group);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers, served;
+  uint64_t sent, echoed;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_listeners> <num_connections> <num_messages>",
+        argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_listeners = parse_uint32_t(argv[2], "num_listeners", &(uint32_t){1});
+  num_connections = parse_uint32_t(argv[3], "num_connections", &(uint32_t){1});
+  num_messages = parse_uint32_t(argv[4], "num_messages", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  /* The handlers are detached, but the scheduler has run all fibers to completion. */
+  served = atomic_load(&num_served);
+  sent = atomic_load(&bytes_sent);
+  echoed = atomic_load(&bytes_echoed);
+  printf("served: %" PRIu32 ", sent: %" PRIu64 ", echoed: %" PRIu64 "\n", served, sent, echoed);
+  CHECK(served == num_connections, "The number of connections is incorrect");
+  CHECK(sent == echoed, "The number of bytes is incorrect");
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_mcs_lock_impl.h"
+#include "../src/fev_spinlock_impl.h"
+#include "../src/fev_thr.h"
+#include "../src/fev_thr_mutex.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+/*
+ * Checks the MCS lock and compares it with the other internal locks: each lock is hammered by all
+ * threads, the time per critical section is printed.
+ */
+
+static struct fev_mcs_lock outer, inner;
+static struct fev_spinlock spinlock;
+static struct fev_thr_mutex mutex;
+static _Atomic uint32_t barrier;
+static uint32_t num_threads;
+static uint32_t num_iterations;
+static uint64_t counter;
+
+#define DEF_WORK(name, lock_stmt, unlock_stmt)                                                     \
+  static void *name(void *arg)                                                                     \
+  {                                                                                                \
+    (void)arg;                                                                                     \
+                                                                                                   \
+    /* Wait until all threads are created. */                                                     \
+    atomic_fetch_sub(&barrier, 1);                                                                 \
+    while (atomic_load_explicit(&barrier, memory_order_acquire) > 0)                               \
+      ;                                                                                            \
+                                                                                                   \
+    for (uint32_t i = 0; i < num_iterations; i++) {                                                \
+      lock_stmt;                                                                                   \
+      counter++;                                                                                   \
+      unlock_stmt;                                                                                 \
+    }                                                                                              \
+                                                                                                   \
+    return NULL;                                                                                   \
+  }
+
+DEF_WORK(work_mcs, fev_mcs_lock_lock(&outer), fev_mcs_lock_unlock(&outer))
+
+/* Nested locks use different nodes, the inner lock must be released first. */
+DEF_WORK(work_mcs_nested, (fev_mcs_lock_lock(&outer), fev_mcs_lock_lock(&inner)),
+         (fev_mcs_lock_unlock(&inner), fev_mcs_lock_unlock(&outer)))
+
+DEF_WORK(work_spinlock, fev_spinlock_lock(&spinlock), fev_spinlock_unlock(&spinlock))
+DEF_WORK(work_mutex, fev_thr_mutex_lock(&mutex), fev_thr_mutex_unlock(&mutex))
+
+#undef DEF_WORK
+
+static void run(const char *name, void *(*work)(void *))
+{
+  struct timespec start, end;
+  struct fev_thr *threads;
+  uint64_t expected, ns;
+  int err;
+
+  counter = 0;
+  atomic_store(&barrier, num_threads);
+
+  threads = malloc((size_t)num_threads * sizeof(*threads));
+  CHECK(threads != NULL, "Allocating memory for threads failed");
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (uint32_t i = 0; i < num_threads; i++) {
+    err = fev_thr_create(&threads[i], work, NULL);
+    CHECK(err == 0, "Creating thread failed, err=%d", err);
+  }
+
+  for (uint32_t i = 0; i < num_threads; i++)
+    fev_thr_join(&threads[i], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  free(threads);
+
+  expected = (uint64_t)num_threads * num_iterations;
+  CHECK(counter == expected, "%s: counter=%" PRIu64 ", expected=%" PRIu64, name, counter,
+        expected);
+
+  ns = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (uint64_t)end.tv_nsec -
+       (uint64_t)start.tv_nsec;
+  printf("%s: %.1f ns/op\n", name, (double)ns / (double)expected);
+}
+
+int main(int argc, char **argv)
+{
+  int err;
+
+  CHECK(argc == 3, "Usage: %s <num_threads> <num_iterations>", argv[0]);
+
+  num_threads = parse_uint32_t(argv[1], "num_threads", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[2], "num_iterations", &(uint32_t){1});
+
+  err = fev_mcs_lock_init(&outer);
+  CHECK(err == 0, "Initializing MCS lock failed: err=%i", err);
+
+  err = fev_mcs_lock_init(&inner);
+  CHECK(err == 0, "Initializing MCS lock failed: err=%i", err);
+
+  err = fev_spinlock_init(&spinlock);
+  CHECK(err == 0, "Initializing spinlock failed: err=%i", err);
+
+  err = fev_thr_mutex_init(&mutex);
+  CHECK(err == 0, "Initializing mutex failed: err=%i", err);
+
+  run("mcs", &work_mcs);
+  run("mcs nested", &work_mcs_nested);
+  run("spinlock", &work_spinlock);
+  run("mutex", &work_mutex);
+
+  fev_thr_mutex_fini(&mutex);
+  fev_spinlock_fini(&spinlock);
+  fev_mcs_lock_fini(&inner);
+  fev_mcs_lock_fini(&outer);
+
+  return 0;
+}
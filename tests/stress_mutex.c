@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <fev/fev.h>
 
@@ -14,12 +15,25 @@ static uint32_t num_iterations;
 static struct fev_mutex *mutex;
 static uint64_t counter;
 
+/* Lock wait times in nanoseconds, `num_iterations` entries per fiber. */
+static uint64_t *wait_times;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
 static void *work(void *arg)
 {
-  (void)arg;
+  uint64_t *times = arg;
+  uint64_t start;
 
   for (uint32_t i = 0; i < num_iterations; i++) {
+    start = now_ns();
     fev_mutex_lock(mutex);
+    times[i] = now_ns() - start;
     counter++;
     fev_mutex_unlock(mutex);
   }
@@ -27,6 +41,28 @@ static void *work(void *arg)
   return NULL;
 }
 
+static int compare_uint64_t(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/* Prints the percentiles of the lock wait times, the long tail shows whether the mutex is fair. */
+static void print_wait_times(void)
+{
+  static const double percentiles[] = {50.0, 90.0, 99.0, 99.9, 99.99};
+  size_t num_times = (size_t)num_fibers * num_iterations;
+
+  qsort(wait_times, num_times, sizeof(*wait_times), &compare_uint64_t);
+
+  printf("lock wait times (ns):");
+  for (size_t i = 0; i < sizeof(percentiles) / sizeof(*percentiles); i++) {
+    size_t index = (size_t)(percentiles[i] / 100.0 * (double)(num_times - 1));
+    printf(" p%g=%" PRIu64, percentiles[i], wait_times[index]);
+  }
+  printf(" max=%" PRIu64 "\n", wait_times[num_times - 1]);
+}
+
 static void *test(void *arg)
 {
   struct fev_fiber **fibers;
@@ -40,8 +76,11 @@ static void *test(void *arg)
   fibers = malloc((size_t)num_fibers * sizeof(*fibers));
   CHECK(fibers != NULL, "Allocating memory for fibers failed");
 
+  wait_times = malloc((size_t)num_fibers * num_iterations * sizeof(*wait_times));
+  CHECK(wait_times != NULL, "Allocating memory for wait times failed");
+
   for (uint32_t i = 0; i < num_fibers; i++) {
-    err = fev_fiber_create(&fibers[i], NULL, &work, NULL, NULL);
+    err = fev_fiber_create(&fibers[i], NULL, &work, &wait_times[(size_t)i * num_iterations], NULL);
     CHECK(err == 0, "Creating fiber failed: err=%i", err);
   }
 
@@ -90,5 +129,8 @@ int main(int argc, char **argv)
   expected = (uint64_t)num_fibers * (uint64_t)num_iterations;
   printf("counter: %" PRIu64 ", expected: %" PRIu64 "\n", counter, expected);
 
+  print_wait_times();
+  free(wait_times);
+
   return counter != expected;
 }
@@ -0,0 +1,233 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_spinlock_impl.h"
+#include "../src/fev_time.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_rounds;
+static uint32_t num_iterations;
+
+/*
+ * A FIFO mutex built on fev_park()/fev_unpark(). The mutex is handed over to the first waiter,
+ * which is unparked after the spinlock is released. Odd fibers park with a deadline and park again
+ * after a timeout.
+ */
+struct waiter {
+  struct fev_fiber *fiber;
+  atomic_bool granted;
+  struct waiter *next;
+};
+
+static struct fev_spinlock lock;
+static bool locked;
+static struct waiter *head, *tail;
+static uint64_t counter;
+
+/* A barrier built on fev_unpark_n(), the last fiber of a round unparks the others at once. */
+static struct fev_spinlock barrier_lock;
+static struct fev_fiber **barrier_fibers;
+static uint32_t num_arrived;
+static _Atomic uint32_t generation;
+
+static bool is_not_granted(void *arg)
+{
+  struct waiter *waiter = arg;
+  return !atomic_load_explicit(&waiter->granted, memory_order_acquire);
+}
+
+static void mutex_lock(bool timed)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 10 * 1000};
+  struct timespec abs_time;
+  struct waiter waiter;
+  int res;
+
+  fev_spinlock_lock(&lock);
+  if (!locked) {
+    locked = true;
+    fev_spinlock_unlock(&lock);
+    return;
+  }
+
+  waiter.fiber = fev_fiber_self();
+  atomic_init(&waiter.granted, false);
+  waiter.next = NULL;
+  if (tail != NULL)
+    tail->next = &waiter;
+  else
+    head = &waiter;
+  tail = &waiter;
+  fev_spinlock_unlock(&lock);
+
+  /* The permit might be left by a previous unpark, thus the state must be checked again. */
+  while (is_not_granted(&waiter)) {
+    if (timed) {
+      fev_get_abs_time_since_now(&abs_time, &rel_time);
+      res = fev_park(&is_not_granted, &waiter, &abs_time);
+      CHECK(res == 0 || res == -ETIMEDOUT, "Parking failed: err=%i", res);
+    } else {
+      res = fev_park(&is_not_granted, &waiter, /*abs_time=*/NULL);
+      CHECK(res == 0, "Parking failed: err=%i", res);
+    }
+  }
+}
+
+static void mutex_unlock(void)
+{
+  struct fev_fiber *fiber = NULL;
+  struct waiter *waiter;
+
+  fev_spinlock_lock(&lock);
+  waiter = head;
+  if (waiter != NULL) {
+    head = waiter->next;
+    if (head == NULL)
+      tail = NULL;
+
+    /* The waiter can return as soon as it sees the flag, the fiber stays alive until joined. */
+    fiber = waiter->fiber;
+    atomic_store_explicit(&waiter->granted, true, memory_order_release);
+  } else {
+    locked = false;
+  }
+  fev_spinlock_unlock(&lock);
+
+  if (fiber != NULL)
+    fev_unpark(fiber);
+}
+
+static bool is_same_generation(void *arg)
+{
+  return atomic_load_explicit(&generation, memory_order_acquire) == (uint32_t)(uintptr_t)arg;
+}
+
+static void barrier_wait(void)
+{
+  uint32_t gen, n;
+  int res;
+
+  fev_spinlock_lock(&barrier_lock);
+  gen = atomic_load_explicit(&generation, memory_order_relaxed);
+  n = num_arrived++;
+  if (n + 1 < num_fibers) {
+    barrier_fibers[n] = fev_fiber_self();
+    fev_spinlock_unlock(&barrier_lock);
+
+    while (is_same_generation((void *)(uintptr_t)gen)) {
+      res = fev_park(&is_same_generation, (void *)(uintptr_t)gen, /*abs_time=*/NULL);
+      CHECK(res == 0, "Parking failed: err=%i", res);
+    }
+    return;
+  }
+
+  num_arrived = 0;
+  atomic_store_explicit(&generation, gen + 1, memory_order_release);
+  fev_unpark_n(barrier_fibers, num_fibers - 1);
+  fev_spinlock_unlock(&barrier_lock);
+}
+
+static void *work(void *arg)
+{
+  bool timed = (uintptr_t)arg % 2 == 1;
+
+  for (uint32_t round = 0; round < num_rounds; round++) {
+    for (uint32_t i = 0; i < num_iterations; i++) {
+      mutex_lock(timed);
+      counter++;
+      mutex_unlock();
+    }
+
+    barrier_wait();
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  uint64_t expected;
+  int err;
+
+  (void)arg;
+
+  err = fev_spinlock_init(&lock);
+  CHECK(err == 0, "Initializing spinlock failed: err=%i", err);
+
+  err = fev_spinlock_init(&barrier_lock);
+  CHECK(err == 0, "Initializing spinlock failed: err=%i", err);
+
+  barrier_fibers = malloc((size_t)num_fibers * sizeof(*barrier_fibers));
+  CHECK(barrier_fibers != NULL, "Allocating memory for fibers failed");
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)i, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+  free(barrier_fibers);
+
+  expected = (uint64_t)num_fibers * num_rounds * num_iterations;
+  CHECK(counter == expected,
+        "The counter value is incorrect: counter=%" PRIu64 " expected=%" PRIu64, counter,
+        expected);
+  CHECK(atomic_load(&generation) == num_rounds, "The generation is incorrect: generation=%" PRIu32,
+        atomic_load(&generation));
+
+  fev_spinlock_fini(&barrier_lock);
+  fev_spinlock_fini(&lock);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_rounds> <num_iterations>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_rounds = parse_uint32_t(argv[3], "num_rounds", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[4], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+#define MAGIC UINT64_C(0x5a5a5a5a5a5a5a5a)
+
+static uint32_t num_readers;
+static uint32_t num_writers;
+static uint32_t num_iterations;
+
+/* The invariant is a + b == MAGIC, the object is poisoned before it is freed. */
+struct object {
+  uint64_t a;
+  uint64_t b;
+};
+
+static _Atomic(struct object *) shared;
+static _Atomic uint64_t num_allocated;
+static _Atomic uint64_t num_freed;
+
+static struct object *object_create(uint64_t a)
+{
+  struct object *object = malloc(sizeof(*object));
+  CHECK(object != NULL, "Allocating memory for object failed");
+  object->a = a;
+  object->b = MAGIC - a;
+  atomic_fetch_add_explicit(&num_allocated, 1, memory_order_relaxed);
+  return object;
+}
+
+static void object_free(void *ptr)
+{
+  struct object *object = ptr;
+  object->a = 0;
+  object->b = 0;
+  free(object);
+  atomic_fetch_add_explicit(&num_freed, 1, memory_order_relaxed);
+}
+
+static void *reader(void *arg)
+{
+  const struct object *object;
+
+  (void)arg;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    fev_rcu_read_lock();
+    object = atomic_load_explicit(&shared, memory_order_acquire);
+    for (uint32_t j = 0; j < 16; j++) {
+      CHECK(object->a + object->b == MAGIC, "Object freed before grace period: a=%" PRIu64,
+            object->a);
+    }
+    fev_rcu_read_unlock();
+
+    fev_yield();
+  }
+
+  return NULL;
+}
+
+/* Even writers defer the free with fev_rcu_call(), odd writers wait for a grace period. */
+static void *writer(void *arg)
+{
+  uintptr_t index = (uintptr_t)arg;
+  struct object *object;
+  int err;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    object = object_create((uint64_t)index * num_iterations + i + 1);
+    object = atomic_exchange_explicit(&shared, object, memory_order_acq_rel);
+
+    if (index % 2 == 0) {
+      err = fev_rcu_call(object, &object_free);
+      CHECK(err == 0, "Deferring free failed: err=%i", err);
+    } else {
+      fev_rcu_synchronize();
+      object_free(object);
+    }
+
+    fev_yield();
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  uint32_t num_fibers = num_readers + num_writers;
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  atomic_store(&shared, object_create(0));
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    void *(*start)(void *) = i < num_readers ? &reader : &writer;
+    err = fev_fiber_create(&fibers[i], NULL, start, (void *)(uintptr_t)(i - num_readers), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  err = fev_rcu_call(atomic_load(&shared), &object_free);
+  CHECK(err == 0, "Deferring free failed: err=%i", err);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_readers> <num_writers> <num_iterations>",
+        argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_readers = parse_uint32_t(argv[2], "num_readers", &(uint32_t){1});
+  num_writers = parse_uint32_t(argv[3], "num_writers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[4], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  /* The remaining callbacks are run when the scheduler is destroyed. */
+  fev_sched_destroy(sched);
+
+  CHECK(atomic_load(&num_freed) == atomic_load(&num_allocated),
+        "Objects leaked: allocated=%" PRIu64 " freed=%" PRIu64, atomic_load(&num_allocated),
+        atomic_load(&num_freed));
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+static uint64_t timeout_ns;
+
+static struct fev_rwlock *rwlock;
+
+/* Written only by writers, both must be equal for readers. */
+static _Atomic uint64_t counter1;
+static _Atomic uint64_t counter2;
+
+static _Atomic uint32_t num_readers;
+static _Atomic uint32_t num_writers;
+static _Atomic uint64_t num_timeouts;
+static _Atomic uint64_t num_writes;
+
+static void read_locked(void)
+{
+  uint64_t value1, value2;
+
+  atomic_fetch_add(&num_readers, 1);
+  CHECK(atomic_load(&num_writers) == 0, "Reader entered with a writer");
+
+  value1 = atomic_load_explicit(&counter1, memory_order_relaxed);
+  fev_yield();
+  value2 = atomic_load_explicit(&counter2, memory_order_relaxed);
+  CHECK(value1 == value2, "Reader saw a partial write: %" PRIu64 " != %" PRIu64, value1, value2);
+
+  atomic_fetch_sub(&num_readers, 1);
+}
+
+static void write_locked(void)
+{
+  uint64_t value;
+
+  CHECK(atomic_fetch_add(&num_writers, 1) == 0, "Two writers entered");
+  CHECK(atomic_load(&num_readers) == 0, "Writer entered with a reader");
+
+  value = atomic_load_explicit(&counter1, memory_order_relaxed) + 1;
+  atomic_store_explicit(&counter1, value, memory_order_relaxed);
+  atomic_store_explicit(&counter2, value, memory_order_relaxed);
+
+  atomic_fetch_sub(&num_writers, 1);
+}
+
+static void *work(void *arg)
+{
+  struct timespec rel_time;
+  uint64_t timeouts = 0, writes = 0;
+  uint32_t r;
+  int ret;
+
+  (void)arg;
+
+  assert(timeout_ns <= LONG_MAX);
+  rel_time.tv_sec = (time_t)timeout_ns / (1000 * 1000 * 1000);
+  rel_time.tv_nsec = (long)timeout_ns % (1000 * 1000 * 1000);
+
+  r = (uint32_t)rand();
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    r = FEV_RANDOM_NEXT(r);
+    switch (r % 16) {
+    case 0:
+      fev_rwlock_write_lock(rwlock);
+      write_locked();
+      fev_rwlock_write_unlock(rwlock);
+      writes++;
+      break;
+
+    case 1:
+      ret = fev_rwlock_try_write_lock_for(rwlock, &rel_time);
+      if (ret == -ETIMEDOUT) {
+        timeouts++;
+        break;
+      }
+      CHECK(ret == 0, "fev_rwlock_try_write_lock_for() failed: err=%i", ret);
+      write_locked();
+      fev_rwlock_write_unlock(rwlock);
+      writes++;
+      break;
+
+    case 2:
+      if (fev_rwlock_try_write_lock(rwlock)) {
+        write_locked();
+        fev_rwlock_write_unlock(rwlock);
+        writes++;
+      }
+      break;
+
+    case 3:
+    case 4:
+      ret = fev_rwlock_try_read_lock_for(rwlock, &rel_time);
+      if (ret == -ETIMEDOUT) {
+        timeouts++;
+        break;
+      }
+      CHECK(ret == 0, "fev_rwlock_try_read_lock_for() failed: err=%i", ret);
+      read_locked();
+      fev_rwlock_read_unlock(rwlock);
+      break;
+
+    case 5:
+      if (fev_rwlock_try_read_lock(rwlock)) {
+        read_locked();
+        fev_rwlock_read_unlock(rwlock);
+      }
+      break;
+
+    default:
+      fev_rwlock_read_lock(rwlock);
+      read_locked();
+      fev_rwlock_read_unlock(rwlock);
+      break;
+    }
+  }
+
+  atomic_fetch_add(&num_timeouts, timeouts);
+  atomic_fetch_add(&num_writes, writes);
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  int err;
+
+  (void)arg;
+
+  err = fev_rwlock_create(&rwlock);
+  CHECK(err == 0, "Creating rwlock failed with: err=%i", err);
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, NULL, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  fev_rwlock_destroy(rwlock);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  uint64_t value;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_iterations> <timeout_ns>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+  timeout_ns = parse_uint64_t(argv[4], "timeout_ns", &(uint64_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  value = atomic_load(&counter1);
+  printf("counter: %" PRIu64 ", expected: %" PRIu64 ", num_timeouts: %" PRIu64 "\n", value,
+         atomic_load(&num_writes), atomic_load(&num_timeouts));
+
+  return value != atomic_load(&num_writes);
+}
@@ -0,0 +1,437 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+#define NUM_CHANS 2
+
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+static uint32_t capacity;
+
+static struct fev_chan *chans[NUM_CHANS];
+static struct fev_sem *sem;
+static struct fev_cond *cond;
+static struct fev_mutex *mutex;
+static struct fev_socket *sockets[2];
+
+static _Atomic uint64_t sum_sent;
+static _Atomic uint64_t sum_received;
+static _Atomic uint64_t num_posts;
+static _Atomic uint64_t num_sem_waits;
+static _Atomic uint64_t num_timeouts;
+static _Atomic uint64_t bytes_written;
+static _Atomic uint64_t bytes_read;
+static _Atomic uint64_t num_notifications;
+static atomic_bool reader_done;
+
+/* Sends to any of the channels or posts the semaphore. */
+static void *producer(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 1000};
+  struct fev_select_case cases[NUM_CHANS];
+  uint64_t sum = 0, posts = 0, timeouts = 0;
+  uint32_t r;
+  int ret;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (uint32_t i = 0; i < num_iterations;) {
+    uintptr_t value = i % 1000 + 1;
+
+    r = FEV_RANDOM_NEXT(r);
+    if (r % 8 == 0) {
+      fev_sem_post(sem);
+      posts++;
+      i++;
+      continue;
+    }
+
+    for (uint32_t j = 0; j < NUM_CHANS; j++) {
+      cases[j].op = FEV_SELECT_SEND;
+      cases[j].chan = chans[(j + r / 8) % NUM_CHANS];
+      cases[j].elem = (void *)value;
+    }
+
+    if (r % 2 == 0) {
+      ret = fev_select(cases, NUM_CHANS);
+    } else {
+      ret = fev_select_for(cases, NUM_CHANS, &rel_time);
+      if (ret == -ETIMEDOUT) {
+        timeouts++;
+        continue;
+      }
+    }
+
+    CHECK(ret >= 0 && ret < NUM_CHANS, "Selecting send failed: err=%i", ret);
+    CHECK(cases[ret].result == 0, "Sending failed: err=%i", cases[ret].result);
+
+    sum += value;
+    i++;
+  }
+
+  atomic_fetch_add(&sum_sent, sum);
+  atomic_fetch_add(&num_posts, posts);
+  atomic_fetch_add(&num_timeouts, timeouts);
+
+  return NULL;
+}
+
+/* Receives from the channels and waits for the semaphore until both channels are closed. */
+static void *consumer(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 1000};
+  struct fev_select_case cases[NUM_CHANS + 1];
+  struct fev_chan *open_chans[NUM_CHANS];
+  uint32_t num_open = NUM_CHANS;
+  uint64_t sum = 0, sem_waits = 0;
+  uint32_t r;
+  int ret;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (uint32_t j = 0; j < NUM_CHANS; j++)
+    open_chans[j] = chans[j];
+
+  while (num_open > 0) {
+    size_t num_cases = 0;
+
+    r = FEV_RANDOM_NEXT(r);
+
+    /* Put the semaphore first or last, the first ready case is chosen. */
+    if (r % 2 == 0) {
+      cases[num_cases].op = FEV_SELECT_SEM_WAIT;
+      cases[num_cases++].sem = sem;
+    }
+
+    for (uint32_t j = 0; j < num_open; j++) {
+      cases[num_cases].op = FEV_SELECT_RECV;
+      cases[num_cases++].chan = open_chans[j];
+    }
+
+    if (r % 2 == 1) {
+      cases[num_cases].op = FEV_SELECT_SEM_WAIT;
+      cases[num_cases++].sem = sem;
+    }
+
+    if (r % 4 < 2) {
+      ret = fev_select(cases, num_cases);
+    } else {
+      ret = fev_select_for(cases, num_cases, &rel_time);
+      if (ret == -ETIMEDOUT)
+        continue;
+    }
+
+    CHECK(ret >= 0 && (size_t)ret < num_cases, "Selecting receive failed: err=%i", ret);
+
+    if (cases[ret].op == FEV_SELECT_SEM_WAIT) {
+      sem_waits++;
+      continue;
+    }
+
+    if (cases[ret].result == -EPIPE) {
+      for (uint32_t j = 0; j < num_open; j++) {
+        if (open_chans[j] == cases[ret].chan) {
+          open_chans[j] = open_chans[--num_open];
+          break;
+        }
+      }
+      continue;
+    }
+
+    CHECK(cases[ret].result == 0, "Receiving failed: err=%i", cases[ret].result);
+    sum += (uintptr_t)cases[ret].elem;
+  }
+
+  atomic_fetch_add(&sum_received, sum);
+  atomic_fetch_add(&num_sem_waits, sem_waits);
+
+  return NULL;
+}
+
+/* Writes bytes to the socket and closes it. */
+static void *writer(void *arg)
+{
+  uint8_t buffer[64];
+  uint64_t total = 0;
+  uint32_t r;
+  ssize_t n;
+
+  r = (uint32_t)(uintptr_t)arg;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    size_t size;
+
+    r = FEV_RANDOM_NEXT(r);
+    size = r % sizeof(buffer) + 1;
+    for (size_t j = 0; j < size; j++)
+      buffer[j] = (uint8_t)(i + j);
+
+    n = fev_socket_write(sockets[1], buffer, size);
+    CHECK(n > 0, "Writing failed: err=%zi", n);
+    total += (uint64_t)n;
+
+    if (r % 16 == 0)
+      fev_yield();
+  }
+
+  atomic_store(&bytes_written, total);
+  fev_socket_close(sockets[1]);
+
+  return NULL;
+}
+
+/* Waits for the socket or the condition variable until the end of the stream. */
+static void *reader(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 10000};
+  struct fev_select_case cases[2];
+  uint8_t buffer[256];
+  uint64_t total = 0, notifications = 0;
+  ssize_t n;
+  int ret;
+
+  (void)arg;
+
+  cases[0].op = FEV_SELECT_COND_WAIT;
+  cases[0].cond = cond;
+  cases[0].mutex = mutex;
+  cases[1].op = FEV_SELECT_READ;
+  cases[1].socket = sockets[0];
+
+  fev_mutex_lock(mutex);
+
+  for (;;) {
+    ret = fev_select_for(cases, 2, &rel_time);
+    if (ret == -ETIMEDOUT)
+      continue;
+
+    CHECK(ret == 0 || ret == 1, "Selecting socket failed: err=%i", ret);
+
+    if (ret == 0) {
+      notifications++;
+      continue;
+    }
+
+    fev_mutex_unlock(mutex);
+    n = fev_socket_read(sockets[0], buffer, sizeof(buffer));
+    fev_mutex_lock(mutex);
+
+    CHECK(n >= 0, "Reading failed: err=%zi", n);
+    if (n == 0)
+      break;
+    total += (uint64_t)n;
+  }
+
+  fev_mutex_unlock(mutex);
+
+  atomic_store(&bytes_read, total);
+  atomic_store(&num_notifications, notifications);
+  atomic_store(&reader_done, true);
+
+  return NULL;
+}
+
+/* Notifies the reader from time to time. */
+static void *notifier(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 0, .tv_nsec = 5000};
+
+  (void)arg;
+
+  while (!atomic_load(&reader_done)) {
+    fev_mutex_lock(mutex);
+    fev_cond_notify_one(cond);
+    fev_mutex_unlock(mutex);
+    fev_sleep_for(&rel_time);
+  }
+
+  return NULL;
+}
+
+static void open_socket_pair(void)
+{
+  struct sockaddr_in address = {0};
+  socklen_t address_len = sizeof(address);
+  struct fev_socket *listener;
+  int err;
+
+  err = fev_socket_create(&listener);
+  CHECK(err == 0, "Creating socket failed: err=%i", err);
+
+  for (int i = 0; i < 2; i++) {
+    err = fev_socket_create(&sockets[i]);
+    CHECK(err == 0, "Creating socket failed: err=%i", err);
+  }
+
+  err = fev_socket_open(listener, AF_INET, SOCK_STREAM, 0);
+  CHECK(err == 0, "Opening socket failed: err=%i", err);
+
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  err = fev_socket_bind(listener, (struct sockaddr *)&address, sizeof(address));
+  CHECK(err == 0, "Binding socket failed: err=%i", err);
+
+  err = fev_socket_listen(listener, /*backlog=*/1);
+  CHECK(err == 0, "Listening failed: err=%i", err);
+
+  err = getsockname(fev_socket_native_handle(listener), (struct sockaddr *)&address, &address_len);
+  CHECK(err == 0, "Getting socket name failed");
+
+  err = fev_socket_open(sockets[1], AF_INET, SOCK_STREAM, 0);
+  CHECK(err == 0, "Opening socket failed: err=%i", err);
+
+  err = fev_socket_connect(sockets[1], (struct sockaddr *)&address, sizeof(address));
+  CHECK(err == 0, "Connecting failed: err=%i", err);
+
+  /* The listener must be ready now, the connection is pending. */
+  err = fev_select(&(struct fev_select_case){.op = FEV_SELECT_READ, .socket = listener}, 1);
+  CHECK(err == 0, "Selecting listener failed: err=%i", err);
+
+  err = fev_socket_accept(listener, sockets[0], /*address=*/NULL, /*address_len=*/NULL);
+  CHECK(err == 0, "Accepting failed: err=%i", err);
+
+  fev_socket_close(listener);
+  fev_socket_destroy(listener);
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **producers, **consumers, *socket_fibers[3];
+  int err;
+
+  (void)arg;
+
+  for (uint32_t i = 0; i < NUM_CHANS; i++) {
+    err = fev_chan_create(&chans[i], capacity);
+    CHECK(err == 0, "Creating channel failed with: err=%i", err);
+  }
+
+  err = fev_sem_create(&sem, 0);
+  CHECK(err == 0, "Creating sem failed with: err=%i", err);
+
+  err = fev_cond_create(&cond);
+  CHECK(err == 0, "Creating cond failed with: err=%i", err);
+
+  err = fev_mutex_create(&mutex);
+  CHECK(err == 0, "Creating mutex failed with: err=%i", err);
+
+  open_socket_pair();
+
+  err = fev_fiber_create(&socket_fibers[0], NULL, &reader, NULL, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_fiber_create(&socket_fibers[1], NULL, &writer, (void *)(uintptr_t)rand(), NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_fiber_create(&socket_fibers[2], NULL, &notifier, NULL, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  producers = malloc((size_t)num_fibers * sizeof(*producers));
+  CHECK(producers != NULL, "Allocating memory for fibers failed");
+
+  consumers = malloc((size_t)num_fibers * sizeof(*consumers));
+  CHECK(consumers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&consumers[i], NULL, &consumer, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+    err = fev_fiber_create(&producers[i], NULL, &producer, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(producers[i], NULL);
+
+  /* The consumers drain the channels and stop. */
+  for (uint32_t i = 0; i < NUM_CHANS; i++)
+    fev_chan_close(chans[i]);
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(consumers[i], NULL);
+
+  for (uint32_t i = 0; i < 3; i++)
+    fev_fiber_join(socket_fibers[i], NULL);
+
+  /* Count the posts that nobody has waited for. */
+  while (fev_sem_wait_for(sem, &(struct timespec){.tv_sec = 0, .tv_nsec = 1}) == 0)
+    atomic_fetch_add(&num_sem_waits, 1);
+
+  free(consumers);
+  free(producers);
+
+  fev_socket_destroy(sockets[1]);
+  fev_socket_close(sockets[0]);
+  fev_socket_destroy(sockets[0]);
+
+  fev_mutex_destroy(mutex);
+  fev_cond_destroy(cond);
+  fev_sem_destroy(sem);
+
+  for (uint32_t i = 0; i < NUM_CHANS; i++)
+    fev_chan_destroy(chans[i]);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  uint64_t sent, received, posts, waits, written, read;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_iterations> <capacity>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+  capacity = parse_uint32_t(argv[4], "capacity", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  sent = atomic_load(&sum_sent);
+  received = atomic_load(&sum_received);
+  posts = atomic_load(&num_posts);
+  waits = atomic_load(&num_sem_waits);
+  written = atomic_load(&bytes_written);
+  read = atomic_load(&bytes_read);
+  printf("sent: %" PRIu64 ", received: %" PRIu64 ", posts: %" PRIu64 ", waits: %" PRIu64
+         ", written: %" PRIu64 ", read: %" PRIu64 ", num_notifications: %" PRIu64
+         ", num_timeouts: %" PRIu64 "\n",
+         sent, received, posts, waits, written, read, atomic_load(&num_notifications),
+         atomic_load(&num_timeouts));
+
+  return sent != received || posts != waits || written != read;
+}
@@ -0,0 +1,129 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+static uint32_t capacity;
+
+static struct fev_sem *sem;
+static _Atomic uint32_t in_use;
+static _Atomic uint64_t counter;
+
+/*
+ * Takes a random number of units, checks that the capacity is not exceeded and returns the units,
+ * either at once or one by one.
+ */
+static void *work(void *arg)
+{
+  uint32_t r = (uint32_t)(uintptr_t)arg;
+  uint32_t n, used;
+  int err;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    r = FEV_RANDOM_NEXT(r);
+    n = r % capacity + 1;
+
+    if (n == 1)
+      err = fev_sem_wait(sem);
+    else
+      err = fev_sem_wait_n(sem, n);
+    CHECK(err == 0, "Waiting on sem failed: err=%i", err);
+
+    used = atomic_fetch_add(&in_use, n) + n;
+    CHECK(used <= capacity, "Capacity exceeded: used=%" PRIu32 " capacity=%" PRIu32, used,
+          capacity);
+    atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+    atomic_fetch_sub(&in_use, n);
+
+    if (r & 16) {
+      for (uint32_t j = 0; j < n; j++)
+        fev_sem_post(sem);
+    } else {
+      fev_sem_post_n(sem, n);
+    }
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  uint64_t expected;
+  int err;
+
+  (void)arg;
+
+  err = fev_sem_create(&sem, (int32_t)capacity);
+  CHECK(err == 0, "Creating sem failed with: err=%i", err);
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  expected = (uint64_t)num_fibers * num_iterations;
+  CHECK(atomic_load(&counter) == expected,
+        "The counter value is incorrect: counter=%" PRIu64 " expected=%" PRIu64,
+        atomic_load(&counter), expected);
+
+  /* All units must have been returned. */
+  err = fev_sem_wait_n(sem, capacity);
+  CHECK(err == 0, "Waiting on sem failed: err=%i", err);
+
+  fev_sem_destroy(sem);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_fibers> <num_iterations> <capacity>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+  capacity = parse_uint32_t(argv[4], "capacity", &(uint32_t){1});
+  CHECK(capacity <= INT32_MAX, "Capacity is too big");
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  return 0;
+}
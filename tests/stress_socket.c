@@ -0,0 +1,160 @@
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_connections;
+static uint32_t num_messages;
+
+static struct fev_socket *listener;
+static struct sockaddr_in listener_address;
+
+static _Atomic uint64_t bytes_echoed;
+static _Atomic uint64_t bytes_sent;
+
+/* Echoes a connection, see echo_serve(). */
+static void *echo(void *arg)
+{
+  atomic_fetch_add(&bytes_echoed, echo_serve(arg));
+  return NULL;
+}
+
+/* Accepts the connections and starts an echo fiber for each. */
+static void *acceptor(void *arg)
+{
+  struct fev_socket *socket;
+  int err;
+
+  (void)arg;
+
+  for (uint32_t i = 0; i < num_connections; i++) {
+    err = fev_socket_create(&socket);
+    CHECK(err == 0, "Creating socket failed: err=%i", err);
+
+    err = fev_socket_accept(listener, socket, /*address=*/NULL, /*address_len=*/NULL);
+    CHECK(err == 0, "Accepting failed: err=%i", err);
+
+    err = fev_fiber_spawn(/*sched=*/NULL, &echo, socket);
+    CHECK(err == 0, "Spawning fiber failed: err=%i", err);
+  }
+
+  return NULL;
+}
+
+/* Sends messages of random sizes, see echo_client(). */
+static void *client(void *arg)
+{
+  uint32_t seed = (uint32_t)(uintptr_t)arg;
+
+  atomic_fetch_add(&bytes_sent, echo_client(&listener_address, num_messages, seed));
+  return NULL;
+}
+
+static void open_listener(void)
+{
+  socklen_t address_len = sizeof(listener_address);
+  int err;
+
+  err = fev_socket_create(&listener);
+  CHECK(err == 0, "Creating socket failed: err=%i", err);
+
+  err = fev_socket_open(listener, AF_INET, SOCK_STREAM, 0);
+  CHECK(err == 0, "Opening socket failed: err=%i", err);
+
+  listener_address.sin_family = AF_INET;
+  listener_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listener_address.sin_port = 0;
+
+  err = fev_socket_bind(listener, (struct sockaddr *)&listener_address, sizeof(listener_address));
+  CHECK(err == 0, "Binding socket failed: err=%i", err);
+
+  err = fev_socket_listen(listener, (int)num_connections);
+  CHECK(err == 0, "Listening failed: err=%i", err);
+
+  err = getsockname(fev_socket_native_handle(listener), (struct sockaddr *)&listener_address,
+                    &address_len);
+  CHECK(err == 0, "Getting socket name failed");
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber *acceptor_fiber, **clients;
+  int err;
+
+  (void)arg;
+
+  open_listener();
+
+  err = fev_fiber_create(&acceptor_fiber, NULL, &acceptor, NULL, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  clients = malloc((size_t)num_connections * sizeof(*clients));
+  CHECK(clients != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_connections; i++) {
+    err = fev_fiber_create(&clients[i], NULL, &client, (void *)(uintptr_t)rand(), NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_connections; i++)
+    fev_fiber_join(clients[i], NULL);
+
+  fev_fiber_join(acceptor_fiber, NULL);
+
+  free(clients);
+
+  fev_socket_close(listener);
+  fev_socket_destroy(listener);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  uint64_t sent, echoed;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_connections> <num_messages>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_connections = parse_uint32_t(argv[2], "num_connections", &(uint32_t){1});
+  num_messages = parse_uint32_t(argv[3], "num_messages", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  /* The echo fibers are not joined, but the scheduler has run all fibers to completion. */
+  sent = atomic_load(&bytes_sent);
+  echoed = atomic_load(&bytes_echoed);
+  printf("sent: %" PRIu64 ", echoed: %" PRIu64 "\n", sent, echoed);
+  CHECK(sent == echoed, "The number of bytes is incorrect");
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/fev_thr.h"
+#include "../src/fev_thr_mutex.h"
+#include "../src/fev_thr_sem.h"
+#include <fev/fev.h>
+
+#include "util.h"
+
+#define NO_REQUEST UINT32_MAX
+
+static uint32_t num_threads;
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+
+static struct fev_sched *sched;
+static struct fev_sem *sem;
+
+/*
+ * Each fiber sends requests to a pool of threads and waits for the results on its event. The
+ * threads also post the semaphore once per request, the units are taken at the end. Meanwhile, the
+ * fibers post and wait on the same semaphore, thus the remote posts contend on its lock.
+ */
+struct request {
+  struct fev_thread_event *event;
+  uint64_t value;
+  uint64_t result;
+};
+
+static struct request *requests;
+
+/* Indices of the pending requests, protected by `queue_mutex` and counted by `queue_sem`. */
+static struct fev_thr_mutex queue_mutex;
+static struct fev_thr_sem queue_sem;
+static uint32_t *queue;
+static uint32_t queue_head, queue_len;
+
+static void push_request(uint32_t index)
+{
+  fev_thr_mutex_lock(&queue_mutex);
+  queue[(queue_head + queue_len++) % (num_fibers + num_threads)] = index;
+  fev_thr_mutex_unlock(&queue_mutex);
+  fev_thr_sem_post(&queue_sem);
+}
+
+static uint32_t pop_request(void)
+{
+  uint32_t index;
+
+  fev_thr_sem_wait(&queue_sem);
+  fev_thr_mutex_lock(&queue_mutex);
+  index = queue[queue_head];
+  queue_head = (queue_head + 1) % (num_fibers + num_threads);
+  queue_len--;
+  fev_thr_mutex_unlock(&queue_mutex);
+
+  return index;
+}
+
+static void *serve(void *arg)
+{
+  struct request *request;
+  uint32_t index;
+
+  (void)arg;
+
+  while ((index = pop_request()) != NO_REQUEST) {
+    request = &requests[index];
+    request->result = request->value * 2 + 1;
+    fev_thread_event_set(request->event);
+    fev_sem_post_from_thread(sem, sched);
+  }
+
+  return NULL;
+}
+
+static void *work(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 10, .tv_nsec = 0};
+  uint32_t index = (uint32_t)(uintptr_t)arg;
+  struct request *request = &requests[index];
+  int res;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    request->value = (uint64_t)index * num_iterations + i;
+    push_request(index);
+
+    /* Odd fibers wait with a timeout, which should never expire. */
+    if (index % 2 == 0)
+      res = fev_thread_event_wait(request->event);
+    else
+      res = fev_thread_event_wait_for(request->event, &rel_time);
+    CHECK(res == 0, "Waiting on thread event failed: err=%i", res);
+
+    CHECK(request->result == request->value * 2 + 1,
+          "The result is incorrect: result=%" PRIu64 " value=%" PRIu64, request->result,
+          request->value);
+
+    fev_thread_event_reset(request->event);
+
+    /* Each fiber posts before it waits, so the fibers take no more units than they have posted. */
+    fev_sem_post(sem);
+    res = fev_sem_wait(sem);
+    CHECK(res == 0, "Waiting on semaphore failed: err=%i", res);
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  uint32_t num_units;
+  int err;
+
+  (void)arg;
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, (void *)(uintptr_t)i, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  /* Each request has posted one unit, some of them might not have been added yet. */
+  num_units = num_fibers * num_iterations;
+  err = fev_sem_wait_n(sem, num_units);
+  CHECK(err == 0, "Waiting on semaphore failed: err=%i", err);
+
+  for (uint32_t i = 0; i < num_threads; i++)
+    push_request(NO_REQUEST);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_thr *thrs;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 5, "Usage: %s <num_workers> <num_threads> <num_fibers> <num_iterations>",
+        argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_threads = parse_uint32_t(argv[2], "num_threads", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[3], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[4], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_sem_create(&sem, 0);
+  CHECK(err == 0, "Creating semaphore failed: err=%i", err);
+
+  requests = malloc((size_t)num_fibers * sizeof(*requests));
+  CHECK(requests != NULL, "Allocating memory for requests failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_thread_event_create(&requests[i].event);
+    CHECK(err == 0, "Creating thread event failed: err=%i", err);
+  }
+
+  queue = malloc((size_t)(num_fibers + num_threads) * sizeof(*queue));
+  CHECK(queue != NULL, "Allocating memory for queue failed");
+
+  err = fev_thr_mutex_init(&queue_mutex);
+  CHECK(err == 0, "Initializing mutex failed: err=%i", err);
+
+  err = fev_thr_sem_init(&queue_sem, 0);
+  CHECK(err == 0, "Initializing semaphore failed: err=%i", err);
+
+  thrs = malloc((size_t)num_threads * sizeof(*thrs));
+  CHECK(thrs != NULL, "Allocating memory for threads failed");
+
+  for (uint32_t i = 0; i < num_threads; i++) {
+    err = fev_thr_create(&thrs[i], &serve, NULL);
+    CHECK(err == 0, "Creating thread failed: err=%i", err);
+  }
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  for (uint32_t i = 0; i < num_threads; i++)
+    fev_thr_join(&thrs[i], NULL);
+
+  free(thrs);
+  fev_thr_sem_fini(&queue_sem);
+  fev_thr_mutex_fini(&queue_mutex);
+  free(queue);
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_thread_event_destroy(requests[i].event);
+
+  free(requests);
+  fev_sem_destroy(sem);
+  fev_sched_destroy(sched);
+
+  return 0;
+}
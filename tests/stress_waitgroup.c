@@ -0,0 +1,105 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_fibers;
+static uint32_t num_rounds;
+
+static struct fev_waitgroup *waitgroup;
+static _Atomic uint64_t counter;
+
+static void *work(void *arg)
+{
+  (void)arg;
+
+  atomic_fetch_add_explicit(&counter, 1, memory_order_relaxed);
+  fev_waitgroup_done(waitgroup);
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  const struct timespec rel_time = {.tv_sec = 10, .tv_nsec = 0};
+  int err;
+
+  (void)arg;
+
+  err = fev_waitgroup_create(&waitgroup);
+  CHECK(err == 0, "Creating wait group failed with: err=%i", err);
+
+  for (uint32_t round = 0; round < num_rounds; round++) {
+    uint64_t expected = (uint64_t)(round + 1) * num_fibers;
+
+    fev_waitgroup_add(waitgroup, (int32_t)num_fibers);
+
+    if (round % 4 < 2) {
+      for (uint32_t i = 0; i < num_fibers; i++) {
+        err = fev_fiber_spawn(NULL, &work, NULL);
+        CHECK(err == 0, "Creating fiber failed: err=%i", err);
+      }
+    } else {
+      err = fev_fiber_spawn_n(NULL, &work, /*args=*/NULL, num_fibers);
+      CHECK(err == 0, "Creating fibers failed: err=%i", err);
+    }
+
+    if (round % 2 == 0) {
+      fev_waitgroup_wait(waitgroup);
+    } else {
+      err = fev_waitgroup_wait_for(waitgroup, &rel_time);
+      CHECK(err == 0, "fev_waitgroup_wait_for() failed: err=%i", err);
+    }
+
+    CHECK(atomic_load_explicit(&counter, memory_order_relaxed) == expected,
+          "Wait group returned before all fibers finished");
+  }
+
+  fev_waitgroup_destroy(waitgroup);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_rounds>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_rounds = parse_uint32_t(argv[3], "num_rounds", &(uint32_t){1});
+
+  CHECK(num_fibers <= INT32_MAX, "num_fibers must be at most %" PRIi32, INT32_MAX);
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  printf("counter: %" PRIu64 "\n", atomic_load(&counter));
+
+  return 0;
+}
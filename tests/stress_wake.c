@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_pairs;
+static uint32_t num_iterations;
+
+/* The semaphores of the pairs, the first fiber of each pair waits on the first one. */
+static struct fev_sem *(*sems)[2];
+
+/* The times of all passes, printed after the scheduler has finished. */
+static uint64_t park_time_ns;
+static uint64_t sem_time_ns;
+
+static void *play_park(void *arg)
+{
+  struct ping_pong_player *player = arg;
+  struct fev_fiber *other = ping_pong_other(player);
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    ping_pong_wait_turn(player);
+    if (ping_pong_pass(player, i, num_iterations))
+      fev_unpark(other);
+  }
+
+  return NULL;
+}
+
+static void *play_sem(void *arg)
+{
+  struct ping_pong_player *player = arg;
+  struct fev_sem **pair_sems = sems[player->pair_index];
+  uint32_t index = player->index;
+  int res;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    res = fev_sem_wait(pair_sems[index]);
+    CHECK(res == 0, "Waiting on semaphore failed: err=%i", res);
+
+    /* The semaphores outlive the fibers, thus the last post is harmless. */
+    ping_pong_pass(player, i, num_iterations);
+    fev_sem_post(pair_sems[1 - index]);
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  int err;
+
+  (void)arg;
+
+  sems = malloc((size_t)num_pairs * sizeof(*sems));
+  CHECK(sems != NULL, "Allocating memory for semaphores failed");
+
+  for (uint32_t i = 0; i < num_pairs; i++) {
+    /* The first fiber of each pair starts. */
+    err = fev_sem_create(&sems[i][0], 1);
+    CHECK(err == 0, "Creating semaphore failed: err=%i", err);
+    err = fev_sem_create(&sems[i][1], 0);
+    CHECK(err == 0, "Creating semaphore failed: err=%i", err);
+  }
+
+  park_time_ns = ping_pong_run("park", num_pairs, num_iterations, &play_park);
+  sem_time_ns = ping_pong_run("sem", num_pairs, num_iterations, &play_sem);
+
+  for (uint32_t i = 0; i < num_pairs; i++) {
+    fev_sem_destroy(sems[i][1]);
+    fev_sem_destroy(sems[i][0]);
+  }
+
+  free(sems);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint64_t num_wakes;
+  uint32_t num_workers;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_pairs> <num_iterations>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_pairs = parse_uint32_t(argv[2], "num_pairs", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  num_wakes = (uint64_t)num_pairs * num_iterations * 2;
+  printf("park: %.1f ns/wake\n", (double)park_time_ns / (double)num_wakes);
+  printf("sem: %.1f ns/wake\n", (double)sem_time_ns / (double)num_wakes);
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_workers;
+static uint32_t num_fibers;
+static uint32_t num_iterations;
+
+static struct fev_counter *counter;
+static struct fev_worker_local *worker_local;
+
+struct slot {
+  uint64_t value;
+};
+
+/*
+ * Updates the counter and the slot of the current worker with plain adds. The fibers yield between
+ * the updates, thus they are migrated between the workers.
+ */
+static void *work(void *arg)
+{
+  struct slot *slot;
+  uint32_t index;
+
+  (void)arg;
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    index = fev_cur_worker_index();
+    CHECK(index < num_workers, "Invalid worker index: index=%" PRIu32, index);
+
+    slot = fev_worker_local_get(worker_local);
+    CHECK(slot == fev_worker_local_at(worker_local, index), "Invalid slot of worker %" PRIu32,
+          index);
+    slot->value++;
+
+    fev_counter_add(counter, 1);
+
+    if (i % 4 == 0)
+      fev_yield();
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  struct fev_fiber **fibers;
+  uint64_t expected;
+  int err;
+
+  (void)arg;
+
+  fibers = malloc((size_t)num_fibers * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_fibers; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, &work, NULL, NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+  }
+
+  for (uint32_t i = 0; i < num_fibers; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  free(fibers);
+
+  /* The additions from main() are counted too. */
+  expected = (uint64_t)num_fibers * num_iterations + 1;
+  CHECK(fev_counter_read(counter) == expected,
+        "The counter value is incorrect: counter=%" PRIu64 " expected=%" PRIu64,
+        fev_counter_read(counter), expected);
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  uint64_t sum, expected;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_fibers> <num_iterations>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_fibers = parse_uint32_t(argv[2], "num_fibers", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  CHECK(fev_sched_get_num_workers(sched) == num_workers, "Invalid number of workers");
+  CHECK(fev_cur_worker_index() == UINT32_MAX, "Worker index outside of a fiber");
+
+  err = fev_counter_create(&counter, sched);
+  CHECK(err == 0, "Creating counter failed: err=%i", err);
+
+  err = fev_worker_local_create(&worker_local, sched, sizeof(struct slot));
+  CHECK(err == 0, "Creating worker-local storage failed: err=%i", err);
+
+  CHECK(fev_worker_local_get(worker_local) == NULL, "Worker-local slot outside of a fiber");
+
+  /* Goes to the shared shard. */
+  fev_counter_add(counter, 1);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  sum = 0;
+  for (uint32_t i = 0; i < num_workers; i++)
+    sum += ((struct slot *)fev_worker_local_at(worker_local, i))->value;
+
+  expected = (uint64_t)num_fibers * num_iterations;
+  CHECK(sum == expected, "The sum of slots is incorrect: sum=%" PRIu64 " expected=%" PRIu64, sum,
+        expected);
+
+  fev_worker_local_destroy(worker_local);
+  fev_counter_destroy(counter);
+  fev_sched_destroy(sched);
+
+  return 0;
+}
@@ -0,0 +1,65 @@
+#include <stdint.h>
+
+#include <fev/fev.h>
+
+#include "util.h"
+
+static uint32_t num_workers;
+static uint32_t num_pairs;
+static uint32_t num_iterations;
+
+/* The fibers of a pair pass the turn to each other with fev_yield_to(). */
+static void *play(void *arg)
+{
+  struct ping_pong_player *player = arg;
+  struct fev_fiber *other = ping_pong_other(player);
+
+  for (uint32_t i = 0; i < num_iterations; i++) {
+    ping_pong_wait_turn(player);
+    if (ping_pong_pass(player, i, num_iterations))
+      fev_yield_to(other);
+  }
+
+  return NULL;
+}
+
+static void *test(void *arg)
+{
+  (void)arg;
+
+  ping_pong_run("yield_to", num_pairs, num_iterations, &play);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct fev_sched_attr *sched_attr;
+  struct fev_sched *sched;
+  int err;
+
+  CHECK(argc == 4, "Usage: %s <num_workers> <num_pairs> <num_iterations>", argv[0]);
+
+  num_workers = parse_uint32_t(argv[1], "num_workers", &(uint32_t){1});
+  num_pairs = parse_uint32_t(argv[2], "num_pairs", &(uint32_t){1});
+  num_iterations = parse_uint32_t(argv[3], "num_iterations", &(uint32_t){1});
+
+  err = fev_sched_attr_create(&sched_attr);
+  CHECK(err == 0, "Creating scheduler attributes failed: err=%i", err);
+
+  fev_sched_attr_set_num_workers(sched_attr, num_workers);
+
+  err = fev_sched_create(&sched, sched_attr);
+  CHECK(err == 0, "Creating scheduler failed: err=%i", err);
+
+  fev_sched_attr_destroy(sched_attr);
+
+  err = fev_fiber_spawn(sched, &test, NULL);
+  CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+  err = fev_sched_run(sched);
+  CHECK(err == 0, "Running scheduler failed: err=%i", err);
+
+  fev_sched_destroy(sched);
+
+  return 0;
+}
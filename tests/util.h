@@ -2,10 +2,21 @@
 #define FEV_TESTS_UTIL_H
 
 #include <inttypes.h>
+#include <netinet/in.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#ifndef __cplusplus
+#include <stdatomic.h>
+#include <stdbool.h>
+#endif
+
+#include "../src/fev_util.h"
+#include <fev/fev.h>
 
 #define FATAL(fmt, ...)                                                                            \
   do {                                                                                             \
@@ -35,4 +46,247 @@ DEF_PARSE(uint64_t, SCNu64, PRIu64)
 
 #undef DEF_PARSE
 
+static inline uint64_t get_time_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* The echo harness needs the sockets of a reactor poller. */
+#if defined(FEV_POLLER_EPOLL) || defined(FEV_POLLER_KQUEUE)
+
+/*
+ * Echo: a client sends messages of random sizes and reads them back from a server, which writes
+ * back everything it reads until the client closes the connection.
+ */
+#define ECHO_BUFFER_SIZE 256
+
+static inline void echo_write_all(struct fev_socket *socket, const uint8_t *buffer, size_t size)
+{
+  ssize_t n;
+
+  while (size > 0) {
+    n = fev_socket_write(socket, buffer, size);
+    CHECK(n > 0, "Writing failed: err=%zi", n);
+    buffer += n;
+    size -= (size_t)n;
+  }
+}
+
+/*
+ * Serves a connection, then closes and destroys the socket. The end of the stream must be seen as
+ * a read of 0, any error fails the test. Returns the number of bytes echoed.
+ */
+static inline uint64_t echo_serve(struct fev_socket *socket)
+{
+  uint8_t buffer[ECHO_BUFFER_SIZE];
+  uint64_t total = 0;
+  ssize_t n;
+
+  for (;;) {
+    n = fev_socket_read(socket, buffer, sizeof(buffer));
+    CHECK(n >= 0, "Reading failed: err=%zi", n);
+    if (n == 0)
+      break;
+
+    echo_write_all(socket, buffer, (size_t)n);
+    total += (uint64_t)n;
+  }
+
+  fev_socket_close(socket);
+  fev_socket_destroy(socket);
+
+  return total;
+}
+
+/*
+ * Connects to `address`, sends `num_messages` messages and checks the echoes. Every other read has
+ * a timeout, which should never expire. The client yields from time to time, thus it can be stolen
+ * by another worker between the waits on its socket. Returns the number of bytes sent.
+ */
+static inline uint64_t echo_client(struct sockaddr_in *address, uint32_t num_messages,
+                                   uint32_t seed)
+{
+  const struct timespec rel_time = {.tv_sec = 10, .tv_nsec = 0};
+  uint8_t out[ECHO_BUFFER_SIZE], in[ECHO_BUFFER_SIZE];
+  struct fev_socket *socket;
+  uint64_t total = 0;
+  uint32_t r = seed;
+  ssize_t n;
+  int err;
+
+  err = fev_socket_create(&socket);
+  CHECK(err == 0, "Creating socket failed: err=%i", err);
+
+  err = fev_socket_open(socket, AF_INET, SOCK_STREAM, 0);
+  CHECK(err == 0, "Opening socket failed: err=%i", err);
+
+  err = fev_socket_connect(socket, (struct sockaddr *)address, sizeof(*address));
+  CHECK(err == 0, "Connecting failed: err=%i", err);
+
+  for (uint32_t i = 0; i < num_messages; i++) {
+    size_t size, received;
+
+    r = FEV_RANDOM_NEXT(r);
+    size = r % ECHO_BUFFER_SIZE + 1;
+    for (size_t j = 0; j < size; j++)
+      out[j] = (uint8_t)(i + j);
+
+    echo_write_all(socket, out, size);
+
+    for (received = 0; received < size; received += (size_t)n) {
+      if (r % 2 == 0)
+        n = fev_socket_read(socket, in + received, size - received);
+      else
+        n = fev_socket_try_read_for(socket, in + received, size - received, &rel_time);
+      CHECK(n > 0, "Reading failed: err=%zi", n);
+    }
+
+    for (size_t j = 0; j < size; j++)
+      CHECK(in[j] == out[j], "The echo is incorrect: message=%" PRIu32 " index=%zu", i, j);
+
+    total += size;
+
+    if (r % 8 == 0)
+      fev_yield();
+  }
+
+  fev_socket_close(socket);
+  fev_socket_destroy(socket);
+
+  return total;
+}
+
+#endif /* FEV_POLLER_EPOLL || FEV_POLLER_KQUEUE */
+
+/* The ping-pong harness uses C11 atomics, it is not available in C++ tests. */
+#ifndef __cplusplus
+
+/*
+ * Ping-pong: two fibers of a pair pass the turn to each other, each pass is one wake up of a
+ * blocked fiber. Only the fiber that has the turn updates the value, thus plain adds are enough.
+ * The first fiber of a pair starts, thus the second one makes the last pass.
+ */
+struct ping_pong_pair {
+  _Atomic(struct fev_fiber *) fibers[2];
+  _Atomic uint32_t turn;
+  uint64_t value;
+};
+
+struct ping_pong_player {
+  struct ping_pong_pair *pair;
+  uint32_t pair_index;
+  uint32_t index;
+};
+
+static inline bool ping_pong_is_not_my_turn(void *arg)
+{
+  const struct ping_pong_player *player = arg;
+  return atomic_load_explicit(&player->pair->turn, memory_order_acquire) != player->index;
+}
+
+/* Returns the other fiber, which could have been created after the calling one has started. */
+static inline struct fev_fiber *ping_pong_other(const struct ping_pong_player *player)
+{
+  struct fev_fiber *other;
+
+  while ((other = atomic_load(&player->pair->fibers[1 - player->index])) == NULL)
+    fev_yield();
+
+  return other;
+}
+
+/* Parks until the player has the turn. */
+static inline void ping_pong_wait_turn(struct ping_pong_player *player)
+{
+  int res;
+
+  /* A permit might be left by a previous pass, thus the turn must be checked again. */
+  while (ping_pong_is_not_my_turn(player)) {
+    res = fev_park(&ping_pong_is_not_my_turn, player, /*abs_time=*/NULL);
+    CHECK(res == 0, "Parking failed: err=%i", res);
+  }
+}
+
+/*
+ * Increments the value and passes the turn. Returns false after the last pass of the pair: the
+ * other fiber has finished its passes and may have already exited, thus it must not be woken up.
+ */
+static inline bool ping_pong_pass(struct ping_pong_player *player, uint32_t iteration,
+                                  uint32_t num_iterations)
+{
+  struct ping_pong_pair *pair = player->pair;
+
+  pair->value++;
+  atomic_store_explicit(&pair->turn, 1 - player->index, memory_order_release);
+  return player->index == 0 || iteration != num_iterations - 1;
+}
+
+/*
+ * Runs `num_pairs` pairs of fibers with `play`, which gets its player, and checks that each fiber
+ * has made `num_iterations` passes. Returns the total time. This must be called from a fiber.
+ */
+static inline uint64_t ping_pong_run(const char *name, uint32_t num_pairs, uint32_t num_iterations,
+                                     void *(*play)(void *))
+{
+  struct ping_pong_player *players;
+  struct ping_pong_pair *pairs;
+  struct fev_fiber **fibers;
+  uint64_t start, end, expected;
+  int err;
+
+  pairs = malloc((size_t)num_pairs * sizeof(*pairs));
+  CHECK(pairs != NULL, "Allocating memory for pairs failed");
+
+  players = malloc((size_t)num_pairs * 2 * sizeof(*players));
+  CHECK(players != NULL, "Allocating memory for players failed");
+
+  fibers = malloc((size_t)num_pairs * 2 * sizeof(*fibers));
+  CHECK(fibers != NULL, "Allocating memory for fibers failed");
+
+  for (uint32_t i = 0; i < num_pairs; i++) {
+    atomic_init(&pairs[i].fibers[0], NULL);
+    atomic_init(&pairs[i].fibers[1], NULL);
+    atomic_init(&pairs[i].turn, 0);
+    pairs[i].value = 0;
+  }
+
+  for (uint32_t i = 0; i < num_pairs * 2; i++) {
+    players[i].pair = &pairs[i / 2];
+    players[i].pair_index = i / 2;
+    players[i].index = i % 2;
+  }
+
+  start = get_time_ns();
+
+  for (uint32_t i = 0; i < num_pairs * 2; i++) {
+    err = fev_fiber_create(&fibers[i], NULL, play, &players[i], NULL);
+    CHECK(err == 0, "Creating fiber failed: err=%i", err);
+
+    atomic_store(&pairs[i / 2].fibers[i % 2], fibers[i]);
+  }
+
+  for (uint32_t i = 0; i < num_pairs * 2; i++)
+    fev_fiber_join(fibers[i], NULL);
+
+  end = get_time_ns();
+
+  expected = (uint64_t)num_iterations * 2;
+  for (uint32_t i = 0; i < num_pairs; i++) {
+    CHECK(pairs[i].value == expected,
+          "%s: The value is incorrect: pair=%" PRIu32 " value=%" PRIu64 " expected=%" PRIu64, name,
+          i, pairs[i].value, expected);
+  }
+
+  free(fibers);
+  free(players);
+  free(pairs);
+
+  return end - start;
+}
+
+#endif /* !__cplusplus */
+
 #endif /* !FEV_TESTS_UTIL_H */